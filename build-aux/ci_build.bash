@@ -232,8 +232,8 @@ then
 
 		add_extra_option "$THREADS" "-DXZ_THREADS=yes" "-DXZ_THREADS=no"
 
-		# Disable MicroLZMA if encoders are not configured.
-		add_extra_option "$ENCODERS" "-DXZ_ENCODERS=$FILTER_LIST" "-DXZ_ENCODERS= -DXZ_MICROLZMA_ENCODER=OFF"
+		# Disable MicroLZMA and lzip encoders if encoders are not configured.
+		add_extra_option "$ENCODERS" "-DXZ_ENCODERS=$FILTER_LIST" "-DXZ_ENCODERS= -DXZ_MICROLZMA_ENCODER=OFF -DXZ_LZIP_ENCODER=OFF"
 
 		# Disable MicroLZMA and lzip decoders if decoders are not configured.
 		add_extra_option "$DECODERS" "-DXZ_DECODERS=$FILTER_LIST" "-DXZ_DECODERS= -DXZ_MICROLZMA_DECODER=OFF -DXZ_LZIP_DECODER=OFF"
@@ -87,6 +87,9 @@
 /* Define to 1 if .lz (lzip) decompression support is enabled. */
 #define HAVE_LZIP_DECODER 1
 
+/* Define to 1 if .lz (lzip) compression support is enabled. */
+#define HAVE_LZIP_ENCODER 1
+
 /* Define to 1 to enable bt2 match finder. */
 #define HAVE_MF_BT2 1
 
@@ -96,12 +99,18 @@
 /* Define to 1 to enable bt4 match finder. */
 #define HAVE_MF_BT4 1
 
+/* Define to 1 to enable bt5 match finder. */
+#define HAVE_MF_BT5 1
+
 /* Define to 1 to enable hc3 match finder. */
 #define HAVE_MF_HC3 1
 
 /* Define to 1 to enable hc4 match finder. */
 #define HAVE_MF_HC4 1
 
+/* Define to 1 to enable hc5 match finder. */
+#define HAVE_MF_HC5 1
+
 /* Define to 1 if stdbool.h conforms to C99. */
 #define HAVE_STDBOOL_H 1
 
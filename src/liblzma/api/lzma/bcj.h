@@ -57,6 +57,27 @@
  */
 #define LZMA_FILTER_RISCV       LZMA_VLI_C(0x0B)
 
+/**
+ * \brief       Experimental x86 filter that splits branch targets
+ *
+ * This is a streamable variant of the BCJ2 idea from 7-Zip. The targets
+ * of x86 CALL, JMP, and Jcc instructions are converted to absolute
+ * addresses like LZMA_FILTER_X86 does, but instead of being left in
+ * place, they are moved into separate call and jump streams that
+ * follow the rest of the data in chunks of up to 64 KiB. This keeps
+ * the literal stream seen by LZMA2 cleaner.
+ *
+ * Unlike the other BCJ filters, this filter changes the size of the data
+ * a little and supports LZMA_SYNC_FLUSH. The options are the same
+ * lzma_options_bcj as with the other BCJ filters.
+ *
+ * \note        This filter uses a custom Filter ID that isn't part of
+ *              the official .xz file format specification. Files that
+ *              use it can only be decompressed with liblzma versions
+ *              that support this filter.
+ */
+#define LZMA_FILTER_X86_SPLIT   LZMA_VLI_C(0x3F0DCE55B3680001)
+
 
 /**
  * \brief       Options for BCJ filters
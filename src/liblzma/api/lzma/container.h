@@ -58,6 +58,33 @@
 #define LZMA_PRESET_EXTREME       (UINT32_C(1) << 31)
 
 
+/**
+ * \brief       Pool of worker threads shared by multithreaded coders
+ *
+ * Normally each multithreaded encoder and decoder creates its own worker
+ * threads and joins them when the coder is freed. With many short-lived
+ * streams the cost of creating the threads can be significant. A thread
+ * pool keeps the threads alive between streams: when lzma_mt.thread_pool
+ * points to a pool, the coder runs its work in the threads of the pool
+ * and a thread is held only while it is working on a Block. Idle threads
+ * pick up the next Block of any stream that uses the pool.
+ *
+ * The pool may be used by any number of streams simultaneously.
+ * lzma_mt.threads still limits how many Blocks of a single stream
+ * are worked on at the same time. The number of threads of the pool
+ * limits how many Blocks of all streams are worked on at the same time.
+ *
+ * With a pool, the encoder starts compressing a Block only after it has
+ * got all the input of the Block. The decoder gives the thread back to
+ * the pool when it has decoded all the input it has got so far. This way
+ * a stream cannot hold a thread of the pool while waiting for more input
+ * from the application.
+ *
+ * \see         lzma_thread_pool_init(), lzma_thread_pool_end()
+ */
+typedef struct lzma_thread_pool_s lzma_thread_pool;
+
+
 /**
  * \brief       Multithreading options
  */
@@ -235,14 +262,41 @@ typedef struct {
 	 */
 	uint64_t memlimit_stop;
 
-	/** \private     Reserved member. */
-	uint64_t reserved_int7;
+	/**
+	 * \brief       Decoder only: Limit for decoding ahead
+	 *
+	 * If this is zero, the decoder keeps at most twice as many Blocks
+	 * in the output queue as there are threads. When the Blocks vary
+	 * a lot in size, one big Block at the head of the queue can then
+	 * stop all threads until its output has been read even though
+	 * memlimit_threading would allow decoding further.
+	 *
+	 * If this is non-zero, the number of Blocks isn't limited.
+	 * Instead, new Blocks are started out of order relative to
+	 * the output as long as the decoded data waiting in the output
+	 * queue stays at or below decode_ahead bytes. Blocks are still
+	 * started in the order in which they will be output so the oldest
+	 * Block is never waiting for a thread. memlimit_threading is
+	 * still obeyed; setting decode_ahead to UINT64_MAX makes
+	 * memlimit_threading the only limit.
+	 *
+	 * Encoder: Ignored.
+	 */
+	uint64_t decode_ahead;
 
 	/** \private     Reserved member. */
 	uint64_t reserved_int8;
 
-	/** \private     Reserved member. */
-	void *reserved_ptr1;
+	/**
+	 * \brief       Thread pool to use instead of private threads
+	 *
+	 * If this is NULL, the coder creates threads of its own. Otherwise
+	 * the threads of the given pool are used. The pool must not be
+	 * freed before lzma_end() has been called for the stream.
+	 *
+	 * \see         lzma_thread_pool
+	 */
+	lzma_thread_pool *thread_pool;
 
 	/** \private     Reserved member. */
 	void *reserved_ptr2;
@@ -462,6 +516,118 @@ extern LZMA_API(uint64_t) lzma_mt_block_size(const lzma_filter *filters)
 		lzma_nothrow;
 
 
+/**
+ * \brief       Create a pool of worker threads
+ *
+ * The pool has the given number of threads. If the streams using the pool
+ * have more Blocks to work on than there are threads, the extra Blocks wait
+ * until a thread becomes free. The threads are kept until
+ * lzma_thread_pool_end() is called.
+ *
+ * A good value for threads is usually lzma_cputhreads().
+ *
+ * \param       threads     Number of threads, from 1 to 16384
+ * \param       allocator   lzma_allocator for custom allocator functions.
+ *                          Set to NULL to use malloc() and free().
+ *
+ * \return      On success, a pointer to an empty initialized
+ *              lzma_thread_pool is returned. NULL is returned if
+ *              the number of threads is invalid or if memory
+ *              allocation or creating the threads fails.
+ */
+extern LZMA_API(lzma_thread_pool *) lzma_thread_pool_init(
+		uint32_t threads, const lzma_allocator *allocator)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Stop the threads of a pool and free the pool
+ *
+ * lzma_end() must have been called for every stream that uses the pool
+ * before calling this function.
+ *
+ * \param       pool        Pointer to lzma_thread_pool to be freed.
+ *                          If NULL, this does nothing.
+ * \param       allocator   lzma_allocator for custom allocator functions.
+ *                          Set to NULL to use malloc() and free().
+ */
+extern LZMA_API(void) lzma_thread_pool_end(
+		lzma_thread_pool *pool, const lzma_allocator *allocator)
+		lzma_nothrow;
+
+
+/**
+ * \brief       Statistics of one worker of a multithreaded coder
+ *
+ * The amount of data processed by each worker shows how evenly the work
+ * was spread over the threads. input_waits tells how often a worker ran
+ * out of input in the middle of a Block; a large value means that the
+ * worker was limited by the application or the main thread rather than
+ * by the CPU.
+ */
+typedef struct {
+	/** \brief       Number of Blocks the worker has finished */
+	uint64_t blocks;
+
+	/** \brief       Amount of input the worker has processed */
+	uint64_t progress_in;
+
+	/** \brief       Amount of output the worker has produced */
+	uint64_t progress_out;
+
+	/**
+	 * \brief       Number of times the worker waited for more input
+	 *              in the middle of a Block
+	 */
+	uint64_t input_waits;
+
+	/**
+	 * \brief       Number of memory allocations avoided
+	 *
+	 * When a new Block is started, the worker reuses the memory that
+	 * was used by the filters of its previous Block. This counts the
+	 * allocations that were satisfied from such memory.
+	 */
+	uint64_t allocs_avoided;
+
+	/** \private     Reserved member. */
+	uint64_t reserved_int2;
+
+	/** \private     Reserved member. */
+	uint64_t reserved_int3;
+
+	/** \private     Reserved member. */
+	uint64_t reserved_int4;
+
+} lzma_worker_stats;
+
+
+/**
+ * \brief       Get statistics of the workers of a multithreaded coder
+ *
+ * This is supported by lzma_stream_encoder_mt(), lzma_stream_decoder_mt(),
+ * lzma_lzip_encoder_mt(), and lzma_lzip_decoder_mt(). The .lz coders count
+ * each .lz member as one Block. The statistics cover the workers that exist
+ * at the time of the call. The decoder recreates its workers when
+ * a Stream needs single-threaded decoding and when it is reinitialized,
+ * which resets the statistics. The progress of Blocks that haven't been
+ * finished is included in progress_in and progress_out.
+ *
+ * \param       strm        Pointer to lzma_stream that is at least
+ *                          initialized with LZMA_STREAM_INIT.
+ * \param       stats       Array of stats_max structures to fill.
+ *                          This can be NULL if stats_max is zero.
+ * \param       stats_max   Number of elements in stats
+ *
+ * \return      Number of workers. This may be greater than stats_max
+ *              in which case only the first stats_max workers were
+ *              stored. Zero is returned if the coder isn't multithreaded
+ *              or if no workers have been started yet.
+ */
+extern LZMA_API(uint32_t) lzma_get_worker_stats(const lzma_stream *strm,
+		lzma_worker_stats *stats, uint32_t stats_max) lzma_nothrow;
+
+
 /**
  * \brief       Initialize .lzma encoder (legacy file format)
  *
@@ -492,6 +658,85 @@ extern LZMA_API(lzma_ret) lzma_alone_encoder(
 		lzma_nothrow lzma_attr_warn_unused_result;
 
 
+/**
+ * \brief       Initialize .lz (lzip) encoder (a foreign file format)
+ *
+ * This creates files in the unextended .lz format version 1 which can be
+ * decompressed with lzip 1.4 and later as well as with lzma_lzip_decoder().
+ * The .lz format uses LZMA1 with fixed lc=3, lp=0, and pb=2. The dictionary
+ * size must be in the range [4 KiB, 512 MiB] and it is rounded up to the
+ * next value that can be stored in the .lz header. A preset dictionary
+ * isn't supported. The integrity check is always CRC32.
+ *
+ * The valid action values for lzma_code() are LZMA_RUN, LZMA_FULL_FLUSH,
+ * LZMA_FULL_BARRIER, and LZMA_FINISH. LZMA_FULL_FLUSH and LZMA_FULL_BARRIER
+ * end the current .lz member and the encoding continues in a new member.
+ * If there was no input since the previous member, no empty member is
+ * created except that the output always has at least one member.
+ *
+ * \param       strm    Pointer to lzma_stream that is at least initialized
+ *                      with LZMA_STREAM_INIT.
+ * \param       options Pointer to encoder options
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK
+ *              - LZMA_MEM_ERROR
+ *              - LZMA_OPTIONS_ERROR
+ *              - LZMA_PROG_ERROR
+ */
+extern LZMA_API(lzma_ret) lzma_lzip_encoder(
+		lzma_stream *strm, const lzma_options_lzma *options)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Calculate approximate memory usage of multithreaded .lz encoder
+ *
+ * \param       options Compression options
+ *
+ * \return      Number of bytes of memory required for encoding with the
+ *              given options. If an error occurs, for example due to
+ *              unsupported preset or filter chain, UINT64_MAX is returned.
+ */
+extern LZMA_API(uint64_t) lzma_lzip_encoder_mt_memusage(
+		const lzma_mt *options) lzma_nothrow lzma_attr_pure;
+
+
+/**
+ * \brief       Initialize multithreaded .lz (lzip) encoder
+ *
+ * The input is split into chunks of lzma_mt.block_size bytes and each chunk
+ * is compressed into an independent .lz member in a worker thread. The
+ * result is like the output of plzip and can be decompressed in parallel
+ * by lzma_lzip_decoder_mt(). If block_size is zero, the default is three
+ * times the dictionary size but at least 1 MiB. The dictionary size is
+ * reduced to block_size if it is bigger.
+ *
+ * The filter chain in lzma_mt.filters must be a single LZMA1 filter with
+ * options that lzma_lzip_encoder() accepts. If lzma_mt.filters is NULL,
+ * the LZMA1 options are taken from lzma_mt.preset. lzma_mt.check is
+ * ignored because the .lz format always uses CRC32. lzma_mt.flags must
+ * be zero.
+ *
+ * The supported actions for lzma_code() are LZMA_RUN, LZMA_FULL_FLUSH,
+ * LZMA_FULL_BARRIER, and LZMA_FINISH. The flushing actions end the current
+ * member.
+ *
+ * \param       strm    Pointer to lzma_stream that is at least initialized
+ *                      with LZMA_STREAM_INIT.
+ * \param       options Pointer to multithreaded compression options
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK
+ *              - LZMA_MEM_ERROR
+ *              - LZMA_OPTIONS_ERROR
+ *              - LZMA_PROG_ERROR
+ */
+extern LZMA_API(lzma_ret) lzma_lzip_encoder_mt(
+		lzma_stream *strm, const lzma_mt *options)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
 /**
  * \brief       Calculate output buffer size for single-call Stream encoder
  *
@@ -618,6 +863,127 @@ extern LZMA_API(lzma_ret) lzma_microlzma_encoder(
 		lzma_nothrow;
 
 
+/**
+ * \brief       One MicroLZMA stream in a batch
+ *
+ * This is used with lzma_microlzma_encode_batch() and
+ * lzma_microlzma_decode_batch(). The application sets the first
+ * members and the batch functions fill in in_used, out_used, and ret.
+ */
+typedef struct {
+	/**
+	 * \brief       Input buffer
+	 *
+	 * When encoding, this is the uncompressed data. When decoding,
+	 * this is the MicroLZMA stream and in_size must be its exact
+	 * compressed size.
+	 */
+	const uint8_t *in;
+
+	/** \brief      Size of the input buffer */
+	size_t in_size;
+
+	/**
+	 * \brief       Output buffer
+	 *
+	 * When decoding, out_size is the uncompressed size of the stream.
+	 * See uncomp_size_is_exact.
+	 */
+	uint8_t *out;
+
+	/** \brief      Size of the output buffer */
+	size_t out_size;
+
+	/**
+	 * \brief       Decoder only: true if out_size is exactly correct
+	 *
+	 * See the uncomp_size_is_exact argument of lzma_microlzma_decoder().
+	 * This is ignored by the encoder.
+	 */
+	lzma_bool uncomp_size_is_exact;
+
+	/**
+	 * \brief       Amount of input that was used
+	 *
+	 * When encoding, this is the uncompressed size of the stream
+	 * which may be less than in_size if not all the input fit into
+	 * the output buffer.
+	 */
+	size_t in_used;
+
+	/** \brief      Amount of output that was produced */
+	size_t out_used;
+
+	/**
+	 * \brief       Result of this stream
+	 *
+	 * LZMA_OK on success. Otherwise this is the error code that
+	 * lzma_microlzma_encoder() or lzma_microlzma_decoder() with
+	 * lzma_code() would have returned, except that LZMA_BUF_ERROR
+	 * means that out_size was less than 6 when encoding.
+	 */
+	lzma_ret ret;
+
+	/*
+	 * Reserved space to allow possible future extensions without
+	 * breaking the ABI. You should not touch these, because the names
+	 * of these variables may change. These are and will never be used
+	 * when the currently supported options are used.
+	 */
+
+	/** \private     Reserved member. */
+	lzma_reserved_enum reserved_enum1;
+
+	/** \private     Reserved member. */
+	uint64_t reserved_int1;
+
+	/** \private     Reserved member. */
+	void *reserved_ptr1;
+
+} lzma_microlzma_buffer;
+
+
+/**
+ * \brief       Encode many independent MicroLZMA streams
+ *
+ * This encodes every buffer in bufs[] as if a separate
+ * lzma_microlzma_encoder() and lzma_code() were used for each of them.
+ * The LZMA encoder is initialized only once per thread and then reset
+ * between the streams, which makes this much faster than the single-stream
+ * API when the streams are small, for example, 4 KiB file system clusters.
+ *
+ * The streams can be encoded in parallel. If mt is NULL, everything is
+ * done in the calling thread. Otherwise mt->threads is the maximum number
+ * of threads to use (including the calling thread) and, if
+ * mt->thread_pool isn't NULL, the additional threads are taken from
+ * the thread pool. The other members of lzma_mt are ignored except that
+ * mt->flags must be zero.
+ *
+ * The memory usage is roughly mt->threads times the memory usage of
+ * the single-stream encoder with the same options.
+ *
+ * \param       options     Pointer to encoder options
+ * \param       bufs        Array of count buffer descriptors
+ * \param       count       Number of elements in bufs
+ * \param       mt          Threading options or NULL
+ * \param       allocator   lzma_allocator for custom allocator functions.
+ *                          Set to NULL to use malloc() and free().
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK: All streams were encoded successfully.
+ *                Check in_used and out_used of each buffer.
+ *              - LZMA_OPTIONS_ERROR: Unsupported options in *mt
+ *              - LZMA_PROG_ERROR
+ *              - Otherwise the value of bufs[i].ret of the first failed
+ *                stream. The other streams have been encoded anyway.
+ */
+extern LZMA_API(lzma_ret) lzma_microlzma_encode_batch(
+		const lzma_options_lzma *options,
+		lzma_microlzma_buffer *bufs, size_t count,
+		const lzma_mt *mt, const lzma_allocator *allocator)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
 /************
  * Decoding *
  ************/
@@ -900,6 +1266,51 @@ extern LZMA_API(lzma_ret) lzma_lzip_decoder(
 		lzma_nothrow lzma_attr_warn_unused_result;
 
 
+/**
+ * \brief       Initialize multithreaded .lz (lzip) decoder
+ *
+ * This works like lzma_lzip_decoder() but decodes several .lz members
+ * in parallel. The end of a member is found from the Member size field
+ * in its footer without decoding the member first; the end must be
+ * followed by the next member or the end of the input. Since the members
+ * are independent, a file with many members, such as one created by
+ * plzip, can be decoded with as many threads as it has members. A file
+ * with only one member is decoded in a single thread, and so is the last
+ * member if trailing data follows it. If a member fails to decode in
+ * a worker thread, it and the rest of the members are decoded again in
+ * single-threaded mode, which reports the error if the member is corrupt.
+ *
+ * The memory usage limits work like with lzma_stream_decoder_mt(). In
+ * threaded mode each member needs a buffer for the whole member and its
+ * whole uncompressed data. A member that doesn't fit within
+ * memlimit_threading is decoded in single-threaded mode, and so are
+ * the rest of the members. Single-threaded mode is also used for
+ * .lz format version 0 members and when LZMA_CONCATENATED isn't used.
+ *
+ * \param       strm        Pointer to lzma_stream that is at least initialized
+ *                          with LZMA_STREAM_INIT.
+ * \param       options     Pointer to multithreaded compression options.
+ *                          The fields flags, threads, timeout,
+ *                          memlimit_threading, memlimit_stop, and
+ *                          thread_pool are used. The flags are those
+ *                          supported by lzma_lzip_decoder() and
+ *                          LZMA_FAIL_FAST which makes errors in the
+ *                          worker threads be reported immediately.
+ *                          LZMA_DATA_ERROR from a worker thread is
+ *                          reported by the single-threaded decoding.
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK: Initialization was successful.
+ *              - LZMA_MEM_ERROR: Cannot allocate memory.
+ *              - LZMA_OPTIONS_ERROR: Unsupported flags or number
+ *                of threads.
+ *              - LZMA_PROG_ERROR
+ */
+extern LZMA_API(lzma_ret) lzma_lzip_decoder_mt(
+		lzma_stream *strm, const lzma_mt *options)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
 /**
  * \brief       Single-call .xz Stream decoder
  *
@@ -993,3 +1404,40 @@ extern LZMA_API(lzma_ret) lzma_microlzma_decoder(
 		lzma_stream *strm, uint64_t comp_size,
 		uint64_t uncomp_size, lzma_bool uncomp_size_is_exact,
 		uint32_t dict_size) lzma_nothrow;
+
+
+/**
+ * \brief       Decode many independent MicroLZMA streams
+ *
+ * This is the decoding counterpart of lzma_microlzma_encode_batch().
+ * Each bufs[i].in must contain exactly one MicroLZMA stream and
+ * bufs[i].out_size is its uncompressed size. If the exact uncompressed
+ * size isn't known, set bufs[i].uncomp_size_is_exact to false; see
+ * lzma_microlzma_decoder().
+ *
+ * All streams must have been compressed with the same dictionary size
+ * or smaller. The threading options are the same as with
+ * lzma_microlzma_encode_batch().
+ *
+ * \param       dict_size   LZMA dictionary size used to compress
+ *                          the streams
+ * \param       bufs        Array of count buffer descriptors
+ * \param       count       Number of elements in bufs
+ * \param       mt          Threading options or NULL
+ * \param       allocator   lzma_allocator for custom allocator functions.
+ *                          Set to NULL to use malloc() and free().
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK: All streams were decoded successfully.
+ *              - LZMA_OPTIONS_ERROR: Unsupported options in *mt
+ *              - LZMA_PROG_ERROR
+ *              - Otherwise the value of bufs[i].ret of the first failed
+ *                stream, for example, LZMA_DATA_ERROR if the stream is
+ *                corrupt or truncated. The other streams have been
+ *                decoded anyway.
+ */
+extern LZMA_API(lzma_ret) lzma_microlzma_decode_batch(
+		uint32_t dict_size,
+		lzma_microlzma_buffer *bufs, size_t count,
+		const lzma_mt *mt, const lzma_allocator *allocator)
+		lzma_nothrow lzma_attr_warn_unused_result;
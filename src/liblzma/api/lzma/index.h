@@ -880,3 +880,298 @@ extern LZMA_API(lzma_ret) lzma_file_info_decoder(
 		lzma_stream *strm, lzma_index **dest_index,
 		uint64_t memlimit, uint64_t file_size)
 		lzma_nothrow;
+
+
+/**
+ * \brief       Opaque data type to hold a flat, read-only Index
+ *
+ * lzma_index is a tree that can be modified and combined with other
+ * Indexes, which makes it big and slow to build when there are millions
+ * of Blocks. lzma_index_flat is an array of the Blocks in one memory
+ * allocation. It can be created straight from the Index field of
+ * a Stream, for example from a memory-mapped file, or from an existing
+ * lzma_index. It cannot be modified after it has been created.
+ */
+typedef struct lzma_index_flat_s lzma_index_flat;
+
+
+/**
+ * \brief       Information about a Block in lzma_index_flat
+ */
+typedef struct {
+	/**
+	 * \brief       Block number in the file
+	 *
+	 * The first Block is 1.
+	 */
+	lzma_vli number_in_file;
+
+	/**
+	 * \brief       Compressed start offset of this Block
+	 *
+	 * This offset is relative to the beginning of the .xz file if
+	 * the correct offset of the first Block was given when creating
+	 * the lzma_index_flat.
+	 */
+	lzma_vli compressed_file_offset;
+
+	/**
+	 * \brief       Uncompressed start offset of this Block
+	 */
+	lzma_vli uncompressed_file_offset;
+
+	/**
+	 * \brief       Unpadded Size of this Block
+	 *
+	 * This is needed by lzma_block_compressed_size().
+	 */
+	lzma_vli unpadded_size;
+
+	/**
+	 * \brief       Total compressed size of this Block
+	 *
+	 * This includes Block Header, Compressed Data, Block Padding,
+	 * and Check field.
+	 */
+	lzma_vli total_size;
+
+	/**
+	 * \brief       Uncompressed size of this Block
+	 */
+	lzma_vli uncompressed_size;
+
+	/** \private     Reserved member. */
+	lzma_vli reserved_vli1;
+
+	/** \private     Reserved member. */
+	lzma_vli reserved_vli2;
+
+} lzma_index_flat_block;
+
+
+/**
+ * \brief       Decode an Index field into lzma_index_flat
+ *
+ * This is like lzma_index_buffer_decode() but the result is stored into
+ * a flat array. Only one memory allocation is made: the Number of Records
+ * field is read first and the array is allocated for that many Blocks.
+ * Since every Record takes at least two bytes, the allocation is never
+ * much bigger than the input. The Index Padding and CRC32 fields are
+ * validated too.
+ *
+ * \param[out]  flat        If decoding succeeds, *flat will point to
+ *                          a new lzma_index_flat. On error, *flat is
+ *                          set to NULL.
+ * \param       allocator   lzma_allocator for custom allocator
+ *                          functions. Set to NULL to use malloc()
+ *                          and free().
+ * \param       in          Beginning of the input buffer
+ * \param       in_pos      The next byte will be read from in[*in_pos].
+ *                          *in_pos is updated only if decoding succeeds.
+ * \param       in_size     Size of the input buffer; the first byte that
+ *                          won't be read is in[in_size].
+ * \param       compressed_offset
+ *                          Offset of the first Block of the Stream in
+ *                          the file. For a single-Stream file this is
+ *                          LZMA_STREAM_HEADER_SIZE.
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK: Decoding was successful.
+ *              - LZMA_MEM_ERROR
+ *              - LZMA_DATA_ERROR
+ *              - LZMA_PROG_ERROR
+ */
+extern LZMA_API(lzma_ret) lzma_index_flat_decode(lzma_index_flat **flat,
+		const lzma_allocator *allocator,
+		const uint8_t *in, size_t *in_pos, size_t in_size,
+		lzma_vli compressed_offset)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Convert lzma_index to lzma_index_flat
+ *
+ * All Blocks of all Streams in the lzma_index are included. The offsets
+ * are the same as lzma_index_iter would give.
+ *
+ * \param[out]  flat        On success, *flat will point to
+ *                          a new lzma_index_flat. On error, *flat is
+ *                          set to NULL.
+ * \param       i           Pointer to lzma_index
+ * \param       allocator   lzma_allocator for custom allocator
+ *                          functions. Set to NULL to use malloc()
+ *                          and free().
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK
+ *              - LZMA_MEM_ERROR
+ *              - LZMA_PROG_ERROR
+ */
+extern LZMA_API(lzma_ret) lzma_index_flat_from_index(lzma_index_flat **flat,
+		const lzma_index *i, const lzma_allocator *allocator)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Deallocate lzma_index_flat
+ *
+ * If flat is NULL, this does nothing.
+ *
+ * \param       flat        Pointer to lzma_index_flat to be freed
+ * \param       allocator   lzma_allocator for custom allocator
+ *                          functions. Set to NULL to use malloc()
+ *                          and free().
+ */
+extern LZMA_API(void) lzma_index_flat_end(
+		lzma_index_flat *flat, const lzma_allocator *allocator)
+		lzma_nothrow;
+
+
+/**
+ * \brief       Get the number of Blocks in lzma_index_flat
+ *
+ * \param       flat    Pointer to lzma_index_flat
+ *
+ * \return      Number of Blocks
+ */
+extern LZMA_API(lzma_vli) lzma_index_flat_block_count(
+		const lzma_index_flat *flat) lzma_nothrow lzma_attr_pure;
+
+
+/**
+ * \brief       Get the uncompressed size of all the Blocks
+ *
+ * \param       flat    Pointer to lzma_index_flat
+ *
+ * \return      Sum of the Uncompressed Sizes of all the Blocks
+ */
+extern LZMA_API(lzma_vli) lzma_index_flat_uncompressed_size(
+		const lzma_index_flat *flat) lzma_nothrow lzma_attr_pure;
+
+
+/**
+ * \brief       Get information about a Block by its number
+ *
+ * \param       flat    Pointer to lzma_index_flat
+ * \param       number  Block number; the first Block is 1.
+ * \param[out]  block   Information about the Block is stored here.
+ *
+ * \return      lzma_bool:
+ *              - true if there is no such Block. *block is not
+ *                modified (failure).
+ *              - false if *block was set (success).
+ */
+extern LZMA_API(lzma_bool) lzma_index_flat_get(const lzma_index_flat *flat,
+		lzma_vli number, lzma_index_flat_block *block)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Locate a Block in lzma_index_flat
+ *
+ * This finds the same Block as lzma_index_iter_locate() would find from
+ * the equivalent lzma_index: the Block that contains the uncompressed
+ * offset target. Empty Blocks are skipped. The Block is found with
+ * a binary search.
+ *
+ * \param       flat    Pointer to lzma_index_flat
+ * \param       target  Uncompressed target offset
+ * \param[out]  block   Information about the Block is stored here.
+ *
+ * \return      lzma_bool:
+ *              - true if the target is greater than or equal to the
+ *                uncompressed size. *block is not modified (failure).
+ *              - false if the Block was found and *block was set
+ *                (success).
+ */
+extern LZMA_API(lzma_bool) lzma_index_flat_locate(
+		const lzma_index_flat *flat, lzma_vli target,
+		lzma_index_flat_block *block)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Serialize a combined lzma_index for caching
+ *
+ * Getting the combined Index of a file with lzma_file_info_decoder()
+ * requires reading the Stream Footer and Index of every Stream. With
+ * many concatenated Streams and slow storage this can take a long time.
+ * An application may store the result of this function, for example,
+ * in a separate file, and later get the lzma_index back with
+ * lzma_index_cache_decode() with a single read.
+ *
+ * The Stream Flags, Stream Padding, and Blocks of every Stream are
+ * stored. The size and modification time of the .xz file are stored
+ * too so that a cache that doesn't match the file can be detected.
+ * The whole cache is protected with CRC32.
+ *
+ * \param       i           Pointer to lzma_index, for example from
+ *                          lzma_file_info_decoder(). Stream Flags must
+ *                          have been set for every Stream with
+ *                          lzma_index_stream_flags().
+ * \param       file_size   Size of the .xz file
+ * \param       mtime       Modification time of the .xz file in any
+ *                          unit the application chooses
+ * \param       allocator   lzma_allocator for custom allocator
+ *                          functions. Set to NULL to use malloc()
+ *                          and free().
+ * \param[out]  out         On success, *out will point to the cache data.
+ *                          It has been allocated with the given allocator
+ *                          and the caller must free it.
+ * \param[out]  out_size    On success, the size of the cache data is
+ *                          stored here.
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK: Encoding was successful.
+ *              - LZMA_MEM_ERROR
+ *              - LZMA_PROG_ERROR: Invalid arguments or Stream Flags
+ *                haven't been set for some Stream.
+ */
+extern LZMA_API(lzma_ret) lzma_index_cache_encode(const lzma_index *i,
+		uint64_t file_size, uint64_t mtime,
+		const lzma_allocator *allocator,
+		uint8_t **out, size_t *out_size)
+		lzma_nothrow lzma_attr_warn_unused_result;
+
+
+/**
+ * \brief       Decode a cached lzma_index
+ *
+ * The data must have been created with lzma_index_cache_encode().
+ * The CRC32, the Indexes, and the file size and modification time are
+ * validated. The file size is also compared to what the decoded Index
+ * says the size of the file must be. If any of these don't match,
+ * LZMA_DATA_ERROR is returned and the application should get
+ * the Index from the .xz file instead.
+ *
+ * \param[out]  i           If decoding succeeds, *i will point to a new
+ *                          lzma_index, which the application must later
+ *                          free with lzma_index_end(). If an error
+ *                          occurs, *i will be NULL.
+ * \param       memlimit    How much memory the resulting lzma_index is
+ *                          allowed to require. Use UINT64_MAX to
+ *                          effectively disable the limiter.
+ * \param       allocator   lzma_allocator for custom allocator
+ *                          functions. Set to NULL to use malloc()
+ *                          and free().
+ * \param       in          Beginning of the input buffer
+ * \param       in_size     Size of the input buffer. It must contain
+ *                          the cache data and nothing else.
+ * \param       file_size   Size of the .xz file
+ * \param       mtime       Modification time of the .xz file in the
+ *                          same unit as was given to
+ *                          lzma_index_cache_encode()
+ *
+ * \return      Possible lzma_ret values:
+ *              - LZMA_OK: Decoding was successful.
+ *              - LZMA_MEM_ERROR
+ *              - LZMA_MEMLIMIT_ERROR: Memory usage limit was reached.
+ *              - LZMA_DATA_ERROR: The cache is corrupt or it doesn't
+ *                match the file.
+ *              - LZMA_PROG_ERROR
+ */
+extern LZMA_API(lzma_ret) lzma_index_cache_decode(lzma_index **i,
+		uint64_t memlimit, const lzma_allocator *allocator,
+		const uint8_t *in, size_t in_size,
+		uint64_t file_size, uint64_t mtime)
+		lzma_nothrow lzma_attr_warn_unused_result;
@@ -99,6 +99,24 @@ typedef enum {
 		 *  - dict_size > 32 MiB: dict_size * 6.5
 		 */
 
+	LZMA_MF_HC5     = 0x05,
+		/**<
+		 * \brief       Hash Chain with 2-, 3-, and 5-byte hashing
+		 *
+		 * This is like LZMA_MF_HC4 but the hash chains are built
+		 * from the first five bytes. Positions that match only
+		 * four bytes no longer share a chain. With binary and
+		 * structured data this can make the search faster.
+		 * Matches of four bytes are still found from the 2- and
+		 * 3-byte hash tables but less often than with HC4.
+		 *
+		 * Minimum nice_len: 5
+		 *
+		 * Memory usage:
+		 *  - dict_size <= 32 MiB: dict_size * 7.5
+		 *  - dict_size > 32 MiB: dict_size * 6.5
+		 */
+
 	LZMA_MF_BT2     = 0x12,
 		/**<
 		 * \brief       Binary Tree with 2-byte hashing
@@ -119,7 +137,7 @@ typedef enum {
 		 *  - dict_size > 16 MiB: dict_size * 9.5 + 64 MiB
 		 */
 
-	LZMA_MF_BT4     = 0x14
+	LZMA_MF_BT4     = 0x14,
 		/**<
 		 * \brief       Binary Tree with 2-, 3-, and 4-byte hashing
 		 *
@@ -129,6 +147,20 @@ typedef enum {
 		 *  - dict_size <= 32 MiB: dict_size * 11.5
 		 *  - dict_size > 32 MiB: dict_size * 10.5
 		 */
+
+	LZMA_MF_BT5     = 0x15
+		/**<
+		 * \brief       Binary Tree with 2-, 3-, and 5-byte hashing
+		 *
+		 * This is to LZMA_MF_BT4 what LZMA_MF_HC5 is to
+		 * LZMA_MF_HC4.
+		 *
+		 * Minimum nice_len: 5
+		 *
+		 * Memory usage:
+		 *  - dict_size <= 32 MiB: dict_size * 11.5
+		 *  - dict_size > 32 MiB: dict_size * 10.5
+		 */
 } lzma_match_finder;
 
 
@@ -169,7 +201,7 @@ typedef enum {
 		 * a hash chain match finder.
 		 */
 
-	LZMA_MODE_NORMAL = 2
+	LZMA_MODE_NORMAL = 2,
 		/**<
 		 * \brief       Normal compression
 		 *
@@ -177,6 +209,22 @@ typedef enum {
 		 * together with binary tree match finders to expose the
 		 * full potential of the LZMA1 or LZMA2 encoder.
 		 */
+
+	LZMA_MODE_TURBO = 3
+		/**<
+		 * \brief       Greedy compression
+		 *
+		 * The longest match found by the match finder is always
+		 * used and only the most recent match distance is checked
+		 * for a repeated match. If depth is zero, only one
+		 * candidate per position is checked from the hash chain
+		 * or binary tree. This is faster than fast mode but the
+		 * compression ratio is worse. The output can be decoded
+		 * by any LZMA1 or LZMA2 decoder.
+		 *
+		 * This is usually at its best when combined with
+		 * LZMA_MF_HC4 or LZMA_MF_HC5.
+		 */
 } lzma_mode;
 
 
@@ -308,6 +356,9 @@ typedef struct {
 	 * There may be LZMA1 streams that have lc + lp > 4 (maximum possible
 	 * lc would be 8). It is not possible to decode such streams with
 	 * liblzma.
+	 *
+	 * With the LZMA2 encoder, lc may be set to LZMA_LCLPPB_AUTO.
+	 * See pb below.
 	 */
 	uint32_t lc;
 #	define LZMA_LCLP_MIN    0
@@ -320,6 +371,9 @@ typedef struct {
 	 * lp affects what kind of alignment in the uncompressed data is
 	 * assumed when encoding literals. A literal is a single 8-bit byte.
 	 * See pb below for more information about alignment.
+	 *
+	 * With the LZMA2 encoder, lp may be set to LZMA_LCLPPB_AUTO.
+	 * See pb below.
 	 */
 	uint32_t lp;
 #	define LZMA_LP_DEFAULT  0
@@ -343,11 +397,28 @@ typedef struct {
 	 * lp, LZMA1 and LZMA2 still slightly favor 16-byte alignment.
 	 * It might be worth taking into account when designing file formats
 	 * that are likely to be often compressed with LZMA1 or LZMA2.
+	 *
+	 * With the LZMA2 encoder, any of lc, lp, and pb may be set to
+	 * LZMA_LCLPPB_AUTO. Then the encoder looks at the first 64 KiB of
+	 * the uncompressed data and picks the value that it estimates to
+	 * give the smallest output, keeping the other two fixed if they
+	 * weren't set to LZMA_LCLPPB_AUTO too. The default value is kept
+	 * unless the estimated difference is clear. The choice is made again
+	 * when the encoder is reset for a new .xz Block and after every
+	 * 1 MiB of uncompressed data within a Block. A new value after
+	 * the start of a Block is used only if it looks clearly better
+	 * than the current one because it needs an LZMA2 state reset,
+	 * after which the probabilities have to adapt again. This is useful
+	 * mostly with tables of binary numbers and similar data where
+	 * a good alignment isn't the default. LZMA_LCLPPB_AUTO cannot be
+	 * used with LZMA1. It can be used with lzma_filters_update() only
+	 * if it was used already when the encoder was initialized.
 	 */
 	uint32_t pb;
 #	define LZMA_PB_MIN      0
 #	define LZMA_PB_MAX      4
 #	define LZMA_PB_DEFAULT  2
+#	define LZMA_LCLPPB_AUTO UINT32_C(0xFFFFFFFF)
 
 	/** Compression mode */
 	lzma_mode mode;
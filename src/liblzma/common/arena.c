@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       arena.c
+/// \brief      Per-thread allocation cache for Block coders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "arena.h"
+
+
+/// Header that is stored in front of every allocation
+struct lzma_arena_chunk_s {
+	/// Next chunk in the cache. This is used only while the chunk
+	/// is in the cache.
+	lzma_arena_chunk *next;
+
+	/// Size of the usable memory after the header
+	size_t size;
+
+	/// Size that was requested when the chunk was given out. This
+	/// is less than size if a bigger chunk was reused.
+	size_t used;
+};
+
+
+/// The header is rounded up to 16 bytes so that the memory given to
+/// the coders is as aligned as what malloc() typically returns.
+#define CHUNK_HEADER_SIZE \
+	((sizeof(lzma_arena_chunk) + 15) & ~(size_t)(15))
+
+
+static void * LZMA_API_CALL
+arena_alloc(void *opaque, size_t nmemb, size_t size)
+{
+	lzma_arena *arena = opaque;
+
+	if (nmemb != 0 && size > SIZE_MAX / nmemb)
+		return NULL;
+
+	size *= nmemb;
+
+	// Find the smallest cached chunk that is big enough. Don't use
+	// chunks that are over twice the requested size so that a small
+	// allocation doesn't keep a huge dictionary buffer reserved.
+	lzma_arena_chunk **best = NULL;
+	for (lzma_arena_chunk **c = &arena->cache; *c != NULL;
+			c = &(*c)->next)
+		if ((*c)->size >= size && (*c)->size / 2 <= size
+				&& (best == NULL
+					|| (*c)->size < (*best)->size))
+			best = c;
+
+	lzma_arena_chunk *chunk;
+
+	if (best != NULL) {
+		chunk = *best;
+		*best = chunk->next;
+		++arena->allocs_avoided;
+		arena->oversize += chunk->size - size;
+	} else {
+		if (size > SIZE_MAX - CHUNK_HEADER_SIZE)
+			return NULL;
+
+		chunk = lzma_alloc(CHUNK_HEADER_SIZE + size, arena->parent);
+		if (chunk == NULL)
+			return NULL;
+
+		chunk->size = size;
+	}
+
+	chunk->used = size;
+	return (uint8_t *)(chunk) + CHUNK_HEADER_SIZE;
+}
+
+
+static void LZMA_API_CALL
+arena_free(void *opaque, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	lzma_arena *arena = opaque;
+	lzma_arena_chunk *chunk = (lzma_arena_chunk *)(
+			(uint8_t *)(ptr) - CHUNK_HEADER_SIZE);
+
+	arena->oversize -= chunk->size - chunk->used;
+	chunk->next = arena->cache;
+	arena->cache = chunk;
+	return;
+}
+
+
+extern void
+lzma_arena_init(lzma_arena *arena, const lzma_allocator *parent)
+{
+	arena->allocator.alloc = &arena_alloc;
+	arena->allocator.free = &arena_free;
+	arena->allocator.opaque = arena;
+	arena->parent = parent;
+	arena->cache = NULL;
+	arena->oversize = 0;
+	arena->allocs_avoided = 0;
+	return;
+}
+
+
+extern void
+lzma_arena_trim(lzma_arena *arena)
+{
+	while (arena->cache != NULL) {
+		lzma_arena_chunk *chunk = arena->cache;
+		arena->cache = chunk->next;
+		lzma_free(chunk, arena->parent);
+	}
+
+	return;
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       arena.h
+/// \brief      Per-thread allocation cache for Block coders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_ARENA_H
+#define LZMA_ARENA_H
+
+#include "common.h"
+
+
+typedef struct lzma_arena_chunk_s lzma_arena_chunk;
+
+
+/// \brief      Allocation cache
+///
+/// The multithreaded coders initialize a new Block coder for every Block.
+/// If the filter chain changes between Blocks, the old filter coders
+/// are freed and new ones allocated. With an arena the freed memory is
+/// kept and given back when a new allocation of a similar size is made,
+/// so that the LZ dictionary, match finder arrays, and probability
+/// tables can be reused even when the filter options change.
+///
+/// An arena isn't thread safe. It is meant to be used by one worker
+/// thread at a time.
+typedef struct {
+	/// Allocator that allocates from this arena. This is given to
+	/// the Block coder. The arena must not be moved in memory
+	/// because allocator.opaque points to it.
+	lzma_allocator allocator;
+
+	/// Allocator used for the memory that isn't in the cache
+	const lzma_allocator *parent;
+
+	/// Freed chunks that haven't been returned to the parent allocator
+	lzma_arena_chunk *cache;
+
+	/// A reused chunk may be up to twice the requested size. This is
+	/// how many bytes more the allocations that are currently in use
+	/// take than what was requested. The memory usage counters of
+	/// the multithreaded decoders must include this.
+	size_t oversize;
+
+	/// Number of allocations that were satisfied from the cache
+	uint64_t allocs_avoided;
+} lzma_arena;
+
+
+/// \brief      Initialize an arena
+///
+/// This cannot fail.
+extern void lzma_arena_init(lzma_arena *arena,
+		const lzma_allocator *parent);
+
+
+/// \brief      Return the cached memory to the parent allocator
+///
+/// The Block coders allocate everything they need when they are
+/// initialized. Calling this after the initialization frees the memory
+/// that the new Block coder didn't reuse.
+extern void lzma_arena_trim(lzma_arena *arena);
+
+
+/// \brief      Free the arena
+///
+/// Everything allocated from the arena must have been freed already.
+static inline void
+lzma_arena_end(lzma_arena *arena)
+{
+	lzma_arena_trim(arena);
+	return;
+}
+
+#endif
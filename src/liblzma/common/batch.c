@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       batch.c
+/// \brief      Run independent single-call coding jobs in parallel
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "batch.h"
+
+#ifdef MYTHREAD_ENABLED
+#	include "thread_pool.h"
+#endif
+
+
+typedef struct {
+	lzma_batch_func func;
+	void *ctx;
+	const lzma_allocator *allocator;
+
+	/// Number of items in the batch
+	size_t count;
+
+	/// Index of the next item that no worker has claimed yet.
+	/// This is protected by the mutex when there are helper threads.
+	size_t next_index;
+
+#ifdef MYTHREAD_ENABLED
+	/// Number of helpers that haven't finished yet
+	uint32_t helpers_running;
+
+	mythread_mutex mutex;
+	mythread_cond cond;
+#endif
+} lzma_batch;
+
+
+/// Get the index of the next unclaimed item or SIZE_MAX if there are none.
+static size_t
+claim_item(lzma_batch *batch, bool locked)
+{
+	size_t index = SIZE_MAX;
+
+#ifdef MYTHREAD_ENABLED
+	if (locked) {
+		mythread_sync(batch->mutex) {
+			if (batch->next_index < batch->count)
+				index = batch->next_index++;
+		}
+
+		return index;
+	}
+#else
+	(void)locked;
+#endif
+
+	if (batch->next_index < batch->count)
+		index = batch->next_index++;
+
+	return index;
+}
+
+
+/// Handle items until all have been claimed. The coder is kept between
+/// the items and freed at the end.
+static void
+batch_work(lzma_batch *batch, bool locked)
+{
+	lzma_next_coder next = LZMA_NEXT_CODER_INIT;
+
+	size_t index;
+	while ((index = claim_item(batch, locked)) != SIZE_MAX)
+		batch->func(batch->ctx, &next, batch->allocator, index);
+
+	lzma_next_end(&next, batch->allocator);
+	return;
+}
+
+
+#ifdef MYTHREAD_ENABLED
+typedef struct {
+	lzma_batch *batch;
+
+	/// Job for running in a thread pool
+	lzma_pool_job job;
+
+	/// Thread ID when not using a thread pool
+	mythread thread_id;
+} lzma_batch_helper;
+
+
+static void
+helper_job(void *helper_ptr)
+{
+	lzma_batch_helper *helper = helper_ptr;
+	lzma_batch *batch = helper->batch;
+
+	batch_work(batch, true);
+
+	// The helper structure must not be touched after this because
+	// the main thread may free it as soon as it sees the counter
+	// reach zero.
+	mythread_sync(batch->mutex) {
+		--batch->helpers_running;
+		mythread_cond_signal(&batch->cond);
+	}
+
+	return;
+}
+
+
+static MYTHREAD_RET_TYPE
+helper_thread(void *helper_ptr)
+{
+	helper_job(helper_ptr);
+	return MYTHREAD_RET_VALUE;
+}
+#endif
+
+
+extern lzma_ret
+lzma_batch_run(size_t count, const lzma_mt *mt,
+		const lzma_allocator *allocator,
+		lzma_batch_func func, void *ctx)
+{
+	uint32_t threads = 1;
+
+	if (mt != NULL) {
+		if (mt->flags != 0 || mt->threads == 0
+				|| mt->threads > LZMA_THREADS_MAX)
+			return LZMA_OPTIONS_ERROR;
+
+		threads = mt->threads;
+	}
+
+	lzma_batch batch = {
+		.func = func,
+		.ctx = ctx,
+		.allocator = allocator,
+		.count = count,
+		.next_index = 0,
+	};
+
+#ifdef MYTHREAD_ENABLED
+	// There is no point to have more threads than items.
+	uint32_t helpers = (uint32_t)(my_min(threads, count)) - 1;
+	if (count == 0)
+		helpers = 0;
+
+	lzma_batch_helper *helper = NULL;
+	if (helpers > 0) {
+		helper = lzma_alloc(helpers * sizeof(lzma_batch_helper),
+				allocator);
+
+		if (helper == NULL) {
+			helpers = 0;
+		} else if (mythread_mutex_init(&batch.mutex)) {
+			lzma_free(helper, allocator);
+			helpers = 0;
+		} else if (mythread_cond_init(&batch.cond)) {
+			mythread_mutex_destroy(&batch.mutex);
+			lzma_free(helper, allocator);
+			helpers = 0;
+		}
+	}
+
+	if (helpers == 0) {
+		batch_work(&batch, false);
+		return LZMA_OK;
+	}
+
+	lzma_thread_pool *pool = mt->thread_pool;
+
+	// helpers_running is updated before a helper is started so that
+	// a quickly-finishing helper cannot make it reach zero too early.
+	uint32_t started = 0;
+	batch.helpers_running = 0;
+
+	for (; started < helpers; ++started) {
+		helper[started].batch = &batch;
+
+		mythread_sync(batch.mutex) {
+			++batch.helpers_running;
+		}
+
+		if (pool != NULL) {
+			helper[started].job.func = &helper_job;
+			helper[started].job.arg = &helper[started];
+			lzma_thread_pool_run(pool, &helper[started].job);
+		} else if (mythread_create(&helper[started].thread_id,
+				&helper_thread, &helper[started])) {
+			// Continue with the helpers that were started.
+			mythread_sync(batch.mutex) {
+				--batch.helpers_running;
+			}
+
+			break;
+		}
+	}
+
+	batch_work(&batch, true);
+
+	// Wait for the helpers.
+	mythread_sync(batch.mutex) {
+		while (batch.helpers_running > 0)
+			mythread_cond_wait(&batch.cond, &batch.mutex);
+	}
+
+	if (pool == NULL)
+		for (uint32_t i = 0; i < started; ++i)
+			mythread_join(helper[i].thread_id);
+
+	mythread_cond_destroy(&batch.cond);
+	mythread_mutex_destroy(&batch.mutex);
+	lzma_free(helper, allocator);
+#else
+	(void)threads;
+	batch_work(&batch, false);
+#endif
+
+	return LZMA_OK;
+}
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       batch.h
+/// \brief      Run independent single-call coding jobs in parallel
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_BATCH_H
+#define LZMA_BATCH_H
+
+#include "common.h"
+
+
+/// \brief      Code one item of a batch
+///
+/// \param      ctx         Context given to lzma_batch_run()
+/// \param      next        Coder of the calling worker. It starts as
+///                         LZMA_NEXT_CODER_INIT and is passed to every
+///                         item handled by the same worker so that
+///                         the coder memory can be reused.
+/// \param      allocator   Allocator given to lzma_batch_run()
+/// \param      index       Index of the item, less than count
+///
+/// The result of the item must be stored in the item itself.
+typedef void (*lzma_batch_func)(void *ctx, lzma_next_coder *next,
+		const lzma_allocator *allocator, size_t index);
+
+
+/// \brief      Call func for the items 0 to count - 1
+///
+/// If mt is NULL or mt->threads is one, the items are handled in the
+/// calling thread. Otherwise up to mt->threads - 1 helper threads are
+/// used in addition to the calling thread. The helpers run in
+/// mt->thread_pool if it is non-NULL; otherwise they are created for
+/// the duration of the call. If a helper cannot be started, its share
+/// of the items is done by the other threads.
+///
+/// \return     LZMA_OK, or LZMA_OPTIONS_ERROR if the options in *mt
+///             are invalid. Only threads and thread_pool are used from
+///             *mt and flags must be zero.
+extern lzma_ret lzma_batch_run(size_t count, const lzma_mt *mt,
+		const lzma_allocator *allocator,
+		lzma_batch_func func, void *ctx);
+
+#endif
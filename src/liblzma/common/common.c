@@ -413,6 +413,20 @@ lzma_get_progress(lzma_stream *strm,
 }
 
 
+extern LZMA_API(uint32_t)
+lzma_get_worker_stats(const lzma_stream *strm,
+		lzma_worker_stats *stats, uint32_t stats_max)
+{
+	// No coder has been initialized if strm->internal is NULL.
+	if (strm == NULL || strm->internal == NULL
+			|| strm->internal->next.get_worker_stats == NULL)
+		return 0;
+
+	return strm->internal->next.get_worker_stats(
+			strm->internal->next.coder, stats, stats_max);
+}
+
+
 extern LZMA_API(lzma_check)
 lzma_get_check(const lzma_stream *strm)
 {
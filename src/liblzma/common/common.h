@@ -248,6 +248,11 @@ struct lzma_next_coder_s {
 	void (*get_progress)(void *coder,
 			uint64_t *progress_in, uint64_t *progress_out);
 
+	/// Pointer to a function to get the statistics of the worker
+	/// threads. This is NULL in coders that aren't multithreaded.
+	uint32_t (*get_worker_stats)(void *coder,
+			lzma_worker_stats *stats, uint32_t stats_max);
+
 	/// Pointer to function to return the type of the integrity check.
 	/// Most coders won't support this.
 	lzma_check (*get_check)(const void *coder);
@@ -284,6 +289,7 @@ struct lzma_next_coder_s {
 		.code = NULL, \
 		.end = NULL, \
 		.get_progress = NULL, \
+		.get_worker_stats = NULL, \
 		.get_check = NULL, \
 		.memconfig = NULL, \
 		.update = NULL, \
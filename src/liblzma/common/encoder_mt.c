@@ -0,0 +1,906 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       encoder_mt.c
+/// \brief      Worker threads of the multithreaded encoders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "encoder_mt.h"
+#include "filter_encoder.h"
+
+
+extern void
+lzma_encoder_mt_worker_error(lzma_encoder_mt_thread *thr, lzma_ret ret)
+{
+	assert(ret != LZMA_OK);
+	assert(ret != LZMA_STREAM_END);
+
+	mythread_sync(thr->mt->mutex) {
+		if (thr->mt->thread_error == LZMA_OK)
+			thr->mt->thread_error = ret;
+
+		mythread_cond_signal(&thr->mt->cond);
+	}
+
+	return;
+}
+
+
+extern worker_state
+lzma_encoder_mt_worker_code(lzma_encoder_mt_thread *thr, size_t *out_pos,
+		lzma_ret *ret, size_t *in_size)
+{
+	assert(thr->progress_in == 0);
+	assert(thr->progress_out == 0);
+
+	worker_state state;
+	size_t in_pos = 0;
+	*in_size = 0;
+
+	const size_t out_size = thr->outbuf->allocated;
+
+	do {
+		mythread_sync(thr->mutex) {
+			// Store in_pos and *out_pos into *thr so that
+			// an application may read them via
+			// lzma_get_progress() to get progress information.
+			//
+			// NOTE: These aren't updated when the encoding
+			// finishes. Instead, the final values are taken
+			// later from thr->outbuf.
+			thr->progress_in = in_pos;
+			thr->progress_out = *out_pos;
+
+			if (*in_size == thr->in_size && thr->state == THR_RUN)
+				++thr->stats.input_waits;
+
+			while (*in_size == thr->in_size
+					&& thr->state == THR_RUN)
+				mythread_cond_wait(&thr->cond, &thr->mutex);
+
+			state = thr->state;
+			*in_size = thr->in_size;
+		}
+
+		// Return if we were asked to stop or exit.
+		if (state >= THR_STOP)
+			return state;
+
+		lzma_action action = state == THR_FINISH
+				? LZMA_FINISH : LZMA_RUN;
+
+		// Limit the amount of input given to the encoder
+		// at once. This way this thread can react fairly quickly
+		// if the main thread wants us to stop or exit.
+		static const size_t in_chunk_max = 16384;
+		size_t in_limit = *in_size;
+		if (*in_size - in_pos > in_chunk_max) {
+			in_limit = in_pos + in_chunk_max;
+			action = LZMA_RUN;
+		}
+
+		*ret = thr->encoder.code(thr->encoder.coder,
+				&thr->arena.allocator,
+				thr->in, &in_pos, in_limit, thr->outbuf->buf,
+				out_pos, out_size, action);
+	} while (*ret == LZMA_OK && *out_pos < out_size);
+
+	return state;
+}
+
+
+extern worker_state
+lzma_encoder_mt_worker_wait(lzma_encoder_mt_thread *thr, size_t *in_size)
+{
+	worker_state state;
+
+	mythread_sync(thr->mutex) {
+		while (thr->state == THR_RUN)
+			mythread_cond_wait(&thr->cond, &thr->mutex);
+
+		state = thr->state;
+		*in_size = thr->in_size;
+	}
+
+	return state;
+}
+
+
+static MYTHREAD_RET_TYPE
+worker_start(void *thr_ptr)
+{
+	lzma_encoder_mt_thread *thr = thr_ptr;
+	lzma_encoder_mt *mt = thr->mt;
+	worker_state state = THR_IDLE; // Init to silence a warning
+
+	while (true) {
+		// Wait for work.
+		bool stopped = false;
+		bool give_back = false;
+		mythread_sync(thr->mutex) {
+			while (true) {
+				// The Block was stopped before this worker
+				// started to encode it. get_thread() took
+				// the worker from threads_free so it has
+				// to be put back there below. In a thread
+				// pool the job stays active meanwhile. If
+				// the worker gets a new Block, this loop
+				// notices it when it runs again.
+				if (thr->state == THR_STOP) {
+					thr->state = THR_IDLE;
+					mythread_cond_signal(&thr->cond);
+					stopped = true;
+					break;
+				}
+
+				state = thr->state;
+
+				// In a thread pool the thread is given back
+				// to the pool instead of waiting for more
+				// work or for the rest of the input of
+				// the Block. encode_in() will queue the job
+				// again when the Block has all its input.
+				if (mt->thread_pool != NULL
+						&& state <= THR_RUN) {
+					thr->job_active = false;
+					give_back = true;
+					break;
+				}
+
+				if (state != THR_IDLE)
+					break;
+
+				mythread_cond_wait(&thr->cond, &thr->mutex);
+			}
+		}
+
+		if (stopped) {
+			mythread_sync(mt->mutex) {
+				thr->next = mt->threads_free;
+				mt->threads_free = thr;
+				mythread_cond_signal(&mt->cond);
+			}
+
+			continue;
+		}
+
+		// thr must not be touched after job_active was cleared.
+		if (give_back)
+			return MYTHREAD_RET_VALUE;
+
+		size_t out_pos = 0;
+
+		assert(state != THR_IDLE);
+		assert(state != THR_STOP);
+
+		if (state <= THR_FINISH)
+			state = mt->encode(mt->coder, thr, &out_pos);
+
+		if (state == THR_EXIT)
+			break;
+
+		// Mark the thread as idle unless the main thread has
+		// told us to exit. Signal is needed for the case
+		// where the main thread is waiting for the threads to stop.
+		mythread_sync(thr->mutex) {
+			if (thr->state != THR_EXIT) {
+				thr->state = THR_IDLE;
+				mythread_cond_signal(&thr->cond);
+			}
+		}
+
+		mythread_sync(mt->mutex) {
+			// If no errors occurred, make the encoded data
+			// available to be copied out and update the main
+			// progress info.
+			if (state == THR_FINISH) {
+				thr->outbuf->pos = out_pos;
+				thr->outbuf->finished = true;
+
+				mt->progress_in += thr->outbuf->uncompressed_size;
+				mt->progress_out += out_pos;
+
+				++thr->stats.blocks;
+				thr->stats.progress_in
+					+= thr->outbuf->uncompressed_size;
+				thr->stats.progress_out += out_pos;
+			}
+
+			thr->progress_in = 0;
+			thr->progress_out = 0;
+			thr->stats.allocs_avoided = thr->arena.allocs_avoided;
+
+			// Return this thread to the stack of free threads.
+			thr->next = mt->threads_free;
+			mt->threads_free = thr;
+
+			mythread_cond_signal(&mt->cond);
+		}
+	}
+
+	// Exiting. threads_end() frees the resources once it knows
+	// that we are done.
+	if (mt->thread_pool != NULL) {
+		mythread_sync(thr->mutex) {
+			thr->job_active = false;
+			mythread_cond_signal(&thr->cond);
+		}
+	}
+
+	return MYTHREAD_RET_VALUE;
+}
+
+
+/// Runs worker_start() in a thread of the pool.
+static void
+worker_job(void *thr_ptr)
+{
+	(void)worker_start(thr_ptr);
+	return;
+}
+
+
+extern void
+lzma_encoder_mt_stop(lzma_encoder_mt *mt, bool wait_for_threads)
+{
+	// Tell the threads to stop. Idle threads are left alone since
+	// an idle worker in a thread pool has no thread that would
+	// change THR_STOP back to THR_IDLE.
+	for (uint32_t i = 0; i < mt->threads_initialized; ++i) {
+		mythread_sync(mt->threads[i].mutex) {
+			if (mt->threads[i].state != THR_IDLE) {
+				mt->threads[i].state = THR_STOP;
+				mythread_cond_signal(&mt->threads[i].cond);
+			}
+		}
+	}
+
+	// A worker in a thread pool has no thread before its Block
+	// has got all its input. Do what the worker would do when
+	// it notices THR_STOP.
+	if (mt->thread_pool != NULL) {
+		for (uint32_t i = 0; i < mt->threads_initialized; ++i) {
+			lzma_encoder_mt_thread *thr = &mt->threads[i];
+			bool stopped = false;
+
+			mythread_sync(thr->mutex) {
+				if (thr->state == THR_STOP
+						&& !thr->job_active) {
+					thr->state = THR_IDLE;
+					stopped = true;
+				}
+			}
+
+			if (stopped) {
+				mythread_sync(mt->mutex) {
+					thr->next = mt->threads_free;
+					mt->threads_free = thr;
+				}
+			}
+		}
+	}
+
+	if (!wait_for_threads)
+		return;
+
+	// Wait for the threads to settle in the idle state.
+	for (uint32_t i = 0; i < mt->threads_initialized; ++i) {
+		mythread_sync(mt->threads[i].mutex) {
+			while (mt->threads[i].state != THR_IDLE)
+				mythread_cond_wait(&mt->threads[i].cond,
+						&mt->threads[i].mutex);
+		}
+	}
+
+	return;
+}
+
+
+/// Stop the threads and free the resources associated with them.
+/// Wait until the threads have exited.
+static void
+threads_end(lzma_encoder_mt *mt, const lzma_allocator *allocator)
+{
+	for (uint32_t i = 0; i < mt->threads_initialized; ++i) {
+		mythread_sync(mt->threads[i].mutex) {
+			mt->threads[i].state = THR_EXIT;
+			mythread_cond_signal(&mt->threads[i].cond);
+		}
+	}
+
+	for (uint32_t i = 0; i < mt->threads_initialized; ++i) {
+		lzma_encoder_mt_thread *thr = &mt->threads[i];
+
+		if (mt->thread_pool != NULL) {
+			mythread_sync(thr->mutex) {
+				while (thr->job_active)
+					mythread_cond_wait(&thr->cond,
+							&thr->mutex);
+			}
+		} else {
+			int ret = mythread_join(thr->thread_id);
+			assert(ret == 0);
+			(void)ret;
+		}
+
+		lzma_filters_free(thr->filters, allocator);
+
+		mythread_mutex_destroy(&thr->mutex);
+		mythread_cond_destroy(&thr->cond);
+
+		lzma_next_end(&thr->encoder, &thr->arena.allocator);
+		lzma_arena_end(&thr->arena);
+		lzma_free(thr->in, allocator);
+	}
+
+	lzma_free(mt->threads, allocator);
+	return;
+}
+
+
+/// Initialize a new lzma_encoder_mt_thread structure and create
+/// a new thread.
+static lzma_ret
+initialize_new_thread(lzma_encoder_mt *mt, const lzma_allocator *allocator)
+{
+	lzma_encoder_mt_thread *thr = &mt->threads[mt->threads_initialized];
+
+	thr->in = lzma_alloc(mt->block_size, allocator);
+	if (thr->in == NULL)
+		return LZMA_MEM_ERROR;
+
+	if (mythread_mutex_init(&thr->mutex))
+		goto error_mutex;
+
+	if (mythread_cond_init(&thr->cond))
+		goto error_cond;
+
+	thr->state = THR_IDLE;
+	thr->mt = mt;
+	thr->progress_in = 0;
+	thr->progress_out = 0;
+	thr->encoder = LZMA_NEXT_CODER_INIT;
+	lzma_arena_init(&thr->arena, allocator);
+	thr->filters[0].id = LZMA_VLI_UNKNOWN;
+	memzero(&thr->stats, sizeof(thr->stats));
+	thr->job.func = &worker_job;
+	thr->job.arg = thr;
+	thr->job_active = false;
+
+	// With a thread pool the job is queued in encode_in().
+	if (mt->thread_pool == NULL && mythread_create(
+			&thr->thread_id, &worker_start, thr))
+		goto error_thread;
+
+	++mt->threads_initialized;
+	mt->thr = thr;
+
+	return LZMA_OK;
+
+error_thread:
+	mythread_cond_destroy(&thr->cond);
+
+error_cond:
+	mythread_mutex_destroy(&thr->mutex);
+
+error_mutex:
+	lzma_free(thr->in, allocator);
+	return LZMA_MEM_ERROR;
+}
+
+
+static lzma_ret
+get_thread(lzma_encoder_mt *mt, const lzma_allocator *allocator)
+{
+	// If there are no free output subqueues, there is no
+	// point to try getting a thread.
+	if (!lzma_outq_has_buf(&mt->outq))
+		return LZMA_OK;
+
+	// That's also true if we cannot allocate memory for the output
+	// buffer in the output queue.
+	return_if_error(lzma_outq_prealloc_buf(&mt->outq, allocator,
+			mt->outbuf_alloc_size));
+
+	// Make a thread-specific copy of the filter chain. Put it in
+	// the cache array first so that if we cannot get a new thread yet,
+	// the allocation is ready when we try again.
+	if (mt->filters_cache[0].id == LZMA_VLI_UNKNOWN)
+		return_if_error(lzma_filters_copy(
+			mt->filters, mt->filters_cache, allocator));
+
+	// If there is a free structure on the stack, use it.
+	mythread_sync(mt->mutex) {
+		if (mt->threads_free != NULL) {
+			mt->thr = mt->threads_free;
+			mt->threads_free = mt->threads_free->next;
+		}
+	}
+
+	if (mt->thr == NULL) {
+		// If there are no uninitialized structures left, return.
+		if (mt->threads_initialized == mt->threads_max)
+			return LZMA_OK;
+
+		// Initialize a new thread.
+		return_if_error(initialize_new_thread(mt, allocator));
+	}
+
+	// Reset the parts of the thread state that have to be done
+	// in the main thread.
+	mythread_sync(mt->thr->mutex) {
+		mt->thr->state = THR_RUN;
+		mt->thr->in_size = 0;
+		mt->thr->outbuf = lzma_outq_get_buf(&mt->outq, NULL);
+
+		// Free the old thread-specific filter options and replace
+		// them with the already-allocated new options from
+		// mt->filters_cache[]. Then mark the cache as empty.
+		lzma_filters_free(mt->thr->filters, allocator);
+		memcpy(mt->thr->filters, mt->filters_cache,
+				sizeof(mt->filters_cache));
+		mt->filters_cache[0].id = LZMA_VLI_UNKNOWN;
+
+		mythread_cond_signal(&mt->thr->cond);
+	}
+
+	mt->block_started = true;
+	return LZMA_OK;
+}
+
+
+/// True if LZMA_FINISH still has to start a Block for empty input
+static inline bool
+empty_block_needed(const lzma_encoder_mt *mt, lzma_action action)
+{
+	return mt->require_block && !mt->block_started
+			&& action == LZMA_FINISH;
+}
+
+
+static lzma_ret
+encode_in(lzma_encoder_mt *mt, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, lzma_action action)
+{
+	while (*in_pos < in_size
+			|| (mt->thr != NULL && action != LZMA_RUN)
+			|| empty_block_needed(mt, action)) {
+		if (mt->thr == NULL) {
+			// Get a new thread.
+			const lzma_ret ret = get_thread(mt, allocator);
+			if (mt->thr == NULL)
+				return ret;
+		}
+
+		// Copy the input data to thread's buffer.
+		size_t thr_in_size = mt->thr->in_size;
+		lzma_bufcpy(in, in_pos, in_size, mt->thr->in,
+				&thr_in_size, mt->block_size);
+
+		// Tell the encoder to finish if
+		//  - it has got block_size bytes of input; or
+		//  - all input was used and LZMA_FINISH, LZMA_FULL_FLUSH,
+		//    or LZMA_FULL_BARRIER was used.
+		//
+		// TODO: LZMA_SYNC_FLUSH and LZMA_SYNC_BARRIER.
+		const bool finish = thr_in_size == mt->block_size
+				|| (*in_pos == in_size && action != LZMA_RUN);
+
+		bool block_error = false;
+
+		mythread_sync(mt->thr->mutex) {
+			if (mt->thr->state == THR_IDLE) {
+				// Something has gone wrong with the
+				// encoder. It has set mt->thread_error
+				// which we will read a few lines later.
+				block_error = true;
+			} else {
+				// Tell the encoder its new amount
+				// of input and update the state if needed.
+				mt->thr->in_size = thr_in_size;
+
+				if (finish)
+					mt->thr->state = THR_FINISH;
+
+				mythread_cond_signal(&mt->thr->cond);
+
+				// With a thread pool, the job is queued
+				// only when the Block has all its input.
+				// If the job is still active, it will
+				// notice the new state before giving its
+				// thread back.
+				if (finish && mt->thread_pool != NULL
+						&& !mt->thr->job_active) {
+					mt->thr->job_active = true;
+					lzma_thread_pool_run(mt->thread_pool,
+							&mt->thr->job);
+				}
+			}
+		}
+
+		if (block_error) {
+			lzma_ret ret = LZMA_OK; // Init to silence a warning.
+
+			mythread_sync(mt->mutex) {
+				ret = mt->thread_error;
+			}
+
+			return ret;
+		}
+
+		if (finish)
+			mt->thr = NULL;
+	}
+
+	return LZMA_OK;
+}
+
+
+/// Wait until more input can be consumed, more output can be read, or
+/// an optional timeout is reached.
+static bool
+wait_for_work(lzma_encoder_mt *mt, mythread_condtime *wait_abs,
+		bool *has_blocked, bool has_input)
+{
+	if (mt->timeout != 0 && !*has_blocked) {
+		// Every time when lzma_encoder_mt_code() is called via
+		// lzma_code(), *has_blocked starts as false. We set it
+		// to true here and calculate the absolute time when
+		// we must return if there's nothing to do.
+		//
+		// This way if we block multiple times for short moments
+		// less than "timeout" milliseconds, we will return once
+		// "timeout" amount of time has passed since the *first*
+		// blocking occurred. If the absolute time was calculated
+		// again every time we block, "timeout" would effectively
+		// be meaningless if we never consecutively block longer
+		// than "timeout" ms.
+		*has_blocked = true;
+		mythread_condtime_set(wait_abs, &mt->cond, mt->timeout);
+	}
+
+	bool timed_out = false;
+
+	mythread_sync(mt->mutex) {
+		// There are four things that we wait. If one of them
+		// becomes possible, we return.
+		//  - If there is input left, we need to get a free
+		//    worker thread and an output buffer for it.
+		//  - Data ready to be read from the output queue.
+		//  - A worker thread indicates an error.
+		//  - Time out occurs.
+		while ((!has_input || mt->threads_free == NULL
+					|| !lzma_outq_has_buf(&mt->outq))
+				&& !lzma_outq_is_readable(&mt->outq)
+				&& mt->thread_error == LZMA_OK
+				&& !timed_out) {
+			if (mt->timeout != 0)
+				timed_out = mythread_cond_timedwait(
+						&mt->cond, &mt->mutex,
+						wait_abs) != 0;
+			else
+				mythread_cond_wait(&mt->cond, &mt->mutex);
+		}
+	}
+
+	return timed_out;
+}
+
+
+extern lzma_ret
+lzma_encoder_mt_code(lzma_encoder_mt *mt, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size,
+		lzma_action action, lzma_index *index)
+{
+	// Initialized to silence warnings.
+	lzma_vli unpadded_size = 0;
+	lzma_vli uncompressed_size = 0;
+	lzma_ret ret = LZMA_OK;
+
+	// These are for wait_for_work().
+	bool has_blocked = false;
+	mythread_condtime wait_abs = { 0 };
+
+	while (true) {
+		mythread_sync(mt->mutex) {
+			// Check for encoder errors.
+			ret = mt->thread_error;
+			if (ret != LZMA_OK) {
+				assert(ret != LZMA_STREAM_END);
+				break; // Break out of mythread_sync.
+			}
+
+			// Try to read compressed data to out[].
+			ret = lzma_outq_read(&mt->outq, allocator,
+					out, out_pos, out_size,
+					&unpadded_size, &uncompressed_size);
+		}
+
+		if (ret == LZMA_STREAM_END) {
+			// End of Block. Add it to the Index.
+			if (index != NULL) {
+				ret = lzma_index_append(index, allocator,
+						unpadded_size,
+						uncompressed_size);
+				if (ret != LZMA_OK) {
+					lzma_encoder_mt_stop(mt, false);
+					return ret;
+				}
+			}
+
+			// If we didn't fill the output buffer yet,
+			// try to read more data. Maybe the next
+			// outbuf has been finished already too.
+			if (*out_pos < out_size)
+				continue;
+
+			ret = LZMA_OK;
+		}
+
+		if (ret != LZMA_OK) {
+			// mt->thread_error was set.
+			lzma_encoder_mt_stop(mt, false);
+			return ret;
+		}
+
+		// Try to give uncompressed data to a worker thread.
+		ret = encode_in(mt, allocator, in, in_pos, in_size, action);
+		if (ret != LZMA_OK) {
+			lzma_encoder_mt_stop(mt, false);
+			return ret;
+		}
+
+		// See if we should wait or return.
+		//
+		// TODO: LZMA_SYNC_FLUSH and LZMA_SYNC_BARRIER.
+		if (*in_pos == in_size) {
+			// LZMA_RUN: More data is probably coming
+			// so return to let the caller fill the
+			// input buffer.
+			if (action == LZMA_RUN)
+				return LZMA_OK;
+
+			// LZMA_FULL_BARRIER: The same as with
+			// LZMA_RUN but tell the caller that the
+			// barrier was completed.
+			if (action == LZMA_FULL_BARRIER)
+				return LZMA_STREAM_END;
+
+			// Finishing or flushing isn't completed until
+			// all input data has been encoded and copied
+			// to the output buffer. With LZMA_FINISH the
+			// Block for empty input must have been started
+			// too if the format needs it.
+			if (lzma_outq_is_empty(&mt->outq)
+					&& !empty_block_needed(mt, action))
+				return LZMA_STREAM_END;
+		}
+
+		// Return if there is no output space left.
+		// This check must be done after testing the input
+		// buffer, because we might want to use a different
+		// return code.
+		if (*out_pos == out_size)
+			return LZMA_OK;
+
+		// Neither in nor out has been used completely.
+		// Wait until there's something we can do.
+		if (wait_for_work(mt, &wait_abs, &has_blocked,
+				*in_pos < in_size
+				|| empty_block_needed(mt, action)))
+			return LZMA_TIMED_OUT;
+	}
+}
+
+
+extern void
+lzma_encoder_mt_get_progress(lzma_encoder_mt *mt,
+		uint64_t *progress_in, uint64_t *progress_out)
+{
+	// Lock mt->mutex to prevent finishing threads from moving their
+	// progress info from the lzma_encoder_mt_thread structure to
+	// lzma_encoder_mt.
+	mythread_sync(mt->mutex) {
+		*progress_in = mt->progress_in;
+		*progress_out = mt->progress_out;
+
+		for (size_t i = 0; i < mt->threads_initialized; ++i) {
+			mythread_sync(mt->threads[i].mutex) {
+				*progress_in += mt->threads[i].progress_in;
+				*progress_out += mt->threads[i].progress_out;
+			}
+		}
+	}
+
+	return;
+}
+
+
+extern uint32_t
+lzma_encoder_mt_get_worker_stats(lzma_encoder_mt *mt,
+		lzma_worker_stats *stats, uint32_t stats_max)
+{
+	uint32_t count = 0;
+
+	// Like in lzma_encoder_mt_get_progress(), lock mt->mutex so that
+	// finishing threads cannot move their progress info meanwhile.
+	mythread_sync(mt->mutex) {
+		count = mt->threads_initialized;
+
+		for (uint32_t i = 0; i < count && i < stats_max; ++i) {
+			lzma_encoder_mt_thread *thr = &mt->threads[i];
+
+			mythread_sync(thr->mutex) {
+				stats[i] = thr->stats;
+				stats[i].progress_in += thr->progress_in;
+				stats[i].progress_out += thr->progress_out;
+			}
+		}
+	}
+
+	return count;
+}
+
+
+extern lzma_ret
+lzma_encoder_mt_create(lzma_encoder_mt *mt, lzma_encoder_mt_function encode,
+		void *coder, bool require_block)
+{
+	// For the mutex and condition variable initializations
+	// the error handling has to be done here because
+	// lzma_encoder_mt_end() doesn't know if they have
+	// already been initialized or not.
+	if (mythread_mutex_init(&mt->mutex))
+		return LZMA_MEM_ERROR;
+
+	if (mythread_cond_init(&mt->cond)) {
+		mythread_mutex_destroy(&mt->mutex);
+		return LZMA_MEM_ERROR;
+	}
+
+	mt->encode = encode;
+	mt->coder = coder;
+	mt->require_block = require_block;
+	mt->block_size = 0;
+	mt->filters[0].id = LZMA_VLI_UNKNOWN;
+	mt->filters_cache[0].id = LZMA_VLI_UNKNOWN;
+	memzero(&mt->outq, sizeof(mt->outq));
+	mt->threads = NULL;
+	mt->threads_max = 0;
+	mt->threads_initialized = 0;
+	mt->thread_pool = NULL;
+
+	return LZMA_OK;
+}
+
+
+extern lzma_ret
+lzma_encoder_mt_init(lzma_encoder_mt *mt, const lzma_allocator *allocator,
+		const lzma_mt *options, const lzma_filter *filters,
+		uint64_t block_size, uint64_t outbuf_size_max)
+{
+#if SIZE_MAX < UINT64_MAX
+	if (block_size > SIZE_MAX || outbuf_size_max > SIZE_MAX)
+		return LZMA_MEM_ERROR;
+#endif
+
+	// Allocate the thread-specific base structures. The threads
+	// cannot be reused if the thread pool or the size of the input
+	// buffers changes.
+	assert(options->threads > 0);
+	if (mt->threads_max != options->threads
+			|| mt->thread_pool != options->thread_pool
+			|| mt->block_size != block_size) {
+		threads_end(mt, allocator);
+
+		mt->threads = NULL;
+		mt->threads_max = 0;
+
+		mt->threads_initialized = 0;
+		mt->threads_free = NULL;
+		mt->thread_pool = options->thread_pool;
+
+		mt->threads = lzma_alloc(
+				options->threads * sizeof(lzma_encoder_mt_thread),
+				allocator);
+		if (mt->threads == NULL)
+			return LZMA_MEM_ERROR;
+
+		mt->threads_max = options->threads;
+	} else {
+		// Reuse the old structures and threads. Tell the running
+		// threads to stop and wait until they have stopped.
+		lzma_encoder_mt_stop(mt, true);
+	}
+
+	// Basic initializations. The threads are idle now.
+	mt->block_started = false;
+	mt->block_size = (size_t)(block_size);
+	mt->outbuf_alloc_size = (size_t)(outbuf_size_max);
+	mt->thread_error = LZMA_OK;
+	mt->thr = NULL;
+
+	// Output queue
+	return_if_error(lzma_outq_init(&mt->outq, allocator,
+			options->threads));
+
+	// Timeout
+	mt->timeout = options->timeout;
+
+	// Free the old filter chain and the cache.
+	lzma_filters_free(mt->filters, allocator);
+	lzma_filters_free(mt->filters_cache, allocator);
+
+	// Copy the new filter chain.
+	return_if_error(lzma_filters_copy(filters, mt->filters, allocator));
+
+	// Progress info
+	mt->progress_in = 0;
+	mt->progress_out = 0;
+
+	return LZMA_OK;
+}
+
+
+extern void
+lzma_encoder_mt_end(lzma_encoder_mt *mt, const lzma_allocator *allocator)
+{
+	// Threads must be killed before the output queue can be freed.
+	threads_end(mt, allocator);
+	lzma_outq_end(&mt->outq, allocator);
+
+	lzma_filters_free(mt->filters, allocator);
+	lzma_filters_free(mt->filters_cache, allocator);
+
+	mythread_cond_destroy(&mt->cond);
+	mythread_mutex_destroy(&mt->mutex);
+
+	return;
+}
+
+
+extern uint64_t
+lzma_encoder_mt_memusage(const lzma_mt *options, const lzma_filter *filters,
+		uint64_t block_size, uint64_t outbuf_size_max,
+		size_t coder_size)
+{
+	// Memory usage of the input buffers
+	const uint64_t inbuf_memusage = options->threads * block_size;
+
+	// Memory usage of the filter encoders
+	uint64_t filters_memusage = lzma_raw_encoder_memusage(filters);
+	if (filters_memusage == UINT64_MAX)
+		return UINT64_MAX;
+
+	filters_memusage *= options->threads;
+
+	// Memory usage of the output queue
+	const uint64_t outq_memusage = lzma_outq_memusage(
+			outbuf_size_max, options->threads);
+	if (outq_memusage == UINT64_MAX)
+		return UINT64_MAX;
+
+	// Sum them with overflow checking.
+	uint64_t total_memusage = LZMA_MEMUSAGE_BASE + coder_size
+			+ options->threads * sizeof(lzma_encoder_mt_thread);
+
+	if (UINT64_MAX - total_memusage < inbuf_memusage)
+		return UINT64_MAX;
+
+	total_memusage += inbuf_memusage;
+
+	if (UINT64_MAX - total_memusage < filters_memusage)
+		return UINT64_MAX;
+
+	total_memusage += filters_memusage;
+
+	if (UINT64_MAX - total_memusage < outq_memusage)
+		return UINT64_MAX;
+
+	return total_memusage + outq_memusage;
+}
@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       encoder_mt.h
+/// \brief      Worker threads of the multithreaded encoders
+///
+/// The .xz and .lz encoders both split the input into independent Blocks
+/// (.lz members) that are compressed in worker threads and written out
+/// in order via lzma_outq. This file contains the parts that don't depend
+/// on the file format. The format-specific code provides a function that
+/// encodes one Block in a worker thread and writes the headers and
+/// footers around the Blocks.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_ENCODER_MT_H
+#define LZMA_ENCODER_MT_H
+
+#include "common.h"
+#include "arena.h"
+#include "outqueue.h"
+#include "thread_pool.h"
+
+
+/// Maximum supported Block size. This makes it simpler to prevent integer
+/// overflows if we are given unusually large Block size.
+#define ENCODER_MT_BLOCK_SIZE_MAX (UINT64_MAX / LZMA_THREADS_MAX)
+
+
+typedef enum {
+	/// Waiting for work.
+	THR_IDLE,
+
+	/// Encoding is in progress.
+	THR_RUN,
+
+	/// Encoding is in progress but no more input data will
+	/// be read.
+	THR_FINISH,
+
+	/// The main thread wants the thread to stop whatever it was doing
+	/// but not exit.
+	THR_STOP,
+
+	/// The main thread wants the thread to exit. We could use
+	/// cancellation but since there's stopped anyway, this is lazier.
+	THR_EXIT,
+
+} worker_state;
+
+
+typedef struct lzma_encoder_mt_s lzma_encoder_mt;
+
+typedef struct lzma_encoder_mt_thread_s lzma_encoder_mt_thread;
+struct lzma_encoder_mt_thread_s {
+	worker_state state;
+
+	/// Input buffer of mt->block_size bytes. The main thread will
+	/// put new input into this and update in_size accordingly. Once
+	/// no more input is coming, state will be set to THR_FINISH.
+	uint8_t *in;
+
+	/// Amount of data available in the input buffer. This is modified
+	/// only by the main thread.
+	size_t in_size;
+
+	/// Output buffer for this thread. This is set by the main
+	/// thread every time a new Block is started with this thread
+	/// structure.
+	lzma_outbuf *outbuf;
+
+	/// Pointer to the main structure is needed when putting this
+	/// thread back to the stack of free threads.
+	lzma_encoder_mt *mt;
+
+	/// Amount of uncompressed data that has already been compressed.
+	uint64_t progress_in;
+
+	/// Amount of compressed data that is ready.
+	uint64_t progress_out;
+
+	/// Statistics for lzma_get_worker_stats(). blocks, progress_in,
+	/// progress_out, and allocs_avoided are updated with the main mutex
+	/// locked when a Block is finished, input_waits with our mutex
+	/// locked.
+	lzma_worker_stats stats;
+
+	/// Block or .lz member encoder. It is initialized by
+	/// the format-specific encode function.
+	lzma_next_coder encoder;
+
+	/// Allocations of the encoder are done from this arena
+	/// so that they can be reused when the filter chain changes
+	/// between Blocks.
+	lzma_arena arena;
+
+	/// Filter chain for this thread. By copying the filters array
+	/// to each thread it is possible to change the filter chain
+	/// between Blocks using lzma_filters_update().
+	lzma_filter filters[LZMA_FILTERS_MAX + 1];
+
+	/// Next structure in the stack of free worker threads.
+	lzma_encoder_mt_thread *next;
+
+	mythread_mutex mutex;
+	mythread_cond cond;
+
+	/// The ID of this thread is used to join the thread
+	/// when it's not needed anymore. This isn't used when
+	/// the worker runs in a thread pool.
+	mythread thread_id;
+
+	/// Job that runs worker_start() in mt->thread_pool
+	lzma_pool_job job;
+
+	/// True if the job has been given to the thread pool and
+	/// worker_start() hasn't returned yet. This is protected
+	/// with our mutex.
+	bool job_active;
+};
+
+
+/// \brief      Encode one Block in a worker thread
+///
+/// This is called with thr->state being THR_RUN or THR_FINISH. The function
+/// initializes thr->encoder and uses lzma_encoder_mt_worker_code() to
+/// encode the input into thr->outbuf->buf. It sets
+/// thr->outbuf->uncompressed_size (and unpadded_size if needed) and
+/// *out_pos and returns THR_FINISH on success. If the main thread asked
+/// the thread to stop or exit, that state is returned. On error,
+/// lzma_encoder_mt_worker_error() is called and THR_STOP returned.
+typedef worker_state (*lzma_encoder_mt_function)(void *coder,
+		lzma_encoder_mt_thread *thr, size_t *out_pos);
+
+
+struct lzma_encoder_mt_s {
+	/// Format-specific Block encoding function and the coder
+	/// that is passed to it
+	lzma_encoder_mt_function encode;
+	void *coder;
+
+	/// If true, LZMA_FINISH produces one Block even if there was
+	/// no input at all. .lz files need at least one member while
+	/// an .xz Stream may have no Blocks.
+	bool require_block;
+
+	/// True once the first Block has been given to a worker thread.
+	bool block_started;
+
+	/// Start a new Block every block_size bytes of input unless
+	/// LZMA_FULL_FLUSH or LZMA_FULL_BARRIER is used earlier.
+	size_t block_size;
+
+	/// The filter chain to use for the next Block.
+	/// This can be updated using lzma_filters_update()
+	/// after LZMA_FULL_BARRIER or LZMA_FULL_FLUSH.
+	lzma_filter filters[LZMA_FILTERS_MAX + 1];
+
+	/// A copy of filters[] will be put here when attempting to get
+	/// a new worker thread. This will be copied to a worker thread
+	/// when a thread becomes free and then this cache is marked as
+	/// empty by setting [0].id = LZMA_VLI_UNKNOWN. Without this cache
+	/// the filter options from filters[] would get uselessly copied
+	/// multiple times (allocated and freed) when waiting for a new free
+	/// worker thread.
+	///
+	/// This is freed if filters[] is updated via lzma_filters_update().
+	lzma_filter filters_cache[LZMA_FILTERS_MAX + 1];
+
+
+	/// Output buffer queue for compressed data
+	lzma_outq outq;
+
+	/// How much memory to allocate for each lzma_outbuf.buf
+	size_t outbuf_alloc_size;
+
+
+	/// Maximum wait time if cannot use all the input and cannot
+	/// fill the output buffer. This is in milliseconds.
+	uint32_t timeout;
+
+
+	/// Error code from a worker thread
+	lzma_ret thread_error;
+
+	/// Array of allocated thread-specific structures
+	lzma_encoder_mt_thread *threads;
+
+	/// Number of structures in "threads" above. This is also the
+	/// number of threads that will be created at maximum.
+	uint32_t threads_max;
+
+	/// Number of thread structures that have been initialized, and
+	/// thus the number of worker threads actually created so far.
+	uint32_t threads_initialized;
+
+	/// Stack of free threads. When a thread finishes, it puts itself
+	/// back into this stack. This starts as empty because threads
+	/// are created only when actually needed.
+	lzma_encoder_mt_thread *threads_free;
+
+	/// The most recent worker thread to which the main thread writes
+	/// the new input from the application.
+	lzma_encoder_mt_thread *thr;
+
+	/// Thread pool from lzma_mt.thread_pool. If this is NULL, each
+	/// worker has a thread of its own. Otherwise a worker runs in
+	/// a thread of the pool only while it has a Block to encode.
+	lzma_thread_pool *thread_pool;
+
+
+	/// Amount of uncompressed data in Blocks that have already
+	/// been finished.
+	uint64_t progress_in;
+
+	/// Amount of compressed data in Blocks that have already been
+	/// finished. The format-specific code may add the sizes of
+	/// headers and footers here.
+	uint64_t progress_out;
+
+
+	mythread_mutex mutex;
+	mythread_cond cond;
+};
+
+
+/// \brief      Initialize the parts of lzma_encoder_mt that stay over
+///             lzma_encoder_mt_init() calls
+///
+/// This is called once after allocating the format-specific coder.
+/// If this fails, lzma_encoder_mt_end() must not be called.
+extern lzma_ret lzma_encoder_mt_create(lzma_encoder_mt *mt,
+		lzma_encoder_mt_function encode, void *coder,
+		bool require_block);
+
+/// \brief      Prepare for encoding a new file
+///
+/// Threads are reused if possible. Otherwise the old threads are ended
+/// and the new ones are created only when needed.
+extern lzma_ret lzma_encoder_mt_init(lzma_encoder_mt *mt,
+		const lzma_allocator *allocator, const lzma_mt *options,
+		const lzma_filter *filters, uint64_t block_size,
+		uint64_t outbuf_size_max);
+
+/// Stop the threads and free everything allocated by lzma_encoder_mt_*().
+extern void lzma_encoder_mt_end(
+		lzma_encoder_mt *mt, const lzma_allocator *allocator);
+
+/// Make the threads stop but not exit. Optionally wait for them to stop.
+extern void lzma_encoder_mt_stop(lzma_encoder_mt *mt, bool wait_for_threads);
+
+/// \brief      Encode the Blocks
+///
+/// The input is given to the worker threads and the finished Blocks are
+/// copied to out[]. If index isn't NULL, the sizes of the finished Blocks
+/// are appended to it.
+///
+/// \return     LZMA_STREAM_END once the action other than LZMA_RUN has
+///             been completed. With LZMA_FINISH and LZMA_FULL_FLUSH this
+///             means that all Blocks have been copied to out[].
+extern lzma_ret lzma_encoder_mt_code(lzma_encoder_mt *mt,
+		const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size,
+		lzma_action action, lzma_index *index);
+
+/// Get progress information for lzma_get_progress().
+extern void lzma_encoder_mt_get_progress(lzma_encoder_mt *mt,
+		uint64_t *progress_in, uint64_t *progress_out);
+
+/// Get statistics for lzma_get_worker_stats().
+extern uint32_t lzma_encoder_mt_get_worker_stats(lzma_encoder_mt *mt,
+		lzma_worker_stats *stats, uint32_t stats_max);
+
+/// \brief      Calculate the memory usage of a multithreaded encoder
+///
+/// \param      coder_size  Size of the format-specific coder structure
+///                         which contains lzma_encoder_mt
+///
+/// \return     Memory usage or UINT64_MAX on error
+extern uint64_t lzma_encoder_mt_memusage(const lzma_mt *options,
+		const lzma_filter *filters, uint64_t block_size,
+		uint64_t outbuf_size_max, size_t coder_size);
+
+
+/// Tell the main thread that something has gone wrong. This is called
+/// from a worker thread.
+extern void lzma_encoder_mt_worker_error(
+		lzma_encoder_mt_thread *thr, lzma_ret ret);
+
+/// \brief      Run the encoder of a worker thread
+///
+/// Input is given to thr->encoder as the main thread makes it available.
+/// This returns when the encoder returns something else than LZMA_OK,
+/// out[] is full, or the main thread wants the thread to stop or exit.
+///
+/// \param      ret     Return value of the last call to the encoder
+/// \param      in_size Amount of input given to the encoder
+///
+/// \return     The state of the thread. If it is THR_STOP or THR_EXIT,
+///             the encode function must return it without touching
+///             thr->outbuf.
+extern worker_state lzma_encoder_mt_worker_code(lzma_encoder_mt_thread *thr,
+		size_t *out_pos, lzma_ret *ret, size_t *in_size);
+
+/// \brief      Wait until the main thread has given all input
+///
+/// \return     The state of the thread: THR_FINISH, THR_STOP, or THR_EXIT
+extern worker_state lzma_encoder_mt_worker_wait(
+		lzma_encoder_mt_thread *thr, size_t *in_size);
+
+#endif
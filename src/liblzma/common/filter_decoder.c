@@ -15,6 +15,7 @@
 #include "lzma2_decoder.h"
 #include "simple_decoder.h"
 #include "delta_decoder.h"
+#include "split_decoder.h"
 
 
 typedef struct {
@@ -128,6 +129,14 @@ static const lzma_filter_decoder decoders[] = {
 		.props_decode = &lzma_simple_props_decode,
 	},
 #endif
+#ifdef HAVE_DECODER_X86SPLIT
+	{
+		.id = LZMA_FILTER_X86_SPLIT,
+		.init = &lzma_split_decoder_init,
+		.memusage = &lzma_split_decoder_memusage,
+		.props_decode = &lzma_split_props_decode,
+	},
+#endif
 #ifdef HAVE_DECODER_DELTA
 	{
 		.id = LZMA_FILTER_DELTA,
@@ -15,6 +15,7 @@
 #include "lzma2_encoder.h"
 #include "simple_encoder.h"
 #include "delta_encoder.h"
+#include "split_encoder.h"
 
 
 typedef struct {
@@ -168,6 +169,16 @@ static const lzma_filter_encoder encoders[] = {
 		.props_encode = &lzma_simple_props_encode,
 	},
 #endif
+#ifdef HAVE_ENCODER_X86SPLIT
+	{
+		.id = LZMA_FILTER_X86_SPLIT,
+		.init = &lzma_split_encoder_init,
+		.memusage = &lzma_split_encoder_memusage,
+		.block_size = NULL,
+		.props_size_get = &lzma_split_props_size,
+		.props_encode = &lzma_split_props_encode,
+	},
+#endif
 #ifdef HAVE_ENCODER_DELTA
 	{
 		.id = LZMA_FILTER_DELTA,
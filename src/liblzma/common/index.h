@@ -30,6 +30,19 @@
 #define INDEX_INDICATOR 0
 
 
+/// Magic bytes at the beginning of the data written by
+/// lzma_index_cache_encode()
+#define INDEX_CACHE_MAGIC "\xFD" "XZidx"
+#define INDEX_CACHE_MAGIC_SIZE 6
+
+/// Size of the fixed header of the cache: magic bytes, version, reserved
+/// byte, file size, modification time, Stream count, and reserved bytes.
+#define INDEX_CACHE_HEADER_SIZE 32
+
+/// Size of the per-Stream header in the cache: Check ID, three reserved
+/// bytes, and Stream Padding. The Index field of the Stream follows.
+#define INDEX_CACHE_STREAM_SIZE 12
+
 /// Get the size of the Index Padding field. This is needed by Index encoder
 /// and decoder, but applications should have no use for this.
 extern uint32_t lzma_index_padding_size(const lzma_index *i);
@@ -370,3 +370,111 @@ lzma_index_buffer_decode(lzma_index **i, uint64_t *memlimit,
 
 	return ret;
 }
+
+
+extern LZMA_API(lzma_ret)
+lzma_index_cache_decode(lzma_index **i, uint64_t memlimit,
+		const lzma_allocator *allocator,
+		const uint8_t *in, size_t in_size,
+		uint64_t file_size, uint64_t mtime)
+{
+	if (i != NULL)
+		*i = NULL;
+
+	if (i == NULL || in == NULL)
+		return LZMA_PROG_ERROR;
+
+	// Validate the fixed header and the CRC32 of the whole cache.
+	// A cache of a different file or of an older version of this
+	// file is rejected here too.
+	if (in_size < INDEX_CACHE_HEADER_SIZE + 4
+			|| memcmp(in, INDEX_CACHE_MAGIC,
+				INDEX_CACHE_MAGIC_SIZE) != 0
+			|| in[6] != 0 || in[7] != 0
+			|| read64le(in + 8) != file_size
+			|| read64le(in + 16) != mtime
+			|| read32le(in + 24) == 0
+			|| read32le(in + 28) != 0
+			|| read32le(in + in_size - 4)
+				!= lzma_crc32(in, in_size - 4, 0))
+		return LZMA_DATA_ERROR;
+
+	const uint32_t streams = read32le(in + 24);
+	const size_t end = in_size - 4;
+	size_t pos = INDEX_CACHE_HEADER_SIZE;
+
+	lzma_index *combined = NULL;
+	lzma_ret ret = LZMA_OK;
+
+	for (uint32_t n = 0; n < streams && ret == LZMA_OK; ++n) {
+		if (end - pos < INDEX_CACHE_STREAM_SIZE
+				|| in[pos] > LZMA_CHECK_ID_MAX
+				|| in[pos + 1] != 0 || in[pos + 2] != 0
+				|| in[pos + 3] != 0) {
+			ret = LZMA_DATA_ERROR;
+			break;
+		}
+
+		lzma_stream_flags flags = {
+			.version = 0,
+			.check = (lzma_check)(in[pos]),
+		};
+
+		const lzma_vli padding = read64le(in + pos + 4);
+		if (padding > LZMA_VLI_MAX || (padding & 3) != 0) {
+			ret = LZMA_DATA_ERROR;
+			break;
+		}
+
+		pos += INDEX_CACHE_STREAM_SIZE;
+
+		// The Index field of the Stream
+		lzma_index *s;
+		uint64_t limit = memlimit;
+		ret = lzma_index_buffer_decode(&s, &limit, allocator,
+				in, &pos, end);
+		if (ret != LZMA_OK)
+			break;
+
+		flags.backward_size = lzma_index_size(s);
+		ret = lzma_index_stream_flags(s, &flags);
+
+		if (ret == LZMA_OK)
+			ret = lzma_index_stream_padding(s, padding);
+
+		if (ret == LZMA_OK) {
+			if (combined == NULL) {
+				combined = s;
+				s = NULL;
+			} else {
+				ret = lzma_index_cat(combined, s, allocator);
+				if (ret == LZMA_OK)
+					s = NULL;
+			}
+		}
+
+		lzma_index_end(s, allocator);
+
+		// The arguments were validated above so LZMA_PROG_ERROR
+		// means that the values don't fit together.
+		if (ret == LZMA_PROG_ERROR)
+			ret = LZMA_DATA_ERROR;
+
+		if (ret == LZMA_OK && lzma_index_memused(combined) > memlimit)
+			ret = LZMA_MEMLIMIT_ERROR;
+	}
+
+	// All the data must have been used, and the Streams must add up
+	// to the size of the file.
+	if (ret == LZMA_OK && (pos != end
+			|| lzma_index_file_size(combined) != file_size))
+		ret = LZMA_DATA_ERROR;
+
+	if (ret != LZMA_OK) {
+		lzma_index_end(combined, allocator);
+		return ret;
+	}
+
+	*i = combined;
+	return LZMA_OK;
+}
@@ -260,3 +260,100 @@ lzma_index_buffer_encode(const lzma_index *i,
 
 	return ret;
 }
+
+
+extern LZMA_API(lzma_ret)
+lzma_index_cache_encode(const lzma_index *i,
+		uint64_t file_size, uint64_t mtime,
+		const lzma_allocator *allocator,
+		uint8_t **out, size_t *out_size)
+{
+	if (i == NULL || out == NULL || out_size == NULL)
+		return LZMA_PROG_ERROR;
+
+	// Every Record takes at most two maximum-sized VLIs. The Index
+	// Indicator, Number of Records, Index Padding, and CRC32 of
+	// each Stream fit in 17 bytes.
+	const lzma_vli streams = lzma_index_stream_count(i);
+	const lzma_vli blocks = lzma_index_block_count(i);
+	const uint64_t limit = my_min(SIZE_MAX, UINT64_MAX / 2);
+	if (streams > UINT32_MAX || blocks > limit / 18 / 2
+			|| streams > limit / (INDEX_CACHE_STREAM_SIZE + 17) / 2)
+		return LZMA_MEM_ERROR;
+
+	const size_t alloc_size = INDEX_CACHE_HEADER_SIZE
+			+ (size_t)(streams) * (INDEX_CACHE_STREAM_SIZE + 17)
+			+ (size_t)(blocks) * 18 + 4;
+	uint8_t *buf = lzma_alloc(alloc_size, allocator);
+	if (buf == NULL)
+		return LZMA_MEM_ERROR;
+
+	memzero(buf, INDEX_CACHE_HEADER_SIZE);
+	memcpy(buf, INDEX_CACHE_MAGIC, INDEX_CACHE_MAGIC_SIZE);
+	write64le(buf + 8, file_size);
+	write64le(buf + 16, mtime);
+	write32le(buf + 24, (uint32_t)(streams));
+	size_t pos = INDEX_CACHE_HEADER_SIZE;
+
+	// The Blocks of each Stream are copied into a temporary lzma_index
+	// which is encoded like the Index field of that Stream. stream_iter
+	// goes through the Streams and block_iter through the Blocks.
+	lzma_index_iter stream_iter;
+	lzma_index_iter block_iter;
+	lzma_index_iter_init(&stream_iter, i);
+	lzma_index_iter_init(&block_iter, i);
+
+	lzma_ret ret = LZMA_OK;
+
+	while (!lzma_index_iter_next(&stream_iter, LZMA_INDEX_ITER_STREAM)) {
+		if (stream_iter.stream.flags == NULL) {
+			ret = LZMA_PROG_ERROR;
+			goto error;
+		}
+
+		buf[pos] = (uint8_t)(stream_iter.stream.flags->check);
+		buf[pos + 1] = 0;
+		buf[pos + 2] = 0;
+		buf[pos + 3] = 0;
+		write64le(buf + pos + 4, stream_iter.stream.padding);
+		pos += INDEX_CACHE_STREAM_SIZE;
+
+		lzma_index *s = lzma_index_init(allocator);
+		if (s == NULL) {
+			ret = LZMA_MEM_ERROR;
+			goto error;
+		}
+
+		for (lzma_vli n = 0; n < stream_iter.stream.block_count
+				&& ret == LZMA_OK; ++n) {
+			const bool end = lzma_index_iter_next(
+					&block_iter, LZMA_INDEX_ITER_BLOCK);
+			assert(!end);
+			(void)end;
+
+			ret = lzma_index_append(s, allocator,
+					block_iter.block.unpadded_size,
+					block_iter.block.uncompressed_size);
+		}
+
+		if (ret == LZMA_OK)
+			ret = lzma_index_buffer_encode(
+					s, buf, &pos, alloc_size - 4);
+
+		lzma_index_end(s, allocator);
+
+		if (ret != LZMA_OK)
+			goto error;
+	}
+
+	write32le(buf + pos, lzma_crc32(buf, pos, 0));
+	pos += 4;
+
+	*out = buf;
+	*out_size = pos;
+	return LZMA_OK;
+
+error:
+	lzma_free(buf, allocator);
+	return ret;
+}
@@ -0,0 +1,267 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       index_flat.c
+/// \brief      Flat read-only Index
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "common.h"
+#include "index.h"
+#include "check.h"
+
+
+typedef struct {
+	/// Uncompressed offset of the end of this Block. The uncompressed
+	/// start offset is the end offset of the previous Block.
+	lzma_vli uncompressed_sum;
+
+	/// Compressed start offset of this Block
+	lzma_vli compressed_offset;
+
+	/// Unpadded Size of this Block
+	lzma_vli unpadded_size;
+} index_flat_record;
+
+
+struct lzma_index_flat_s {
+	/// Number of Blocks in records[]
+	lzma_vli count;
+
+	/// The Blocks sorted by their offsets
+	index_flat_record records[];
+};
+
+
+/// Allocate lzma_index_flat for count Blocks.
+static lzma_index_flat *
+index_flat_alloc(lzma_vli count, const lzma_allocator *allocator)
+{
+	if (count > (SIZE_MAX - sizeof(lzma_index_flat))
+			/ sizeof(index_flat_record))
+		return NULL;
+
+	lzma_index_flat *flat = lzma_alloc(sizeof(lzma_index_flat)
+			+ (size_t)(count) * sizeof(index_flat_record),
+			allocator);
+	if (flat != NULL)
+		flat->count = count;
+
+	return flat;
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_index_flat_decode(lzma_index_flat **flat,
+		const lzma_allocator *allocator,
+		const uint8_t *in, size_t *in_pos, size_t in_size,
+		lzma_vli compressed_offset)
+{
+	if (flat != NULL)
+		*flat = NULL;
+
+	// Sanity checks
+	if (flat == NULL || in == NULL || in_pos == NULL
+			|| *in_pos > in_size
+			|| compressed_offset > LZMA_VLI_MAX)
+		return LZMA_PROG_ERROR;
+
+	size_t pos = *in_pos;
+
+	// Index Indicator
+	if (pos == in_size || in[pos++] != INDEX_INDICATOR)
+		return LZMA_DATA_ERROR;
+
+	// Number of Records. lzma_vli_decode() returns LZMA_BUF_ERROR
+	// in single-call mode if the input is truncated, but the Index is
+	// simply corrupt then.
+	lzma_vli count;
+	if (lzma_vli_decode(&count, NULL, in, &pos, in_size) != LZMA_OK)
+		return LZMA_DATA_ERROR;
+
+	// Each Record needs at least two bytes. This check also keeps
+	// a corrupt Number of Records from making us allocate lots of
+	// memory.
+	if (count > (in_size - pos) / 2)
+		return LZMA_DATA_ERROR;
+
+	lzma_index_flat *f = index_flat_alloc(count, allocator);
+	if (f == NULL)
+		return LZMA_MEM_ERROR;
+
+	// List of Records
+	const size_t list_start = pos;
+	lzma_vli uncompressed_sum = 0;
+
+	for (lzma_vli i = 0; i < count; ++i) {
+		lzma_vli unpadded_size;
+		lzma_vli uncompressed_size;
+
+		if (lzma_vli_decode(&unpadded_size, NULL,
+					in, &pos, in_size) != LZMA_OK
+				|| lzma_vli_decode(&uncompressed_size, NULL,
+					in, &pos, in_size) != LZMA_OK
+				|| unpadded_size < UNPADDED_SIZE_MIN
+				|| unpadded_size > UNPADDED_SIZE_MAX
+				|| uncompressed_size
+					> LZMA_VLI_MAX - uncompressed_sum
+				|| vli_ceil4(unpadded_size)
+					> LZMA_VLI_MAX - compressed_offset)
+			goto error;
+
+		uncompressed_sum += uncompressed_size;
+
+		f->records[i].uncompressed_sum = uncompressed_sum;
+		f->records[i].compressed_offset = compressed_offset;
+		f->records[i].unpadded_size = unpadded_size;
+
+		compressed_offset += vli_ceil4(unpadded_size);
+	}
+
+	// Index Padding
+	const lzma_vli padding = index_size(count, pos - list_start)
+			- index_size_unpadded(count, pos - list_start);
+	if (padding > in_size - pos)
+		goto error;
+
+	for (lzma_vli i = 0; i < padding; ++i)
+		if (in[pos++] != 0x00)
+			goto error;
+
+	// CRC32
+	if (in_size - pos < 4)
+		goto error;
+
+	const uint32_t crc32 = lzma_crc32(in + *in_pos, pos - *in_pos, 0);
+	if (read32le(in + pos) != crc32) {
+#ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
+		goto error;
+#endif
+	}
+
+	*in_pos = pos + 4;
+	*flat = f;
+	return LZMA_OK;
+
+error:
+	lzma_free(f, allocator);
+	return LZMA_DATA_ERROR;
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_index_flat_from_index(lzma_index_flat **flat,
+		const lzma_index *i, const lzma_allocator *allocator)
+{
+	if (flat != NULL)
+		*flat = NULL;
+
+	if (flat == NULL || i == NULL)
+		return LZMA_PROG_ERROR;
+
+	lzma_index_flat *f = index_flat_alloc(
+			lzma_index_block_count(i), allocator);
+	if (f == NULL)
+		return LZMA_MEM_ERROR;
+
+	lzma_index_iter iter;
+	lzma_index_iter_init(&iter, i);
+
+	for (lzma_vli n = 0; n < f->count; ++n) {
+		const bool end = lzma_index_iter_next(
+				&iter, LZMA_INDEX_ITER_BLOCK);
+		assert(!end);
+		(void)end;
+
+		f->records[n].uncompressed_sum
+				= iter.block.uncompressed_file_offset
+				+ iter.block.uncompressed_size;
+		f->records[n].compressed_offset
+				= iter.block.compressed_file_offset;
+		f->records[n].unpadded_size = iter.block.unpadded_size;
+	}
+
+	*flat = f;
+	return LZMA_OK;
+}
+
+
+extern LZMA_API(void)
+lzma_index_flat_end(lzma_index_flat *flat, const lzma_allocator *allocator)
+{
+	lzma_free(flat, allocator);
+	return;
+}
+
+
+extern LZMA_API(lzma_vli)
+lzma_index_flat_block_count(const lzma_index_flat *flat)
+{
+	return flat->count;
+}
+
+
+extern LZMA_API(lzma_vli)
+lzma_index_flat_uncompressed_size(const lzma_index_flat *flat)
+{
+	return flat->count == 0 ? 0
+			: flat->records[flat->count - 1].uncompressed_sum;
+}
+
+
+/// Fill *block from records[n], which is Block number n + 1.
+static void
+index_flat_set_block(const lzma_index_flat *flat, size_t n,
+		lzma_index_flat_block *block)
+{
+	const index_flat_record *r = &flat->records[n];
+
+	block->number_in_file = n + 1;
+	block->compressed_file_offset = r->compressed_offset;
+	block->uncompressed_file_offset
+			= n == 0 ? 0 : flat->records[n - 1].uncompressed_sum;
+	block->unpadded_size = r->unpadded_size;
+	block->total_size = vli_ceil4(r->unpadded_size);
+	block->uncompressed_size
+			= r->uncompressed_sum - block->uncompressed_file_offset;
+	return;
+}
+
+
+extern LZMA_API(lzma_bool)
+lzma_index_flat_get(const lzma_index_flat *flat, lzma_vli number,
+		lzma_index_flat_block *block)
+{
+	if (number == 0 || number > flat->count)
+		return true;
+
+	index_flat_set_block(flat, (size_t)(number - 1), block);
+	return false;
+}
+
+
+extern LZMA_API(lzma_bool)
+lzma_index_flat_locate(const lzma_index_flat *flat, lzma_vli target,
+		lzma_index_flat_block *block)
+{
+	if (target >= lzma_index_flat_uncompressed_size(flat))
+		return true;
+
+	// Find the first Block whose end is after the target. This skips
+	// empty Blocks since their end equals the end of the previous one.
+	size_t left = 0;
+	size_t right = (size_t)(flat->count) - 1;
+
+	while (left < right) {
+		const size_t pos = left + (right - left) / 2;
+
+		if (flat->records[pos].uncompressed_sum <= target)
+			left = pos + 1;
+		else
+			right = pos;
+	}
+
+	index_flat_set_block(flat, left, block);
+	return false;
+}
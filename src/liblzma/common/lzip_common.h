@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       lzip_common.h
+/// \brief      Definitions common to .lz (lzip) encoder and decoder
+//
+//  Author:     Michał Górny
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_LZIP_COMMON_H
+#define LZMA_LZIP_COMMON_H
+
+#include "common.h"
+
+
+/// Size of the .lz member header: ID string, version, and dictionary size
+#define LZIP_HEADER_SIZE 6
+
+// .lz format version 0 lacks the 64-bit Member size field in the footer.
+#define LZIP_V0_FOOTER_SIZE 12
+#define LZIP_V1_FOOTER_SIZE 20
+#define LZIP_FOOTER_SIZE_MAX LZIP_V1_FOOTER_SIZE
+
+// lc/lp/pb are hardcoded in the .lz format.
+#define LZIP_LC 3
+#define LZIP_LP 0
+#define LZIP_PB 2
+
+/// The format versions 0 and 1 allow dictionary size in the
+/// range [4 KiB, 512 MiB].
+#define LZIP_DICT_SIZE_MIN (UINT32_C(1) << 12)
+#define LZIP_DICT_SIZE_MAX (UINT32_C(1) << 29)
+
+
+/// \brief      Decode the dictionary size field of the .lz header
+///
+/// \return     Dictionary size or zero if the field is invalid
+static inline uint32_t
+lzip_dict_size_decode(uint8_t ds)
+{
+	// The five lowest bits are for the base-2 logarithm of
+	// the dictionary size and the highest three bits are
+	// the fractional part (0/16 to 7/16) that will be
+	// subtracted to get the final value.
+	//
+	// For example, with 0xB5:
+	//     b2log = 21
+	//     fracnum = 5
+	//     dict_size = 2^21 - 2^21 * 5 / 16 = 1408 KiB
+	const uint32_t b2log = ds & 0x1F;
+	const uint32_t fracnum = ds >> 5;
+
+	if (b2log < 12 || b2log > 29 || (b2log == 12 && fracnum > 0))
+		return 0;
+
+	//   2^[b2log] - 2^[b2log] * [fracnum] / 16
+	// = 2^[b2log] - [fracnum] * 2^([b2log] - 4)
+	return (UINT32_C(1) << b2log) - (fracnum << (b2log - 4));
+}
+
+
+/// \brief      Encode the dictionary size field of the .lz header
+///
+/// The dictionary size is rounded up to the next value that can be
+/// represented in the header. dict_size must be at most
+/// LZIP_DICT_SIZE_MAX; sizes under LZIP_DICT_SIZE_MIN are rounded up
+/// to the minimum.
+static inline uint8_t
+lzip_dict_size_encode(uint32_t dict_size)
+{
+	assert(dict_size <= LZIP_DICT_SIZE_MAX);
+
+	if (dict_size <= LZIP_DICT_SIZE_MIN)
+		return 12;
+
+	// Find the smallest power of two that isn't smaller than
+	// dict_size and then subtract as many sixteenths of it as
+	// possible without going under dict_size.
+	uint32_t b2log = 13;
+	while ((UINT32_C(1) << b2log) < dict_size)
+		++b2log;
+
+	const uint32_t base = UINT32_C(1) << b2log;
+	const uint32_t fracnum = my_min(7, (base - dict_size)
+			>> (b2log - 4));
+
+	return (uint8_t)((fracnum << 5) | b2log);
+}
+
+#endif
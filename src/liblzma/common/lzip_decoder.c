@@ -15,17 +15,6 @@
 #include "check.h"
 
 
-// .lz format version 0 lacks the 64-bit Member size field in the footer.
-#define LZIP_V0_FOOTER_SIZE 12
-#define LZIP_V1_FOOTER_SIZE 20
-#define LZIP_FOOTER_SIZE_MAX LZIP_V1_FOOTER_SIZE
-
-// lc/lp/pb are hardcoded in the .lz format.
-#define LZIP_LC 3
-#define LZIP_LP 0
-#define LZIP_PB 2
-
-
 typedef struct {
 	enum {
 		SEQ_ID_STRING,
@@ -179,31 +168,13 @@ lzip_decode(void *coder_ptr, const lzma_allocator *allocator,
 		if (*in_pos >= in_size)
 			return LZMA_OK;
 
-		const uint32_t ds = in[(*in_pos)++];
+		coder->options.dict_size
+				= lzip_dict_size_decode(in[(*in_pos)++]);
 		++coder->member_size;
 
-		// The five lowest bits are for the base-2 logarithm of
-		// the dictionary size and the highest three bits are
-		// the fractional part (0/16 to 7/16) that will be
-		// subtracted to get the final value.
-		//
-		// For example, with 0xB5:
-		//     b2log = 21
-		//     fracnum = 5
-		//     dict_size = 2^21 - 2^21 * 5 / 16 = 1408 KiB
-		const uint32_t b2log = ds & 0x1F;
-		const uint32_t fracnum = ds >> 5;
-
-		// The format versions 0 and 1 allow dictionary size in the
-		// range [4 KiB, 512 MiB].
-		if (b2log < 12 || b2log > 29 || (b2log == 12 && fracnum > 0))
+		if (coder->options.dict_size == 0)
 			return LZMA_DATA_ERROR;
 
-		//   2^[b2log] - 2^[b2log] * [fracnum] / 16
-		// = 2^[b2log] - [fracnum] * 2^([b2log] - 4)
-		coder->options.dict_size = (UINT32_C(1) << b2log)
-				- (fracnum << (b2log - 4));
-
 		assert(coder->options.dict_size >= 4096);
 		assert(coder->options.dict_size <= (UINT32_C(512) << 20));
 
@@ -12,7 +12,8 @@
 #ifndef LZMA_LZIP_DECODER_H
 #define LZMA_LZIP_DECODER_H
 
-#include "common.h"
+#include "lzip_common.h"
+
 
 extern lzma_ret lzma_lzip_decoder_init(
 		lzma_next_coder *next, const lzma_allocator *allocator,
@@ -0,0 +1,1594 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       lzip_decoder_mt.c
+/// \brief      Multithreaded .lz (lzip) decoder
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lzip_decoder.h"
+#include "lzma_decoder.h"
+#include "outqueue.h"
+#include "arena.h"
+#include "thread_pool.h"
+
+
+/// The smallest possible .lz member is 36 bytes: the header, the LZMA
+/// data of an empty member with the end of payload marker, and the footer.
+/// Shorter candidates for the end of a member aren't considered.
+#define LZIP_MEMBER_SIZE_MIN 36
+
+/// LZMA cannot compress better than about 7000:1. A member whose Data size
+/// field claims more than this is corrupt; such a member is left to the
+/// direct mode decoder instead of trying to allocate a huge output buffer.
+#define LZMA_RATIO_MAX 8192
+
+/// Initial size of the buffer that collects a member from the input
+#define MEMBER_BUF_MIN 4096
+
+
+/// The "ID string" or magic bytes are "LZIP" in US-ASCII.
+static const uint8_t lzip_id_string[4] = { 0x4C, 0x5A, 0x49, 0x50 };
+
+
+/// Input of a member that has been given to a worker thread
+struct member_input {
+	/// The whole .lz member
+	uint8_t *buf;
+
+	/// Size of the member in buf
+	size_t size;
+
+	/// Allocated size of buf. This is included in coder->mem_in_use
+	/// until the output of the member has been read.
+	size_t alloc;
+};
+
+
+typedef enum {
+	/// Waiting for work.
+	/// Main thread may change this to THR_RUN or THR_EXIT.
+	THR_IDLE,
+
+	/// Decoding is in progress.
+	/// Main thread may change this to THR_STOP or THR_EXIT.
+	/// The worker thread may change this to THR_IDLE.
+	THR_RUN,
+
+	/// The main thread wants the thread to stop whatever it was doing
+	/// but not exit. Main thread may change this to THR_EXIT.
+	/// The worker thread may change this to THR_IDLE.
+	THR_STOP,
+
+	/// The main thread wants the thread to exit.
+	THR_EXIT,
+
+} worker_state;
+
+
+struct worker_thread {
+	/// Worker state is protected with our mutex.
+	worker_state state;
+
+	/// The whole .lz member to decode. The buffer is owned by
+	/// coder->inputs and is freed when the output has been read.
+	const uint8_t *in;
+
+	/// Size of the member in "in"
+	size_t in_size;
+
+	/// Amount of memory that this member was accounted for in
+	/// coder->mem_in_use for the LZMA decoder, including the extra
+	/// size of the chunks reused from the arena. The input buffer
+	/// is accounted separately; see struct member_input.
+	uint64_t mem_member;
+
+	/// Output buffer of this thread. The size of the buffer is the
+	/// Data size field from the footer of the member.
+	lzma_outbuf *outbuf;
+
+	/// Pointer to the main structure is needed to (1) lock the main
+	/// mutex (coder->mutex) when updating outbuf->pos and (2) when
+	/// putting this thread back to the stack of free threads.
+	struct lzma_lzip_coder *coder;
+
+	/// The allocator is set by the main thread. Since a copy of the
+	/// pointer is kept here, the application must not change the
+	/// allocator before calling lzma_end().
+	const lzma_allocator *allocator;
+
+	/// Amount of compressed data that has been decoded from the
+	/// current member. This is updated after every chunk of input
+	/// so that lzma_get_progress() is reasonably accurate.
+	size_t progress_in;
+
+	/// Like progress_in but for uncompressed data.
+	size_t progress_out;
+
+	/// Single-threaded .lz decoder that decodes one member at a time
+	lzma_next_coder lzip_decoder;
+
+	/// Allocations of the .lz decoder are done from this arena so that
+	/// the dictionary can be reused when the dictionary size changes
+	/// between members.
+	lzma_arena arena;
+
+	/// Statistics for lzma_get_worker_stats(). These are updated with
+	/// the main mutex locked when a member is finished.
+	lzma_worker_stats stats;
+
+	/// Next structure in the stack of free worker threads.
+	struct worker_thread *next;
+
+	mythread_mutex mutex;
+	mythread_cond cond;
+
+	/// The ID of this thread is used to join the thread
+	/// when it's not needed anymore. This isn't used when
+	/// the worker runs in a thread pool.
+	mythread thread_id;
+
+	/// Job that runs worker_decoder() in coder->thread_pool
+	lzma_pool_job job;
+
+	/// True if the job has been given to the thread pool and
+	/// worker_decoder() hasn't returned yet. This is protected
+	/// with our mutex.
+	bool job_active;
+};
+
+
+struct lzma_lzip_coder {
+	enum {
+		SEQ_MEMBER_HEADER,
+		SEQ_MEMBER_DATA,
+		SEQ_MEMBER_DISPATCH,
+		SEQ_FINISH,
+		SEQ_DIRECT_INIT,
+		SEQ_DIRECT_RUN,
+	} sequence;
+
+	/// Single-threaded .lz decoder that is used in direct mode
+	lzma_next_coder direct_decoder;
+
+	/// Buffer that collects the current member from the input.
+	/// When the end of the member has been found, the buffer is
+	/// given to a worker thread and a new buffer is allocated for
+	/// the next member. In direct mode this holds the bytes that
+	/// were read before switching to direct mode.
+	uint8_t *member;
+
+	/// Number of bytes in "member"
+	size_t member_size;
+
+	/// Allocated size of "member"
+	size_t member_alloc;
+
+	/// Size to allocate for the next member buffer. Members of a file
+	/// tend to have similar sizes so this is based on the size of
+	/// the previous member to avoid growing the buffer every time.
+	size_t member_alloc_next;
+
+	/// In direct mode, the position in "member" or in the first
+	/// element of "inputs" of the next byte to give to the direct
+	/// mode decoder
+	size_t member_pos;
+
+	/// Position in "member" from which the search for the end of
+	/// the member continues
+	size_t member_scan;
+
+	/// Number of bytes of the ID string of the next member that were
+	/// read from the input before the end of the current member was
+	/// known. They are after member_size in "member".
+	size_t id_carry;
+
+	/// Inputs of the members that have been given to worker threads
+	/// but whose output hasn't been read yet. They are in the same
+	/// order as the buffers in outq. This is a ring buffer of
+	/// inputs_max elements of which inputs_count are in use starting
+	/// from inputs_first.
+	struct member_input *inputs;
+	uint32_t inputs_max;
+	uint32_t inputs_first;
+	uint32_t inputs_count;
+
+	/// Maximum wait time if cannot use all the input and cannot
+	/// fill the output buffer. This is in milliseconds.
+	uint32_t timeout;
+
+	/// Error code from a worker thread.
+	///
+	/// \note       Use mutex.
+	lzma_ret thread_error;
+
+	/// Set in read_output_and_wait() when a worker thread has failed.
+	/// No more members are started after that; the output before the
+	/// error is read and then the error is returned.
+	bool pending_error;
+
+	/// Set in read_output_and_wait() when the output of a member that
+	/// failed with LZMA_DATA_ERROR is reached in the output queue.
+	/// The end of the member might have been found in a wrong place,
+	/// so the members from it on are decoded again in direct mode.
+	bool redo_direct;
+
+	/// Number of threads that will be created at maximum.
+	uint32_t threads_max;
+
+	/// Number of thread structures that have been initialized, and
+	/// thus the number of worker threads actually created so far.
+	uint32_t threads_initialized;
+
+	/// Array of allocated thread-specific structures. When no threads
+	/// are in use (direct mode) this is NULL.
+	struct worker_thread *threads;
+
+	/// Stack of free threads. When a thread finishes, it puts itself
+	/// back into this stack.
+	///
+	/// \note       Use mutex.
+	struct worker_thread *threads_free;
+
+	/// Thread pool from lzma_mt.thread_pool. If this is NULL, each
+	/// worker has a thread of its own. Otherwise a worker runs in
+	/// a thread of the pool only while it has a member to decode.
+	lzma_thread_pool *thread_pool;
+
+	/// Output buffer queue for decompressed data from the worker threads
+	///
+	/// \note       Use mutex with operations that need it.
+	lzma_outq outq;
+
+	mythread_mutex mutex;
+	mythread_cond cond;
+
+	/// Memory usage that will not be exceeded in multi-threaded mode.
+	uint64_t memlimit_threading;
+
+	/// Memory usage limit that should never be exceeded. This is
+	/// given to the direct mode decoder.
+	uint64_t memlimit_stop;
+
+	/// Amount of memory needed by the running worker threads.
+	/// This doesn't include the memory needed by the output buffers.
+	///
+	/// \note       Use mutex.
+	uint64_t mem_in_use;
+
+	/// Memory usage of the LZMA decoder of the next member
+	uint64_t mem_next_filters;
+
+	/// Amount of memory needed for the input buffer and the decoder
+	/// of the next member
+	uint64_t mem_next_member;
+
+	/// Amount of memory needed for the output buffer of the next member
+	uint64_t mem_next_out;
+
+	/// Amount of compressed data in members that have been finished
+	///
+	/// \note       Use mutex.
+	uint64_t progress_in;
+
+	/// Amount of uncompressed data in members that have been finished
+	///
+	/// \note       Use mutex.
+	uint64_t progress_out;
+
+	/// Flags given to the single-threaded .lz decoders
+	uint32_t flags;
+
+	/// If true, LZMA_GET_CHECK is returned after decoding a member header.
+	bool tell_any_check;
+
+	/// If true, we will decode concatenated .lz members. Without this
+	/// only one member is decoded and direct mode is always used.
+	bool concatenated;
+
+	/// If true, we will return any errors immediately instead of first
+	/// producing all output before the location of the error.
+	bool fail_fast;
+
+	/// True as long as the first member hasn't been started. This is
+	/// needed to tell LZMA_FORMAT_ERROR apart from trailing data.
+	bool first_member;
+
+	/// This is used to track if the previous call to lzip_decode_mt()
+	/// had output space and managed to fill the output buffer. See
+	/// the same variable in stream_decoder_mt.c.
+	bool out_was_filled;
+};
+
+
+/// Things do to at THR_STOP or when finishing a member.
+/// This is called with coder->mutex locked.
+static void
+worker_stop(struct worker_thread *thr)
+{
+	thr->coder->mem_in_use -= thr->mem_member;
+	thr->mem_member = 0;
+	thr->in_size = 0; // thr->in was freed already.
+
+	// Put this thread to the stack of free threads.
+	thr->next = thr->coder->threads_free;
+	thr->coder->threads_free = thr;
+
+	mythread_cond_signal(&thr->coder->cond);
+	return;
+}
+
+
+static MYTHREAD_RET_TYPE
+worker_decoder(void *thr_ptr)
+{
+	struct worker_thread *thr = thr_ptr;
+
+next_loop_lock:
+	mythread_mutex_lock(&thr->mutex);
+next_loop_unlocked:
+
+	if (thr->state == THR_IDLE) {
+		// In a thread pool the thread is given back to the pool
+		// instead of waiting for more work. thr must not be touched
+		// after job_active has been cleared.
+		if (thr->coder->thread_pool != NULL) {
+			thr->job_active = false;
+			mythread_mutex_unlock(&thr->mutex);
+			return MYTHREAD_RET_VALUE;
+		}
+
+		mythread_cond_wait(&thr->cond, &thr->mutex);
+		goto next_loop_unlocked;
+	}
+
+	if (thr->state == THR_EXIT) {
+		// threads_end() frees the resources once it knows
+		// that we are done.
+		if (thr->coder->thread_pool != NULL) {
+			thr->job_active = false;
+			mythread_cond_signal(&thr->cond);
+		}
+
+		mythread_mutex_unlock(&thr->mutex);
+		return MYTHREAD_RET_VALUE;
+	}
+
+	if (thr->state == THR_STOP) {
+		thr->state = THR_IDLE;
+		mythread_mutex_unlock(&thr->mutex);
+
+		thr->in = NULL;
+
+		mythread_sync(thr->coder->mutex) {
+			worker_stop(thr);
+		}
+
+		goto next_loop_lock;
+	}
+
+	assert(thr->state == THR_RUN);
+	mythread_mutex_unlock(&thr->mutex);
+
+	// The member header has been validated by the main thread but
+	// the single-threaded decoder checks it again. That's cheap.
+	lzma_ret ret = lzma_lzip_decoder_init(&thr->lzip_decoder,
+			&thr->arena.allocator, UINT64_MAX,
+			thr->coder->flags & LZMA_IGNORE_CHECK);
+
+	size_t in_pos = 0;
+	size_t out_pos = 0;
+
+	while (ret == LZMA_OK) {
+		// Pass the input in small chunks to the decoder so that
+		// we react reasonably fast if we are told to stop or exit.
+		const size_t chunk_size = 16384;
+		const size_t in_start = in_pos;
+		const size_t out_start = out_pos;
+		const bool is_last = thr->in_size - in_pos <= chunk_size;
+		const size_t in_limit = is_last
+				? thr->in_size : in_pos + chunk_size;
+
+		ret = thr->lzip_decoder.code(thr->lzip_decoder.coder,
+				&thr->arena.allocator,
+				thr->in, &in_pos, in_limit,
+				thr->outbuf->buf, &out_pos,
+				thr->outbuf->allocated,
+				is_last ? LZMA_FINISH : LZMA_RUN);
+
+		// The memory that the previous member's decoder didn't
+		// reuse isn't needed anymore. The chunks that were reused
+		// may be bigger than what the decoder asked for, so count
+		// the extra memory too.
+		if (in_start == 0) {
+			lzma_arena_trim(&thr->arena);
+
+			mythread_sync(thr->coder->mutex) {
+				thr->mem_member += thr->arena.oversize;
+				thr->coder->mem_in_use += thr->arena.oversize;
+			}
+		}
+
+		// The whole member is available and the output buffer is
+		// as big as the footer says. If no progress is possible,
+		// the member is corrupt.
+		if (ret == LZMA_OK && in_pos == in_start
+				&& out_pos == out_start)
+			ret = LZMA_DATA_ERROR;
+
+		bool stop;
+		mythread_sync(thr->mutex) {
+			thr->progress_in = in_pos;
+			thr->progress_out = out_pos;
+			stop = thr->state != THR_RUN;
+		}
+
+		if (stop)
+			goto next_loop_lock;
+	}
+
+	// The end of the member was found by looking at the Member size
+	// field in the footer. The decoder checked that the field matches
+	// so this can only fail if the Data size field was wrong.
+	if (ret == LZMA_STREAM_END && (in_pos != thr->in_size
+			|| out_pos != thr->outbuf->allocated))
+		ret = LZMA_DATA_ERROR;
+
+	// With LZMA_DATA_ERROR the member is decoded again in direct mode
+	// so its output is thrown away.
+	if (ret == LZMA_DATA_ERROR)
+		out_pos = 0;
+
+	thr->in = NULL;
+
+	mythread_sync(thr->mutex) {
+		if (thr->state != THR_EXIT)
+			thr->state = THR_IDLE;
+	}
+
+	mythread_sync(thr->coder->mutex) {
+		// Move our progress info to the main thread.
+		thr->coder->progress_in += in_pos;
+		thr->coder->progress_out += out_pos;
+		thr->progress_in = 0;
+		thr->progress_out = 0;
+
+		++thr->stats.blocks;
+		thr->stats.progress_in += in_pos;
+		thr->stats.progress_out += out_pos;
+		thr->stats.allocs_avoided = thr->arena.allocs_avoided;
+
+		// Mark the outbuf as finished. The sizes are needed to
+		// take the member out of the progress info if it is
+		// decoded again in direct mode.
+		thr->outbuf->pos = out_pos;
+		thr->outbuf->finished = true;
+		thr->outbuf->finish_ret = ret;
+		thr->outbuf->unpadded_size = in_pos;
+		thr->outbuf->uncompressed_size = out_pos;
+		thr->outbuf = NULL;
+
+		// If an error occurred, tell it to the main thread.
+		if (ret != LZMA_STREAM_END
+				&& thr->coder->thread_error == LZMA_OK)
+			thr->coder->thread_error = ret;
+
+		worker_stop(thr);
+	}
+
+	goto next_loop_lock;
+}
+
+
+/// Runs worker_decoder() in a thread of the pool.
+static void
+worker_job(void *thr_ptr)
+{
+	(void)worker_decoder(thr_ptr);
+	return;
+}
+
+
+/// Tells the worker threads to exit and waits for them to terminate.
+static void
+threads_end(struct lzma_lzip_coder *coder, const lzma_allocator *allocator)
+{
+	for (uint32_t i = 0; i < coder->threads_initialized; ++i) {
+		mythread_sync(coder->threads[i].mutex) {
+			coder->threads[i].state = THR_EXIT;
+			mythread_cond_signal(&coder->threads[i].cond);
+		}
+	}
+
+	for (uint32_t i = 0; i < coder->threads_initialized; ++i) {
+		struct worker_thread *thr = &coder->threads[i];
+
+		if (coder->thread_pool != NULL) {
+			mythread_sync(thr->mutex) {
+				while (thr->job_active)
+					mythread_cond_wait(&thr->cond,
+							&thr->mutex);
+			}
+		} else {
+			mythread_join(thr->thread_id);
+		}
+
+		lzma_next_end(&thr->lzip_decoder, &thr->arena.allocator);
+		lzma_arena_end(&thr->arena);
+
+		mythread_mutex_destroy(&thr->mutex);
+		mythread_cond_destroy(&thr->cond);
+	}
+
+	lzma_free(coder->threads, allocator);
+	coder->threads_initialized = 0;
+	coder->threads = NULL;
+	coder->threads_free = NULL;
+
+	// The threads don't update this when they exit. Do it here.
+	coder->mem_in_use = 0;
+
+	return;
+}
+
+
+static void
+threads_stop(struct lzma_lzip_coder *coder)
+{
+	for (uint32_t i = 0; i < coder->threads_initialized; ++i) {
+		mythread_sync(coder->threads[i].mutex) {
+			// The state must be changed conditionally because
+			// THR_IDLE -> THR_STOP is not a valid state change.
+			if (coder->threads[i].state != THR_IDLE) {
+				coder->threads[i].state = THR_STOP;
+				mythread_cond_signal(&coder->threads[i].cond);
+			}
+		}
+	}
+
+	return;
+}
+
+
+/// Frees the input of the oldest member in coder->inputs. If called
+/// while worker threads are running, coder->mutex must be locked.
+static void
+inputs_pop(struct lzma_lzip_coder *coder, const lzma_allocator *allocator)
+{
+	assert(coder->inputs_count > 0);
+
+	struct member_input *input = &coder->inputs[coder->inputs_first];
+	coder->mem_in_use -= input->alloc;
+	lzma_free(input->buf, allocator);
+	input->buf = NULL;
+
+	coder->inputs_first = (coder->inputs_first + 1) % coder->inputs_max;
+	--coder->inputs_count;
+	return;
+}
+
+
+/// Frees all inputs in coder->inputs. This is called after threads_end()
+/// which has already reset coder->mem_in_use.
+static void
+inputs_clear(struct lzma_lzip_coder *coder, const lzma_allocator *allocator)
+{
+	for (uint32_t i = 0; i < coder->inputs_count; ++i)
+		lzma_free(coder->inputs[(coder->inputs_first + i)
+				% coder->inputs_max].buf, allocator);
+
+	coder->inputs_first = 0;
+	coder->inputs_count = 0;
+	return;
+}
+
+
+/// Initialize a new worker_thread structure and create a new thread.
+static struct worker_thread *
+initialize_new_thread(struct lzma_lzip_coder *coder,
+		const lzma_allocator *allocator)
+{
+	if (coder->threads == NULL) {
+		coder->threads = lzma_alloc(
+			coder->threads_max * sizeof(struct worker_thread),
+			allocator);
+
+		if (coder->threads == NULL)
+			return NULL;
+	}
+
+	assert(coder->threads_initialized < coder->threads_max);
+	struct worker_thread *thr
+			= &coder->threads[coder->threads_initialized];
+
+	if (mythread_mutex_init(&thr->mutex))
+		goto error_mutex;
+
+	if (mythread_cond_init(&thr->cond))
+		goto error_cond;
+
+	thr->state = THR_IDLE;
+	thr->in = NULL;
+	thr->in_size = 0;
+	thr->mem_member = 0;
+	thr->allocator = allocator;
+	thr->coder = coder;
+	thr->outbuf = NULL;
+	thr->progress_in = 0;
+	thr->progress_out = 0;
+	thr->lzip_decoder = LZMA_NEXT_CODER_INIT;
+	lzma_arena_init(&thr->arena, allocator);
+	memzero(&thr->stats, sizeof(thr->stats));
+	thr->job.func = &worker_job;
+	thr->job.arg = thr;
+	thr->job_active = false;
+
+	// With a thread pool the job is queued when the thread
+	// is given a member to decode.
+	if (coder->thread_pool == NULL && mythread_create(
+			&thr->thread_id, worker_decoder, thr))
+		goto error_thread;
+
+	++coder->threads_initialized;
+	return thr;
+
+error_thread:
+	mythread_cond_destroy(&thr->cond);
+
+error_cond:
+	mythread_mutex_destroy(&thr->mutex);
+
+error_mutex:
+	return NULL;
+}
+
+
+/// Give the member in coder->member to a worker thread.
+static lzma_ret
+member_start(struct lzma_lzip_coder *coder, const lzma_allocator *allocator,
+		size_t data_size)
+{
+	return_if_error(lzma_outq_prealloc_buf(
+			&coder->outq, allocator, data_size));
+
+	// If there is a free thread on the stack, use it.
+	struct worker_thread *thr = NULL;
+	mythread_sync(coder->mutex) {
+		if (coder->threads_free != NULL) {
+			thr = coder->threads_free;
+			coder->threads_free = thr->next;
+		}
+	}
+
+	if (thr == NULL) {
+		thr = initialize_new_thread(coder, allocator);
+		if (thr == NULL)
+			return LZMA_MEM_ERROR;
+	}
+
+	// The input is kept until the output of the member has been
+	// read so that the member can be decoded again in direct mode.
+	assert(coder->inputs_count < coder->inputs_max);
+	struct member_input *input = &coder->inputs[
+			(coder->inputs_first + coder->inputs_count)
+			% coder->inputs_max];
+	input->buf = coder->member;
+	input->size = coder->member_size;
+	input->alloc = coder->member_alloc;
+	++coder->inputs_count;
+
+	thr->in = coder->member;
+	thr->in_size = coder->member_size;
+	thr->mem_member = coder->mem_next_filters;
+	thr->progress_in = 0;
+	thr->progress_out = 0;
+
+	// The next member is likely to be about as big as this one.
+	coder->member_alloc_next = coder->member_alloc;
+	coder->member = NULL;
+	coder->member_size = 0;
+	coder->member_alloc = 0;
+
+	// Only the main thread modifies the list of buffers in outq.
+	thr->outbuf = lzma_outq_get_buf(&coder->outq, thr);
+
+	mythread_sync(coder->mutex) {
+		coder->mem_in_use += coder->mem_next_member;
+	}
+
+	mythread_sync(thr->mutex) {
+		assert(thr->state == THR_IDLE);
+		thr->state = THR_RUN;
+		mythread_cond_signal(&thr->cond);
+
+		if (coder->thread_pool != NULL && !thr->job_active) {
+			thr->job_active = true;
+			lzma_thread_pool_run(coder->thread_pool, &thr->job);
+		}
+	}
+
+	return LZMA_OK;
+}
+
+
+/// Copy output from the finished members to the application and, if
+/// waiting is allowed, wait until more output is available or, if
+/// can_start isn't NULL, the next member can be started.
+static lzma_ret
+read_output_and_wait(struct lzma_lzip_coder *coder,
+		const lzma_allocator *allocator,
+		uint8_t *restrict out, size_t *restrict out_pos,
+		size_t out_size, bool *can_start, bool waiting_allowed,
+		mythread_condtime *wait_abs, bool *has_blocked)
+{
+	// The output after a failed member must not be read.
+	if (coder->redo_direct)
+		return LZMA_OK;
+
+	lzma_ret ret = LZMA_OK;
+
+	mythread_sync(coder->mutex) {
+		do {
+			// Get as much output from the queue as is possible
+			// without blocking. Loop around even if the output
+			// buffer is full because members with no
+			// uncompressed data need no output space.
+			const size_t out_start = *out_pos;
+			lzma_vli member_in = 0;
+			lzma_vli member_out = 0;
+			while (true) {
+				ret = lzma_outq_read(&coder->outq, allocator,
+						out, out_pos, out_size,
+						&member_in, &member_out);
+				if (ret != LZMA_STREAM_END)
+					break;
+
+				inputs_pop(coder, allocator);
+			}
+
+			// The end of the member might have been found in
+			// a wrong place. Decode it and the rest of the input
+			// again in direct mode. If the member really is
+			// corrupt, the direct mode decoder reports it.
+			if (ret == LZMA_DATA_ERROR) {
+				coder->progress_in -= member_in;
+				coder->progress_out -= member_out;
+				coder->redo_direct = true;
+				coder->pending_error = true;
+				ret = LZMA_OK;
+				break;
+			}
+
+			// Check if lzma_outq_read reported an error from
+			// a worker thread.
+			if (ret != LZMA_OK)
+				break;
+
+			if (*out_pos == out_size && *out_pos != out_start)
+				coder->out_was_filled = true;
+
+			// Check if any thread has indicated an error. Without
+			// LZMA_FAIL_FAST the error is returned by
+			// lzma_outq_read() once the output before it has
+			// been read. LZMA_DATA_ERROR is always handled that
+			// way because the member is decoded again.
+			if (coder->thread_error != LZMA_OK) {
+				if (coder->fail_fast && coder->thread_error
+						!= LZMA_DATA_ERROR) {
+					ret = coder->thread_error;
+					break;
+				}
+
+				coder->pending_error = true;
+			}
+
+			// Check if the next member can be started. The
+			// memory usage must stay within memlimit_threading,
+			// there must be a free slot in the output queue, and
+			// there must be a free thread (that can be either
+			// created or an existing one reused).
+			//
+			// NOTE: If the output queue is empty, then starting
+			// will always be possible.
+			if (can_start != NULL
+					&& coder->memlimit_threading
+						- coder->mem_in_use
+						- coder->outq.mem_in_use
+						>= coder->mem_next_member
+							+ coder->mem_next_out
+					&& lzma_outq_has_buf(&coder->outq)
+					&& (coder->threads_initialized
+							< coder->threads_max
+						|| coder->threads_free
+							!= NULL)) {
+				*can_start = true;
+				break;
+			}
+
+			// If the caller doesn't want us to block, return now.
+			if (!waiting_allowed)
+				break;
+
+			// Nothing more will be coming from the queue.
+			if (lzma_outq_is_empty(&coder->outq)) {
+				assert(can_start == NULL);
+				break;
+			}
+
+			// If there is more data available from the queue,
+			// our out buffer must be full and we need to return
+			// so that the application can provide more output
+			// space.
+			if (lzma_outq_is_readable(&coder->outq)) {
+				assert(*out_pos == out_size);
+				break;
+			}
+
+			// Each worker thread has its whole member so all of
+			// them will finish without more input from us.
+			if (coder->timeout != 0) {
+				if (!*has_blocked) {
+					*has_blocked = true;
+					mythread_condtime_set(wait_abs,
+							&coder->cond,
+							coder->timeout);
+				}
+
+				if (mythread_cond_timedwait(&coder->cond,
+						&coder->mutex,
+						wait_abs) != 0) {
+					ret = LZMA_TIMED_OUT;
+					break;
+				}
+			} else {
+				mythread_cond_wait(&coder->cond,
+						&coder->mutex);
+			}
+		} while (ret == LZMA_OK);
+	}
+
+	// If we are returning an error, then the application cannot get
+	// more output from us and thus keeping the threads running is
+	// useless and waste of CPU time.
+	if (ret != LZMA_OK && ret != LZMA_TIMED_OUT)
+		threads_stop(coder);
+
+	return ret;
+}
+
+
+/// Prepares for decoding the members in coder->inputs again in direct
+/// mode. The worker threads must have been stopped.
+static lzma_ret
+redo_prepare(struct lzma_lzip_coder *coder, const lzma_allocator *allocator)
+{
+	mythread_sync(coder->mutex) {
+		// Take the members that were finished after the failed one
+		// out of the progress info. Their output is thrown away.
+		for (const lzma_outbuf *buf = coder->outq.head; buf != NULL;
+				buf = buf->next) {
+			if (buf->finished) {
+				coder->progress_in -= buf->unpadded_size;
+				coder->progress_out -= buf->uncompressed_size;
+			}
+		}
+
+		// threads_end() reset this. The inputs are still needed.
+		for (uint32_t i = 0; i < coder->inputs_count; ++i)
+			coder->mem_in_use += coder->inputs[(coder->inputs_first
+					+ i) % coder->inputs_max].alloc;
+	}
+
+	coder->redo_direct = false;
+	coder->pending_error = false;
+	coder->thread_error = LZMA_OK;
+
+	// Move the output buffers from the queue to the cache.
+	return lzma_outq_init(&coder->outq, allocator, coder->threads_max);
+}
+
+
+/// Gives buf[*pos] to buf[size - 1] to the direct mode decoder.
+static lzma_ret
+direct_decode_buf(struct lzma_lzip_coder *coder,
+		const lzma_allocator *allocator,
+		const uint8_t *buf, size_t *pos, size_t size,
+		uint8_t *restrict out, size_t *restrict out_pos,
+		size_t out_size)
+{
+	const size_t in_start = *pos;
+	const size_t out_start = *out_pos;
+
+	const lzma_ret ret = coder->direct_decoder.code(
+			coder->direct_decoder.coder, allocator,
+			buf, pos, size, out, out_pos, out_size, LZMA_RUN);
+
+	mythread_sync(coder->mutex) {
+		coder->progress_in += *pos - in_start;
+		coder->progress_out += *out_pos - out_start;
+	}
+
+	return ret;
+}
+
+
+static lzma_ret
+lzip_decode_mt(void *coder_ptr, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size, lzma_action action)
+{
+	struct lzma_lzip_coder *coder = coder_ptr;
+
+	mythread_condtime wait_abs;
+	bool has_blocked = false;
+
+	// Wait for output only if no new input was given or if the input
+	// is finished. See the comment in stream_decoder_mt.c.
+	const bool waiting_allowed = action == LZMA_FINISH
+			|| (*in_pos == in_size && !coder->out_was_filled);
+	coder->out_was_filled = false;
+
+	while (true)
+	switch (coder->sequence) {
+	case SEQ_MEMBER_HEADER: {
+		// Read output before collecting the next member so that
+		// the output queue keeps moving while we wait for input.
+		return_if_error(read_output_and_wait(coder, allocator,
+				out, out_pos, out_size, NULL,
+				*in_pos == in_size && waiting_allowed,
+				&wait_abs, &has_blocked));
+
+		// Don't start new members after a worker has failed.
+		if (coder->pending_error) {
+			coder->sequence = SEQ_FINISH;
+			break;
+		}
+
+		if (coder->member == NULL) {
+			coder->member = lzma_alloc(coder->member_alloc_next,
+					allocator);
+			if (coder->member == NULL)
+				return LZMA_MEM_ERROR;
+
+			coder->member_alloc = coder->member_alloc_next;
+
+			// The start of the ID string may have been read
+			// already when looking for the end of the previous
+			// member.
+			memcpy(coder->member, lzip_id_string,
+					coder->id_carry);
+			coder->member_size = coder->id_carry;
+			coder->id_carry = 0;
+		}
+
+		while (coder->member_size < LZIP_HEADER_SIZE) {
+			if (*in_pos >= in_size) {
+				if (action != LZMA_FINISH)
+					return LZMA_OK;
+
+				// Like the single-threaded decoder, ignore
+				// up to three bytes of the ID string at
+				// the end of the input after a member.
+				// A truncated header is left to the direct
+				// mode decoder to report.
+				coder->sequence = coder->first_member
+					|| coder->member_size
+						>= sizeof(lzip_id_string)
+					? SEQ_DIRECT_INIT : SEQ_FINISH;
+				break;
+			}
+
+			if (coder->member_size < sizeof(lzip_id_string)
+					&& in[*in_pos] != lzip_id_string[
+						coder->member_size]) {
+				// Non-.lz data after a member isn't consumed
+				// and ends the decoding. See lzip_decoder.c.
+				if (coder->first_member)
+					return LZMA_FORMAT_ERROR;
+
+				coder->sequence = SEQ_FINISH;
+				break;
+			}
+
+			coder->member[coder->member_size++] = in[(*in_pos)++];
+		}
+
+		if (coder->sequence != SEQ_MEMBER_HEADER)
+			break;
+
+		// Version 0 members have no Member size field so their
+		// end cannot be found without decoding them. Those and
+		// invalid headers are handled by the direct mode decoder.
+		const lzma_options_lzma options = {
+			.dict_size = lzip_dict_size_decode(coder->member[5]),
+			.lc = LZIP_LC,
+			.lp = LZIP_LP,
+			.pb = LZIP_PB,
+		};
+
+		if (coder->member[4] != 1 || options.dict_size == 0) {
+			coder->sequence = SEQ_DIRECT_INIT;
+			break;
+		}
+
+		coder->mem_next_filters = lzma_lzma_decoder_memusage(&options)
+				+ LZMA_MEMUSAGE_BASE;
+		coder->member_scan = LZIP_MEMBER_SIZE_MIN;
+		coder->sequence = SEQ_MEMBER_DATA;
+	}
+
+	// Fall through
+
+	case SEQ_MEMBER_DATA: {
+		// Grow the buffer if it is full. If the member doesn't
+		// fit within memlimit_threading, it is decoded in
+		// direct mode.
+		if (coder->member_size == coder->member_alloc) {
+			if (coder->member_alloc > SIZE_MAX / 2
+					|| coder->memlimit_threading
+						< coder->mem_next_filters
+					|| coder->memlimit_threading
+						- coder->mem_next_filters
+						< (uint64_t)coder->member_alloc
+							* 2) {
+				coder->sequence = SEQ_DIRECT_INIT;
+				break;
+			}
+
+			const size_t new_alloc = coder->member_alloc * 2;
+			uint8_t *buf = lzma_alloc(new_alloc, allocator);
+			if (buf == NULL)
+				return LZMA_MEM_ERROR;
+
+			memcpy(buf, coder->member, coder->member_size);
+			lzma_free(coder->member, allocator);
+			coder->member = buf;
+			coder->member_alloc = new_alloc;
+		}
+
+		const size_t copy_start = coder->member_size;
+		lzma_bufcpy(in, in_pos, in_size, coder->member,
+				&coder->member_size, coder->member_alloc);
+
+		const bool input_ended = action == LZMA_FINISH
+				&& *in_pos == in_size;
+
+		// A member ends where the Member size field of the footer
+		// equals the number of bytes from the beginning of the
+		// member and the next member or the end of the input
+		// follows. This finds the end without decoding the LZMA
+		// data, like plzip does. A false match inside the LZMA
+		// data is still possible in theory; if the worker thread
+		// fails, the member is decoded again in direct mode.
+		bool found = false;
+		bool trailing = false;
+		size_t end = coder->member_scan;
+		for (; end <= coder->member_size; ++end) {
+			if (read64le(coder->member + end - 8) != end)
+				continue;
+
+			// If something else follows, this is either the
+			// last member followed by trailing data or a false
+			// match. The direct mode decoder handles both.
+			const size_t avail = my_min(coder->member_size - end,
+					sizeof(lzip_id_string));
+			if (memcmp(coder->member + end, lzip_id_string,
+					avail) != 0) {
+				trailing = true;
+				break;
+			}
+
+			// Wait for the whole ID string unless the input
+			// has ended.
+			found = avail == sizeof(lzip_id_string)
+					|| input_ended;
+			break;
+		}
+
+		coder->member_scan = end;
+
+		if (trailing) {
+			// Leave the bytes that were copied in this call
+			// after the candidate in the input buffer. Bytes
+			// from earlier calls can only be the start of the
+			// ID string which the direct mode decoder would
+			// ignore anyway.
+			const size_t give_back = coder->member_size
+					- my_max(end, copy_start);
+			*in_pos -= give_back;
+			coder->member_size -= give_back;
+			coder->sequence = SEQ_DIRECT_INIT;
+			break;
+		}
+
+		if (!found) {
+			// If the buffer is full, grow it and continue.
+			if (*in_pos < in_size)
+				break;
+
+			// If the input ends without a Member size field,
+			// let the direct mode decoder report the problem.
+			if (action == LZMA_FINISH) {
+				coder->sequence = SEQ_DIRECT_INIT;
+				break;
+			}
+
+			return_if_error(read_output_and_wait(coder, allocator,
+					out, out_pos, out_size, NULL,
+					waiting_allowed,
+					&wait_abs, &has_blocked));
+			return LZMA_OK;
+		}
+
+		// Leave the bytes that were copied in this call after the
+		// end of the member in the input buffer. The bytes from
+		// earlier calls are the start of the ID string of the next
+		// member. They stay after the end in "member" until the
+		// next member is started.
+		coder->id_carry = copy_start > end ? copy_start - end : 0;
+		assert(coder->id_carry < sizeof(lzip_id_string));
+		assert(coder->member_size - end - coder->id_carry <= *in_pos);
+		*in_pos -= coder->member_size - end - coder->id_carry;
+		coder->member_size = end;
+
+		// Calculate the memory needed to decode the member in
+		// a worker thread.
+		const uint64_t data_size = read64le(
+				coder->member + coder->member_size - 16);
+		if (data_size > SIZE_MAX - sizeof(lzma_outbuf)
+				|| data_size > coder->memlimit_threading
+				|| data_size / LZMA_RATIO_MAX
+					> coder->member_size) {
+			coder->sequence = SEQ_DIRECT_INIT;
+			break;
+		}
+
+		coder->mem_next_member = coder->mem_next_filters
+				+ coder->member_alloc;
+		coder->mem_next_out = lzma_outq_outbuf_memusage(
+				(size_t)data_size);
+
+		if (coder->memlimit_threading < coder->mem_next_out
+				|| coder->memlimit_threading
+						- coder->mem_next_out
+					< coder->mem_next_member) {
+			coder->sequence = SEQ_DIRECT_INIT;
+			break;
+		}
+
+		coder->sequence = SEQ_MEMBER_DISPATCH;
+	}
+
+	// Fall through
+
+	case SEQ_MEMBER_DISPATCH: {
+		// Wait until the member can be given to a worker thread.
+		bool can_start = false;
+		return_if_error(read_output_and_wait(coder, allocator,
+				out, out_pos, out_size, &can_start, true,
+				&wait_abs, &has_blocked));
+
+		if (coder->pending_error) {
+			coder->sequence = SEQ_FINISH;
+			break;
+		}
+
+		if (!can_start)
+			return LZMA_OK;
+
+		return_if_error(member_start(coder, allocator, (size_t)read64le(
+				coder->member + coder->member_size - 16)));
+
+		coder->first_member = false;
+		coder->sequence = SEQ_MEMBER_HEADER;
+
+		// .lz versions 0 and 1 use CRC32 as the integrity check.
+		if (coder->tell_any_check)
+			return LZMA_GET_CHECK;
+
+		break;
+	}
+
+	case SEQ_FINISH:
+		// Read the output of the remaining members. An error from
+		// a worker thread is returned once the output before it
+		// has been read.
+		return_if_error(read_output_and_wait(coder, allocator,
+				out, out_pos, out_size, NULL, true,
+				&wait_abs, &has_blocked));
+
+		if (coder->redo_direct) {
+			coder->sequence = SEQ_DIRECT_INIT;
+			break;
+		}
+
+		if (!lzma_outq_is_empty(&coder->outq))
+			return LZMA_OK;
+
+		return LZMA_STREAM_END;
+
+	case SEQ_DIRECT_INIT:
+		// The output of the earlier members must be read first.
+		return_if_error(read_output_and_wait(coder, allocator,
+				out, out_pos, out_size, NULL, true,
+				&wait_abs, &has_blocked));
+
+		if (!coder->redo_direct) {
+			if (!lzma_outq_is_empty(&coder->outq))
+				return LZMA_OK;
+
+			if (coder->pending_error) {
+				coder->sequence = SEQ_FINISH;
+				break;
+			}
+
+			assert(coder->inputs_count == 0);
+		}
+
+		// The threads and the cached output buffers aren't
+		// needed anymore.
+		threads_end(coder, allocator);
+
+		if (coder->redo_direct)
+			return_if_error(redo_prepare(coder, allocator));
+
+		lzma_outq_clear_cache(&coder->outq, allocator);
+
+		return_if_error(lzma_lzip_decoder_init(&coder->direct_decoder,
+				allocator, coder->memlimit_stop,
+				coder->flags));
+
+		// The start of the ID string of the next member is after
+		// the current member in its buffer. If the current member
+		// was already given to a worker thread, it is the last of
+		// the members that are decoded again.
+		if (coder->member != NULL) {
+			coder->member_size += coder->id_carry;
+		} else if (coder->id_carry > 0) {
+			assert(coder->inputs_count > 0);
+			coder->inputs[(coder->inputs_first
+					+ coder->inputs_count - 1)
+					% coder->inputs_max].size
+					+= coder->id_carry;
+		}
+
+		coder->id_carry = 0;
+		coder->member_pos = 0;
+		coder->sequence = SEQ_DIRECT_RUN;
+
+	// Fall through
+
+	case SEQ_DIRECT_RUN: {
+		// First decode the members that are decoded again and
+		// then the bytes that were collected before switching
+		// to direct mode.
+		while (coder->inputs_count > 0) {
+			const struct member_input *input
+					= &coder->inputs[coder->inputs_first];
+
+			const lzma_ret ret = direct_decode_buf(coder,
+					allocator, input->buf,
+					&coder->member_pos, input->size,
+					out, out_pos, out_size);
+			if (ret != LZMA_OK)
+				return ret;
+
+			if (coder->member_pos < input->size)
+				return LZMA_OK;
+
+			mythread_sync(coder->mutex) {
+				inputs_pop(coder, allocator);
+			}
+
+			coder->member_pos = 0;
+		}
+
+		if (coder->member_pos < coder->member_size) {
+			const lzma_ret ret = direct_decode_buf(coder,
+					allocator, coder->member,
+					&coder->member_pos, coder->member_size,
+					out, out_pos, out_size);
+			if (ret != LZMA_OK)
+				return ret;
+
+			if (coder->member_pos < coder->member_size)
+				return LZMA_OK;
+		}
+
+		lzma_free(coder->member, allocator);
+		coder->member = NULL;
+		coder->member_size = 0;
+		coder->member_alloc = 0;
+		coder->member_pos = 0;
+
+		const size_t in_start = *in_pos;
+		const size_t out_start = *out_pos;
+
+		const lzma_ret ret = coder->direct_decoder.code(
+				coder->direct_decoder.coder, allocator,
+				in, in_pos, in_size,
+				out, out_pos, out_size, action);
+
+		mythread_sync(coder->mutex) {
+			coder->progress_in += *in_pos - in_start;
+			coder->progress_out += *out_pos - out_start;
+		}
+
+		return ret;
+	}
+
+	default:
+		assert(0);
+		return LZMA_PROG_ERROR;
+	}
+
+	// Never reached
+}
+
+
+static void
+lzip_decoder_mt_end(void *coder_ptr, const lzma_allocator *allocator)
+{
+	struct lzma_lzip_coder *coder = coder_ptr;
+
+	threads_end(coder, allocator);
+	lzma_outq_end(&coder->outq, allocator);
+	inputs_clear(coder, allocator);
+	lzma_free(coder->inputs, allocator);
+
+	lzma_next_end(&coder->direct_decoder, allocator);
+	lzma_free(coder->member, allocator);
+
+	mythread_cond_destroy(&coder->cond);
+	mythread_mutex_destroy(&coder->mutex);
+
+	lzma_free(coder, allocator);
+	return;
+}
+
+
+static lzma_check
+lzip_decoder_mt_get_check(const void *coder_ptr lzma_attribute((__unused__)))
+{
+	return LZMA_CHECK_CRC32;
+}
+
+
+static lzma_ret
+lzip_decoder_mt_memconfig(void *coder_ptr, uint64_t *memusage,
+		uint64_t *old_memlimit, uint64_t new_memlimit)
+{
+	// Like in stream_decoder_mt.c, this gets/sets memlimit_stop and
+	// *memusage includes the cached output buffers.
+	struct lzma_lzip_coder *coder = coder_ptr;
+
+	mythread_sync(coder->mutex) {
+		*memusage = coder->mem_in_use + coder->outq.mem_allocated
+				+ coder->member_alloc;
+	}
+
+	// In direct mode the memory usage of the direct mode decoder
+	// is included too.
+	const bool is_direct = coder->sequence == SEQ_DIRECT_RUN;
+	if (is_direct) {
+		uint64_t direct_memusage;
+		uint64_t direct_memlimit;
+		return_if_error(coder->direct_decoder.memconfig(
+				coder->direct_decoder.coder,
+				&direct_memusage, &direct_memlimit, 0));
+		*memusage += direct_memusage;
+	}
+
+	// Always return at least LZMA_MEMUSAGE_BASE.
+	if (*memusage < LZMA_MEMUSAGE_BASE)
+		*memusage = LZMA_MEMUSAGE_BASE;
+
+	*old_memlimit = coder->memlimit_stop;
+
+	if (new_memlimit != 0) {
+		if (new_memlimit < *memusage)
+			return LZMA_MEMLIMIT_ERROR;
+
+		coder->memlimit_stop = new_memlimit;
+
+		// The direct mode decoder may be waiting for a higher limit.
+		if (is_direct) {
+			uint64_t direct_memusage;
+			uint64_t direct_memlimit;
+			return_if_error(coder->direct_decoder.memconfig(
+					coder->direct_decoder.coder,
+					&direct_memusage, &direct_memlimit,
+					new_memlimit));
+		}
+	}
+
+	return LZMA_OK;
+}
+
+
+static void
+lzip_decoder_mt_get_progress(void *coder_ptr,
+		uint64_t *progress_in, uint64_t *progress_out)
+{
+	struct lzma_lzip_coder *coder = coder_ptr;
+
+	// Lock coder->mutex to prevent finishing threads from moving their
+	// progress info from the worker_thread structure to lzma_lzip_coder.
+	mythread_sync(coder->mutex) {
+		*progress_in = coder->progress_in;
+		*progress_out = coder->progress_out;
+
+		for (size_t i = 0; i < coder->threads_initialized; ++i) {
+			mythread_sync(coder->threads[i].mutex) {
+				*progress_in += coder->threads[i].progress_in;
+				*progress_out += coder->threads[i]
+						.progress_out;
+			}
+		}
+	}
+
+	return;
+}
+
+
+static uint32_t
+lzip_decoder_mt_get_worker_stats(void *coder_ptr,
+		lzma_worker_stats *stats, uint32_t stats_max)
+{
+	struct lzma_lzip_coder *coder = coder_ptr;
+	uint32_t count = 0;
+
+	mythread_sync(coder->mutex) {
+		count = coder->threads_initialized;
+
+		for (uint32_t i = 0; i < count && i < stats_max; ++i) {
+			struct worker_thread *thr = &coder->threads[i];
+
+			mythread_sync(thr->mutex) {
+				stats[i] = thr->stats;
+				stats[i].progress_in += thr->progress_in;
+				stats[i].progress_out += thr->progress_out;
+			}
+		}
+	}
+
+	return count;
+}
+
+
+static lzma_ret
+lzip_decoder_mt_init(lzma_next_coder *next, const lzma_allocator *allocator,
+		const lzma_mt *options)
+{
+	if (options->threads == 0 || options->threads > LZMA_THREADS_MAX)
+		return LZMA_OPTIONS_ERROR;
+
+	if (options->flags & ~LZMA_SUPPORTED_FLAGS)
+		return LZMA_OPTIONS_ERROR;
+
+	lzma_next_coder_init(&lzip_decoder_mt_init, next, allocator);
+
+	struct lzma_lzip_coder *coder = next->coder;
+	if (coder == NULL) {
+		coder = lzma_alloc(sizeof(struct lzma_lzip_coder), allocator);
+		if (coder == NULL)
+			return LZMA_MEM_ERROR;
+
+		next->coder = coder;
+
+		if (mythread_mutex_init(&coder->mutex)) {
+			lzma_free(coder, allocator);
+			return LZMA_MEM_ERROR;
+		}
+
+		if (mythread_cond_init(&coder->cond)) {
+			mythread_mutex_destroy(&coder->mutex);
+			lzma_free(coder, allocator);
+			return LZMA_MEM_ERROR;
+		}
+
+		next->code = &lzip_decode_mt;
+		next->end = &lzip_decoder_mt_end;
+		next->get_check = &lzip_decoder_mt_get_check;
+		next->memconfig = &lzip_decoder_mt_memconfig;
+		next->get_progress = &lzip_decoder_mt_get_progress;
+		next->get_worker_stats = &lzip_decoder_mt_get_worker_stats;
+
+		memzero(&coder->outq, sizeof(coder->outq));
+		coder->direct_decoder = LZMA_NEXT_CODER_INIT;
+		coder->member = NULL;
+		coder->member_alloc = 0;
+		coder->inputs = NULL;
+		coder->inputs_max = 0;
+		coder->inputs_first = 0;
+		coder->inputs_count = 0;
+		coder->threads = NULL;
+		coder->threads_free = NULL;
+		coder->threads_initialized = 0;
+		coder->thread_pool = NULL;
+	}
+
+	// Threads are created from scratch so that memory usage
+	// accounting can start from scratch too. The direct mode
+	// decoder is reused if it is needed again.
+	threads_end(coder, allocator);
+
+	// A member buffer and inputs of members may remain if
+	// the previous decoding was unfinished.
+	inputs_clear(coder, allocator);
+	lzma_free(coder->member, allocator);
+	coder->member = NULL;
+	coder->member_size = 0;
+	coder->member_alloc = 0;
+	coder->member_alloc_next = MEMBER_BUF_MIN;
+	coder->member_pos = 0;
+	coder->id_carry = 0;
+
+	coder->mem_in_use = 0;
+	coder->mem_next_filters = 0;
+	coder->mem_next_member = 0;
+	coder->mem_next_out = 0;
+
+	coder->progress_in = 0;
+	coder->progress_out = 0;
+
+	coder->thread_error = LZMA_OK;
+	coder->pending_error = false;
+	coder->redo_direct = false;
+	coder->timeout = options->timeout;
+
+	coder->memlimit_threading = my_max(1, options->memlimit_threading);
+	coder->memlimit_stop = my_max(1, options->memlimit_stop);
+	if (coder->memlimit_threading > coder->memlimit_stop)
+		coder->memlimit_threading = coder->memlimit_stop;
+
+	// These flags are the ones the single-threaded decoder supports.
+	coder->flags = options->flags & (LZMA_TELL_ANY_CHECK
+			| LZMA_IGNORE_CHECK | LZMA_CONCATENATED);
+	coder->tell_any_check = (options->flags & LZMA_TELL_ANY_CHECK) != 0;
+	coder->concatenated = (options->flags & LZMA_CONCATENATED) != 0;
+	coder->fail_fast = (options->flags & LZMA_FAIL_FAST) != 0;
+
+	coder->first_member = true;
+	coder->out_was_filled = false;
+
+	coder->threads_max = options->threads;
+	coder->thread_pool = options->thread_pool;
+
+	return_if_error(lzma_outq_init(&coder->outq, allocator,
+			coder->threads_max));
+
+	// There is an input for each output buffer in use and for
+	// a failed member whose output buffer has been freed.
+	if (coder->inputs_max != coder->outq.bufs_limit + 1) {
+		lzma_free(coder->inputs, allocator);
+		coder->inputs_max = coder->outq.bufs_limit + 1;
+		coder->inputs = lzma_alloc(coder->inputs_max
+				* sizeof(struct member_input), allocator);
+		if (coder->inputs == NULL) {
+			coder->inputs_max = 0;
+			return LZMA_MEM_ERROR;
+		}
+	}
+
+	// Without LZMA_CONCATENATED only one member is decoded and there
+	// is nothing to do in parallel.
+	coder->sequence = coder->concatenated
+			? SEQ_MEMBER_HEADER : SEQ_DIRECT_INIT;
+
+	return LZMA_OK;
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_lzip_decoder_mt(lzma_stream *strm, const lzma_mt *options)
+{
+	lzma_next_strm_init(lzip_decoder_mt_init, strm, options);
+
+	strm->internal->supported_actions[LZMA_RUN] = true;
+	strm->internal->supported_actions[LZMA_FINISH] = true;
+
+	return LZMA_OK;
+}
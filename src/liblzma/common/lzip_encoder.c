@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       lzip_encoder.c
+/// \brief      Encodes .lz (lzip) files
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lzip_encoder.h"
+#include "lzma_encoder.h"
+#include "check.h"
+
+
+typedef struct {
+	enum {
+		SEQ_MEMBER_INIT,
+		SEQ_HEADER,
+		SEQ_LZMA_STREAM,
+		SEQ_MEMBER_FOOTER,
+	} sequence;
+
+	/// True once at least one .lz member has been written. If the
+	/// input is empty, LZMA_FINISH still has to produce one member.
+	bool member_written;
+
+	/// True if the LZMA1 encoder has to be (re)initialized before
+	/// starting the next member
+	bool need_encoder_init;
+
+	/// CRC32 of the uncompressed data in the current .lz member
+	uint32_t crc32;
+
+	/// Uncompressed size of the current .lz member
+	uint64_t uncompressed_size;
+
+	/// Compressed size of the current .lz member
+	uint64_t member_size;
+
+	/// Writing position in the header and footer fields
+	size_t pos;
+
+	/// Buffer to hold the .lz header or footer fields. The header
+	/// is smaller than the footer.
+	uint8_t buffer[LZIP_V1_FOOTER_SIZE];
+
+	/// Options for the LZMA1 encoder. They are needed again every
+	/// time a new member is started.
+	lzma_options_lzma options;
+
+	/// LZMA1 encoder
+	lzma_next_coder lzma_encoder;
+
+} lzma_lzip_coder;
+
+
+/// Initialize the LZMA1 encoder for a new .lz member. The memory
+/// allocated for the previous member is reused.
+static lzma_ret
+lzip_encoder_reset(lzma_lzip_coder *coder, const lzma_allocator *allocator)
+{
+	const lzma_filter_info filters[2] = {
+		{
+			.id = LZMA_FILTER_LZMA1,
+			.init = &lzma_lzma_encoder_init,
+			.options = &coder->options,
+		}, {
+			.init = NULL,
+		}
+	};
+
+	return lzma_next_filter_init(&coder->lzma_encoder, allocator,
+			filters);
+}
+
+
+static lzma_ret
+lzip_encode(void *coder_ptr, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size, lzma_action action)
+{
+	lzma_lzip_coder *coder = coder_ptr;
+
+	while (true)
+	switch (coder->sequence) {
+	case SEQ_MEMBER_INIT: {
+		// Don't start a new member until there is input for it.
+		// The only exception is empty input with LZMA_FINISH:
+		// a .lz file must have at least one member.
+		if (*in_pos == in_size) {
+			if (action == LZMA_RUN)
+				return LZMA_OK;
+
+			if (action != LZMA_FINISH || coder->member_written)
+				return LZMA_STREAM_END;
+		}
+
+		if (coder->need_encoder_init) {
+			return_if_error(lzip_encoder_reset(
+					coder, allocator));
+			coder->need_encoder_init = false;
+		}
+
+		// ID string "LZIP", version 1, and the coded dictionary size
+		coder->buffer[0] = 0x4C;
+		coder->buffer[1] = 0x5A;
+		coder->buffer[2] = 0x49;
+		coder->buffer[3] = 0x50;
+		coder->buffer[4] = 1;
+		coder->buffer[5] = lzip_dict_size_encode(
+				coder->options.dict_size);
+
+		coder->pos = 0;
+		coder->crc32 = 0;
+		coder->uncompressed_size = 0;
+		coder->member_size = LZIP_HEADER_SIZE;
+		coder->sequence = SEQ_HEADER;
+	}
+
+	// Fall through
+
+	case SEQ_HEADER:
+		lzma_bufcpy(coder->buffer, &coder->pos, LZIP_HEADER_SIZE,
+				out, out_pos, out_size);
+		if (coder->pos < LZIP_HEADER_SIZE)
+			return LZMA_OK;
+
+		coder->sequence = SEQ_LZMA_STREAM;
+
+	// Fall through
+
+	case SEQ_LZMA_STREAM: {
+		const size_t in_start = *in_pos;
+		const size_t out_start = *out_pos;
+
+		// All actions other than LZMA_RUN end the member.
+		const lzma_ret ret = coder->lzma_encoder.code(
+				coder->lzma_encoder.coder, allocator,
+				in, in_pos, in_size, out, out_pos, out_size,
+				action == LZMA_RUN ? LZMA_RUN : LZMA_FINISH);
+
+		const size_t in_used = *in_pos - in_start;
+
+		coder->member_size += *out_pos - out_start;
+		coder->uncompressed_size += in_used;
+
+		// Avoid null pointer + 0 (undefined behavior) when
+		// there was no new input.
+		if (in_used > 0)
+			coder->crc32 = lzma_crc32(in + in_start, in_used,
+					coder->crc32);
+
+		if (ret != LZMA_STREAM_END)
+			return ret;
+
+		coder->member_size += LZIP_V1_FOOTER_SIZE;
+
+		write32le(coder->buffer, coder->crc32);
+		write64le(coder->buffer + 4, coder->uncompressed_size);
+		write64le(coder->buffer + 12, coder->member_size);
+
+		coder->pos = 0;
+		coder->sequence = SEQ_MEMBER_FOOTER;
+	}
+
+	// Fall through
+
+	case SEQ_MEMBER_FOOTER:
+		lzma_bufcpy(coder->buffer, &coder->pos, LZIP_V1_FOOTER_SIZE,
+				out, out_pos, out_size);
+		if (coder->pos < LZIP_V1_FOOTER_SIZE)
+			return LZMA_OK;
+
+		coder->member_written = true;
+		coder->need_encoder_init = true;
+		coder->sequence = SEQ_MEMBER_INIT;
+		return LZMA_STREAM_END;
+
+	default:
+		assert(0);
+		return LZMA_PROG_ERROR;
+	}
+
+	// Never reached
+}
+
+
+static void
+lzip_encoder_end(void *coder_ptr, const lzma_allocator *allocator)
+{
+	lzma_lzip_coder *coder = coder_ptr;
+	lzma_next_end(&coder->lzma_encoder, allocator);
+	lzma_free(coder, allocator);
+	return;
+}
+
+
+extern bool
+lzma_lzip_options_valid(const lzma_options_lzma *options)
+{
+	return options->lc == LZIP_LC && options->lp == LZIP_LP
+			&& options->pb == LZIP_PB
+			&& options->preset_dict == NULL
+			&& options->dict_size >= LZMA_DICT_SIZE_MIN
+			&& options->dict_size <= LZIP_DICT_SIZE_MAX;
+}
+
+
+extern lzma_ret
+lzma_lzip_encoder_init(lzma_next_coder *next,
+		const lzma_allocator *allocator,
+		const lzma_options_lzma *options)
+{
+	lzma_next_coder_init(&lzma_lzip_encoder_init, next, allocator);
+
+	if (options == NULL || !lzma_lzip_options_valid(options))
+		return LZMA_OPTIONS_ERROR;
+
+	lzma_lzip_coder *coder = next->coder;
+	if (coder == NULL) {
+		coder = lzma_alloc(sizeof(lzma_lzip_coder), allocator);
+		if (coder == NULL)
+			return LZMA_MEM_ERROR;
+
+		next->coder = coder;
+		next->code = &lzip_encode;
+		next->end = &lzip_encoder_end;
+
+		coder->lzma_encoder = LZMA_NEXT_CODER_INIT;
+	}
+
+	coder->sequence = SEQ_MEMBER_INIT;
+	coder->member_written = false;
+	coder->need_encoder_init = false;
+	coder->options = *options;
+
+	// Initialize the LZMA1 encoder for the first member already here
+	// so that the rest of the option errors are caught immediately.
+	return lzip_encoder_reset(coder, allocator);
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_lzip_encoder(lzma_stream *strm, const lzma_options_lzma *options)
+{
+	lzma_next_strm_init(lzma_lzip_encoder_init, strm, options);
+
+	strm->internal->supported_actions[LZMA_RUN] = true;
+	strm->internal->supported_actions[LZMA_FULL_FLUSH] = true;
+	strm->internal->supported_actions[LZMA_FULL_BARRIER] = true;
+	strm->internal->supported_actions[LZMA_FINISH] = true;
+
+	return LZMA_OK;
+}
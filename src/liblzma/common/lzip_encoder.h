@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       lzip_encoder.h
+/// \brief      Encodes .lz (lzip) files
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_LZIP_ENCODER_H
+#define LZMA_LZIP_ENCODER_H
+
+#include "lzip_common.h"
+
+
+/// \brief      Check that the options can be stored in a .lz file
+///
+/// The .lz format has fixed lc/lp/pb and a limited dictionary size range,
+/// and it cannot store a preset dictionary.
+extern bool lzma_lzip_options_valid(const lzma_options_lzma *options);
+
+
+/// \brief      Initialize .lz encoder
+///
+/// Each LZMA_FULL_FLUSH, LZMA_FULL_BARRIER, and LZMA_FINISH ends the
+/// current .lz member. Encoding continues in a new member on the next
+/// LZMA_RUN.
+extern lzma_ret lzma_lzip_encoder_init(
+		lzma_next_coder *next, const lzma_allocator *allocator,
+		const lzma_options_lzma *options);
+
+#endif
@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       lzip_encoder_mt.c
+/// \brief      Multithreaded .lz (lzip) encoder
+///
+/// The input is split into chunks of block_size bytes and each chunk is
+/// compressed into an independent .lz member by a worker thread. The
+/// members are then written out in order. The threading is done by
+/// encoder_mt.c which is shared with the .xz encoder.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lzip_encoder.h"
+#include "filter_encoder.h"
+#include "encoder_mt.h"
+
+
+typedef struct {
+	/// Worker threads and the output queue. The filter chain
+	/// is a single LZMA1 filter whose options are used for
+	/// every member.
+	lzma_encoder_mt mt;
+} lzma_lzip_coder_mt;
+
+
+/// Encode one .lz member in a worker thread
+static worker_state
+worker_encode(void *coder_ptr lzma_attribute((__unused__)),
+		lzma_encoder_mt_thread *thr, size_t *out_pos)
+{
+	assert(thr->filters[0].id == LZMA_FILTER_LZMA1);
+
+	lzma_ret ret = lzma_lzip_encoder_init(&thr->encoder,
+			&thr->arena.allocator, thr->filters[0].options);
+	lzma_arena_trim(&thr->arena);
+	if (ret != LZMA_OK) {
+		lzma_encoder_mt_worker_error(thr, ret);
+		return THR_STOP;
+	}
+
+	*out_pos = 0;
+
+	size_t in_size;
+	const worker_state state = lzma_encoder_mt_worker_code(
+			thr, out_pos, &ret, &in_size);
+	if (state >= THR_STOP)
+		return state;
+
+	if (ret != LZMA_STREAM_END) {
+		// Unlike LZMA2, LZMA1 cannot fall back to storing
+		// incompressible data uncompressed. The output buffer
+		// is sized for the worst case so running out of it
+		// would be a bug.
+		lzma_encoder_mt_worker_error(thr,
+				ret == LZMA_OK ? LZMA_PROG_ERROR : ret);
+		return THR_STOP;
+	}
+
+	assert(state == THR_FINISH);
+	thr->outbuf->uncompressed_size = in_size;
+
+	return THR_FINISH;
+}
+
+
+static lzma_ret
+lzip_encode_mt(void *coder_ptr, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size, lzma_action action)
+{
+	lzma_lzip_coder_mt *coder = coder_ptr;
+	return lzma_encoder_mt_code(&coder->mt, allocator, in, in_pos,
+			in_size, out, out_pos, out_size, action, NULL);
+}
+
+
+static void
+lzip_encoder_mt_end(void *coder_ptr, const lzma_allocator *allocator)
+{
+	lzma_lzip_coder_mt *coder = coder_ptr;
+	lzma_encoder_mt_end(&coder->mt, allocator);
+	lzma_free(coder, allocator);
+	return;
+}
+
+
+/// Options handling for lzma_lzip_encoder_mt_init() and
+/// lzma_lzip_encoder_mt_memusage()
+static lzma_ret
+get_options(const lzma_mt *options, lzma_options_lzma *lzma_options,
+		uint64_t *block_size, uint64_t *outbuf_size_max)
+{
+	// Validate some of the options.
+	if (options == NULL)
+		return LZMA_PROG_ERROR;
+
+	if (options->flags != 0 || options->threads == 0
+			|| options->threads > LZMA_THREADS_MAX)
+		return LZMA_OPTIONS_ERROR;
+
+	if (options->filters != NULL) {
+		// The filter chain must be a single LZMA1 filter.
+		if (options->filters[0].id != LZMA_FILTER_LZMA1
+				|| options->filters[0].options == NULL
+				|| options->filters[1].id
+					!= LZMA_VLI_UNKNOWN)
+			return LZMA_OPTIONS_ERROR;
+
+		*lzma_options = *(const lzma_options_lzma *)(
+				options->filters[0].options);
+	} else {
+		// Use a preset.
+		if (lzma_lzma_preset(lzma_options, options->preset))
+			return LZMA_OPTIONS_ERROR;
+	}
+
+	if (!lzma_lzip_options_valid(lzma_options))
+		return LZMA_OPTIONS_ERROR;
+
+	// If the member size is not set, use the same default as
+	// the .xz encoder uses with LZMA2.
+	if (options->block_size > 0)
+		*block_size = options->block_size;
+	else
+		*block_size = my_max((uint64_t)(lzma_options->dict_size) * 3,
+				UINT64_C(1) << 20);
+
+	if (*block_size > ENCODER_MT_BLOCK_SIZE_MAX)
+		return LZMA_OPTIONS_ERROR;
+
+	// A dictionary bigger than the member only wastes memory
+	// in both the encoder and the decoder.
+	if (lzma_options->dict_size > *block_size)
+		lzma_options->dict_size = my_max(LZMA_DICT_SIZE_MIN,
+				(uint32_t)(*block_size));
+
+	// Calculate the maximum size of a member. LZMA1 may expand
+	// incompressible data and there is no way to store the data
+	// uncompressed, so this must cover the worst case of the
+	// LZMA1 encoder. The worst case is well under input + 1/3
+	// of it + 128 bytes.
+	*outbuf_size_max = *block_size + *block_size / 3 + 128
+			+ LZIP_HEADER_SIZE + LZIP_V1_FOOTER_SIZE;
+
+	return LZMA_OK;
+}
+
+
+static void
+get_progress(void *coder_ptr, uint64_t *progress_in, uint64_t *progress_out)
+{
+	lzma_lzip_coder_mt *coder = coder_ptr;
+	lzma_encoder_mt_get_progress(&coder->mt, progress_in, progress_out);
+	return;
+}
+
+
+static uint32_t
+get_worker_stats(void *coder_ptr, lzma_worker_stats *stats, uint32_t stats_max)
+{
+	lzma_lzip_coder_mt *coder = coder_ptr;
+	return lzma_encoder_mt_get_worker_stats(&coder->mt, stats, stats_max);
+}
+
+
+static lzma_ret
+lzip_encoder_mt_init(lzma_next_coder *next, const lzma_allocator *allocator,
+		const lzma_mt *options)
+{
+	lzma_next_coder_init(&lzip_encoder_mt_init, next, allocator);
+
+	lzma_options_lzma lzma_options;
+	uint64_t block_size;
+	uint64_t outbuf_size_max;
+	return_if_error(get_options(options, &lzma_options,
+			&block_size, &outbuf_size_max));
+
+	// Validate the rest of the LZMA1 options so that we can give
+	// an error in this function instead of delaying it to the first
+	// call to lzma_code().
+	const lzma_filter filters[2] = {
+		{ .id = LZMA_FILTER_LZMA1, .options = &lzma_options },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+	if (lzma_raw_encoder_memusage(filters) == UINT64_MAX)
+		return LZMA_OPTIONS_ERROR;
+
+	// Allocate and initialize the base structure if needed.
+	lzma_lzip_coder_mt *coder = next->coder;
+	if (coder == NULL) {
+		coder = lzma_alloc(sizeof(lzma_lzip_coder_mt), allocator);
+		if (coder == NULL)
+			return LZMA_MEM_ERROR;
+
+		// A .lz file has at least one member even if
+		// the input is empty.
+		if (lzma_encoder_mt_create(&coder->mt, &worker_encode,
+				coder, true) != LZMA_OK) {
+			lzma_free(coder, allocator);
+			return LZMA_MEM_ERROR;
+		}
+
+		next->coder = coder;
+		next->code = &lzip_encode_mt;
+		next->end = &lzip_encoder_mt_end;
+		next->get_progress = &get_progress;
+		next->get_worker_stats = &get_worker_stats;
+	}
+
+	return lzma_encoder_mt_init(&coder->mt, allocator, options,
+			filters, block_size, outbuf_size_max);
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_lzip_encoder_mt(lzma_stream *strm, const lzma_mt *options)
+{
+	lzma_next_strm_init(lzip_encoder_mt_init, strm, options);
+
+	strm->internal->supported_actions[LZMA_RUN] = true;
+	strm->internal->supported_actions[LZMA_FULL_FLUSH] = true;
+	strm->internal->supported_actions[LZMA_FULL_BARRIER] = true;
+	strm->internal->supported_actions[LZMA_FINISH] = true;
+
+	return LZMA_OK;
+}
+
+
+extern LZMA_API(uint64_t)
+lzma_lzip_encoder_mt_memusage(const lzma_mt *options)
+{
+	lzma_options_lzma lzma_options;
+	uint64_t block_size;
+	uint64_t outbuf_size_max;
+
+	if (get_options(options, &lzma_options, &block_size,
+			&outbuf_size_max) != LZMA_OK)
+		return UINT64_MAX;
+
+	const lzma_filter filters[2] = {
+		{ .id = LZMA_FILTER_LZMA1, .options = &lzma_options },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+	return lzma_encoder_mt_memusage(options, filters, block_size,
+			outbuf_size_max, sizeof(lzma_lzip_coder_mt));
+}
@@ -11,6 +11,7 @@
 
 #include "lzma_decoder.h"
 #include "lz_decoder.h"
+#include "batch.h"
 
 
 typedef struct {
@@ -218,3 +219,82 @@ lzma_microlzma_decoder(lzma_stream *strm, uint64_t comp_size,
 
 	return LZMA_OK;
 }
+
+
+
+typedef struct {
+	uint32_t dict_size;
+	lzma_microlzma_buffer *bufs;
+} lzma_microlzma_batch;
+
+
+static void
+microlzma_decode_item(void *batch_ptr, lzma_next_coder *next,
+		const lzma_allocator *allocator, size_t index)
+{
+	const lzma_microlzma_batch *batch = batch_ptr;
+	lzma_microlzma_buffer *buf = &batch->bufs[index];
+
+	buf->in_used = 0;
+	buf->out_used = 0;
+
+	// The compressed size is the size of the input buffer and
+	// the uncompressed size is the size of the output buffer.
+	lzma_ret ret = microlzma_decoder_init(next, allocator,
+			buf->in_size, buf->out_size,
+			buf->uncomp_size_is_exact, batch->dict_size);
+
+	while (ret == LZMA_OK) {
+		const size_t in_used = buf->in_used;
+		const size_t out_used = buf->out_used;
+
+		ret = next->code(next->coder, allocator,
+				buf->in, &buf->in_used, buf->in_size,
+				buf->out, &buf->out_used, buf->out_size,
+				LZMA_FINISH);
+
+		// All input and output space was available so if
+		// the decoder cannot make progress, the input is truncated.
+		if (ret == LZMA_OK && in_used == buf->in_used
+				&& out_used == buf->out_used)
+			ret = LZMA_DATA_ERROR;
+	}
+
+	if (ret == LZMA_STREAM_END)
+		ret = LZMA_OK;
+	else
+		lzma_next_end(next, allocator);
+
+	buf->ret = ret;
+	return;
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_microlzma_decode_batch(uint32_t dict_size,
+		lzma_microlzma_buffer *bufs, size_t count,
+		const lzma_mt *mt, const lzma_allocator *allocator)
+{
+	if (bufs == NULL && count > 0)
+		return LZMA_PROG_ERROR;
+
+	for (size_t i = 0; i < count; ++i)
+		if ((bufs[i].in == NULL && bufs[i].in_size > 0)
+				|| (bufs[i].out == NULL
+					&& bufs[i].out_size > 0))
+			return LZMA_PROG_ERROR;
+
+	lzma_microlzma_batch batch = {
+		.dict_size = dict_size,
+		.bufs = bufs,
+	};
+
+	return_if_error(lzma_batch_run(count, mt, allocator,
+			&microlzma_decode_item, &batch));
+
+	for (size_t i = 0; i < count; ++i)
+		if (bufs[i].ret != LZMA_OK)
+			return bufs[i].ret;
+
+	return LZMA_OK;
+}
@@ -10,6 +10,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "lzma_encoder.h"
+#include "batch.h"
 
 
 typedef struct {
@@ -138,3 +139,77 @@ lzma_microlzma_encoder(lzma_stream *strm, const lzma_options_lzma *options)
 	return LZMA_OK;
 
 }
+
+
+typedef struct {
+	const lzma_options_lzma *options;
+	lzma_microlzma_buffer *bufs;
+} lzma_microlzma_batch;
+
+
+static void
+microlzma_encode_item(void *batch_ptr, lzma_next_coder *next,
+		const lzma_allocator *allocator, size_t index)
+{
+	const lzma_microlzma_batch *batch = batch_ptr;
+	lzma_microlzma_buffer *buf = &batch->bufs[index];
+
+	buf->in_used = 0;
+	buf->out_used = 0;
+
+	// microlzma_encode() cannot return LZMA_BUF_ERROR so catch
+	// too small output buffers here.
+	if (buf->out_size < 6) {
+		buf->ret = LZMA_BUF_ERROR;
+		return;
+	}
+
+	// The same worker encodes many buffers in a row so reinitializing
+	// reuses the memory of the LZMA encoder.
+	lzma_ret ret = microlzma_encoder_init(next, allocator, batch->options);
+	if (ret == LZMA_OK) {
+		ret = next->code(next->coder, allocator,
+				buf->in, &buf->in_used, buf->in_size,
+				buf->out, &buf->out_used, buf->out_size,
+				LZMA_FINISH);
+
+		if (ret == LZMA_STREAM_END)
+			ret = LZMA_OK;
+	}
+
+	// Don't keep a coder that may be in an inconsistent state.
+	if (ret != LZMA_OK)
+		lzma_next_end(next, allocator);
+
+	buf->ret = ret;
+	return;
+}
+
+
+extern LZMA_API(lzma_ret)
+lzma_microlzma_encode_batch(const lzma_options_lzma *options,
+		lzma_microlzma_buffer *bufs, size_t count,
+		const lzma_mt *mt, const lzma_allocator *allocator)
+{
+	if (options == NULL || (bufs == NULL && count > 0))
+		return LZMA_PROG_ERROR;
+
+	for (size_t i = 0; i < count; ++i)
+		if ((bufs[i].in == NULL && bufs[i].in_size > 0)
+				|| bufs[i].out == NULL)
+			return LZMA_PROG_ERROR;
+
+	lzma_microlzma_batch batch = {
+		.options = options,
+		.bufs = bufs,
+	};
+
+	return_if_error(lzma_batch_run(count, mt, allocator,
+			&microlzma_encode_item, &batch));
+
+	for (size_t i = 0; i < count; ++i)
+		if (bufs[i].ret != LZMA_OK)
+			return bufs[i].ret;
+
+	return LZMA_OK;
+}
@@ -15,6 +15,8 @@
 #include "stream_decoder.h"
 #include "index.h"
 #include "outqueue.h"
+#include "arena.h"
+#include "thread_pool.h"
 
 
 typedef enum {
@@ -117,6 +119,13 @@ struct worker_thread {
 	/// Block decoder
 	lzma_next_coder block_decoder;
 
+	/// Allocations of the Block decoder are done from this arena
+	/// so that they can be reused when the filter chain changes
+	/// between Blocks. The input buffer isn't allocated from the
+	/// arena because the memory usage counters assume that it is
+	/// freed when the Block has been decoded.
+	lzma_arena arena;
+
 	/// Thread-specific Block options are needed because the Block
 	/// decoder modifies the struct given to it at initialization.
 	lzma_block block_options;
@@ -124,6 +133,12 @@ struct worker_thread {
 	/// Filter chain memory usage
 	uint64_t mem_filters;
 
+	/// Statistics for lzma_get_worker_stats(). blocks, progress_in,
+	/// and progress_out are updated with the main mutex locked when
+	/// a Block is finished, input_waits and allocs_avoided with our
+	/// mutex locked.
+	lzma_worker_stats stats;
+
 	/// Next structure in the stack of free worker threads.
 	struct worker_thread *next;
 
@@ -131,8 +146,17 @@ struct worker_thread {
 	mythread_cond cond;
 
 	/// The ID of this thread is used to join the thread
-	/// when it's not needed anymore.
+	/// when it's not needed anymore. This isn't used when
+	/// the worker runs in a thread pool.
 	mythread thread_id;
+
+	/// Job that runs worker_decoder() in coder->thread_pool
+	lzma_pool_job job;
+
+	/// True if the job has been given to the thread pool and
+	/// worker_decoder() hasn't returned yet. This is protected
+	/// with our mutex.
+	bool job_active;
 };
 
 
@@ -217,6 +241,11 @@ struct lzma_stream_coder {
 	/// the new input from the application.
 	struct worker_thread *thr;
 
+	/// Thread pool from lzma_mt.thread_pool. If this is NULL, each
+	/// worker has a thread of its own. Otherwise a worker runs in
+	/// a thread of the pool only while it has a Block to decode.
+	lzma_thread_pool *thread_pool;
+
 	/// Output buffer queue for decompressed data from the worker threads
 	///
 	/// \note       Use mutex with operations that need it.
@@ -235,6 +264,11 @@ struct lzma_stream_coder {
 	/// even in single-threaded mode without exceeding this limit.
 	uint64_t memlimit_stop;
 
+	/// Maximum amount of memory that the buffers in the output queue
+	/// may use when starting a new Block. If this is zero, the number
+	/// of buffers is limited by the output queue instead.
+	uint64_t decode_ahead;
+
 	/// Amount of memory in use by the direct mode decoder
 	/// (coder->block_decoder). In threaded mode this is 0.
 	uint64_t mem_direct_mode;
@@ -258,6 +292,9 @@ struct lzma_stream_coder {
 	/// for the next Block.
 	uint64_t mem_next_in;
 
+	/// Amount of memory needed for the output buffer of the next Block
+	uint64_t mem_next_out;
+
 	/// Amount of memory actually needed to decode the next Block
 	/// in threaded mode. This is
 	/// mem_next_filters + mem_next_in + memory needed for lzma_outbuf.
@@ -334,6 +371,25 @@ struct lzma_stream_coder {
 
 /// Enables updating of outbuf->pos. This is a callback function that is
 /// used with lzma_outq_enable_partial_output().
+/// Wakes up the worker. In a thread pool the job of the worker is queued
+/// if it has given its thread back to the pool. This is called with
+/// thr->mutex locked.
+static void
+worker_signal(struct worker_thread *thr)
+{
+	mythread_cond_signal(&thr->cond);
+
+	// If the job is still active, the worker will notice the change
+	// before giving its thread back.
+	if (thr->coder->thread_pool != NULL && !thr->job_active) {
+		thr->job_active = true;
+		lzma_thread_pool_run(thr->coder->thread_pool, &thr->job);
+	}
+
+	return;
+}
+
+
 static void
 worker_enable_partial_update(void *thr_ptr)
 {
@@ -341,7 +397,7 @@ worker_enable_partial_update(void *thr_ptr)
 
 	mythread_sync(thr->mutex) {
 		thr->partial_update = PARTIAL_START;
-		mythread_cond_signal(&thr->cond);
+		worker_signal(thr);
 	}
 }
 
@@ -381,19 +437,29 @@ next_loop_lock:
 next_loop_unlocked:
 
 	if (thr->state == THR_IDLE) {
+		// In a thread pool the thread is given back to the pool
+		// instead of waiting for more work. The main thread will
+		// queue the job again. thr must not be touched after
+		// job_active has been cleared.
+		if (thr->coder->thread_pool != NULL) {
+			thr->job_active = false;
+			mythread_mutex_unlock(&thr->mutex);
+			return MYTHREAD_RET_VALUE;
+		}
+
 		mythread_cond_wait(&thr->cond, &thr->mutex);
 		goto next_loop_unlocked;
 	}
 
 	if (thr->state == THR_EXIT) {
-		mythread_mutex_unlock(&thr->mutex);
-
-		lzma_free(thr->in, thr->allocator);
-		lzma_next_end(&thr->block_decoder, thr->allocator);
-
-		mythread_mutex_destroy(&thr->mutex);
-		mythread_cond_destroy(&thr->cond);
+		// threads_end() frees the resources once it knows
+		// that we are done.
+		if (thr->coder->thread_pool != NULL) {
+			thr->job_active = false;
+			mythread_cond_signal(&thr->cond);
+		}
 
+		mythread_mutex_unlock(&thr->mutex);
 		return MYTHREAD_RET_VALUE;
 	}
 
@@ -423,6 +489,17 @@ next_loop_unlocked:
 	partial_update = thr->partial_update;
 
 	if (in_filled == thr->in_pos && partial_update != PARTIAL_START) {
+		++thr->stats.input_waits;
+
+		// A job in a thread pool must not wait for the application
+		// to provide more input. The main thread will queue the job
+		// again when it has copied more input to thr->in.
+		if (thr->coder->thread_pool != NULL) {
+			thr->job_active = false;
+			mythread_mutex_unlock(&thr->mutex);
+			return MYTHREAD_RET_VALUE;
+		}
+
 		mythread_cond_wait(&thr->cond, &thr->mutex);
 		goto next_loop_unlocked;
 	}
@@ -438,7 +515,7 @@ next_loop_unlocked:
 		in_filled = thr->in_pos + chunk_size;
 
 	ret = thr->block_decoder.code(
-			thr->block_decoder.coder, thr->allocator,
+			thr->block_decoder.coder, &thr->arena.allocator,
 			thr->in, &thr->in_pos, in_filled,
 			thr->outbuf->buf, &thr->out_pos,
 			thr->outbuf->allocated, LZMA_RUN);
@@ -498,6 +575,10 @@ next_loop_unlocked:
 		thr->progress_in = 0;
 		thr->progress_out = 0;
 
+		++thr->stats.blocks;
+		thr->stats.progress_in += thr->in_pos;
+		thr->stats.progress_out += thr->out_pos;
+
 		// Mark the outbuf as finished.
 		thr->outbuf->pos = thr->out_pos;
 		thr->outbuf->decoder_in_pos = thr->in_pos;
@@ -517,6 +598,15 @@ next_loop_unlocked:
 }
 
 
+/// Runs worker_decoder() in a thread of the pool.
+static void
+worker_job(void *thr_ptr)
+{
+	(void)worker_decoder(thr_ptr);
+	return;
+}
+
+
 /// Tells the worker threads to exit and waits for them to terminate.
 static void
 threads_end(struct lzma_stream_coder *coder, const lzma_allocator *allocator)
@@ -528,8 +618,26 @@ threads_end(struct lzma_stream_coder *coder, const lzma_allocator *allocator)
 		}
 	}
 
-	for (uint32_t i = 0; i < coder->threads_initialized; ++i)
-		mythread_join(coder->threads[i].thread_id);
+	for (uint32_t i = 0; i < coder->threads_initialized; ++i) {
+		struct worker_thread *thr = &coder->threads[i];
+
+		if (coder->thread_pool != NULL) {
+			mythread_sync(thr->mutex) {
+				while (thr->job_active)
+					mythread_cond_wait(&thr->cond,
+							&thr->mutex);
+			}
+		} else {
+			mythread_join(thr->thread_id);
+		}
+
+		lzma_free(thr->in, thr->allocator);
+		lzma_next_end(&thr->block_decoder, &thr->arena.allocator);
+		lzma_arena_end(&thr->arena);
+
+		mythread_mutex_destroy(&thr->mutex);
+		mythread_cond_destroy(&thr->cond);
+	}
 
 	lzma_free(coder->threads, allocator);
 	coder->threads_initialized = 0;
@@ -553,7 +661,7 @@ threads_stop(struct lzma_stream_coder *coder)
 			// THR_IDLE -> THR_STOP is not a valid state change.
 			if (coder->threads[i].state != THR_IDLE) {
 				coder->threads[i].state = THR_STOP;
-				mythread_cond_signal(&coder->threads[i].cond);
+				worker_signal(&coder->threads[i]);
 			}
 		}
 	}
@@ -598,9 +706,17 @@ initialize_new_thread(struct lzma_stream_coder *coder,
 	thr->coder = coder;
 	thr->outbuf = NULL;
 	thr->block_decoder = LZMA_NEXT_CODER_INIT;
+	lzma_arena_init(&thr->arena, allocator);
 	thr->mem_filters = 0;
-
-	if (mythread_create(&thr->thread_id, worker_decoder, thr))
+	memzero(&thr->stats, sizeof(thr->stats));
+	thr->job.func = &worker_job;
+	thr->job.arg = thr;
+	thr->job_active = false;
+
+	// With a thread pool the job is queued when the thread
+	// is given a Block to decode.
+	if (coder->thread_pool == NULL && mythread_create(
+			&thr->thread_id, worker_decoder, thr))
 		goto error_thread;
 
 	++coder->threads_initialized;
@@ -746,6 +862,13 @@ read_output_and_wait(struct lzma_stream_coder *coder,
 			// above because reading the output can free a slot in
 			// the output queue and also reduce active memusage.
 			//
+			// With decode_ahead the amount of decoded data
+			// waiting in the output queue is limited instead of
+			// the number of buffers. The Block at the head of
+			// the queue may be slow to finish while the later
+			// ones are already done. This lets the threads
+			// continue with the following Blocks.
+			//
 			// NOTE: If output queue is empty, then input will
 			// always be possible.
 			if (input_is_possible != NULL
@@ -754,6 +877,15 @@ read_output_and_wait(struct lzma_stream_coder *coder,
 						- coder->outq.mem_in_use
 						>= coder->mem_next_block
 					&& lzma_outq_has_buf(&coder->outq)
+					&& (coder->decode_ahead == 0
+						|| lzma_outq_is_empty(
+							&coder->outq)
+						|| (coder->decode_ahead
+							>= coder->mem_next_out
+						&& coder->decode_ahead
+							- coder->mem_next_out
+							>= coder->outq
+								.mem_in_use))
 					&& (coder->threads_initialized
 							< coder->threads_max
 						|| coder->threads_free
@@ -1258,9 +1390,10 @@ stream_decode_mt(void *coder_ptr, const lzma_allocator *allocator,
 		// These cannot overflow because we already checked that
 		// the sizes are small enough using is_direct_mode_needed().
 		coder->mem_next_in = comp_blk_size(coder);
-		const uint64_t mem_buffers = coder->mem_next_in
-				+ lzma_outq_outbuf_memusage(
+		coder->mem_next_out = lzma_outq_outbuf_memusage(
 				coder->block_options.uncompressed_size);
+		const uint64_t mem_buffers = coder->mem_next_in
+				+ coder->mem_next_out;
 
 		// Add the amount needed by the filters.
 		// Avoid integer overflows.
@@ -1416,7 +1549,9 @@ stream_decode_mt(void *coder_ptr, const lzma_allocator *allocator,
 				thr = thr->next;
 
 			while (thr != NULL) {
-				lzma_next_end(&thr->block_decoder, allocator);
+				lzma_next_end(&thr->block_decoder,
+						&thr->arena.allocator);
+				lzma_arena_trim(&thr->arena);
 				mem_freed += thr->mem_filters;
 				thr->mem_filters = 0;
 				thr = thr->next;
@@ -1465,8 +1600,18 @@ stream_decode_mt(void *coder_ptr, const lzma_allocator *allocator,
 		// Initialize the Block decoder.
 		coder->thr->block_options = coder->block_options;
 		ret = lzma_block_decoder_init(
-					&coder->thr->block_decoder, allocator,
+					&coder->thr->block_decoder,
+					&coder->thr->arena.allocator,
 					&coder->thr->block_options);
+		lzma_arena_trim(&coder->thr->arena);
+
+		// A chunk that was reused from the arena may be bigger
+		// than what the Block decoder asked for. Count the extra
+		// memory too so that memlimit_threading stays accurate.
+		coder->thr->mem_filters += coder->thr->arena.oversize;
+		mythread_sync(coder->mutex) {
+			coder->mem_in_use += coder->thr->arena.oversize;
+		}
 
 		// Free the allocated filter options since they are needed
 		// only to initialize the Block decoder.
@@ -1497,7 +1642,9 @@ stream_decode_mt(void *coder_ptr, const lzma_allocator *allocator,
 		mythread_sync(coder->thr->mutex) {
 			assert(coder->thr->state == THR_IDLE);
 			coder->thr->state = THR_RUN;
-			mythread_cond_signal(&coder->thr->cond);
+			coder->thr->stats.allocs_avoided
+					= coder->thr->arena.allocs_avoided;
+			worker_signal(coder->thr);
 		}
 
 		// Enable output from the thread that holds the oldest output
@@ -1543,7 +1690,7 @@ stream_decode_mt(void *coder_ptr, const lzma_allocator *allocator,
 			// we cannot make it conditional because thr->in_pos
 			// is updated without a mutex. And the overhead should
 			// be very much negligible anyway.
-			mythread_cond_signal(&coder->thr->cond);
+			worker_signal(coder->thr);
 		}
 
 		// Read output from the output queue. Just like in
@@ -1889,6 +2036,33 @@ stream_decoder_mt_get_progress(void *coder_ptr,
 }
 
 
+static uint32_t
+stream_decoder_mt_get_worker_stats(void *coder_ptr,
+		lzma_worker_stats *stats, uint32_t stats_max)
+{
+	struct lzma_stream_coder *coder = coder_ptr;
+	uint32_t count = 0;
+
+	// Lock coder->mutex to prevent finishing threads from moving their
+	// progress info into the statistics while we read them.
+	mythread_sync(coder->mutex) {
+		count = coder->threads_initialized;
+
+		for (uint32_t i = 0; i < count && i < stats_max; ++i) {
+			struct worker_thread *thr = &coder->threads[i];
+
+			mythread_sync(thr->mutex) {
+				stats[i] = thr->stats;
+				stats[i].progress_in += thr->progress_in;
+				stats[i].progress_out += thr->progress_out;
+			}
+		}
+	}
+
+	return count;
+}
+
+
 static lzma_ret
 stream_decoder_mt_init(lzma_next_coder *next, const lzma_allocator *allocator,
 		       const lzma_mt *options)
@@ -1927,6 +2101,7 @@ stream_decoder_mt_init(lzma_next_coder *next, const lzma_allocator *allocator,
 		next->get_check = &stream_decoder_mt_get_check;
 		next->memconfig = &stream_decoder_mt_memconfig;
 		next->get_progress = &stream_decoder_mt_get_progress;
+		next->get_worker_stats = &stream_decoder_mt_get_worker_stats;
 
 		coder->filters[0].id = LZMA_VLI_UNKNOWN;
 		memzero(&coder->outq, sizeof(coder->outq));
@@ -1938,6 +2113,7 @@ stream_decoder_mt_init(lzma_next_coder *next, const lzma_allocator *allocator,
 		coder->threads = NULL;
 		coder->threads_free = NULL;
 		coder->threads_initialized = 0;
+		coder->thread_pool = NULL;
 	}
 
 	// Cleanup old filter chain if one remains after unfinished decoding
@@ -1997,9 +2173,15 @@ stream_decoder_mt_init(lzma_next_coder *next, const lzma_allocator *allocator,
 	coder->pos = 0;
 
 	coder->threads_max = options->threads;
+	coder->thread_pool = options->thread_pool;
+	coder->decode_ahead = options->decode_ahead;
 
+	// With decode_ahead the output queue may hold as many buffers
+	// as it supports at most. The memory limits decide how many
+	// are actually used.
 	return_if_error(lzma_outq_init(&coder->outq, allocator,
-				       coder->threads_max));
+			coder->decode_ahead == 0
+				? coder->threads_max : LZMA_THREADS_MAX));
 
 	return stream_decoder_reset(coder, allocator);
 }
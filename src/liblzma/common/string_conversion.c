@@ -153,6 +153,11 @@ str_append_u32(lzma_str *str, uint32_t v, bool use_byte_suffix)
 /// BCJ filter start offset which usually is zero.
 #define OPTMAP_NO_STRFY_ZERO 0x04
 
+/// For option_map.flags: Allow the value "auto" in the input string. It is
+/// stored as UINT32_MAX and stringified back to "auto". This is used for
+/// LZMA_LCLPPB_AUTO in LZMA1/2 lc, lp, and pb.
+#define OPTMAP_ALLOW_AUTO 0x08
+
 /// Possible values for option_map.type. Since OPTMAP_TYPE_UINT32 is 0,
 /// it doesn't need to be specified in the initializers as it is
 /// the implicit value.
@@ -187,11 +192,14 @@ typedef struct {
 ///     converted to an integer using the name_value_map pointed by .u.map.
 ///     The last element in .u.map must have .name = "" as the terminator.
 ///
-/// (3) Otherwise the string is treated as a non-negative unsigned decimal
+/// (3) If .flags has OPTMAP_ALLOW_AUTO set and the string is "auto" then
+///     the integer is UINT32_MAX.
+///
+/// (4) Otherwise the string is treated as a non-negative unsigned decimal
 ///     integer which must be in the range set in .u.range. If .flags has
 ///     OPTMAP_USE_BYTE_SUFFIX then KiB, MiB, and GiB suffixes are allowed.
 ///
-/// The integer value from (2) or (3) is then stored to filter_options
+/// The integer value from (2), (3), or (4) is then stored to filter_options
 /// at the offset specified in .offset using the type specified in .type
 /// (default is uint32_t).
 ///
@@ -206,9 +214,13 @@ typedef struct {
 /// to convert the option to a string. If the map doesn't contain a string
 /// for the integer value then "UNKNOWN" is used.
 ///
-/// If .flags doesn't have OPTMAP_USE_NAME_VALUE_MAP set then the integer is
-/// converted to a decimal value. If OPTMAP_USE_BYTE_SUFFIX is used then KiB,
-/// MiB, or GiB suffix is used if the value is an exact multiple of these.
+/// If .flags has OPTMAP_ALLOW_AUTO set and the integer is UINT32_MAX then
+/// "auto" is used.
+///
+/// Otherwise, if .flags doesn't have OPTMAP_USE_NAME_VALUE_MAP set then
+/// the integer is converted to a decimal value. If OPTMAP_USE_BYTE_SUFFIX
+/// is used then KiB, MiB, or GiB suffix is used if the value is an exact
+/// multiple of these.
 /// Plain "B" suffix is never used.
 typedef struct {
 	char name[NAME_LEN_MAX + 1];
@@ -253,7 +265,9 @@ static const char *parse_options(const char **const str, const char *str_end,
 		|| defined(HAVE_ENCODER_SPARC) \
 		|| defined(HAVE_DECODER_SPARC) \
 		|| defined(HAVE_ENCODER_RISCV) \
-		|| defined(HAVE_DECODER_RISCV)
+		|| defined(HAVE_DECODER_RISCV) \
+		|| defined(HAVE_ENCODER_X86SPLIT) \
+		|| defined(HAVE_DECODER_X86SPLIT)
 static const option_map bcj_optmap[] = {
 	{
 		.name = "start",
@@ -355,6 +369,7 @@ set_lzma12_preset(const char **const str, const char *str_end,
 static const name_value_map lzma12_mode_map[] = {
 	{ "fast",   LZMA_MODE_FAST },
 	{ "normal", LZMA_MODE_NORMAL },
+	{ "turbo",  LZMA_MODE_TURBO },
 	{ "",       0 }
 };
 
@@ -362,9 +377,11 @@ static const name_value_map lzma12_mode_map[] = {
 static const name_value_map lzma12_mf_map[] = {
 	{ "hc3", LZMA_MF_HC3 },
 	{ "hc4", LZMA_MF_HC4 },
+	{ "hc5", LZMA_MF_HC5 },
 	{ "bt2", LZMA_MF_BT2 },
 	{ "bt3", LZMA_MF_BT3 },
 	{ "bt4", LZMA_MF_BT4 },
+	{ "bt5", LZMA_MF_BT5 },
 	{ "",    0 }
 };
 
@@ -383,16 +400,19 @@ static const option_map lzma12_optmap[] = {
 		.u.range.max = (UINT32_C(1) << 30) + (UINT32_C(1) << 29),
 	}, {
 		.name = "lc",
+		.flags = OPTMAP_ALLOW_AUTO,
 		.offset = offsetof(lzma_options_lzma, lc),
 		.u.range.min = LZMA_LCLP_MIN,
 		.u.range.max = LZMA_LCLP_MAX,
 	}, {
 		.name = "lp",
+		.flags = OPTMAP_ALLOW_AUTO,
 		.offset = offsetof(lzma_options_lzma, lp),
 		.u.range.min = LZMA_LCLP_MIN,
 		.u.range.max = LZMA_LCLP_MAX,
 	}, {
 		.name = "pb",
+		.flags = OPTMAP_ALLOW_AUTO,
 		.offset = offsetof(lzma_options_lzma, pb),
 		.u.range.min = LZMA_PB_MIN,
 		.u.range.max = LZMA_PB_MAX,
@@ -437,13 +457,33 @@ parse_lzma12(const char **const str, const char *str_end, void *filter_options)
 	if (errmsg != NULL)
 		return errmsg;
 
-	if (opts->lc + opts->lp > LZMA_LCLP_MAX)
+	if (opts->lc != LZMA_LCLPPB_AUTO && opts->lp != LZMA_LCLPPB_AUTO
+			&& opts->lc + opts->lp > LZMA_LCLP_MAX)
 		return "The sum of lc and lp must not exceed 4";
 
 	return NULL;
 }
 
 
+#if defined (HAVE_ENCODER_LZMA1) || defined(HAVE_DECODER_LZMA1)
+static const char *
+parse_lzma1(const char **const str, const char *str_end, void *filter_options)
+{
+	const char *errmsg = parse_lzma12(str, str_end, filter_options);
+	if (errmsg != NULL)
+		return errmsg;
+
+	// Only the LZMA2 encoder can choose lc/lp/pb by itself.
+	const lzma_options_lzma *opts = filter_options;
+	if (opts->lc == LZMA_LCLPPB_AUTO || opts->lp == LZMA_LCLPPB_AUTO
+			|| opts->pb == LZMA_LCLPPB_AUTO)
+		return "lc, lp, and pb cannot be \"auto\" with LZMA1";
+
+	return NULL;
+}
+#endif
+
+
 /////////////////////////////////////////
 // Generic parsing and stringification //
 /////////////////////////////////////////
@@ -484,7 +524,7 @@ static const struct {
 } filter_name_map[] = {
 #if defined (HAVE_ENCODER_LZMA1) || defined(HAVE_DECODER_LZMA1)
 	{ "lzma1",        sizeof(lzma_options_lzma),  LZMA_FILTER_LZMA1,
-	  &parse_lzma12,  lzma12_optmap, 9, 5, false },
+	  &parse_lzma1,   lzma12_optmap, 9, 5, false },
 #endif
 
 #if defined(HAVE_ENCODER_LZMA2) || defined(HAVE_DECODER_LZMA2)
@@ -532,6 +572,11 @@ static const struct {
 	  &parse_bcj,     bcj_optmap, 1, 1, true },
 #endif
 
+#if defined(HAVE_ENCODER_X86SPLIT) || defined(HAVE_DECODER_X86SPLIT)
+	{ "x86split",     sizeof(lzma_options_bcj),   LZMA_FILTER_X86_SPLIT,
+	  &parse_bcj,     bcj_optmap, 1, 1, true },
+#endif
+
 #if defined(HAVE_ENCODER_DELTA) || defined(HAVE_DECODER_DELTA)
 	{ "delta",        sizeof(lzma_options_delta), LZMA_FILTER_DELTA,
 	  &parse_delta,   delta_optmap, 1, 1, false },
@@ -644,6 +689,10 @@ parse_options(const char **const str, const char *str_end,
 
 				++j;
 			}
+		} else if ((optmap[i].flags & OPTMAP_ALLOW_AUTO)
+				&& value_len == 4
+				&& memcmp(*str, "auto", 4) == 0) {
+			v = UINT32_MAX;
 		} else if (**str < '0' || **str > '9') {
 			// Note that "max" isn't supported while it is
 			// supported in xz. It's not useful here.
@@ -1098,6 +1147,9 @@ strfy_filter(lzma_str *dest, const char *delimiter,
 
 				++j;
 			}
+		} else if ((optmap[i].flags & OPTMAP_ALLOW_AUTO)
+				&& v == UINT32_MAX) {
+			str_append_str(dest, "auto");
 		} else {
 			str_append_u32(dest, v,
 				optmap[i].flags & OPTMAP_USE_BYTE_SUFFIX);
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       thread_pool.c
+/// \brief      Pool of worker threads shared by multithreaded coders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "thread_pool.h"
+
+
+typedef struct lzma_pool_thread_s lzma_pool_thread;
+struct lzma_pool_thread_s {
+	/// The ID of this thread is used to join the thread
+	/// in lzma_thread_pool_end().
+	mythread thread_id;
+
+	/// Next thread in the list of all threads of the pool
+	lzma_pool_thread *next;
+};
+
+
+struct lzma_thread_pool_s {
+	/// Oldest queued job or NULL if the queue is empty
+	lzma_pool_job *head;
+
+	/// Newest queued job. This is valid only when head != NULL.
+	lzma_pool_job *tail;
+
+	/// All threads of the pool
+	lzma_pool_thread *threads;
+
+	/// True when lzma_thread_pool_end() wants the threads to exit
+	bool exiting;
+
+	mythread_mutex mutex;
+	mythread_cond cond;
+};
+
+
+static MYTHREAD_RET_TYPE
+pool_thread_start(void *pool_ptr)
+{
+	lzma_thread_pool *pool = pool_ptr;
+
+	mythread_mutex_lock(&pool->mutex);
+
+	while (true) {
+		if (pool->head == NULL) {
+			if (pool->exiting) {
+				// Wake up the next thread so that
+				// all threads will exit.
+				mythread_cond_signal(&pool->cond);
+				break;
+			}
+
+			mythread_cond_wait(&pool->cond, &pool->mutex);
+			continue;
+		}
+
+		// Take the oldest job. The job structure belongs to
+		// the caller and may be freed by func so copy what
+		// is needed before unlocking.
+		lzma_pool_job *job = pool->head;
+		pool->head = job->next;
+
+		void (*func)(void *arg) = job->func;
+		void *arg = job->arg;
+
+		mythread_mutex_unlock(&pool->mutex);
+		func(arg);
+		mythread_mutex_lock(&pool->mutex);
+	}
+
+	mythread_mutex_unlock(&pool->mutex);
+	return MYTHREAD_RET_VALUE;
+}
+
+
+/// Create a new thread and add it to the pool. This is called with
+/// pool->mutex locked, thus the new thread cannot start running before
+/// the caller has unlocked the mutex.
+static lzma_ret
+pool_add_thread(lzma_thread_pool *pool, const lzma_allocator *allocator)
+{
+	lzma_pool_thread *thr = lzma_alloc(sizeof(lzma_pool_thread),
+			allocator);
+	if (thr == NULL)
+		return LZMA_MEM_ERROR;
+
+	if (mythread_create(&thr->thread_id, &pool_thread_start, pool)) {
+		lzma_free(thr, allocator);
+		return LZMA_MEM_ERROR;
+	}
+
+	thr->next = pool->threads;
+	pool->threads = thr;
+	return LZMA_OK;
+}
+
+
+extern void
+lzma_thread_pool_run(lzma_thread_pool *pool, lzma_pool_job *job)
+{
+	mythread_sync(pool->mutex) {
+		job->next = NULL;
+
+		if (pool->head == NULL)
+			pool->head = job;
+		else
+			pool->tail->next = job;
+
+		pool->tail = job;
+
+		// Wake up an idle thread. If all threads are busy,
+		// the job waits in the queue.
+		mythread_cond_signal(&pool->cond);
+	}
+
+	return;
+}
+
+
+extern LZMA_API(lzma_thread_pool *)
+lzma_thread_pool_init(uint32_t threads, const lzma_allocator *allocator)
+{
+	if (threads == 0 || threads > LZMA_THREADS_MAX)
+		return NULL;
+
+	lzma_thread_pool *pool = lzma_alloc(sizeof(lzma_thread_pool),
+			allocator);
+	if (pool == NULL)
+		return NULL;
+
+	if (mythread_mutex_init(&pool->mutex))
+		goto error_mutex;
+
+	if (mythread_cond_init(&pool->cond))
+		goto error_cond;
+
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->threads = NULL;
+	pool->exiting = false;
+
+	// The pool never gets more threads than this.
+	for (uint32_t i = 0; i < threads; ++i) {
+		lzma_ret ret = LZMA_OK;
+
+		mythread_sync(pool->mutex) {
+			ret = pool_add_thread(pool, allocator);
+		}
+
+		if (ret != LZMA_OK) {
+			lzma_thread_pool_end(pool, allocator);
+			return NULL;
+		}
+	}
+
+	return pool;
+
+error_cond:
+	mythread_mutex_destroy(&pool->mutex);
+
+error_mutex:
+	lzma_free(pool, allocator);
+	return NULL;
+}
+
+
+extern LZMA_API(void)
+lzma_thread_pool_end(lzma_thread_pool *pool, const lzma_allocator *allocator)
+{
+	if (pool == NULL)
+		return;
+
+	// All streams using the pool have been ended so the queue
+	// is empty and the threads are idle.
+	mythread_sync(pool->mutex) {
+		assert(pool->head == NULL);
+		pool->exiting = true;
+		mythread_cond_signal(&pool->cond);
+	}
+
+	lzma_pool_thread *thr = pool->threads;
+	while (thr != NULL) {
+		lzma_pool_thread *next = thr->next;
+
+		const int ret = mythread_join(thr->thread_id);
+		assert(ret == 0);
+		(void)ret;
+
+		lzma_free(thr, allocator);
+		thr = next;
+	}
+
+	mythread_cond_destroy(&pool->cond);
+	mythread_mutex_destroy(&pool->mutex);
+	lzma_free(pool, allocator);
+	return;
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       thread_pool.h
+/// \brief      Pool of worker threads shared by multithreaded coders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_THREAD_POOL_H
+#define LZMA_THREAD_POOL_H
+
+#include "common.h"
+
+
+/// A unit of work to run in a thread of the pool. The structure is
+/// owned by the caller of lzma_thread_pool_run(). The pool doesn't
+/// touch it after func has been called so func may free it.
+typedef struct lzma_pool_job_s lzma_pool_job;
+struct lzma_pool_job_s {
+	/// Function to call in a thread of the pool
+	void (*func)(void *arg);
+
+	/// Argument for func
+	void *arg;
+
+	/// Next job in the queue. This is used by the pool.
+	lzma_pool_job *next;
+};
+
+
+/// \brief      Run a job in a thread of the pool
+///
+/// The job is queued and run by an idle thread. If no thread is idle,
+/// the job waits until one of the threads has finished its job. Thus
+/// a job must not block waiting for the application to provide more
+/// input. Instead, it has to return and be queued again once there is
+/// something to do.
+///
+/// The job must not be queued again before its func has been called.
+extern void lzma_thread_pool_run(lzma_thread_pool *pool, lzma_pool_job *job);
+
+#endif
@@ -13,15 +13,144 @@
 #include "delta_private.h"
 
 
+#ifdef DELTA_SSE2
+/// Decodes buffer[i] to buffer[size - 1] when the distance is 1, 2, 4,
+/// or 8 and buffer[i - 16] to buffer[i - 1] have already been decoded.
+///
+/// Each 16-byte vector is decoded with a prefix sum: adding the vector
+/// shifted left by distance, 2 * distance, 4 * distance, ... bytes
+/// gives every byte the sum of the earlier bytes in the same vector that
+/// are a multiple of the distance away. What is left is the contribution
+/// of the previous vector, which is its last `distance` bytes repeated.
+///
+/// This is always inlined with a constant distance so that the branches
+/// disappear.
+static inline size_t
+decode_sse2_prefix(uint8_t *buffer, size_t i, size_t size,
+		const size_t distance)
+{
+	__m128i prev = _mm_loadu_si128((const __m128i *)(buffer + i - 16));
+
+	for (; size - i >= 16; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(buffer + i));
+
+		if (distance <= 1)
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+
+		if (distance <= 2)
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+
+		if (distance <= 4)
+			v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+
+		__m128i carry;
+		switch (distance) {
+		case 1:
+			carry = _mm_unpackhi_epi8(prev, prev);
+			carry = _mm_shufflehi_epi16(carry, 0xFF);
+			carry = _mm_shuffle_epi32(carry, 0xFF);
+			break;
+
+		case 2:
+			carry = _mm_shufflehi_epi16(prev, 0xFF);
+			carry = _mm_shuffle_epi32(carry, 0xFF);
+			break;
+
+		case 4:
+			carry = _mm_shuffle_epi32(prev, 0xFF);
+			break;
+
+		default:
+			carry = _mm_unpackhi_epi64(prev, prev);
+			break;
+		}
+
+		prev = _mm_add_epi8(v, carry);
+		_mm_storeu_si128((__m128i *)(buffer + i), prev);
+	}
+
+	return i;
+}
+#endif
+
+
+/// Decodes buffer[distance] to buffer[size - 1] when buffer[0] to
+/// buffer[distance - 1] have already been decoded. history[] isn't
+/// used or updated here.
+static void
+decode_linear(uint8_t *buffer, size_t size, size_t distance)
+{
+	size_t i = distance;
+
+#ifdef DELTA_SSE2
+	if (distance >= 16) {
+		// Every byte of a 16-byte vector depends only on bytes
+		// that were decoded by earlier iterations.
+		for (; size - i >= 16; i += 16) {
+			const __m128i a = _mm_loadu_si128(
+					(const __m128i *)(buffer + i));
+			const __m128i b = _mm_loadu_si128(
+					(const __m128i *)(buffer + i - distance));
+			_mm_storeu_si128((__m128i *)(buffer + i),
+					_mm_add_epi8(a, b));
+		}
+
+	} else if ((distance & (distance - 1)) == 0 && size >= 32) {
+		// The prefix sum needs the previous 16 decoded bytes.
+		for (; i < 16; ++i)
+			buffer[i] += buffer[i - distance];
+
+		switch (distance) {
+		case 1:
+			i = decode_sse2_prefix(buffer, i, size, 1);
+			break;
+
+		case 2:
+			i = decode_sse2_prefix(buffer, i, size, 2);
+			break;
+
+		case 4:
+			i = decode_sse2_prefix(buffer, i, size, 4);
+			break;
+
+		default:
+			i = decode_sse2_prefix(buffer, i, size, 8);
+			break;
+		}
+	}
+#endif
+
+	for (; i < size; ++i)
+		buffer[i] += buffer[i - distance];
+
+	return;
+}
+
+
 static void
 decode_buffer(lzma_delta_coder *coder, uint8_t *buffer, size_t size)
 {
 	const size_t distance = coder->distance;
 
-	for (size_t i = 0; i < size; ++i) {
+	// The first `distance` bytes depend on the history from
+	// the previous call.
+	const size_t head = my_min(size, distance);
+
+	for (size_t i = 0; i < head; ++i) {
 		buffer[i] += coder->history[(distance + coder->pos) & 0xFF];
 		coder->history[coder->pos-- & 0xFF] = buffer[i];
 	}
+
+	// The rest only depend on the bytes that have already been
+	// decoded in buffer[] so history[] isn't needed for them.
+	if (size > distance) {
+		decode_linear(buffer, size, distance);
+		delta_history_save(coder, buffer + size, size - distance);
+	}
+
+	return;
 }
 
 
@@ -13,6 +13,30 @@
 #include "delta_private.h"
 
 
+/// Encodes out[distance] to out[size - 1]. The input bytes in[0] to
+/// in[size - 1] must not be modified while this runs. history[] isn't
+/// used or updated here.
+static void
+encode_linear(const uint8_t *in, uint8_t *out, size_t size, size_t distance)
+{
+	size_t i = distance;
+
+#ifdef DELTA_SSE2
+	for (; size - i >= 16; i += 16) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)(in + i));
+		const __m128i b = _mm_loadu_si128(
+				(const __m128i *)(in + i - distance));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_sub_epi8(a, b));
+	}
+#endif
+
+	for (; i < size; ++i)
+		out[i] = in[i] - in[i - distance];
+
+	return;
+}
+
+
 /// Copies and encodes the data at the same time. This is used when Delta
 /// is the first filter in the chain (and thus the last filter in the
 /// encoder's filter stack).
@@ -21,13 +45,19 @@ copy_and_encode(lzma_delta_coder *coder,
 		const uint8_t *restrict in, uint8_t *restrict out, size_t size)
 {
 	const size_t distance = coder->distance;
+	const size_t head = my_min(size, distance);
 
-	for (size_t i = 0; i < size; ++i) {
+	for (size_t i = 0; i < head; ++i) {
 		const uint8_t tmp = coder->history[
 				(distance + coder->pos) & 0xFF];
 		coder->history[coder->pos-- & 0xFF] = in[i];
 		out[i] = in[i] - tmp;
 	}
+
+	if (size > distance) {
+		encode_linear(in, out, size, distance);
+		delta_history_save(coder, in + size, size - distance);
+	}
 }
 
 
@@ -38,12 +68,46 @@ encode_in_place(lzma_delta_coder *coder, uint8_t *buffer, size_t size)
 {
 	const size_t distance = coder->distance;
 
-	for (size_t i = 0; i < size; ++i) {
+	// The end of the buffer gets overwritten below but its original
+	// contents are needed as the history for the next call.
+	uint8_t tail[LZMA_DELTA_DIST_MAX];
+	if (size > distance) {
+		memcpy(tail, buffer + size - distance, distance);
+
+		// Encode from the end towards the beginning so that
+		// the bytes that are still needed as input haven't been
+		// overwritten yet.
+		size_t i = size;
+
+#ifdef DELTA_SSE2
+		while (i - distance >= 16) {
+			i -= 16;
+			const __m128i a = _mm_loadu_si128(
+					(const __m128i *)(buffer + i));
+			const __m128i b = _mm_loadu_si128(
+					(const __m128i *)(buffer + i - distance));
+			_mm_storeu_si128((__m128i *)(buffer + i),
+					_mm_sub_epi8(a, b));
+		}
+#endif
+
+		while (i > distance) {
+			--i;
+			buffer[i] -= buffer[i - distance];
+		}
+	}
+
+	const size_t head = my_min(size, distance);
+
+	for (size_t i = 0; i < head; ++i) {
 		const uint8_t tmp = coder->history[
 				(distance + coder->pos) & 0xFF];
 		coder->history[coder->pos-- & 0xFF] = buffer[i];
 		buffer[i] -= tmp;
 	}
+
+	if (size > distance)
+		delta_history_save(coder, tail + distance, size - distance);
 }
 
 
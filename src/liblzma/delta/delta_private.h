@@ -14,6 +14,18 @@
 
 #include "delta_common.h"
 
+// SSE2 is used to process 16 bytes at a time. It's always available
+// on x86-64 so there is no need for runtime detection there. On 32-bit
+// x86 it's used if the compiler has been told that SSE2 is available.
+// GCC and Clang define __SSE2__ in both cases. The MSVC macros are
+// checked like in memcmplen.h.
+#if defined(__SSE2__) \
+		|| (defined(_MSC_VER) && (defined(_M_X64) \
+			|| (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#	define DELTA_SSE2 1
+#	include <emmintrin.h>
+#endif
+
 typedef struct {
 	/// Next coder in the chain
 	lzma_next_coder next;
@@ -29,6 +41,30 @@ typedef struct {
 } lzma_delta_coder;
 
 
+/// \brief      Update history[] after a linear pass over a buffer
+///
+/// The scalar loops store every byte into history[] but the faster loops
+/// only look at the buffer itself. Only the last `distance` bytes are
+/// ever read from history[], so it's enough to store those and to move
+/// `pos` as if all `count` bytes had been stored one by one.
+///
+/// \param      coder   Delta coder
+/// \param      end     Pointer to one past the last byte. At least
+///                     coder->distance bytes before it must be readable.
+/// \param      count   Number of bytes that haven't been stored into
+///                     history[] yet
+static inline void
+delta_history_save(lzma_delta_coder *coder, const uint8_t *end, size_t count)
+{
+	coder->pos = (uint8_t)(coder->pos - count);
+
+	for (size_t i = 1; i <= coder->distance; ++i)
+		coder->history[(coder->pos + i) & 0xFF] = *(end - i);
+
+	return;
+}
+
+
 extern lzma_ret lzma_delta_coder_init(
 		lzma_next_coder *next, const lzma_allocator *allocator,
 		const lzma_filter_info *filters);
@@ -35,6 +35,18 @@
 /// LZMA's longest match length is 273 so pick a multiple of 16 above that.
 #define LZ_DICT_REPEAT_MAX 288
 
+/// dict_repeat() copies in 8- or 16-byte units and may write up to
+/// LZ_DICT_COPY_EXTRA - 1 bytes past the end of the match. Those bytes
+/// are either beyond dict->pos where they will be overwritten before
+/// they are used, or in the LZ_DICT_COPY_EXTRA bytes that are allocated
+/// after dict->size.
+///
+/// The bytes after dict->pos are never part of the history: the history
+/// is at most dict->size - 2 * LZ_DICT_REPEAT_MAX bytes and it ends at
+/// dict->pos, so the first LZ_DICT_REPEAT_MAX bytes after dict->pos are
+/// older than that.
+#define LZ_DICT_COPY_EXTRA 16
+
 
 typedef struct {
 	/// Pointer to the dictionary buffer.
@@ -156,6 +168,70 @@ dict_is_distance_valid(const lzma_dict *const dict, const size_t distance)
 }
 
 
+#ifndef HAVE_SMALL
+/// \brief      Copy a match that may overlap its source
+///
+/// Copy len bytes from dst - dist to dst in the same order as a byte
+/// by byte loop would do it, so dist < len repeats the last dist bytes.
+/// If dist is at least LZ_DICT_REPEAT_MAX, src may also point after dst
+/// (the source has wrapped around the end of the dictionary buffer).
+///
+/// This may read and write up to LZ_DICT_COPY_EXTRA - 1 bytes past
+/// the end of the match.
+static inline void
+dict_copy_match(uint8_t *dst, const uint8_t *src, size_t dist, size_t len)
+{
+	uint8_t *const end = dst + len;
+
+	if (dist >= 16) {
+		// Each 16-byte unit reads only bytes that have been
+		// written by the previous units or that were there before.
+		do {
+			memcpy(dst, src, 16);
+			dst += 16;
+			src += 16;
+		} while (dst < end);
+
+		return;
+	}
+
+	if (dist < 8) {
+		// Write the first eight bytes. The first four are copied
+		// one at a time since they may overlap their source.
+		// The next four are copied from src + inc4[dist] which
+		// has the same bytes as src + 4 because inc4[dist] and
+		// 4 are equal modulo dist, and which ends at or before
+		// dst + 4 so the copy doesn't overlap.
+		//
+		// After that the source can be moved to the smallest
+		// multiple of dist that is at least eight bytes behind.
+		static const uint8_t inc4[8] = { 0, 1, 2, 1, 4, 4, 4, 4 };
+		static const uint8_t mul8[8] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = src[3];
+		memcpy(dst + 4, src + inc4[dist], 4);
+		dst += 8;
+		src = dst - mul8[dist];
+
+		if (dst >= end)
+			return;
+	}
+
+	// Now the distance is at least eight.
+	do {
+		memcpy(dst, src, 8);
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+
+	return;
+}
+#endif
+
+
 /// Repeat *len bytes at distance.
 static inline bool
 dict_repeat(lzma_dict *dict, uint32_t distance, uint32_t *len)
@@ -169,6 +245,19 @@ dict_repeat(lzma_dict *dict, uint32_t distance, uint32_t *len)
 	if (distance >= dict->pos)
 		back += dict->size - LZ_DICT_REPEAT_MAX;
 
+#ifndef HAVE_SMALL
+	// Use wide copies that may overshoot the end of the match.
+	// This avoids a byte by byte loop also with the short
+	// overlapping matches that are common in text.
+	//
+	// If the match is empty because the dictionary is full,
+	// nothing may be written: dict->pos may equal dict->size.
+	if (left > 0) {
+		dict_copy_match(dict->buf + dict->pos, dict->buf + back,
+				(size_t)(distance) + 1, left);
+		dict->pos += left;
+	}
+#else
 	// Repeat a block of data from the history. Because memcpy() is faster
 	// than copying byte by byte in a loop, the copying process gets split
 	// into two cases.
@@ -182,6 +271,7 @@ dict_repeat(lzma_dict *dict, uint32_t distance, uint32_t *len)
 		memcpy(dict->buf + dict->pos, dict->buf + back, left);
 		dict->pos += left;
 	}
+#endif
 
 	// Update how full the dictionary is.
 	if (!dict->has_wrapped)
@@ -267,6 +267,12 @@ lz_encoder_prepare(lzma_mf *mf, const lzma_allocator *allocator,
 		mf->skip = &lzma_mf_hc4_skip;
 		break;
 #endif
+#ifdef HAVE_MF_HC5
+	case LZMA_MF_HC5:
+		mf->find = &lzma_mf_hc5_find;
+		mf->skip = &lzma_mf_hc5_skip;
+		break;
+#endif
 #ifdef HAVE_MF_BT2
 	case LZMA_MF_BT2:
 		mf->find = &lzma_mf_bt2_find;
@@ -285,6 +291,12 @@ lz_encoder_prepare(lzma_mf *mf, const lzma_allocator *allocator,
 		mf->skip = &lzma_mf_bt4_skip;
 		break;
 #endif
+#ifdef HAVE_MF_BT5
+	case LZMA_MF_BT5:
+		mf->find = &lzma_mf_bt5_find;
+		mf->skip = &lzma_mf_bt5_skip;
+		break;
+#endif
 
 	default:
 		return true;
@@ -332,7 +344,8 @@ lz_encoder_prepare(lzma_mf *mf, const lzma_allocator *allocator,
 	if (hash_bytes > 3)
 		hs += HASH_3_SIZE;
 /*
-	No match finder uses this at the moment.
+	No match finder uses this at the moment. HC5 and BT5 have
+	the same 2- and 3-byte hashes as HC4 and BT4 but no 4-byte hash.
 	if (mf->hash_bytes > 4)
 		hs += HASH_4_SIZE;
 */
@@ -392,7 +405,32 @@ lz_encoder_init(lzma_mf *mf, const lzma_allocator *allocator,
 	// avoiding a few branches in the match finders. The downside is
 	// that match finder needs to be normalized more often, which may
 	// hurt performance with huge dictionaries.
-	mf->offset = mf->cyclic_size;
+	//
+	// If the hash arrays are kept from the previous initialization,
+	// their contents don't need to be cleared. The match finders
+	// ignore positions that are cyclic_size or more bytes behind the
+	// current position, so it's enough to continue from a position
+	// that is at least cyclic_size bytes after everything that has
+	// been stored in the arrays. This way resetting the encoder for
+	// a new Block doesn't need to touch the whole hash table which
+	// can be tens of megabytes. The old positions are cleared
+	// normally when the arrays are normalized. If there isn't enough
+	// room before the normalization point, the arrays are cleared.
+	bool clear_hash = true;
+
+	if (mf->hash == NULL) {
+		mf->offset = mf->cyclic_size;
+	} else {
+		const uint64_t offset = (uint64_t)(mf->offset)
+				+ mf->read_pos + mf->cyclic_size;
+		if (offset < UINT32_MAX) {
+			mf->offset = (uint32_t)(offset);
+			clear_hash = false;
+		} else {
+			mf->offset = mf->cyclic_size;
+		}
+	}
+
 	mf->read_pos = 0;
 	mf->read_ahead = 0;
 	mf->read_limit = 0;
@@ -432,7 +470,7 @@ lz_encoder_init(lzma_mf *mf, const lzma_allocator *allocator,
 
 			return true;
 		}
-	} else {
+	} else if (clear_hash) {
 /*
 		for (uint32_t i = 0; i < mf->hash_count; ++i)
 			mf->hash[i] = EMPTY_HASH_VALUE;
@@ -614,6 +652,10 @@ lzma_mf_is_supported(lzma_match_finder mf)
 	case LZMA_MF_HC4:
 		return true;
 #endif
+#ifdef HAVE_MF_HC5
+	case LZMA_MF_HC5:
+		return true;
+#endif
 #ifdef HAVE_MF_BT2
 	case LZMA_MF_BT2:
 		return true;
@@ -625,6 +667,10 @@ lzma_mf_is_supported(lzma_match_finder mf)
 #ifdef HAVE_MF_BT4
 	case LZMA_MF_BT4:
 		return true;
+#endif
+#ifdef HAVE_MF_BT5
+	case LZMA_MF_BT5:
+		return true;
 #endif
 	default:
 		return false;
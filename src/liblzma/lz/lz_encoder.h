@@ -340,6 +340,9 @@ extern void lzma_mf_hc3_skip(lzma_mf *dict, uint32_t amount);
 extern uint32_t lzma_mf_hc4_find(lzma_mf *dict, lzma_match *matches);
 extern void lzma_mf_hc4_skip(lzma_mf *dict, uint32_t amount);
 
+extern uint32_t lzma_mf_hc5_find(lzma_mf *dict, lzma_match *matches);
+extern void lzma_mf_hc5_skip(lzma_mf *dict, uint32_t amount);
+
 extern uint32_t lzma_mf_bt2_find(lzma_mf *dict, lzma_match *matches);
 extern void lzma_mf_bt2_skip(lzma_mf *dict, uint32_t amount);
 
@@ -349,4 +352,7 @@ extern void lzma_mf_bt3_skip(lzma_mf *dict, uint32_t amount);
 extern uint32_t lzma_mf_bt4_find(lzma_mf *dict, lzma_match *matches);
 extern void lzma_mf_bt4_skip(lzma_mf *dict, uint32_t amount);
 
+extern uint32_t lzma_mf_bt5_find(lzma_mf *dict, lzma_match *matches);
+extern void lzma_mf_bt5_skip(lzma_mf *dict, uint32_t amount);
+
 #endif
@@ -74,20 +74,19 @@
 	const uint32_t hash_value = (temp ^ ((uint32_t)(cur[2]) << 8) \
 			^ (hash_table[cur[3]] << 5)) & mf->hash_mask
 
-
-// The following are not currently used.
-
+// HC5 and BT5 use the same 2- and 3-byte hashes as HC4 and BT4 but
+// there is no separate 4-byte hash. The main hash covers five bytes.
 #define hash_5_calc() \
 	const uint32_t temp = hash_table[cur[0]] ^ cur[1]; \
 	const uint32_t hash_2_value = temp & HASH_2_MASK; \
 	const uint32_t hash_3_value \
 			= (temp ^ ((uint32_t)(cur[2]) << 8)) & HASH_3_MASK; \
-	uint32_t hash_4_value = (temp ^ ((uint32_t)(cur[2]) << 8) ^ \
-			^ hash_table[cur[3]] << 5); \
-	const uint32_t hash_value \
-			= (hash_4_value ^ (hash_table[cur[4]] << 3)) \
-				& mf->hash_mask; \
-	hash_4_value &= HASH_4_MASK
+	const uint32_t hash_value = (temp ^ ((uint32_t)(cur[2]) << 8) \
+			^ (hash_table[cur[3]] << 5) \
+			^ (hash_table[cur[4]] << 3)) & mf->hash_mask
+
+
+// The following are not currently used.
 
 /*
 #define hash_zip_calc() \
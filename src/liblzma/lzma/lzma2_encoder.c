@@ -12,15 +12,103 @@
 
 #include "lz_encoder.h"
 #include "lzma_encoder.h"
+#include "lzma_common.h"
 #include "fastpos.h"
+#include "price.h"
+#include "memcmplen.h"
 #include "lzma2_encoder.h"
 
 
+/// Number of bytes that are looked at when deciding if a chunk should be
+/// stored without trying to compress it. While a chunk is being stored,
+/// the next PROBE_SIZE bytes are looked at again every PROBE_SIZE bytes.
+#define PROBE_SIZE 4096
+
+/// When storing a chunk without compressing it, the match finder is asked
+/// for matches once every PROBE_INTERVAL bytes. If a long match is found,
+/// the data isn't random after all (for example, a second copy of
+/// a compressed file) and the chunk is ended early.
+#define PROBE_INTERVAL 32
+
+/// A match at least this long ends a chunk that is being stored
+#define PROBE_MATCH_LEN 32
+
+/// Number of bytes that are looked at when choosing lc, lp, or pb that
+/// is LZMA_LCLPPB_AUTO
+#define AUTO_SAMPLE_SIZE (UINT32_C(1) << 16)
+
+/// After this many uncompressed bytes in the same LZMA2 stream, lc, lp,
+/// and pb that are LZMA_LCLPPB_AUTO are chosen again from the data that
+/// follows. Changing them needs a state reset which costs some output
+/// while the probabilities adapt again.
+#define AUTO_INTERVAL (UINT32_C(1) << 20)
+
+/// Size of the hash table used by the first pass as a power of two
+#define AUTO_HASH_BITS 12
+
+/// The current values (the defaults at the start of the stream) are
+/// replaced only if the estimated price with the best lc/lp/pb is smaller
+/// by at least 1 / 2^AUTO_MARGIN_SHIFT. The first pass
+/// finds fewer matches than the LZMA encoder, which exaggerates the
+/// differences between the candidates a lot.
+#define AUTO_MARGIN_SHIFT 4
+
+
+/// Type of each byte in the sample after the first pass
+enum {
+	AUTO_COVERED,         ///< Part of a match but not the first byte
+	AUTO_MATCH,           ///< First byte of a match
+	AUTO_LITERAL,         ///< Literal after a literal
+	AUTO_MATCHED_LITERAL, ///< Literal after a match
+};
+
+
+/// Data for choosing lc, lp, and pb from the uncompressed data
+///
+/// The start of the data is parsed once with a greedy parser that looks
+/// for matches at the repeated distances and at the latest position
+/// with the same hash. The literals and matches found in this first pass
+/// are then priced with adaptive probabilities like the LZMA encoder
+/// would do it, once for each candidate value. The literals depend on
+/// lc and lp, the literal/match decisions and match lengths on pb.
+typedef struct {
+	/// lc, lp, and pb as given in the options. The ones that are
+	/// LZMA_LCLPPB_AUTO are chosen before the first LZMA chunk
+	/// that has properties and again every AUTO_INTERVAL bytes.
+	uint32_t lc;
+	uint32_t lp;
+	uint32_t pb;
+
+	/// Uncompressed bytes left until the values are chosen again
+	uint32_t interval_left;
+
+	/// Byte types from the first pass
+	uint8_t type[AUTO_SAMPLE_SIZE];
+
+	/// The byte at rep0 for each AUTO_MATCHED_LITERAL
+	uint8_t match_byte[AUTO_SAMPLE_SIZE];
+
+	/// Position + 1 of the latest three bytes with each hash value;
+	/// zero means none.
+	uint32_t hash[1 << AUTO_HASH_BITS];
+
+	/// Probabilities for pricing the candidates
+	probability literal[LITERAL_CODERS_MAX * LITERAL_CODER_SIZE];
+	probability is_match[2][POS_STATES_MAX];
+	probability len_choice;
+	probability len_choice2;
+	probability len_low[POS_STATES_MAX][LEN_LOW_SYMBOLS];
+	probability len_mid[POS_STATES_MAX][LEN_MID_SYMBOLS];
+	probability len_high[LEN_HIGH_SYMBOLS];
+} lzma_lclppb_auto;
+
+
 typedef struct {
 	enum {
 		SEQ_INIT,
 		SEQ_LZMA_ENCODE,
 		SEQ_LZMA_COPY,
+		SEQ_UNCOMPRESSED_SKIP,
 		SEQ_UNCOMPRESSED_HEADER,
 		SEQ_UNCOMPRESSED_COPY,
 	} sequence;
@@ -31,13 +119,29 @@ typedef struct {
 	/// LZMA options currently in use.
 	lzma_options_lzma opt_cur;
 
+	/// Used when lc, lp, or pb is LZMA_LCLPPB_AUTO; otherwise NULL
+	lzma_lclppb_auto *lclppb_auto;
+
 	bool need_properties;
 	bool need_state_reset;
 	bool need_dictionary_reset;
 
+	/// True if a stored chunk was ended because a long match was found.
+	/// The next chunk is then given to the LZMA encoder even if the data
+	/// looks random.
+	bool match_found;
+
 	/// Uncompressed size of a chunk
 	size_t uncompressed_size;
 
+	/// When storing a chunk without compressing it, the data is checked
+	/// again when uncompressed_size reaches this value.
+	size_t probe_next;
+
+	/// If non-zero, the current chunk is ended after this many
+	/// uncompressed bytes so that lc/lp/pb can be changed after it.
+	uint32_t uncompressed_end;
+
 	/// Compressed size of a chunk (excluding headers); this is also used
 	/// to indicate the end of buf[] in SEQ_LZMA_COPY.
 	size_t compressed_size;
@@ -45,11 +149,28 @@ typedef struct {
 	/// Read position in buf[]
 	size_t buf_pos;
 
+	/// Match finder output when checking data that is being stored
+	/// without compression
+	lzma_match matches[MATCH_LEN_MAX + 1];
+
 	/// Buffer to hold the chunk header and LZMA compressed data
 	uint8_t buf[LZMA2_HEADER_MAX + LZMA2_CHUNK_MAX];
 } lzma_lzma2_coder;
 
 
+/// Counts the uncompressed bytes of a finished chunk towards the next
+/// time that lc/lp/pb are chosen.
+static void
+lclppb_interval_update(lzma_lclppb_auto *a, size_t size)
+{
+	if (a != NULL)
+		a->interval_left = size < a->interval_left
+				? a->interval_left - (uint32_t)(size) : 0;
+
+	return;
+}
+
+
 static void
 lzma2_header_lzma(lzma_lzma2_coder *coder)
 {
@@ -98,6 +219,8 @@ lzma2_header_lzma(lzma_lzma2_coder *coder)
 	coder->need_state_reset = false;
 	coder->need_dictionary_reset = false;
 
+	lclppb_interval_update(coder->lclppb_auto, coder->uncompressed_size);
+
 	// The copying code uses coder->compressed_size to indicate the end
 	// of coder->buf[], so we need add the maximum size of the header here.
 	coder->compressed_size += LZMA2_HEADER_MAX;
@@ -121,6 +244,8 @@ lzma2_header_uncompressed(lzma_lzma2_coder *coder)
 
 	coder->need_dictionary_reset = false;
 
+	lclppb_interval_update(coder->lclppb_auto, coder->uncompressed_size);
+
 	// "Compressed" size
 	coder->buf[1] = (coder->uncompressed_size - 1) >> 8;
 	coder->buf[2] = (coder->uncompressed_size - 1) & 0xFF;
@@ -131,6 +256,521 @@ lzma2_header_uncompressed(lzma_lzma2_coder *coder)
 }
 
 
+/// Returns true if the next bytes in the dictionary look random. Then it's
+/// not worth running the LZMA encoder on them since the chunk would end up
+/// being stored uncompressed anyway. The distribution of the byte values
+/// is compared to the uniform distribution using the chi-squared statistic.
+/// Its expected value is 255 for random data. Compressed file formats
+/// commonly give values up to a few hundred. Data that LZMA can compress
+/// clearly gives much higher values.
+static bool
+is_incompressible(const lzma_mf *mf)
+{
+	// If there's only a little input, let the LZMA encoder
+	// have a look at it.
+	const uint32_t avail = mf_avail(mf);
+	if (avail < PROBE_SIZE)
+		return false;
+
+	const uint8_t *buf = mf_ptr(mf);
+	uint32_t counts[256];
+	memzero(counts, sizeof(counts));
+
+	for (size_t i = 0; i < PROBE_SIZE; ++i)
+		++counts[buf[i]];
+
+	uint64_t sum = 0;
+	for (size_t i = 0; i < 256; ++i)
+		sum += (uint64_t)(counts[i]) * counts[i];
+
+	// chi^2 = 256 * sum / PROBE_SIZE - PROBE_SIZE <= 3 * 256
+	return sum * 256 <= (uint64_t)(PROBE_SIZE) * (PROBE_SIZE + 3 * 256);
+}
+
+
+static inline bool
+is_lclppb_auto(uint32_t lc, uint32_t lp, uint32_t pb)
+{
+	return lc == LZMA_LCLPPB_AUTO || lp == LZMA_LCLPPB_AUTO
+			|| pb == LZMA_LCLPPB_AUTO;
+}
+
+
+/// Replaces LZMA_LCLPPB_AUTO in lc, lp, and pb with the default values.
+/// lc is lowered if needed to keep lc + lp valid.
+static void
+lclppb_set_defaults(lzma_options_lzma *opt)
+{
+	if (opt->lp == LZMA_LCLPPB_AUTO)
+		opt->lp = LZMA_LP_DEFAULT;
+
+	if (opt->lc == LZMA_LCLPPB_AUTO)
+		opt->lc = opt->lp <= LZMA_LCLP_MAX
+				? my_min(LZMA_LC_DEFAULT,
+					LZMA_LCLP_MAX - opt->lp)
+				: LZMA_LC_DEFAULT;
+
+	if (opt->pb == LZMA_LCLPPB_AUTO)
+		opt->pb = LZMA_PB_DEFAULT;
+
+	return;
+}
+
+
+/// Returns the price of encoding the bit and updates the probability
+/// like the range encoder does.
+static inline uint32_t
+auto_bit(probability *prob, uint32_t bit)
+{
+	const uint32_t price = rc_bit_price(*prob, bit);
+
+	if (bit == 0)
+		*prob += (RC_BIT_MODEL_TOTAL - *prob) >> RC_MOVE_BITS;
+	else
+		*prob -= *prob >> RC_MOVE_BITS;
+
+	return price;
+}
+
+
+static inline uint32_t
+auto_bittree(probability *probs, uint32_t bit_levels, uint32_t symbol)
+{
+	uint32_t price = 0;
+	uint32_t model_index = 1;
+
+	do {
+		const uint32_t bit = (symbol >> --bit_levels) & 1;
+		price += auto_bit(&probs[model_index], bit);
+		model_index = (model_index << 1) + bit;
+	} while (bit_levels != 0);
+
+	return price;
+}
+
+
+static inline uint32_t
+auto_hash(const uint8_t *buf)
+{
+	const uint32_t value = (uint32_t)(buf[0])
+			| ((uint32_t)(buf[1]) << 8)
+			| ((uint32_t)(buf[2]) << 16);
+	return (value * UINT32_C(0x9E3779B1)) >> (32 - AUTO_HASH_BITS);
+}
+
+
+/// Parses buf[0] to buf[size - 1] greedily and stores the byte types
+/// to a->type[].
+static void
+auto_first_pass(lzma_lclppb_auto *a, const uint8_t *buf, uint32_t size)
+{
+	memzero(a->hash, sizeof(a->hash));
+
+	uint32_t reps[REPS] = { 1, 1, 1, 1 };
+	bool after_match = false;
+	uint32_t pos = 0;
+
+	while (pos < size) {
+		const uint32_t limit = my_min(size - pos, MATCH_LEN_MAX);
+		uint32_t len = 0;
+		uint32_t dist = 0;
+		uint32_t rep_index = REPS - 1;
+
+		// Repeated distances are cheap so they are preferred
+		// like in the LZMA encoder.
+		for (uint32_t i = 0; i < REPS && limit >= MATCH_LEN_MIN; ++i) {
+			if (reps[i] > pos)
+				continue;
+
+			const uint32_t rep_len = lzma_memcmplen(buf + pos,
+					buf + pos - reps[i], 0, limit);
+			if (rep_len >= MATCH_LEN_MIN && rep_len > len) {
+				len = rep_len;
+				dist = reps[i];
+				rep_index = i;
+			}
+		}
+
+		if (limit >= 3) {
+			const uint32_t hash_value = auto_hash(buf + pos);
+			const uint32_t cur = a->hash[hash_value];
+			a->hash[hash_value] = pos + 1;
+
+			if (cur != 0) {
+				const uint32_t match_dist = pos + 1 - cur;
+				const uint32_t match_len = lzma_memcmplen(
+						buf + pos, buf + cur - 1,
+						0, limit);
+
+				// A three-byte match with a big distance
+				// would cost more than the literals.
+				if (match_len >= 3 && match_len > len + 1
+						&& (match_len > 3
+							|| match_dist < 0x80)) {
+					len = match_len;
+					dist = match_dist;
+					rep_index = REPS - 1;
+				}
+			}
+		}
+
+		if (len == 0) {
+			if (after_match) {
+				a->type[pos] = AUTO_MATCHED_LITERAL;
+				a->match_byte[pos] = buf[pos - reps[0]];
+				after_match = false;
+			} else {
+				a->type[pos] = AUTO_LITERAL;
+			}
+
+			++pos;
+			continue;
+		}
+
+		// Move the distance to the front. A new distance
+		// drops the oldest one.
+		for (uint32_t i = rep_index; i > 0; --i)
+			reps[i] = reps[i - 1];
+
+		reps[0] = dist;
+
+		a->type[pos] = AUTO_MATCH;
+		memset(a->type + pos + 1, AUTO_COVERED, len - 1);
+
+		for (uint32_t i = pos + 1; i < pos + len && i + 3 <= size; ++i)
+			a->hash[auto_hash(buf + i)] = i + 1;
+
+		pos += len;
+		after_match = true;
+	}
+
+	return;
+}
+
+
+/// Returns the price of the literals from the first pass with lc and lp.
+/// If reset is false, the probabilities from the previous call with the
+/// same lc and lp are used as is.
+static uint64_t
+auto_literal_price(lzma_lclppb_auto *a, const uint8_t *buf, uint32_t size,
+		uint32_t lc, uint32_t lp, bool reset)
+{
+	if (reset)
+		literal_init(a->literal, lc, lp);
+
+	const uint32_t literal_mask = literal_mask_calc(lc, lp);
+	uint64_t price = 0;
+
+	for (uint32_t pos = 0; pos < size; ++pos) {
+		if (a->type[pos] < AUTO_LITERAL)
+			continue;
+
+		probability *subcoder = literal_subcoder(a->literal, lc,
+				literal_mask, pos, pos == 0 ? 0 : buf[pos - 1]);
+
+		if (a->type[pos] == AUTO_LITERAL) {
+			price += auto_bittree(subcoder, 8, buf[pos]);
+			continue;
+		}
+
+		// This is like literal_matched() in lzma_encoder.c.
+		uint32_t match_byte = a->match_byte[pos];
+		uint32_t symbol = buf[pos] + (UINT32_C(1) << 8);
+		uint32_t offset = 0x100;
+
+		do {
+			match_byte <<= 1;
+			const uint32_t match_bit = match_byte & offset;
+			const uint32_t subcoder_index
+					= offset + match_bit + (symbol >> 8);
+			const uint32_t bit = (symbol >> 7) & 1;
+			price += auto_bit(&subcoder[subcoder_index], bit);
+
+			symbol <<= 1;
+			offset &= ~(match_byte ^ symbol);
+
+		} while (symbol < (UINT32_C(1) << 16));
+	}
+
+	return price;
+}
+
+
+/// Returns the price of the literal/match decisions and the match lengths
+/// from the first pass with pb. If reset is false, the probabilities from
+/// the previous call with the same pb are used as is.
+static uint64_t
+auto_match_price(lzma_lclppb_auto *a, uint32_t size, uint32_t pb, bool reset)
+{
+	const uint32_t pos_mask = (UINT32_C(1) << pb) - 1;
+
+	if (reset) {
+		for (uint32_t i = 0; i < 2; ++i)
+			for (uint32_t j = 0; j <= pos_mask; ++j)
+				bit_reset(a->is_match[i][j]);
+
+		bit_reset(a->len_choice);
+		bit_reset(a->len_choice2);
+
+		for (uint32_t i = 0; i <= pos_mask; ++i) {
+			bittree_reset(a->len_low[i], LEN_LOW_BITS);
+			bittree_reset(a->len_mid[i], LEN_MID_BITS);
+		}
+
+		bittree_reset(a->len_high, LEN_HIGH_BITS);
+	}
+
+	uint64_t price = 0;
+	uint32_t after_match = 0;
+	uint32_t pos = 0;
+
+	while (pos < size) {
+		const uint32_t pos_state = pos & pos_mask;
+		probability *is_match = &a->is_match[after_match][pos_state];
+
+		if (a->type[pos] != AUTO_MATCH) {
+			price += auto_bit(is_match, 0);
+			after_match = 0;
+			++pos;
+			continue;
+		}
+
+		price += auto_bit(is_match, 1);
+
+		uint32_t len = 1;
+		while (pos + len < size && a->type[pos + len] == AUTO_COVERED)
+			++len;
+
+		// This is like length() in lzma_encoder.c.
+		uint32_t symbol = len - MATCH_LEN_MIN;
+		if (symbol < LEN_LOW_SYMBOLS) {
+			price += auto_bit(&a->len_choice, 0);
+			price += auto_bittree(a->len_low[pos_state],
+					LEN_LOW_BITS, symbol);
+		} else {
+			price += auto_bit(&a->len_choice, 1);
+			symbol -= LEN_LOW_SYMBOLS;
+
+			if (symbol < LEN_MID_SYMBOLS) {
+				price += auto_bit(&a->len_choice2, 0);
+				price += auto_bittree(a->len_mid[pos_state],
+						LEN_MID_BITS, symbol);
+			} else {
+				price += auto_bit(&a->len_choice2, 1);
+				price += auto_bittree(a->len_high,
+						LEN_HIGH_BITS,
+						symbol - LEN_MID_SYMBOLS);
+			}
+		}
+
+		after_match = 1;
+		pos += len;
+	}
+
+	return price;
+}
+
+
+/// Estimates the best values for lc, lp, and pb that are LZMA_LCLPPB_AUTO
+/// in *a from the size bytes in buf. The current values in *opt are kept
+/// unless the estimate for the best values is clearly better. If warm is
+/// true, the LZMA encoder has already adapted its probabilities to the
+/// current values and changing them would need an extra state reset.
+/// Returns true if the values in *opt were changed.
+static bool
+lclppb_estimate(lzma_lclppb_auto *a, const uint8_t *buf, uint32_t size,
+		lzma_options_lzma *opt, bool warm)
+{
+	// Too little data tells nothing about the best values.
+	if (size < PROBE_SIZE)
+		return false;
+
+	auto_first_pass(a, buf, size);
+
+	const uint32_t pb_min = a->pb == LZMA_LCLPPB_AUTO
+			? LZMA_PB_MIN : a->pb;
+	const uint32_t pb_max = a->pb == LZMA_LCLPPB_AUTO
+			? LZMA_PB_MAX : a->pb;
+	const uint32_t lc_min = a->lc == LZMA_LCLPPB_AUTO
+			? LZMA_LCLP_MIN : a->lc;
+	const uint32_t lc_max = a->lc == LZMA_LCLPPB_AUTO
+			? LZMA_LCLP_MAX : a->lc;
+	const uint32_t lp_min = a->lp == LZMA_LCLPPB_AUTO
+			? LZMA_LCLP_MIN : a->lp;
+	const uint32_t lp_max = a->lp == LZMA_LCLPPB_AUTO
+			? LZMA_LCLP_MAX : a->lp;
+
+	uint64_t current_price = 0;
+	uint64_t best_price = UINT64_MAX;
+	uint32_t best_pb = opt->pb;
+
+	for (uint32_t pb = pb_min; pb <= pb_max; ++pb) {
+		const uint64_t price = auto_match_price(a, size, pb, true);
+
+		if (pb == opt->pb)
+			current_price = price;
+
+		if (price < best_price) {
+			best_price = price;
+			best_pb = pb;
+		}
+	}
+
+	// The literal and match prices are independent of each
+	// other so they can be minimized separately.
+	const uint64_t match_price = best_price;
+	best_price = UINT64_MAX;
+	uint32_t best_lc = opt->lc;
+	uint32_t best_lp = opt->lp;
+
+	for (uint32_t lc = lc_min; lc <= lc_max; ++lc)
+	for (uint32_t lp = lp_min; lp <= lp_max; ++lp) {
+		if (lc + lp > LZMA_LCLP_MAX)
+			continue;
+
+		const uint64_t price = auto_literal_price(
+				a, buf, size, lc, lp, true);
+
+		if (lc == opt->lc && lp == opt->lp)
+			current_price += price;
+
+		if (price < best_price) {
+			best_price = price;
+			best_lc = lc;
+			best_lp = lp;
+		}
+	}
+
+	best_price += match_price;
+
+	// The state reset costs about as much as the probabilities gain
+	// when they adapt to the data. Charge it by pricing the current
+	// values a second time with the probabilities that have already
+	// adapted to the sample. The new values start from the initial
+	// probabilities.
+	if (warm) {
+		auto_match_price(a, size, opt->pb, true);
+		current_price = auto_match_price(a, size, opt->pb, false);
+
+		auto_literal_price(a, buf, size, opt->lc, opt->lp, true);
+		current_price += auto_literal_price(
+				a, buf, size, opt->lc, opt->lp, false);
+	}
+
+	if (best_price + (current_price >> AUTO_MARGIN_SHIFT)
+			>= current_price)
+		return false;
+
+	opt->lc = best_lc;
+	opt->lp = best_lp;
+	opt->pb = best_pb;
+	return true;
+}
+
+
+/// Chooses the values for lc, lp, and pb that are LZMA_LCLPPB_AUTO in *a
+/// from the first AUTO_SAMPLE_SIZE bytes in buf. If warm is true, the
+/// values are being chosen again within the stream and the next
+/// AUTO_SAMPLE_SIZE bytes must agree with the choice. Otherwise a short
+/// run of different data could decide the values for the next
+/// AUTO_INTERVAL bytes.
+/// Returns true if the values in *opt were changed.
+static bool
+lclppb_choose(lzma_lclppb_auto *a, const uint8_t *buf, uint32_t size,
+		lzma_options_lzma *opt, bool warm)
+{
+	a->interval_left = AUTO_INTERVAL;
+
+	lzma_options_lzma first = *opt;
+	if (!lclppb_estimate(a, buf, my_min(size, AUTO_SAMPLE_SIZE),
+			&first, warm))
+		return false;
+
+	if (warm) {
+		if (size <= AUTO_SAMPLE_SIZE)
+			return false;
+
+		lzma_options_lzma second = *opt;
+		if (!lclppb_estimate(a, buf + AUTO_SAMPLE_SIZE,
+					my_min(size - AUTO_SAMPLE_SIZE,
+						AUTO_SAMPLE_SIZE),
+					&second, warm)
+				|| second.lc != first.lc
+				|| second.lp != first.lp
+				|| second.pb != first.pb)
+			return false;
+	}
+
+	opt->lc = first.lc;
+	opt->lp = first.lp;
+	opt->pb = first.pb;
+	return true;
+}
+
+
+/// Returns true if lc, lp, or pb is LZMA_LCLPPB_AUTO and the values
+/// should be chosen before the next LZMA chunk.
+static bool
+lclppb_is_due(const lzma_lzma2_coder *coder)
+{
+	const lzma_lclppb_auto *a = coder->lclppb_auto;
+	return a != NULL && is_lclppb_auto(a->lc, a->lp, a->pb)
+			&& (coder->need_properties || a->interval_left == 0);
+}
+
+
+/// Runs the input through the match finder without encoding it so that
+/// it can be stored as an uncompressed chunk. The match finder has to be
+/// updated so that the later chunks can still refer to this data.
+/// Returns true when the chunk is ready.
+static bool
+lzma2_skip(lzma_lzma2_coder *coder, lzma_mf *mf)
+{
+	while (coder->uncompressed_size < LZMA2_CHUNK_MAX
+			&& mf->read_pos < mf->read_limit) {
+		// If the data doesn't look random anymore, end the chunk
+		// here. SEQ_INIT then gives the data to the LZMA encoder.
+		// Like in SEQ_INIT, wait for enough input first. If there
+		// is no more input, the rest of the chunk is stored.
+		if (coder->uncompressed_size == coder->probe_next) {
+			if (mf->action == LZMA_RUN
+					&& mf_avail(mf) < PROBE_SIZE
+					&& mf->write_pos < mf->size) {
+				mf->read_limit = mf->read_pos;
+				return false;
+			}
+
+			if (mf_avail(mf) >= PROBE_SIZE
+					&& !is_incompressible(mf))
+				return true;
+
+			coder->probe_next += PROBE_SIZE;
+		}
+
+		uint32_t amount = my_min(PROBE_INTERVAL, mf_avail(mf));
+		amount = my_min(amount, LZMA2_CHUNK_MAX
+				- coder->uncompressed_size);
+		amount = my_min(amount, coder->probe_next
+				- coder->uncompressed_size);
+
+		mf_skip(mf, amount - 1);
+
+		uint32_t count;
+		const uint32_t len = mf_find(mf, &count, coder->matches);
+
+		coder->uncompressed_size += amount;
+
+		if (len >= PROBE_MATCH_LEN) {
+			coder->match_found = true;
+			return true;
+		}
+	}
+
+	return coder->uncompressed_size == LZMA2_CHUNK_MAX
+			|| mf->action != LZMA_RUN;
+}
+
+
 static lzma_ret
 lzma2_encode(void *coder_ptr, lzma_mf *restrict mf,
 		uint8_t *restrict out, size_t *restrict out_pos,
@@ -152,12 +792,92 @@ lzma2_encode(void *coder_ptr, lzma_mf *restrict mf,
 					? LZMA_OK : LZMA_STREAM_END;
 		}
 
+		coder->uncompressed_size = 0;
+		coder->uncompressed_end = 0;
+		coder->compressed_size = 0;
+
+		// Store data that looks random without compressing it.
+		// The bytes that the LZMA encoder has already run through
+		// the match finder are stored too and thus the LZMA state
+		// must be reset before the next LZMA chunk. After a stored
+		// chunk that ended at a long match, the match is given to
+		// the LZMA encoder even though the data looks random.
+		if (!coder->match_found) {
+			// Like with lc/lp/pb below, wait for enough input
+			// so that the result doesn't depend on how the input
+			// is split into lzma_code() calls.
+			if (mf->action == LZMA_RUN
+					&& mf_avail(mf) < PROBE_SIZE
+					&& mf->write_pos < mf->size) {
+				mf->read_limit = mf->read_pos;
+				return LZMA_OK;
+			}
+
+			if (is_incompressible(mf)) {
+				coder->uncompressed_size = mf->read_ahead;
+				coder->probe_next = mf->read_ahead
+						+ PROBE_SIZE;
+				mf->read_ahead = 0;
+				coder->need_state_reset = true;
+				coder->sequence = SEQ_UNCOMPRESSED_SKIP;
+				break;
+			}
+		}
+
+		// The first LZMA chunk of the stream and the first one
+		// after new options have properties. Choose lc, lp, and pb
+		// that are LZMA_LCLPPB_AUTO before it and again after every
+		// AUTO_INTERVAL bytes.
+		if (lclppb_is_due(coder)) {
+			// Changing the values within the stream needs
+			// an extra state reset unless there is one anyway.
+			// Then the choice is checked with a second sample.
+			const bool warm = !coder->need_properties
+					&& !coder->need_state_reset;
+			const uint32_t sample_size = warm
+					? 2 * AUTO_SAMPLE_SIZE
+					: AUTO_SAMPLE_SIZE;
+
+			// Unless flushing or finishing, wait until there is
+			// enough input for the whole sample. Setting
+			// read_limit makes lz_encode() read more input
+			// before calling us again.
+			if (mf->action == LZMA_RUN
+					&& mf_unencoded(mf) < sample_size
+					&& mf->write_pos < mf->size) {
+				mf->read_limit = mf->read_pos;
+				return LZMA_OK;
+			}
+
+			lzma_options_lzma opt = coder->opt_cur;
+			if (lclppb_choose(coder->lclppb_auto,
+					mf_ptr(mf) - mf->read_ahead,
+					my_min(mf_unencoded(mf),
+						sample_size),
+					&opt, warm)) {
+				// The LZMA encoder may have parsed the
+				// start of the data already. The symbols
+				// must be encoded with the old values, so
+				// end this chunk after them and choose again.
+				const uint32_t pending
+						= lzma_lzma_encoder_pending(
+							coder->lzma);
+				if (pending == 0) {
+					coder->opt_cur = opt;
+					coder->need_properties = true;
+					coder->need_state_reset = true;
+				} else {
+					coder->uncompressed_end = pending;
+					coder->lclppb_auto->interval_left = 0;
+				}
+			}
+		}
+
 		if (coder->need_state_reset)
 			return_if_error(lzma_lzma_encoder_reset(
 					coder->lzma, &coder->opt_cur));
 
-		coder->uncompressed_size = 0;
-		coder->compressed_size = 0;
+		coder->match_found = false;
 		coder->sequence = SEQ_LZMA_ENCODE;
 
 	// Fall through
@@ -169,7 +889,12 @@ lzma2_encode(void *coder_ptr, lzma_mf *restrict mf,
 				- coder->uncompressed_size;
 		uint32_t limit;
 
-		if (left < mf->match_len_max) {
+		if (coder->uncompressed_end != 0) {
+			// The pending symbols end exactly at the limit.
+			limit = mf->read_pos - mf->read_ahead
+					+ coder->uncompressed_end
+					- (uint32_t)(coder->uncompressed_size);
+		} else if (left < mf->match_len_max) {
 			// Must flush immediately since the next LZMA symbol
 			// could make the uncompressed size of the chunk too
 			// big.
@@ -235,6 +960,21 @@ lzma2_encode(void *coder_ptr, lzma_mf *restrict mf,
 		coder->sequence = SEQ_INIT;
 		break;
 
+	case SEQ_UNCOMPRESSED_SKIP:
+		if (!lzma2_skip(coder, mf))
+			return LZMA_OK;
+
+		// mf_skip() and mf_find() count the bytes in read_ahead
+		// but coder->uncompressed_size has them already.
+		mf->read_ahead = 0;
+
+		lzma_lzma_encoder_skip(coder->lzma,
+				(uint32_t)(coder->uncompressed_size));
+		lzma2_header_uncompressed(coder);
+		coder->sequence = SEQ_UNCOMPRESSED_HEADER;
+
+	// Fall through
+
 	case SEQ_UNCOMPRESSED_HEADER:
 		// Copy the three-byte header to indicate uncompressed chunk.
 		lzma_bufcpy(coder->buf, &coder->buf_pos,
@@ -267,6 +1007,7 @@ lzma2_encoder_end(void *coder_ptr, const lzma_allocator *allocator)
 {
 	lzma_lzma2_coder *coder = coder_ptr;
 	lzma_free(coder->lzma, allocator);
+	lzma_free(coder->lclppb_auto, allocator);
 	lzma_free(coder, allocator);
 	return;
 }
@@ -284,21 +1025,42 @@ lzma2_encoder_options_update(void *coder_ptr, const lzma_filter *filter)
 		return LZMA_PROG_ERROR;
 
 	// Look if there are new options. At least for now,
-	// only lc/lp/pb can be changed.
+	// only lc/lp/pb can be changed. With LZMA_LCLPPB_AUTO the options
+	// are compared to the earlier options, not to the chosen values.
 	const lzma_options_lzma *opt = filter->options;
-	if (coder->opt_cur.lc != opt->lc || coder->opt_cur.lp != opt->lp
-			|| coder->opt_cur.pb != opt->pb) {
+	lzma_lclppb_auto *a = coder->lclppb_auto;
+	const lzma_options_lzma *old = &coder->opt_cur;
+	if (a != NULL ? a->lc != opt->lc || a->lp != opt->lp
+				|| a->pb != opt->pb
+			: old->lc != opt->lc || old->lp != opt->lp
+				|| old->pb != opt->pb) {
+		// LZMA_LCLPPB_AUTO needs memory that is allocated only
+		// if it was used when the encoder was initialized.
+		const bool is_auto = is_lclppb_auto(opt->lc, opt->lp, opt->pb);
+		if (is_auto && a == NULL)
+			return LZMA_OPTIONS_ERROR;
+
 		// Validate the options.
-		if (opt->lc > LZMA_LCLP_MAX || opt->lp > LZMA_LCLP_MAX
-				|| opt->lc + opt->lp > LZMA_LCLP_MAX
-				|| opt->pb > LZMA_PB_MAX)
+		lzma_options_lzma new_opt;
+		new_opt.lc = opt->lc;
+		new_opt.lp = opt->lp;
+		new_opt.pb = opt->pb;
+		lclppb_set_defaults(&new_opt);
+
+		if (!is_lclppb_valid(&new_opt))
 			return LZMA_OPTIONS_ERROR;
 
+		if (a != NULL) {
+			a->lc = opt->lc;
+			a->lp = opt->lp;
+			a->pb = opt->pb;
+		}
+
 		// The new options will be used when the encoder starts
 		// a new LZMA2 chunk.
-		coder->opt_cur.lc = opt->lc;
-		coder->opt_cur.lp = opt->lp;
-		coder->opt_cur.pb = opt->pb;
+		coder->opt_cur.lc = new_opt.lc;
+		coder->opt_cur.lp = new_opt.lp;
+		coder->opt_cur.pb = new_opt.pb;
 		coder->need_properties = true;
 		coder->need_state_reset = true;
 	}
@@ -327,13 +1089,37 @@ lzma2_encoder_init(lzma_lz_encoder *lz, const lzma_allocator *allocator,
 		lz->options_update = &lzma2_encoder_options_update;
 
 		coder->lzma = NULL;
+		coder->lclppb_auto = NULL;
 	}
 
-	coder->opt_cur = *(const lzma_options_lzma *)(options);
+	const lzma_options_lzma *opt = options;
+	coder->opt_cur = *opt;
+
+	if (is_lclppb_auto(opt->lc, opt->lp, opt->pb)) {
+		if (coder->lclppb_auto == NULL) {
+			coder->lclppb_auto = lzma_alloc(
+					sizeof(lzma_lclppb_auto), allocator);
+			if (coder->lclppb_auto == NULL)
+				return LZMA_MEM_ERROR;
+		}
+
+		coder->lclppb_auto->lc = opt->lc;
+		coder->lclppb_auto->lp = opt->lp;
+		coder->lclppb_auto->pb = opt->pb;
+		coder->lclppb_auto->interval_left = 0;
+
+		// The LZMA encoder is initialized with the defaults.
+		// The values are chosen when there is data to look at.
+		lclppb_set_defaults(&coder->opt_cur);
+	} else {
+		lzma_free(coder->lclppb_auto, allocator);
+		coder->lclppb_auto = NULL;
+	}
 
 	coder->sequence = SEQ_INIT;
 	coder->need_properties = true;
 	coder->need_state_reset = false;
+	coder->match_found = false;
 	coder->need_dictionary_reset
 			= coder->opt_cur.preset_dict == NULL
 			|| coder->opt_cur.preset_dict_size == 0;
@@ -367,11 +1153,19 @@ lzma_lzma2_encoder_init(lzma_next_coder *next, const lzma_allocator *allocator,
 extern uint64_t
 lzma_lzma2_encoder_memusage(const void *options)
 {
-	const uint64_t lzma_mem = lzma_lzma_encoder_memusage(options);
+	const lzma_options_lzma *const opt = options;
+	lzma_options_lzma opt_defaults = *opt;
+	lclppb_set_defaults(&opt_defaults);
+
+	const uint64_t lzma_mem = lzma_lzma_encoder_memusage(&opt_defaults);
 	if (lzma_mem == UINT64_MAX)
 		return UINT64_MAX;
 
-	return sizeof(lzma_lzma2_coder) + lzma_mem;
+	uint64_t mem = sizeof(lzma_lzma2_coder) + lzma_mem;
+	if (is_lclppb_auto(opt->lc, opt->lp, opt->pb))
+		mem += sizeof(lzma_lclppb_auto);
+
+	return mem;
 }
 
 
@@ -370,12 +370,34 @@ lzma_lzma_encode(lzma_lzma1_encoder *restrict coder, lzma_mf *restrict mf,
 		uint32_t len;
 		uint32_t back;
 
-		if (coder->fast_mode)
+		if (coder->turbo_mode)
+			lzma_lzma_optimum_turbo(coder, mf, &back, &len);
+		else if (coder->fast_mode)
 			lzma_lzma_optimum_fast(coder, mf, &back, &len);
 		else
 			lzma_lzma_optimum_normal(coder, mf, &back, &len,
 					(uint32_t)(coder->uncomp_size));
 
+		// In the fast mode, if there is plenty of output space,
+		// encode the symbol directly into the output buffer.
+		// This is skipped when output size limiting is active
+		// because then it must be possible to throw the symbol
+		// away after encoding it. The normal mode isn't supported
+		// because length() updates the price tables from
+		// probabilities that would then already include the bits
+		// of the current symbol, which would change the output.
+		if (coder->fast_mode && coder->out_limit == 0
+				&& rc_immediate_allowed(
+				&coder->rc, *out_pos, out_size)) {
+			rc_immediate_begin(&coder->rc, out, *out_pos);
+			encode_symbol(coder, mf, back, len,
+					(uint32_t)(coder->uncomp_size));
+			*out_pos = rc_immediate_end(&coder->rc, *out_pos);
+
+			coder->uncomp_size += len;
+			continue;
+		}
+
 		encode_symbol(coder, mf, back, len,
 				(uint32_t)(coder->uncomp_size));
 
@@ -449,6 +471,32 @@ lzma_encode(void *coder, lzma_mf *restrict mf,
 }
 
 
+extern void
+lzma_lzma_encoder_skip(lzma_lzma1_encoder *coder, uint32_t size)
+{
+	// Keep the position in sync with the LZMA2 decoder so that
+	// the pos_state and literal position contexts stay aligned
+	// with the data.
+	coder->uncomp_size += size;
+
+	// If the data was stored from the very beginning, there is
+	// now history and the first LZMA symbol needn't be a literal.
+	if (size > 0)
+		coder->is_initialized = true;
+
+	return;
+}
+
+
+extern uint32_t
+lzma_lzma_encoder_pending(const lzma_lzma1_encoder *coder)
+{
+	// Only the normal mode parses ahead. In the other modes
+	// both indexes stay zero.
+	return coder->opts_end_index - coder->opts_current_index;
+}
+
+
 static lzma_ret
 lzma_lzma_set_out_limit(
 		void *coder_ptr, uint64_t *uncomp_size, uint64_t out_limit)
@@ -479,7 +527,8 @@ is_options_valid(const lzma_options_lzma *options)
 			&& options->nice_len >= MATCH_LEN_MIN
 			&& options->nice_len <= MATCH_LEN_MAX
 			&& (options->mode == LZMA_MODE_FAST
-				|| options->mode == LZMA_MODE_NORMAL);
+				|| options->mode == LZMA_MODE_NORMAL
+				|| options->mode == LZMA_MODE_TURBO);
 }
 
 
@@ -496,6 +545,12 @@ set_lz_options(lzma_lz_options *lz_options, const lzma_options_lzma *options)
 				options->nice_len);
 	lz_options->match_finder = options->mf;
 	lz_options->depth = options->depth;
+
+	// The turbo mode uses only the most recent candidate from
+	// the hash chain or tree unless depth was set explicitly.
+	if (options->mode == LZMA_MODE_TURBO && options->depth == 0)
+		lz_options->depth = 1;
+
 	lz_options->preset_dict = options->preset_dict;
 	lz_options->preset_dict_size = options->preset_dict_size;
 	return;
@@ -621,10 +676,17 @@ lzma_lzma_encoder_create(void **coder_ptr, const lzma_allocator *allocator,
 	switch (options->mode) {
 		case LZMA_MODE_FAST:
 			coder->fast_mode = true;
+			coder->turbo_mode = false;
+			break;
+
+		case LZMA_MODE_TURBO:
+			coder->fast_mode = true;
+			coder->turbo_mode = true;
 			break;
 
 		case LZMA_MODE_NORMAL: {
 			coder->fast_mode = false;
+			coder->turbo_mode = false;
 
 			// Set dist_table_size.
 			// Round the dictionary size up to next 2^n.
@@ -782,5 +844,6 @@ lzma_lzma_props_encode(const void *options, uint8_t *out)
 extern LZMA_API(lzma_bool)
 lzma_mode_is_supported(lzma_mode mode)
 {
-	return mode == LZMA_MODE_FAST || mode == LZMA_MODE_NORMAL;
+	return mode == LZMA_MODE_FAST || mode == LZMA_MODE_NORMAL
+			|| mode == LZMA_MODE_TURBO;
 }
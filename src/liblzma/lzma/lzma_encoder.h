@@ -53,6 +53,18 @@ extern lzma_ret lzma_lzma_encode(lzma_lzma1_encoder *restrict coder,
 		size_t *restrict out_pos, size_t out_size,
 		uint32_t read_limit);
 
+
+/// Tells the LZMA encoder that LZMA2 has stored size bytes as uncompressed
+/// chunks without passing them through the LZMA encoder. The encoder has
+/// to be reset before it is used again.
+extern void lzma_lzma_encoder_skip(lzma_lzma1_encoder *coder, uint32_t size);
+
+
+/// Returns the number of uncompressed bytes that the encoder has already
+/// parsed into LZMA symbols but hasn't encoded yet. The encoder can be
+/// reset with new lc/lp/pb only when this is zero.
+extern uint32_t lzma_lzma_encoder_pending(const lzma_lzma1_encoder *coder);
+
 #endif
 
 #endif
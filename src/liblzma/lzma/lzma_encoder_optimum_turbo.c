@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       lzma_encoder_optimum_turbo.c
+/// \brief      Greedy parsing for LZMA_MODE_TURBO
+///
+/// The longest match from the match finder is taken as is, without looking
+/// at the next byte or at shorter matches with smaller distances. Of the
+/// repeated distances only rep0 is checked because it is by far the most
+/// useful one and checking the others costs time with little benefit.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "lzma_encoder_private.h"
+#include "memcmplen.h"
+
+
+extern void
+lzma_lzma_optimum_turbo(lzma_lzma1_encoder *restrict coder,
+		lzma_mf *restrict mf,
+		uint32_t *restrict back_res, uint32_t *restrict len_res)
+{
+	// The greedy parser never reads ahead.
+	assert(mf->read_ahead == 0);
+
+	uint32_t matches_count;
+	uint32_t len_main = mf_find(mf, &matches_count, coder->matches);
+
+	const uint8_t *buf = mf_ptr(mf) - 1;
+	const uint32_t buf_avail = my_min(mf_avail(mf) + 1, MATCH_LEN_MAX);
+
+	if (buf_avail < 2) {
+		*back_res = UINT32_MAX;
+		*len_res = 1;
+		return;
+	}
+
+	// A rep0 match is cheap to encode so prefer it unless the normal
+	// match is clearly longer.
+	const uint8_t *const buf_back = buf - coder->reps[0] - 1;
+	if (!not_equal_16(buf, buf_back)) {
+		const uint32_t rep_len = lzma_memcmplen(
+				buf, buf_back, 2, buf_avail);
+
+		if (rep_len + 1 >= len_main) {
+			*back_res = 0;
+			*len_res = rep_len;
+			mf_skip(mf, rep_len - 1);
+			return;
+		}
+	}
+
+	if (len_main < 2) {
+		*back_res = UINT32_MAX;
+		*len_res = 1;
+		return;
+	}
+
+	const uint32_t back_main = coder->matches[matches_count - 1].dist;
+
+	// A two-byte match with a big distance is more expensive
+	// than two literals.
+	if (len_main == 2 && back_main >= 0x80) {
+		*back_res = UINT32_MAX;
+		*len_res = 1;
+		return;
+	}
+
+	*back_res = back_main + REPS;
+	*len_res = len_main;
+	mf_skip(mf, len_main - 1);
+	return;
+}
@@ -102,6 +102,11 @@ struct lzma_lzma1_encoder_s {
 	/// True if using getoptimumfast
 	bool fast_mode;
 
+	/// True if using the greedy parser of LZMA_MODE_TURBO.
+	/// fast_mode is true too then because the price tables
+	/// aren't needed.
+	bool turbo_mode;
+
 	/// True if the encoder has been initialized by encoding the first
 	/// byte as a literal.
 	bool is_initialized;
@@ -154,6 +159,10 @@ extern void lzma_lzma_optimum_fast(
 		lzma_lzma1_encoder *restrict coder, lzma_mf *restrict mf,
 		uint32_t *restrict back_res, uint32_t *restrict len_res);
 
+extern void lzma_lzma_optimum_turbo(
+		lzma_lzma1_encoder *restrict coder, lzma_mf *restrict mf,
+		uint32_t *restrict back_res, uint32_t *restrict len_res);
+
 extern void lzma_lzma_optimum_normal(lzma_lzma1_encoder *restrict coder,
 		lzma_mf *restrict mf, uint32_t *restrict back_res,
 		uint32_t *restrict len_res, uint32_t position);
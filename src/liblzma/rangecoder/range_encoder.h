@@ -22,6 +22,12 @@
 /// (match with big distance and length followed by range encoder flush).
 #define RC_SYMBOLS_MAX 53
 
+/// Minimum free output space, not counting the pending bytes (cache_size),
+/// that is needed to encode one LZMA symbol without queueing. Each bit
+/// can call rc_shift_low() at most once, and one call writes at most
+/// one byte more than cache_size was before it.
+#define RC_IMMEDIATE_OUT_MIN RC_SYMBOLS_MAX
+
 
 typedef struct {
 	uint64_t low;
@@ -50,6 +56,14 @@ typedef struct {
 	/// Probabilities associated with RC_BIT_0 or RC_BIT_1
 	probability *probs[RC_SYMBOLS_MAX];
 
+	/// Output buffer when encoding without the symbol queue, that is,
+	/// between rc_immediate_begin() and rc_immediate_end(). NULL when
+	/// the symbols are queued for rc_encode().
+	uint8_t *imm_out;
+
+	/// Position in imm_out
+	size_t imm_out_pos;
+
 } lzma_range_encoder;
 
 
@@ -63,6 +77,8 @@ rc_reset(lzma_range_encoder *rc)
 	rc->out_total = 0;
 	rc->count = 0;
 	rc->pos = 0;
+	rc->imm_out = NULL;
+	rc->imm_out_pos = 0;
 }
 
 
@@ -75,9 +91,105 @@ rc_forget(lzma_range_encoder *rc)
 }
 
 
+/// Returns true if the next symbol can be encoded with rc_immediate_begin().
+/// There must be nothing queued and enough output space for the pending
+/// bytes and all the bits of one LZMA symbol.
+static inline bool
+rc_immediate_allowed(const lzma_range_encoder *rc,
+		size_t out_pos, size_t out_size)
+{
+	return rc->count == 0 && out_size - out_pos >= RC_IMMEDIATE_OUT_MIN
+			&& rc->cache_size <= out_size - out_pos
+				- RC_IMMEDIATE_OUT_MIN;
+}
+
+
+/// Start encoding the bits directly into out[] instead of queueing them.
+/// This avoids storing and replaying the symbols and the output space
+/// checks in rc_shift_low(). The caller must have checked
+/// rc_immediate_allowed() and must call rc_immediate_end() after at most
+/// RC_SYMBOLS_MAX bits. rc_flush() must not be used in between.
+static inline void
+rc_immediate_begin(lzma_range_encoder *rc, uint8_t *out, size_t out_pos)
+{
+	assert(rc->count == 0);
+	rc->imm_out = out;
+	rc->imm_out_pos = out_pos;
+}
+
+
+/// Stop encoding directly and return the new output position.
+static inline size_t
+rc_immediate_end(lzma_range_encoder *rc, size_t out_pos)
+{
+	assert(rc->imm_out != NULL);
+	rc->out_total += rc->imm_out_pos - out_pos;
+	rc->imm_out = NULL;
+	return rc->imm_out_pos;
+}
+
+
+/// rc_shift_low() without the output space checks
+static inline void
+rc_shift_low_immediate(lzma_range_encoder *rc)
+{
+	if ((uint32_t)(rc->low) < (uint32_t)(0xFF000000)
+			|| (uint32_t)(rc->low >> 32) != 0) {
+		uint8_t *out = rc->imm_out;
+		size_t out_pos = rc->imm_out_pos;
+
+		out[out_pos++] = rc->cache + (uint8_t)(rc->low >> 32);
+
+		// If a carry occurred, the pending 0xFF bytes become 0x00.
+		const uint8_t fill = 0xFF + (uint8_t)(rc->low >> 32);
+		while (--rc->cache_size != 0)
+			out[out_pos++] = fill;
+
+		rc->imm_out_pos = out_pos;
+		rc->cache = (rc->low >> 24) & 0xFF;
+	}
+
+	++rc->cache_size;
+	rc->low = (rc->low & 0x00FFFFFF) << RC_SHIFT_BITS;
+}
+
+
+static inline void
+rc_normalize_immediate(lzma_range_encoder *rc)
+{
+	if (rc->range < RC_TOP_VALUE) {
+		rc_shift_low_immediate(rc);
+		rc->range <<= RC_SHIFT_BITS;
+	}
+}
+
+
+static inline void
+rc_bit_immediate(lzma_range_encoder *rc, probability *prob, uint32_t bit)
+{
+	rc_normalize_immediate(rc);
+
+	const uint32_t bound = (rc->range >> RC_BIT_MODEL_TOTAL_BITS) * *prob;
+
+	if (bit == 0) {
+		rc->range = bound;
+		*prob += (RC_BIT_MODEL_TOTAL - *prob) >> RC_MOVE_BITS;
+	} else {
+		rc->low += bound;
+		rc->range -= bound;
+		*prob -= *prob >> RC_MOVE_BITS;
+	}
+}
+
+
 static inline void
 rc_bit(lzma_range_encoder *rc, probability *prob, uint32_t bit)
 {
+	if (rc->imm_out != NULL) {
+		rc_bit_immediate(rc, prob, bit);
+		return;
+	}
+
 	rc->symbols[rc->count] = bit;
 	rc->probs[rc->count] = prob;
 	++rc->count;
@@ -117,6 +229,17 @@ static inline void
 rc_direct(lzma_range_encoder *rc,
 		uint32_t value, uint32_t bit_count)
 {
+	if (rc->imm_out != NULL) {
+		do {
+			rc_normalize_immediate(rc);
+			rc->range >>= 1;
+			rc->low += rc->range
+					& (0U - ((value >> --bit_count) & 1));
+		} while (bit_count != 0);
+
+		return;
+	}
+
 	do {
 		rc->symbols[rc->count++]
 				= RC_DIRECT_0 + ((value >> --bit_count) & 1);
@@ -127,6 +250,8 @@ rc_direct(lzma_range_encoder *rc,
 static inline void
 rc_flush(lzma_range_encoder *rc)
 {
+	assert(rc->imm_out == NULL);
+
 	for (size_t i = 0; i < 5; ++i)
 		rc->symbols[rc->count++] = RC_FLUSH;
 }
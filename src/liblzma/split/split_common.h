@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       split_common.h
+/// \brief      Common stuff for the x86 split filter encoder and decoder
+///
+/// The x86 split filter is a streamable variant of the BCJ2 idea: the
+/// 32-bit targets of x86 CALL (E8), JMP (E9), and Jcc (0F 80-8F)
+/// instructions are converted to absolute addresses and moved out of
+/// the main byte stream into separate call and jump streams.
+///
+/// The encoded data is a sequence of independent chunks. Each chunk
+/// encodes 1 to SPLIT_CHUNK_MAX bytes of uncompressed data:
+///
+///   - Header: four 32-bit little endian integers: the sizes of the main
+///     stream, the number of flag bits, and the sizes of the call and
+///     jump streams
+///   - Main stream: the input data without the converted targets
+///   - Flags: one bit per branch opcode (LSB first), set if the target
+///     was converted. The unused bits of the last byte are zero.
+///   - Call stream: converted CALL targets as big endian absolute addresses
+///   - Jump stream: converted JMP and Jcc targets, likewise
+///
+/// Since every chunk is self-delimiting, the encoder and the decoder
+/// need only a fixed amount of memory and LZMA_SYNC_FLUSH is supported.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_SPLIT_COMMON_H
+#define LZMA_SPLIT_COMMON_H
+
+#include "common.h"
+
+/// Maximum amount of uncompressed data in one chunk
+#define SPLIT_CHUNK_MAX (UINT32_C(1) << 16)
+
+/// Size of the chunk header
+#define SPLIT_HEADER_SIZE 16
+
+/// Maximum size of the flags in one chunk
+#define SPLIT_FLAGS_MAX ((SPLIT_CHUNK_MAX + 7) / 8)
+
+/// Maximum size of one encoded chunk
+#define SPLIT_ENCODED_MAX \
+	(SPLIT_HEADER_SIZE + SPLIT_CHUNK_MAX + SPLIT_FLAGS_MAX)
+
+
+/// Returns true if `cur` is an opcode that is followed by a 32-bit
+/// relative target. `prev` is the byte before `cur`.
+static inline bool
+split_is_branch(uint8_t prev, uint8_t cur)
+{
+	return cur == 0xE8 || cur == 0xE9
+			|| (prev == 0x0F && (cur & 0xF0) == 0x80);
+}
+
+
+/// Returns true if the branch target should go to the call stream
+/// and false if it should go to the jump stream.
+static inline bool
+split_is_call(uint8_t cur)
+{
+	return cur == 0xE8;
+}
+
+
+/// The same heuristic as in the x86 BCJ filter: convert only targets
+/// that are within +/-16 MiB. Other values are unlikely to be
+/// real branch targets.
+static inline bool
+split_is_convertible(uint8_t target_msb)
+{
+	return target_msb == 0x00 || target_msb == 0xFF;
+}
+
+#endif
@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       split_decoder.c
+/// \brief      x86 split filter decoder
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "split_decoder.h"
+#include "split_common.h"
+
+
+typedef struct {
+	/// Next coder in the chain
+	lzma_next_coder next;
+
+	/// True if the next coder in the chain has returned LZMA_STREAM_END.
+	bool end_was_reached;
+
+	/// Previous byte of the uncompressed data
+	uint8_t prev_byte;
+
+	/// The lowest 32 bits of the uncompressed position of out_buf[0]
+	uint32_t now_pos;
+
+	/// Amount of encoded data in in_buf[]
+	size_t in_size;
+
+	/// Size of the current encoded chunk. This is SPLIT_HEADER_SIZE
+	/// until the header has been decoded.
+	size_t in_need;
+
+	/// Sizes of the streams of the current chunk from the chunk header
+	size_t main_size;
+	size_t flag_count;
+	size_t call_size;
+	size_t jump_size;
+
+	/// Position of the next byte to copy from out_buf[]
+	size_t out_pos;
+
+	/// Amount of decoded data in out_buf[]
+	size_t out_size;
+
+	/// The current encoded chunk
+	uint8_t in_buf[SPLIT_ENCODED_MAX];
+
+	/// The decoded chunk
+	uint8_t out_buf[SPLIT_CHUNK_MAX];
+
+} lzma_split_coder;
+
+
+/// Validates the chunk header in in_buf[] and sets coder->in_need to
+/// the size of the whole encoded chunk.
+static lzma_ret
+decode_header(lzma_split_coder *coder)
+{
+	const uint32_t main_size = read32le(coder->in_buf);
+	const uint32_t flag_count = read32le(coder->in_buf + 4);
+	const uint32_t call_size = read32le(coder->in_buf + 8);
+	const uint32_t jump_size = read32le(coder->in_buf + 12);
+
+	// Check each value separately first so that the sum below
+	// cannot overflow.
+	if (main_size == 0 || main_size > SPLIT_CHUNK_MAX
+			|| flag_count > main_size
+			|| call_size > SPLIT_CHUNK_MAX
+			|| jump_size > SPLIT_CHUNK_MAX
+			|| call_size % 4 != 0 || jump_size % 4 != 0
+			|| main_size + call_size + jump_size > SPLIT_CHUNK_MAX)
+		return LZMA_DATA_ERROR;
+
+	coder->main_size = main_size;
+	coder->flag_count = flag_count;
+	coder->call_size = call_size;
+	coder->jump_size = jump_size;
+	coder->in_need = SPLIT_HEADER_SIZE + main_size
+			+ (flag_count + 7) / 8 + call_size + jump_size;
+
+	return LZMA_OK;
+}
+
+
+/// Decodes the chunk in in_buf[] into out_buf[].
+static lzma_ret
+decode_chunk(lzma_split_coder *coder)
+{
+	const uint8_t *main_stream = coder->in_buf + SPLIT_HEADER_SIZE;
+	const uint8_t *flags = main_stream + coder->main_size;
+	const uint8_t *calls = flags + (coder->flag_count + 7) / 8;
+	const uint8_t *jumps = calls + coder->call_size;
+
+	const size_t size = coder->main_size + coder->call_size
+			+ coder->jump_size;
+
+	uint8_t *out = coder->out_buf;
+	size_t main_pos = 0;
+	size_t flag_pos = 0;
+	size_t call_pos = 0;
+	size_t jump_pos = 0;
+
+	uint8_t prev = coder->prev_byte;
+	size_t i = 0;
+
+	while (i < size) {
+		if (main_pos == coder->main_size)
+			return LZMA_DATA_ERROR;
+
+		const uint8_t b = main_stream[main_pos++];
+		out[i++] = b;
+
+		if (!split_is_branch(prev, b) || size - i < 4) {
+			prev = b;
+			continue;
+		}
+
+		if (flag_pos == coder->flag_count)
+			return LZMA_DATA_ERROR;
+
+		const bool converted = (flags[flag_pos / 8]
+				>> (flag_pos % 8)) & 1;
+		++flag_pos;
+
+		if (!converted) {
+			prev = b;
+			continue;
+		}
+
+		uint32_t dest;
+		if (split_is_call(b)) {
+			if (call_pos == coder->call_size)
+				return LZMA_DATA_ERROR;
+
+			dest = read32be(calls + call_pos);
+			call_pos += 4;
+		} else {
+			if (jump_pos == coder->jump_size)
+				return LZMA_DATA_ERROR;
+
+			dest = read32be(jumps + jump_pos);
+			jump_pos += 4;
+		}
+
+		// Absolute to relative
+		dest -= (uint32_t)(coder->now_pos + i + 4);
+		write32le(out + i, dest);
+
+		// Don't accept targets that the encoder wouldn't
+		// have converted.
+		if (!split_is_convertible(out[i + 3]))
+			return LZMA_DATA_ERROR;
+
+		prev = out[i + 3];
+		i += 4;
+	}
+
+	// Everything in the chunk must have been used, and the unused
+	// bits of the last flag byte must be zero.
+	if (main_pos != coder->main_size
+			|| flag_pos != coder->flag_count
+			|| call_pos != coder->call_size
+			|| jump_pos != coder->jump_size)
+		return LZMA_DATA_ERROR;
+
+	if (coder->flag_count % 8 != 0 && (flags[coder->flag_count / 8]
+			>> (coder->flag_count % 8)) != 0)
+		return LZMA_DATA_ERROR;
+
+	coder->prev_byte = prev;
+	coder->now_pos += (uint32_t)(size);
+
+	coder->out_pos = 0;
+	coder->out_size = size;
+	coder->in_size = 0;
+	coder->in_need = SPLIT_HEADER_SIZE;
+
+	return LZMA_OK;
+}
+
+
+static lzma_ret
+split_decode(void *coder_ptr, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size, lzma_action action)
+{
+	lzma_split_coder *coder = coder_ptr;
+
+	assert(coder->next.code != NULL);
+
+	while (true) {
+		// Flush the decoded chunk.
+		if (coder->out_pos < coder->out_size) {
+			lzma_bufcpy(coder->out_buf, &coder->out_pos,
+					coder->out_size,
+					out, out_pos, out_size);
+			if (coder->out_pos < coder->out_size)
+				return LZMA_OK;
+		}
+
+		if (coder->end_was_reached) {
+			// The data must not end in the middle of a chunk.
+			return coder->in_size == 0
+					? LZMA_STREAM_END : LZMA_DATA_ERROR;
+		}
+
+		// Decode more data into in_buf[].
+		const lzma_ret ret = coder->next.code(
+				coder->next.coder, allocator,
+				in, in_pos, in_size,
+				coder->in_buf, &coder->in_size,
+				coder->in_need, action);
+
+		if (ret == LZMA_STREAM_END)
+			coder->end_was_reached = true;
+		else if (ret != LZMA_OK)
+			return ret;
+
+		if (coder->in_size < coder->in_need) {
+			if (coder->end_was_reached)
+				continue;
+
+			return LZMA_OK;
+		}
+
+		if (coder->in_need == SPLIT_HEADER_SIZE) {
+			return_if_error(decode_header(coder));
+
+			// The chunk is never only the header.
+			assert(coder->in_need > SPLIT_HEADER_SIZE);
+			continue;
+		}
+
+		return_if_error(decode_chunk(coder));
+	}
+}
+
+
+static void
+split_decoder_end(void *coder_ptr, const lzma_allocator *allocator)
+{
+	lzma_split_coder *coder = coder_ptr;
+	lzma_next_end(&coder->next, allocator);
+	lzma_free(coder, allocator);
+	return;
+}
+
+
+extern lzma_ret
+lzma_split_decoder_init(lzma_next_coder *next,
+		const lzma_allocator *allocator,
+		const lzma_filter_info *filters)
+{
+	lzma_split_coder *coder = next->coder;
+	if (coder == NULL) {
+		coder = lzma_alloc(sizeof(lzma_split_coder), allocator);
+		if (coder == NULL)
+			return LZMA_MEM_ERROR;
+
+		next->coder = coder;
+		next->code = &split_decode;
+		next->end = &split_decoder_end;
+
+		coder->next = LZMA_NEXT_CODER_INIT;
+	}
+
+	const lzma_options_bcj *opt = filters[0].options;
+	coder->now_pos = opt == NULL ? 0 : opt->start_offset;
+
+	coder->end_was_reached = false;
+	coder->prev_byte = 0;
+	coder->in_size = 0;
+	coder->in_need = SPLIT_HEADER_SIZE;
+	coder->out_pos = 0;
+	coder->out_size = 0;
+
+	return lzma_next_filter_init(&coder->next, allocator, filters + 1);
+}
+
+
+extern uint64_t
+lzma_split_decoder_memusage(const void *options lzma_attribute((__unused__)))
+{
+	return sizeof(lzma_split_coder);
+}
+
+
+extern lzma_ret
+lzma_split_props_decode(void **options, const lzma_allocator *allocator,
+		const uint8_t *props, size_t props_size)
+{
+	if (props_size == 0)
+		return LZMA_OK;
+
+	if (props_size != 4)
+		return LZMA_OPTIONS_ERROR;
+
+	lzma_options_bcj *opt = lzma_alloc(
+			sizeof(lzma_options_bcj), allocator);
+	if (opt == NULL)
+		return LZMA_MEM_ERROR;
+
+	opt->start_offset = read32le(props);
+
+	// Don't leave an options structure allocated if start_offset is zero.
+	if (opt->start_offset == 0)
+		lzma_free(opt, allocator);
+	else
+		*options = opt;
+
+	return LZMA_OK;
+}
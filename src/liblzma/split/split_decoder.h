@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       split_decoder.h
+/// \brief      x86 split filter decoder
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_SPLIT_DECODER_H
+#define LZMA_SPLIT_DECODER_H
+
+#include "common.h"
+
+extern lzma_ret lzma_split_decoder_init(lzma_next_coder *next,
+		const lzma_allocator *allocator,
+		const lzma_filter_info *filters);
+
+extern uint64_t lzma_split_decoder_memusage(const void *options);
+
+extern lzma_ret lzma_split_props_decode(
+		void **options, const lzma_allocator *allocator,
+		const uint8_t *props, size_t props_size);
+
+#endif
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       split_encoder.c
+/// \brief      x86 split filter encoder
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "split_encoder.h"
+#include "split_common.h"
+
+
+typedef struct {
+	/// Next coder in the chain
+	lzma_next_coder next;
+
+	/// True if all the input has been collected because the next
+	/// coder returned LZMA_STREAM_END or the application is finishing
+	/// or flushing and all input has been consumed.
+	bool end_was_reached;
+
+	/// Previous byte of the uncompressed data. This is needed to
+	/// detect the 0F 8x (Jcc) opcodes across chunk boundaries.
+	uint8_t prev_byte;
+
+	/// The lowest 32 bits of the uncompressed position of in_buf[0]
+	uint32_t now_pos;
+
+	/// Amount of uncompressed data in in_buf[]
+	size_t in_size;
+
+	/// Position of the next byte to copy from out_buf[]
+	size_t out_pos;
+
+	/// Size of the encoded chunk in out_buf[]
+	size_t out_size;
+
+	/// Uncompressed data of the current chunk
+	uint8_t in_buf[SPLIT_CHUNK_MAX];
+
+	/// The encoded chunk. The main stream is written directly here
+	/// and the other streams are appended after it.
+	uint8_t out_buf[SPLIT_ENCODED_MAX];
+
+	/// Temporary buffers for the flags and the call and jump streams
+	uint8_t flags[SPLIT_FLAGS_MAX];
+	uint8_t calls[SPLIT_CHUNK_MAX];
+	uint8_t jumps[SPLIT_CHUNK_MAX];
+
+} lzma_split_coder;
+
+
+/// Encodes in_buf[] into out_buf[].
+static void
+encode_chunk(lzma_split_coder *coder)
+{
+	const uint8_t *in = coder->in_buf;
+	const size_t size = coder->in_size;
+	assert(size > 0 && size <= SPLIT_CHUNK_MAX);
+
+	uint8_t *main_stream = coder->out_buf + SPLIT_HEADER_SIZE;
+	size_t main_size = 0;
+	size_t flag_count = 0;
+	size_t call_size = 0;
+	size_t jump_size = 0;
+
+	memzero(coder->flags, (size + 7) / 8);
+
+	uint8_t prev = coder->prev_byte;
+	size_t i = 0;
+
+	while (i < size) {
+		const uint8_t b = in[i++];
+		main_stream[main_size++] = b;
+
+		// The decoder does the same check based on the
+		// uncompressed size of the chunk, which it knows.
+		if (!split_is_branch(prev, b) || size - i < 4) {
+			prev = b;
+			continue;
+		}
+
+		if (!split_is_convertible(in[i + 3])) {
+			++flag_count;
+			prev = b;
+			continue;
+		}
+
+		coder->flags[flag_count / 8] |= (uint8_t)(1U << (flag_count % 8));
+		++flag_count;
+
+		// Relative to absolute. The target is relative to the end
+		// of the instruction.
+		const uint32_t dest = read32le(in + i)
+				+ (uint32_t)(coder->now_pos + i + 4);
+
+		if (split_is_call(b)) {
+			write32be(coder->calls + call_size, dest);
+			call_size += 4;
+		} else {
+			write32be(coder->jumps + jump_size, dest);
+			jump_size += 4;
+		}
+
+		prev = in[i + 3];
+		i += 4;
+	}
+
+	coder->prev_byte = prev;
+	coder->now_pos += (uint32_t)(size);
+
+	assert(main_size + call_size + jump_size == size);
+
+	uint8_t *out = coder->out_buf;
+	write32le(out, (uint32_t)(main_size));
+	write32le(out + 4, (uint32_t)(flag_count));
+	write32le(out + 8, (uint32_t)(call_size));
+	write32le(out + 12, (uint32_t)(jump_size));
+
+	size_t out_size = SPLIT_HEADER_SIZE + main_size;
+
+	const size_t flags_size = (flag_count + 7) / 8;
+	memcpy(out + out_size, coder->flags, flags_size);
+	out_size += flags_size;
+
+	memcpy(out + out_size, coder->calls, call_size);
+	out_size += call_size;
+
+	memcpy(out + out_size, coder->jumps, jump_size);
+	out_size += jump_size;
+
+	coder->out_pos = 0;
+	coder->out_size = out_size;
+	coder->in_size = 0;
+	return;
+}
+
+
+static lzma_ret
+split_encode(void *coder_ptr, const lzma_allocator *allocator,
+		const uint8_t *restrict in, size_t *restrict in_pos,
+		size_t in_size, uint8_t *restrict out,
+		size_t *restrict out_pos, size_t out_size, lzma_action action)
+{
+	lzma_split_coder *coder = coder_ptr;
+
+	while (true) {
+		// Flush the encoded chunk.
+		if (coder->out_pos < coder->out_size) {
+			lzma_bufcpy(coder->out_buf, &coder->out_pos,
+					coder->out_size,
+					out, out_pos, out_size);
+			if (coder->out_pos < coder->out_size)
+				return LZMA_OK;
+		}
+
+		if (coder->end_was_reached && coder->in_size == 0) {
+			// Finishing or flushing is complete. After
+			// LZMA_SYNC_FLUSH the encoding may continue.
+			coder->end_was_reached = false;
+			return LZMA_STREAM_END;
+		}
+
+		// Collect more input to in_buf[].
+		if (!coder->end_was_reached) {
+			if (coder->next.code == NULL) {
+				lzma_bufcpy(in, in_pos, in_size,
+						coder->in_buf, &coder->in_size,
+						SPLIT_CHUNK_MAX);
+
+				if (action != LZMA_RUN && *in_pos == in_size)
+					coder->end_was_reached = true;
+			} else {
+				const lzma_ret ret = coder->next.code(
+						coder->next.coder, allocator,
+						in, in_pos, in_size,
+						coder->in_buf, &coder->in_size,
+						SPLIT_CHUNK_MAX, action);
+
+				if (ret == LZMA_STREAM_END)
+					coder->end_was_reached = true;
+				else if (ret != LZMA_OK)
+					return ret;
+			}
+		}
+
+		// Encode a chunk if in_buf[] is full or if there won't be
+		// any more input before finishing or flushing.
+		if (coder->in_size == SPLIT_CHUNK_MAX
+				|| (coder->end_was_reached
+					&& coder->in_size > 0))
+			encode_chunk(coder);
+		else if (!coder->end_was_reached)
+			return LZMA_OK;
+	}
+}
+
+
+static void
+split_encoder_end(void *coder_ptr, const lzma_allocator *allocator)
+{
+	lzma_split_coder *coder = coder_ptr;
+	lzma_next_end(&coder->next, allocator);
+	lzma_free(coder, allocator);
+	return;
+}
+
+
+static lzma_ret
+split_encoder_update(void *coder_ptr, const lzma_allocator *allocator,
+		const lzma_filter *filters_null lzma_attribute((__unused__)),
+		const lzma_filter *reversed_filters)
+{
+	lzma_split_coder *coder = coder_ptr;
+
+	// No update support, just call the next filter in the chain.
+	return lzma_next_filter_update(
+			&coder->next, allocator, reversed_filters + 1);
+}
+
+
+extern lzma_ret
+lzma_split_encoder_init(lzma_next_coder *next,
+		const lzma_allocator *allocator,
+		const lzma_filter_info *filters)
+{
+	lzma_split_coder *coder = next->coder;
+	if (coder == NULL) {
+		coder = lzma_alloc(sizeof(lzma_split_coder), allocator);
+		if (coder == NULL)
+			return LZMA_MEM_ERROR;
+
+		next->coder = coder;
+		next->code = &split_encode;
+		next->end = &split_encoder_end;
+		next->update = &split_encoder_update;
+
+		coder->next = LZMA_NEXT_CODER_INIT;
+	}
+
+	const lzma_options_bcj *opt = filters[0].options;
+	coder->now_pos = opt == NULL ? 0 : opt->start_offset;
+
+	coder->end_was_reached = false;
+	coder->prev_byte = 0;
+	coder->in_size = 0;
+	coder->out_pos = 0;
+	coder->out_size = 0;
+
+	return lzma_next_filter_init(&coder->next, allocator, filters + 1);
+}
+
+
+extern uint64_t
+lzma_split_encoder_memusage(const void *options lzma_attribute((__unused__)))
+{
+	return sizeof(lzma_split_coder);
+}
+
+
+extern lzma_ret
+lzma_split_props_size(uint32_t *size, const void *options)
+{
+	const lzma_options_bcj *const opt = options;
+	*size = (opt == NULL || opt->start_offset == 0) ? 0 : 4;
+	return LZMA_OK;
+}
+
+
+extern lzma_ret
+lzma_split_props_encode(const void *options, uint8_t *out)
+{
+	const lzma_options_bcj *const opt = options;
+
+	// Like with the BCJ filters, the start offset is stored only
+	// if it is non-zero.
+	if (opt == NULL || opt->start_offset == 0)
+		return LZMA_OK;
+
+	write32le(out, opt->start_offset);
+
+	return LZMA_OK;
+}
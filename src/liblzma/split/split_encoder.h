@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       split_encoder.h
+/// \brief      x86 split filter encoder
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#ifndef LZMA_SPLIT_ENCODER_H
+#define LZMA_SPLIT_ENCODER_H
+
+#include "common.h"
+
+extern lzma_ret lzma_split_encoder_init(lzma_next_coder *next,
+		const lzma_allocator *allocator,
+		const lzma_filter_info *filters);
+
+extern uint64_t lzma_split_encoder_memusage(const void *options);
+
+extern lzma_ret lzma_split_props_size(uint32_t *size, const void *options);
+
+extern lzma_ret lzma_split_props_encode(const void *options, uint8_t *out);
+
+#endif
@@ -23,6 +23,8 @@ bool opt_force = false;
 bool opt_keep_original = false;
 bool opt_robot = false;
 bool opt_ignore_check = false;
+bool opt_index_cache = false;
+bool opt_index_cache_write = false;
 
 // We don't modify or free() this, but we need to assign it in some
 // non-const pointers.
@@ -213,16 +215,19 @@ parse_real(args_info *args, int argc, char **argv)
 		OPT_ARM64,
 		OPT_SPARC,
 		OPT_RISCV,
+		OPT_X86SPLIT,
 		OPT_DELTA,
 		OPT_LZMA1,
 		OPT_LZMA2,
 
 		OPT_SINGLE_STREAM,
 		OPT_NO_SPARSE,
+		OPT_INDEX_CACHE,
 		OPT_FILES,
 		OPT_FILES0,
 		OPT_BLOCK_SIZE,
 		OPT_BLOCK_LIST,
+		OPT_AUTO_FILTERS,
 		OPT_MEM_COMPRESS,
 		OPT_MEM_DECOMPRESS,
 		OPT_MEM_MT_DECOMPRESS,
@@ -251,6 +256,7 @@ parse_real(args_info *args, int argc, char **argv)
 		{ "to-stdout",    no_argument,       NULL,  'c' },
 		{ "single-stream", no_argument,      NULL,  OPT_SINGLE_STREAM },
 		{ "no-sparse",    no_argument,       NULL,  OPT_NO_SPARSE },
+		{ "index-cache",  optional_argument, NULL,  OPT_INDEX_CACHE },
 		{ "suffix",       required_argument, NULL,  'S' },
 		{ "files",        optional_argument, NULL,  OPT_FILES },
 		{ "files0",       optional_argument, NULL,  OPT_FILES0 },
@@ -261,6 +267,7 @@ parse_real(args_info *args, int argc, char **argv)
 		{ "ignore-check", no_argument,       NULL,  OPT_IGNORE_CHECK },
 		{ "block-size",   required_argument, NULL,  OPT_BLOCK_SIZE },
 		{ "block-list",   required_argument, NULL,  OPT_BLOCK_LIST },
+		{ "auto-filters", no_argument,       NULL,  OPT_AUTO_FILTERS },
 		{ "memlimit-compress",   required_argument, NULL, OPT_MEM_COMPRESS },
 		{ "memlimit-decompress", required_argument, NULL, OPT_MEM_DECOMPRESS },
 		{ "memlimit-mt-decompress", required_argument, NULL, OPT_MEM_MT_DECOMPRESS },
@@ -297,6 +304,7 @@ parse_real(args_info *args, int argc, char **argv)
 		{ "arm64",        optional_argument, NULL,  OPT_ARM64 },
 		{ "sparc",        optional_argument, NULL,  OPT_SPARC },
 		{ "riscv",        optional_argument, NULL,  OPT_RISCV },
+		{ "x86split",     optional_argument, NULL,  OPT_X86SPLIT },
 		{ "delta",        optional_argument, NULL,  OPT_DELTA },
 
 		// Other options
@@ -519,6 +527,11 @@ parse_real(args_info *args, int argc, char **argv)
 					options_bcj(optarg));
 			break;
 
+		case OPT_X86SPLIT:
+			coder_add_filter(LZMA_FILTER_X86_SPLIT,
+					options_bcj(optarg));
+			break;
+
 		case OPT_DELTA:
 			coder_add_filter(LZMA_FILTER_DELTA,
 					options_delta(optarg));
@@ -549,7 +562,7 @@ parse_real(args_info *args, int argc, char **argv)
 				{ "xz",     FORMAT_XZ },
 				{ "lzma",   FORMAT_LZMA },
 				{ "alone",  FORMAT_LZMA },
-#ifdef HAVE_LZIP_DECODER
+#if defined(HAVE_LZIP_ENCODER) || defined(HAVE_LZIP_DECODER)
 				{ "lzip",   FORMAT_LZIP },
 #endif
 				{ "raw",    FORMAT_RAW },
@@ -610,6 +623,10 @@ parse_real(args_info *args, int argc, char **argv)
 			break;
 		}
 
+		case OPT_AUTO_FILTERS:
+			opt_auto_filters = true;
+			break;
+
 		case OPT_SINGLE_STREAM:
 			opt_single_stream = true;
 			break;
@@ -618,6 +635,20 @@ parse_real(args_info *args, int argc, char **argv)
 			io_no_sparse();
 			break;
 
+		// --index-cache[=MODE]
+		case OPT_INDEX_CACHE:
+			opt_index_cache = true;
+
+			if (optarg == NULL || strcmp(optarg, "read") == 0)
+				opt_index_cache_write = false;
+			else if (strcmp(optarg, "write") == 0)
+				opt_index_cache_write = true;
+			else
+				message_fatal(_("%s: Unsupported index cache "
+						"mode"), optarg);
+
+			break;
+
 		case OPT_FILES:
 			args->files_delim = '\n';
 
@@ -809,10 +840,17 @@ args_parse(args_info *args, int argc, char **argv)
 				"at build time"));
 #endif
 
-#ifdef HAVE_LZIP_DECODER
+	// The same for .lz whose compression and decompression support
+	// can be disabled separately.
+#if defined(HAVE_LZIP_DECODER) && !defined(HAVE_LZIP_ENCODER)
 	if (opt_mode == MODE_COMPRESS && opt_format == FORMAT_LZIP)
-		message_fatal(_("Compression of lzip files (.lz) "
-				"is not supported"));
+		message_fatal(_(".lz compression support was disabled "
+				"at build time"));
+#endif
+#if defined(HAVE_LZIP_ENCODER) && !defined(HAVE_LZIP_DECODER)
+	if (opt_mode != MODE_COMPRESS && opt_format == FORMAT_LZIP)
+		message_fatal(_(".lz decompression support was disabled "
+				"at build time"));
 #endif
 
 	// Never remove the source file when the destination is not on disk.
@@ -839,6 +877,20 @@ args_parse(args_info *args, int argc, char **argv)
 		opt_block_list = NULL;
 	}
 
+	// Likewise, --auto-filters only makes sense when creating .xz files.
+	// It chooses the filter chain of every Block by itself so it cannot
+	// be combined with --block-list.
+	if (opt_auto_filters) {
+		if (opt_mode != MODE_COMPRESS || opt_format != FORMAT_XZ) {
+			message(V_WARNING, _("--auto-filters is ignored "
+					"unless compressing to the .xz format"));
+			opt_auto_filters = false;
+		} else if (opt_block_list != NULL) {
+			message_fatal(_("--auto-filters cannot be used "
+					"together with --block-list"));
+		}
+	}
+
 	// If raw format is used and a custom suffix is not provided,
 	// then only stdout mode can be used when compressing or
 	// decompressing.
@@ -37,6 +37,8 @@ extern bool opt_keep_original;
 // extern bool opt_recursive;
 extern bool opt_robot;
 extern bool opt_ignore_check;
+extern bool opt_index_cache;
+extern bool opt_index_cache_write;
 
 extern const char stdin_filename[];
 
@@ -18,6 +18,7 @@
 enum coder_init_ret {
 	CODER_INIT_NORMAL,
 	CODER_INIT_PASSTHRU,
+	CODER_INIT_PARALLEL_TEST,
 	CODER_INIT_ERROR,
 };
 
@@ -27,6 +28,7 @@ enum format_type opt_format = FORMAT_AUTO;
 bool opt_auto_adjust = true;
 bool opt_single_stream = false;
 uint64_t opt_block_size = 0;
+bool opt_auto_filters = false;
 block_list_entry *opt_block_list = NULL;
 uint64_t block_list_largest;
 uint32_t block_list_chain_mask;
@@ -86,6 +88,11 @@ static lzma_mt mt_options = {
 };
 #endif
 
+#ifdef PARALLEL_ENABLED
+/// Index of the file when coder_init() returns CODER_INIT_PARALLEL_TEST
+static lzma_index *parallel_index = NULL;
+#endif
+
 
 extern void
 coder_set_check(lzma_check new_check)
@@ -267,7 +274,14 @@ get_chains_memusage(uint64_t *chains_memusages, const lzma_mt *mt, bool encode)
 		if (mt != NULL) {
 			assert(encode);
 			mt_local.filters = chains[i];
-			memusage = lzma_stream_encoder_mt_memusage(&mt_local);
+#	ifdef HAVE_LZIP_ENCODER
+			if (opt_format == FORMAT_LZIP)
+				memusage = lzma_lzip_encoder_mt_memusage(
+						&mt_local);
+			else
+#	endif
+				memusage = lzma_stream_encoder_mt_memusage(
+						&mt_local);
 		} else
 #endif
 		if (encode) {
@@ -291,14 +305,24 @@ get_chains_memusage(uint64_t *chains_memusages, const lzma_mt *mt, bool encode)
 #endif
 
 
-extern void
-coder_set_compression_settings(void)
+#if defined(HAVE_ENCODERS) && defined(MYTHREAD_ENABLED)
+/// Return true if there is a multithreaded encoder for opt_format.
+static bool
+format_has_mt_encoder(void)
 {
-#ifdef HAVE_LZIP_DECODER
-	// .lz compression isn't supported.
-	assert(opt_format != FORMAT_LZIP);
+#ifdef HAVE_LZIP_ENCODER
+	if (opt_format == FORMAT_LZIP)
+		return true;
+#endif
+
+	return opt_format == FORMAT_XZ;
+}
 #endif
 
+
+extern void
+coder_set_compression_settings(void)
+{
 	// The default check type is CRC64, but fallback to CRC32
 	// if CRC64 isn't supported by the copy of liblzma we are
 	// using. CRC32 is always supported.
@@ -376,9 +400,15 @@ coder_set_compression_settings(void)
 		if (lzma_lzma_preset(&opt_lzma, preset_number))
 			message_bug();
 
-		// Use LZMA2 except with --format=lzma we use LZMA1.
+		// Use LZMA2 except with --format=lzma and --format=lzip
+		// we use LZMA1. The LZMA1 presets use lc=3, lp=0, and pb=2
+		// which is what the .lz format requires.
 		default_filters[0].id = opt_format == FORMAT_LZMA
 				? LZMA_FILTER_LZMA1 : LZMA_FILTER_LZMA2;
+#ifdef HAVE_LZIP_ENCODER
+		if (opt_format == FORMAT_LZIP)
+			default_filters[0].id = LZMA_FILTER_LZMA1;
+#endif
 		default_filters[0].options = &opt_lzma;
 
 		filters_count = 1;
@@ -396,6 +426,27 @@ coder_set_compression_settings(void)
 		message_fatal(_("The .lzma format supports only "
 				"the LZMA1 filter"));
 
+#ifdef HAVE_LZIP_ENCODER
+	// The .lz format is even more restricted: lc/lp/pb are fixed and
+	// the dictionary size cannot be over 512 MiB. --block-list is
+	// incompatible with FORMAT_LZIP too.
+	if (opt_format == FORMAT_LZIP) {
+		if (filters_count != 1
+				|| default_filters[0].id != LZMA_FILTER_LZMA1)
+			message_fatal(_("The .lz format supports only "
+					"the LZMA1 filter"));
+
+		const lzma_options_lzma *opt = default_filters[0].options;
+		if (opt->lc != 3 || opt->lp != 0 || opt->pb != 2)
+			message_fatal(_("The .lz format requires "
+					"lc=3, lp=0, and pb=2"));
+
+		if (opt->dict_size > (UINT32_C(512) << 20))
+			message_fatal(_("The .lz format supports "
+					"dictionary sizes up to 512 MiB"));
+	}
+#endif
+
 	// If we are using the .xz format, make sure that there is no LZMA1
 	// filter to prevent LZMA_PROG_ERROR. With the chains from --filtersX
 	// we have already ensured this by calling lzma_str_to_filters()
@@ -411,6 +462,40 @@ coder_set_compression_settings(void)
 		message_filters_show(V_DEBUG, default_filters);
 	}
 
+#ifdef HAVE_ENCODERS
+	if (opt_auto_filters) {
+		// args.c ensures these.
+		assert(opt_mode == MODE_COMPRESS);
+		assert(opt_format == FORMAT_XZ);
+		assert(opt_block_list == NULL);
+
+		// The automatically chosen filters are put in front of
+		// the LZMA2 filter of the default chain. Other filters
+		// in the default chain would be in the way.
+		if (filters_count != 1
+				|| default_filters[0].id != LZMA_FILTER_LZMA2)
+			message_fatal(_("With --auto-filters, the filter "
+					"chain must contain only LZMA2"));
+
+		// The filter chain can only be changed between Blocks.
+		// Unless --block-size was used, use the same Block size
+		// as the multithreaded encoder would use by default.
+		// The memory usage of the filters added in front of
+		// LZMA2 is tiny and isn't taken into account.
+		if (opt_block_size == 0) {
+			opt_block_size = lzma_mt_block_size(default_filters);
+			if (opt_block_size == UINT64_MAX)
+				message_fatal(_("Unsupported options in "
+						"filter chain %u"), 0);
+		}
+
+		// The BCJ filters don't support LZMA_SYNC_FLUSH.
+		if (opt_flush_timeout != 0)
+			message_fatal(_("--auto-filters is incompatible "
+					"with --flush-timeout"));
+	}
+#endif
+
 	// The --flush-timeout option requires LZMA_SYNC_FLUSH support
 	// from the filter chain. Currently the threaded encoder doesn't
 	// support LZMA_SYNC_FLUSH so single-threaded mode must be used.
@@ -461,15 +546,16 @@ coder_set_compression_settings(void)
 	if (opt_mode == MODE_COMPRESS) {
 #ifdef HAVE_ENCODERS
 #	ifdef MYTHREAD_ENABLED
-		if (opt_format == FORMAT_XZ && hardware_threads_is_mt()) {
+		if (format_has_mt_encoder() && hardware_threads_is_mt()) {
 			memory_limit = hardware_memlimit_mtenc_get();
 			mt_options.threads = hardware_threads_get();
 
 			uint64_t block_size = opt_block_size;
 
 			// If opt_block_size is not set, find the maximum
-			// recommended Block size based on the filter chains
-			if (block_size == 0) {
+			// recommended Block size based on the filter chains.
+			// The .lz encoder picks the member size by itself.
+			if (block_size == 0 && opt_format == FORMAT_XZ) {
 				for (unsigned i = 0; i < ARRAY_SIZE(chains);
 						i++) {
 					if (!(chains_used_mask & (1U << i)))
@@ -557,7 +643,7 @@ coder_set_compression_settings(void)
 
 #ifdef HAVE_ENCODERS
 #	ifdef MYTHREAD_ENABLED
-	if (opt_format == FORMAT_XZ && hardware_threads_is_mt()) {
+	if (format_has_mt_encoder() && hardware_threads_is_mt()) {
 		// Try to reduce the number of threads before
 		// adjusting the compression settings down.
 		while (mt_options.threads > 1) {
@@ -804,8 +890,9 @@ is_format_lzip(void)
 /// Detect the input file type (for now, this done only when decompressing),
 /// and initialize an appropriate coder. Return value indicates if a normal
 /// liblzma-based coder was initialized (CODER_INIT_NORMAL), if passthru
-/// mode should be used (CODER_INIT_PASSTHRU), or if an error occurred
-/// (CODER_INIT_ERROR).
+/// mode should be used (CODER_INIT_PASSTHRU), if the .xz file should be
+/// tested with parallel_test() (CODER_INIT_PARALLEL_TEST), or if an error
+/// occurred (CODER_INIT_ERROR).
 static enum coder_init_ret
 coder_init(file_pair *pair)
 {
@@ -849,11 +936,22 @@ coder_init(file_pair *pair)
 					active_filters[0].options);
 			break;
 
-#	ifdef HAVE_LZIP_DECODER
+#	ifdef HAVE_LZIP_ENCODER
 		case FORMAT_LZIP:
-			// args.c should disallow this.
+#		ifdef MYTHREAD_ENABLED
+			mt_options.filters = active_filters;
+			if (hardware_threads_is_mt())
+				ret = lzma_lzip_encoder_mt(
+						&strm, &mt_options);
+			else
+#		endif
+				ret = lzma_lzip_encoder(&strm,
+						active_filters[0].options);
+			break;
+#	elif defined(HAVE_LZIP_DECODER)
+		case FORMAT_LZIP:
+			// args.c ensures this.
 			assert(0);
-			ret = LZMA_PROG_ERROR;
 			break;
 #	endif
 
@@ -911,6 +1009,11 @@ coder_init(file_pair *pair)
 			if (is_format_lzip())
 				init_format = FORMAT_LZIP;
 			break;
+#	elif defined(HAVE_LZIP_ENCODER)
+		case FORMAT_LZIP:
+			// args.c ensures this.
+			assert(0);
+			break;
 #	endif
 
 		case FORMAT_RAW:
@@ -937,6 +1040,21 @@ coder_init(file_pair *pair)
 			break;
 
 		case FORMAT_XZ:
+#	ifdef PARALLEL_ENABLED
+			// With --test the Blocks can be decoded straight
+			// from the file using the Index. Unlike the threaded
+			// Stream decoder, this doesn't need the sizes to be
+			// stored in the Block Headers.
+			parallel_index = opt_mode == MODE_TEST
+					? parallel_test_init(pair) : NULL;
+			if (parallel_index != NULL) {
+				// These are needed for progress info.
+				strm.total_in = 0;
+				strm.total_out = 0;
+				return CODER_INIT_PARALLEL_TEST;
+			}
+#	endif
+
 #	ifdef MYTHREAD_ENABLED
 			mt_options.flags = flags;
 
@@ -956,6 +1074,12 @@ coder_init(file_pair *pair)
 					= mt_options.threads == 1
 					? 0 : hardware_memlimit_mtdec_get();
 
+			// Let the threads decode ahead as far as the memory
+			// limit allows. This keeps the threads busy when
+			// a big Block is followed by many small ones.
+			mt_options.decode_ahead
+					= mt_options.memlimit_threading;
+
 			ret = lzma_stream_decoder_mt(&strm, &mt_options);
 #	else
 			ret = lzma_stream_decoder(&strm,
@@ -973,9 +1097,30 @@ coder_init(file_pair *pair)
 #	ifdef HAVE_LZIP_DECODER
 		case FORMAT_LZIP:
 			allow_trailing_input = true;
+#		ifdef MYTHREAD_ENABLED
+			// The threaded .lz decoder decodes the members
+			// in parallel. The memory limits are used like
+			// with .xz above.
+			mt_options.flags = flags;
+			mt_options.threads = hardware_threads_get();
+			mt_options.memlimit_stop
+				= hardware_memlimit_get(MODE_DECOMPRESS);
+			mt_options.memlimit_threading
+					= mt_options.threads == 1
+					? 0 : hardware_memlimit_mtdec_get();
+
+			ret = lzma_lzip_decoder_mt(&strm, &mt_options);
+#		else
 			ret = lzma_lzip_decoder(&strm,
 					hardware_memlimit_get(
 						MODE_DECOMPRESS), flags);
+#		endif
+			break;
+#	elif defined(HAVE_LZIP_ENCODER)
+		case FORMAT_LZIP:
+			// The .lz format is never detected without
+			// the decoder.
+			assert(0);
 			break;
 #	endif
 
@@ -1123,6 +1268,70 @@ coder_write_output(file_pair *pair)
 }
 
 
+#ifdef HAVE_ENCODERS
+/// Choose the filter chain for the next Block when --auto-filters is used.
+/// buf and size are the first chunk of the uncompressed data of the Block.
+/// current is the result that was used for the previous Block.
+static void
+auto_filters_update(sniff_result *current, const uint8_t *buf, size_t size)
+{
+	sniff_result result;
+	sniff_data(&result, buf, size);
+
+	// Avoid reinitializing the encoder if nothing changes.
+	if (result.filter_id == current->filter_id
+			&& result.delta_dist == current->delta_dist
+			&& result.incompressible == current->incompressible)
+		return;
+
+	*current = result;
+
+	// lzma_filters_update() makes a copy of the options.
+	lzma_options_delta opt_delta;
+	lzma_options_lzma opt_lzma;
+
+	lzma_filter filters[3];
+	size_t i = 0;
+
+	if (result.filter_id == LZMA_FILTER_DELTA) {
+		opt_delta.type = LZMA_DELTA_TYPE_BYTE;
+		opt_delta.dist = result.delta_dist;
+		filters[i].id = LZMA_FILTER_DELTA;
+		filters[i].options = &opt_delta;
+		++i;
+	} else if (result.filter_id != LZMA_VLI_UNKNOWN) {
+		// BCJ filters with the default options
+		filters[i].id = result.filter_id;
+		filters[i].options = NULL;
+		++i;
+	}
+
+	// coder_set_compression_settings() ensures that the default
+	// filter chain is only LZMA2. With incompressible data use
+	// the fastest settings that don't change the memory usage.
+	// LZMA2 will store the data in uncompressed chunks anyway.
+	opt_lzma = *(const lzma_options_lzma *)(chains[0][0].options);
+	if (result.incompressible) {
+		opt_lzma.mode = LZMA_MODE_FAST;
+		opt_lzma.nice_len = 8;
+		opt_lzma.depth = 4;
+	}
+
+	filters[i].id = LZMA_FILTER_LZMA2;
+	filters[i].options = &opt_lzma;
+	filters[++i].id = LZMA_VLI_UNKNOWN;
+
+	const lzma_ret ret = lzma_filters_update(&strm, filters);
+	if (ret != LZMA_OK)
+		message_fatal(_("Error changing the filter chain: %s"),
+				message_strm(ret));
+
+	message_filters_show(V_DEBUG, filters);
+	return;
+}
+#endif
+
+
 /// Compress or decompress using liblzma.
 static bool
 coder_normal(file_pair *pair)
@@ -1143,8 +1352,9 @@ coder_normal(file_pair *pair)
 	// block_remaining indicates how many input bytes to encode before
 	// finishing the current .xz Block. The Block size is set with
 	// --block-size=SIZE and --block-list. They have an effect only when
-	// compressing to the .xz format. If block_remaining == UINT64_MAX,
-	// only a single block is created.
+	// compressing to the .xz format or, in single-threaded mode, to
+	// the .lz format. If block_remaining == UINT64_MAX, only a single
+	// block is created.
 	uint64_t block_remaining = UINT64_MAX;
 
 	// next_block_remaining for when we are in single-threaded mode and
@@ -1154,6 +1364,25 @@ coder_normal(file_pair *pair)
 	// Position in opt_block_list. Unused if --block-list wasn't used.
 	size_t list_pos = 0;
 
+	// With --auto-filters, this is set to true when a new Block is
+	// started so that the filter chain is chosen based on the next
+	// input chunk. The encoder has been initialized with the default
+	// chain, that is, plain LZMA2.
+	bool auto_filters_needed = false;
+	sniff_result auto_filters_current = {
+		.filter_id = LZMA_VLI_UNKNOWN,
+		.delta_dist = 0,
+		.incompressible = false,
+	};
+
+#	ifdef HAVE_LZIP_ENCODER
+	// With .lz, --block-size sets the member size. Like with .xz,
+	// the threaded encoder does the splitting by itself.
+	if (opt_mode == MODE_COMPRESS && opt_format == FORMAT_LZIP
+			&& !hardware_threads_is_mt() && opt_block_size > 0)
+		block_remaining = opt_block_size;
+#	endif
+
 	// Handle --block-size for single-threaded mode and the first step
 	// of --block-list.
 	if (opt_mode == MODE_COMPRESS && opt_format == FORMAT_XZ) {
@@ -1163,6 +1392,14 @@ coder_normal(file_pair *pair)
 		if (!hardware_threads_is_mt() && opt_block_size > 0)
 			block_remaining = opt_block_size;
 
+		// With --auto-filters we need to know where the Blocks
+		// start in multithreaded mode too. coder_set_compression_
+		// settings() has ensured that opt_block_size is set.
+		if (opt_auto_filters) {
+			block_remaining = opt_block_size;
+			auto_filters_needed = true;
+		}
+
 		// If --block-list was used, start with the first size.
 		//
 		// For threaded case, --block-size specifies how big Blocks
@@ -1205,6 +1442,14 @@ coder_normal(file_pair *pair)
 			if (strm.avail_in == SIZE_MAX)
 				break;
 
+#ifdef HAVE_ENCODERS
+			if (auto_filters_needed) {
+				auto_filters_needed = false;
+				auto_filters_update(&auto_filters_current,
+						in_buf.u8, strm.avail_in);
+			}
+#endif
+
 			if (pair->src_eof) {
 				action = LZMA_FINISH;
 			}
@@ -1248,9 +1493,11 @@ coder_normal(file_pair *pair)
 			} else {
 				// Start a new Block after LZMA_FULL_BARRIER.
 				if (opt_block_list == NULL) {
-					assert(!hardware_threads_is_mt());
+					assert(!hardware_threads_is_mt()
+							|| opt_auto_filters);
 					assert(opt_block_size > 0);
 					block_remaining = opt_block_size;
+					auto_filters_needed = opt_auto_filters;
 				} else {
 					split_block(&block_remaining,
 							&next_block_remaining,
@@ -1350,6 +1597,40 @@ coder_normal(file_pair *pair)
 }
 
 
+#ifdef MYTHREAD_ENABLED
+/// Show how the work was divided between the threads.
+static void
+show_worker_stats(void)
+{
+	if (message_verbosity_get() < V_DEBUG)
+		return;
+
+	const uint32_t count = lzma_get_worker_stats(&strm, NULL, 0);
+	if (count == 0)
+		return;
+
+	lzma_worker_stats *stats = xmalloc(count * sizeof(*stats));
+	lzma_get_worker_stats(&strm, stats, count);
+
+	for (uint32_t i = 0; i < count; ++i)
+		message(V_DEBUG, _("Thread %" PRIu32 ": %s Blocks, "
+				"%s in, %s out, waited for input %s times, "
+				"reused %s allocations"),
+				i + 1,
+				uint64_to_str(stats[i].blocks, 0),
+				uint64_to_nicestr(stats[i].progress_in,
+					NICESTR_B, NICESTR_TIB, false, 1),
+				uint64_to_nicestr(stats[i].progress_out,
+					NICESTR_B, NICESTR_TIB, false, 2),
+				uint64_to_str(stats[i].input_waits, 3),
+				uint64_to_str(stats[i].allocs_avoided, 4));
+
+	free(stats);
+	return;
+}
+#endif
+
+
 /// Copy from input file to output file without processing the data in any
 /// way. This is used only when trying to decompress unrecognized files
 /// with --decompress --stdout --force, so the output is always stdout.
@@ -1427,23 +1708,43 @@ coder_run(const char *filename)
 				// to take into account the current reading
 				// position since with stdin it isn't
 				// necessarily at the beginning of the file.
-				const bool is_passthru = init_ret
-						== CODER_INIT_PASSTHRU;
+				//
+				// In passthru mode and when testing in
+				// parallel, the progress is taken from
+				// strm.total_in and strm.total_out.
+				const bool is_normal = init_ret
+						== CODER_INIT_NORMAL;
 				const uint64_t in_size
 					= pair->src_st.st_size <= 0
 					? 0 : (uint64_t)(pair->src_st.st_size);
 				message_progress_start(&strm,
-						is_passthru, in_size);
+						!is_normal, in_size);
 
 				// Do the actual coding or passthru.
-				if (is_passthru)
+				if (init_ret == CODER_INIT_PASSTHRU)
 					success = coder_passthru(pair);
+#ifdef PARALLEL_ENABLED
+				else if (init_ret
+						== CODER_INIT_PARALLEL_TEST)
+					success = parallel_test(pair, &strm,
+							parallel_index);
+#endif
 				else
 					success = coder_normal(pair);
 
 				message_progress_end(success);
+
+#ifdef MYTHREAD_ENABLED
+				if (is_normal)
+					show_worker_stats();
+#endif
 			}
 		}
+
+#ifdef PARALLEL_ENABLED
+		lzma_index_end(parallel_index, NULL);
+		parallel_index = NULL;
+#endif
 	}
 
 	// Close the file pair. It needs to know if coding was successful to
@@ -23,7 +23,7 @@ enum format_type {
 	FORMAT_AUTO,
 	FORMAT_XZ,
 	FORMAT_LZMA,
-#ifdef HAVE_LZIP_DECODER
+#if defined(HAVE_LZIP_ENCODER) || defined(HAVE_LZIP_DECODER)
 	FORMAT_LZIP,
 #endif
 	FORMAT_RAW,
@@ -60,6 +60,10 @@ extern bool opt_single_stream;
 /// of input. This has an effect only when compressing to the .xz format.
 extern uint64_t opt_block_size;
 
+/// If true, the filter chain of each .xz Block is chosen automatically
+/// based on the beginning of the uncompressed data of the Block.
+extern bool opt_auto_filters;
+
 /// List of block size and filter chain pointer pairs.
 extern block_list_entry *opt_block_list;
 
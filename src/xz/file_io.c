@@ -1203,6 +1203,169 @@ io_pread(file_pair *pair, io_buf *buf, size_t size, uint64_t pos)
 }
 
 
+#ifdef HAVE_DECODERS
+/// Maximum size of a single read() or write() of the index cache. Keep
+/// it small enough for the read() and write() macros used with MSVC.
+#define INDEX_CACHE_CHUNK ((size_t)(1) << 20)
+
+
+/// The new cache is written to a temporary file which is then renamed
+/// over the old cache so that a partially written cache never replaces
+/// a good one.
+#define INDEX_CACHE_TMP_SUFFIX INDEX_CACHE_SUFFIX ".tmp"
+
+
+static char *
+index_cache_name(const file_pair *pair, const char *suffix)
+{
+	const size_t len = strlen(pair->src_name);
+	const size_t suffix_size = strlen(suffix) + 1;
+	char *name = xmalloc(len + suffix_size);
+	memcpy(name, pair->src_name, len);
+	memcpy(name + len, suffix, suffix_size);
+	return name;
+}
+
+
+/// Get the modification time of the source file in nanoseconds
+/// if the nanoseconds are available.
+static uint64_t
+index_cache_mtime(const file_pair *pair)
+{
+	uint64_t mtime = (uint64_t)(pair->src_st.st_mtime) * 1000000000;
+
+#	if defined(HAVE_STRUCT_STAT_ST_ATIM_TV_NSEC)
+	mtime += (uint64_t)(pair->src_st.st_mtim.tv_nsec);
+#	elif defined(HAVE_STRUCT_STAT_ST_ATIMESPEC_TV_NSEC)
+	mtime += (uint64_t)(pair->src_st.st_mtimespec.tv_nsec);
+#	endif
+
+	return mtime;
+}
+
+
+extern lzma_index *
+io_index_cache_load(const file_pair *pair, uint64_t memlimit)
+{
+	char *name = index_cache_name(pair, INDEX_CACHE_SUFFIX);
+	const int fd = open(name, O_RDONLY | O_BINARY | O_NOCTTY);
+	free(name);
+
+	if (fd == -1)
+		return NULL;
+
+	// The cache is read with one read() in the common case. Don't
+	// allocate a silly amount of memory if the cache file is huge.
+	lzma_index *idx = NULL;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+			&& (uint64_t)(st.st_size) <= my_min(
+				memlimit, SIZE_MAX / 2)) {
+		const size_t size = (size_t)(st.st_size);
+		uint8_t *buf = xmalloc(size);
+		size_t pos = 0;
+
+		while (pos < size) {
+			const ssize_t amount = read(fd, buf + pos,
+					my_min(size - pos, INDEX_CACHE_CHUNK));
+			if (amount > 0)
+				pos += (size_t)(amount);
+			else if (amount == 0 || errno != EINTR || user_abort)
+				break;
+		}
+
+		// lzma_index_cache_decode() sets idx to NULL on error.
+		if (pos == size && lzma_index_cache_decode(&idx, memlimit,
+				NULL, buf, size,
+				(uint64_t)(pair->src_st.st_size),
+				index_cache_mtime(pair)) != LZMA_OK)
+			assert(idx == NULL);
+
+		free(buf);
+	}
+
+	(void)close(fd);
+	return idx;
+}
+
+
+extern void
+io_index_cache_save(const file_pair *pair, const lzma_index *idx)
+{
+#ifdef HAVE_ENCODERS
+	char *name = index_cache_name(pair, INDEX_CACHE_SUFFIX);
+
+	uint8_t *buf;
+	size_t size;
+	const lzma_ret ret = lzma_index_cache_encode(idx,
+			(uint64_t)(pair->src_st.st_size),
+			index_cache_mtime(pair), NULL, &buf, &size);
+	if (ret != LZMA_OK) {
+		message(V_DEBUG, _("%s: Cannot write the index cache: %s"),
+				name, message_strm(ret));
+		free(name);
+		return;
+	}
+	char *tmp_name = index_cache_name(pair, INDEX_CACHE_TMP_SUFFIX);
+
+	// O_EXCL makes this fail if another xz is writing the same cache
+	// or if an old temporary file was left behind. Neither is
+	// overwritten.
+	int saved_errno = 0;
+	const int fd = open(tmp_name, O_WRONLY | O_BINARY | O_NOCTTY
+			| O_CREAT | O_EXCL, 0666);
+	if (fd == -1) {
+		saved_errno = errno;
+	} else {
+		size_t pos = 0;
+		while (pos < size) {
+			const ssize_t amount = write(fd, buf + pos,
+					my_min(size - pos, INDEX_CACHE_CHUNK));
+			if (amount > 0) {
+				pos += (size_t)(amount);
+			} else if (amount == -1 && errno == EINTR
+					&& !user_abort) {
+				continue;
+			} else {
+				saved_errno = amount == -1 ? errno : EIO;
+				break;
+			}
+		}
+
+		if (close(fd) && saved_errno == 0)
+			saved_errno = errno;
+
+#	ifdef TUKLIB_DOSLIKE
+		// rename() doesn't replace an existing file on DOS and
+		// Windows. A reader may miss the cache for a moment but
+		// it never sees a partial one.
+		if (saved_errno == 0)
+			(void)unlink(name);
+#	endif
+
+		if (saved_errno == 0 && rename(tmp_name, name))
+			saved_errno = errno;
+
+		if (saved_errno != 0)
+			(void)unlink(tmp_name);
+	}
+
+	if (saved_errno != 0)
+		message(V_DEBUG, _("%s: Cannot write the index cache: %s"),
+				name, strerror(saved_errno));
+
+	free(tmp_name);
+	free(name);
+	free(buf);
+#else
+	(void)pair;
+	(void)idx;
+#endif
+	return;
+}
+#endif
+
+
 static bool
 is_sparse(const io_buf *buf)
 {
@@ -40,6 +40,10 @@ typedef union {
 } io_buf;
 
 
+/// Suffix of the file that holds the index cache of a .xz file
+#define INDEX_CACHE_SUFFIX ".xzidx"
+
+
 typedef struct {
 	/// Name of the source filename (as given on the command line) or
 	/// pointer to static "(stdin)" when reading from standard input.
@@ -171,6 +175,33 @@ extern bool io_seek_src(file_pair *pair, uint64_t pos);
 extern bool io_pread(file_pair *pair, io_buf *buf, size_t size, uint64_t pos);
 
 
+#ifdef HAVE_DECODERS
+/// \brief      Read the Index of the source file from its index cache
+///
+/// The index cache is a file whose name is the name of the source file
+/// with INDEX_CACHE_SUFFIX appended. It is used only if it matches the
+/// size and modification time of the source file. Errors are silently
+/// ignored since the caller can always read the Index from the source
+/// file instead.
+///
+/// \param      pair        File pair having the source file open
+/// \param      memlimit    Memory usage limit for the lzma_index
+///
+/// \return     The Index of the source file or NULL if there is no
+///             usable index cache.
+extern lzma_index *io_index_cache_load(
+		const file_pair *pair, uint64_t memlimit);
+
+
+/// \brief      Write the index cache of the source file
+///
+/// The cache is written to a temporary file that is then renamed over
+/// the old cache. Errors are shown only with --verbose --verbose since
+/// the cache is only an optimization.
+extern void io_index_cache_save(const file_pair *pair, const lzma_index *idx);
+#endif
+
+
 /// \brief      Writes a buffer to the destination file
 ///
 /// \param      pair    File pair having the destination file open for writing
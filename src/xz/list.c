@@ -197,6 +197,29 @@ static const char check_names[LZMA_CHECK_ID_MAX + 1][12] = {
 static char check_value[2 * LZMA_CHECK_SIZE_MAX + 1];
 
 
+/// Number of Blocks whose Block Header and Check field are read at once.
+/// Without threads the Blocks are read one at a time so that an error
+/// is shown after the information of the preceding Blocks like before.
+#ifdef PARALLEL_ENABLED
+#	define PREFETCH_BLOCKS 256
+#else
+#	define PREFETCH_BLOCKS 1
+#endif
+
+/// Block Headers and Check fields read by prefetch_blocks()
+static struct {
+	/// Array of PREFETCH_BLOCKS elements
+	parallel_block *blocks;
+
+	/// Number of the first Block in blocks[] (number_in_file)
+	uint64_t first;
+
+	/// Number of Blocks in blocks[]. This is reset to zero for
+	/// each file.
+	size_t count;
+} prefetch;
+
+
 /// Totals that are displayed if there was more than one file.
 /// The "files" counter is also used in print_info_adv() to show
 /// the file number.
@@ -335,6 +358,19 @@ xz_ver_to_str(uint32_t ver)
 }
 
 
+/// Calculate xfi->stream_padding from xfi->idx.
+static void
+set_stream_padding(xz_file_info *xfi)
+{
+	lzma_index_iter iter;
+	lzma_index_iter_init(&iter, xfi->idx);
+	while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_STREAM))
+		xfi->stream_padding += iter.stream.padding;
+
+	return;
+}
+
+
 /// \brief      Parse the Index(es) from the given .xz file
 ///
 /// \param      xfi     Pointer to structure where the decoded information
@@ -357,6 +393,15 @@ parse_indexes(xz_file_info *xfi, file_pair *pair)
 		return true;
 	}
 
+	if (opt_index_cache) {
+		xfi->idx = io_index_cache_load(pair,
+				hardware_memlimit_get(MODE_LIST));
+		if (xfi->idx != NULL) {
+			set_stream_padding(xfi);
+			return false;
+		}
+	}
+
 	io_buf buf;
 	lzma_stream strm = LZMA_STREAM_INIT;
 	lzma_index *idx = NULL;
@@ -396,19 +441,15 @@ parse_indexes(xz_file_info *xfi, file_pair *pair)
 			strm.avail_in = 0;
 			break;
 
-		case LZMA_STREAM_END: {
+		case LZMA_STREAM_END:
 			lzma_end(&strm);
 			xfi->idx = idx;
 
-			// Calculate xfi->stream_padding.
-			lzma_index_iter iter;
-			lzma_index_iter_init(&iter, xfi->idx);
-			while (!lzma_index_iter_next(&iter,
-					LZMA_INDEX_ITER_STREAM))
-				xfi->stream_padding += iter.stream.padding;
+			if (opt_index_cache_write)
+				io_index_cache_save(pair, idx);
 
+			set_stream_padding(xfi);
 			return false;
-		}
 
 		default:
 			message_error(_("%s: %s"), pair->src_name,
@@ -437,23 +478,14 @@ error:
 /// \return     False on success, true on error.
 static bool
 parse_block_header(file_pair *pair, const lzma_index_iter *iter,
-		block_header_info *bhi, xz_file_info *xfi)
+		const parallel_block *blk, block_header_info *bhi,
+		xz_file_info *xfi)
 {
-#if IO_BUFFER_SIZE < LZMA_BLOCK_HEADER_SIZE_MAX
-#	error IO_BUFFER_SIZE < LZMA_BLOCK_HEADER_SIZE_MAX
-#endif
-
-	// Get the whole Block Header with one read, but don't read past
-	// the end of the Block (or even its Check field).
-	const uint32_t size = my_min(iter->block.total_size
-				- lzma_check_size(iter->stream.flags->check),
-			LZMA_BLOCK_HEADER_SIZE_MAX);
-	io_buf buf;
-	if (io_pread(pair, &buf, size, iter->block.compressed_file_offset))
-		return true;
+	const uint32_t size = blk->header_size;
+	const uint8_t *buf = blk->header;
 
 	// Zero would mean Index Indicator and thus not a valid Block.
-	if (buf.u8[0] == 0)
+	if (buf[0] == 0)
 		goto data_error;
 
 	// Initialize the block structure and decode Block Header Size.
@@ -463,12 +495,12 @@ parse_block_header(file_pair *pair, const lzma_index_iter *iter,
 	block.check = iter->stream.flags->check;
 	block.filters = filters;
 
-	block.header_size = lzma_block_header_size_decode(buf.u8[0]);
+	block.header_size = lzma_block_header_size_decode(buf[0]);
 	if (block.header_size > size)
 		goto data_error;
 
 	// Decode the Block Header.
-	switch (lzma_block_header_decode(&block, NULL, buf.u8)) {
+	switch (lzma_block_header_decode(&block, NULL, buf)) {
 	case LZMA_OK:
 		break;
 
@@ -605,44 +637,86 @@ data_error:
 /// \brief      Parse the Check field and put it into check_value[]
 ///
 /// \return     False on success, true on error.
-static bool
-parse_check_value(file_pair *pair, const lzma_index_iter *iter)
+static void
+parse_check_value(const lzma_index_iter *iter, const parallel_block *blk)
 {
-	// Don't read anything from the file if there is no integrity Check.
 	if (iter->stream.flags->check == LZMA_CHECK_NONE) {
 		snprintf(check_value, sizeof(check_value), "---");
-		return false;
+		return;
 	}
 
-	// Locate and read the Check field.
-	const uint32_t size = lzma_check_size(iter->stream.flags->check);
-	const uint64_t offset = iter->block.compressed_file_offset
-			+ iter->block.total_size - size;
-	io_buf buf;
-	if (io_pread(pair, &buf, size, offset))
-		return true;
+	const uint32_t size = blk->check_size;
+	const uint8_t *buf = blk->check;
 
 	// CRC32 and CRC64 are in little endian. Guess that all the future
 	// 32-bit and 64-bit Check values are little endian too. It shouldn't
 	// be a too big problem if this guess is wrong.
 	if (size == 4)
 		snprintf(check_value, sizeof(check_value),
-				"%08" PRIx32, conv32le(buf.u32[0]));
+				"%08" PRIx32, read32le(buf));
 	else if (size == 8)
 		snprintf(check_value, sizeof(check_value),
-				"%016" PRIx64, conv64le(buf.u64[0]));
+				"%016" PRIx64, read64le(buf));
 	else
 		for (size_t i = 0; i < size; ++i)
-			snprintf(check_value + i * 2, 3, "%02x", buf.u8[i]);
+			snprintf(check_value + i * 2, 3, "%02x", buf[i]);
 
-	return false;
+	return;
+}
+
+
+/// \brief      Read the Block Headers and Check fields of the next Blocks
+///
+/// The Blocks starting from iter are read into prefetch.blocks[] so that
+/// the file isn't accessed once per Block and the reads can be done in
+/// parallel.
+///
+/// \return     False on success, true on error.
+static bool
+prefetch_blocks(file_pair *pair, const lzma_index_iter *iter)
+{
+	if (prefetch.blocks == NULL)
+		prefetch.blocks = xmalloc(
+				PREFETCH_BLOCKS * sizeof(parallel_block));
+
+	// The iterator is copied so that the caller's iterator
+	// stays where it was.
+	lzma_index_iter it = *iter;
+	size_t count = 0;
+
+	do {
+		parallel_block *blk = &prefetch.blocks[count];
+		const uint32_t check_size
+				= lzma_check_size(it.stream.flags->check);
+
+		// Get the whole Block Header with one read, but don't read
+		// past the end of the Block (or even its Check field).
+		blk->header_pos = it.block.compressed_file_offset;
+		blk->header_size = (uint32_t)(my_min(
+				it.block.total_size - check_size,
+				LZMA_BLOCK_HEADER_SIZE_MAX));
+
+		// Don't read anything from the file if there is
+		// no integrity Check.
+		blk->check_size = it.stream.flags->check == LZMA_CHECK_NONE
+				? 0 : check_size;
+		blk->check_pos = it.block.compressed_file_offset
+				+ it.block.total_size - check_size;
+	} while (++count < PREFETCH_BLOCKS
+			&& !lzma_index_iter_next(&it, LZMA_INDEX_ITER_BLOCK));
+
+	prefetch.first = iter->block.number_in_file;
+	prefetch.count = count;
+
+	return parallel_read_blocks(pair, prefetch.blocks, count);
 }
 
 
 /// \brief      Parse detailed information about a Block
 ///
 /// Since this requires seek(s), listing information about all Blocks can
-/// be slow.
+/// be slow. To make it faster, the Block Headers and Check fields of
+/// many Blocks are read at once, in parallel if threading is supported.
 ///
 /// \param      pair    Input file
 /// \param      iter    Location of the Block whose Check value should
@@ -657,12 +731,24 @@ static bool
 parse_details(file_pair *pair, const lzma_index_iter *iter,
 		block_header_info *bhi, xz_file_info *xfi)
 {
-	if (parse_block_header(pair, iter, bhi, xfi))
+	// The Blocks are parsed in order so the next Block is either
+	// the next one in prefetch.blocks[] or the first one after them.
+	const uint64_t block = iter->block.number_in_file;
+	if (block < prefetch.first || block - prefetch.first
+			>= prefetch.count) {
+		if (prefetch_blocks(pair, iter))
+			return true;
+	}
+
+	const parallel_block *blk
+			= &prefetch.blocks[block - prefetch.first];
+	if (parallel_block_error(pair, blk))
 		return true;
 
-	if (parse_check_value(pair, iter))
+	if (parse_block_header(pair, iter, blk, bhi, xfi))
 		return true;
 
+	parse_check_value(iter, blk);
 	return false;
 }
 
@@ -1317,6 +1403,8 @@ list_file(const char *filename)
 		return;
 
 	xz_file_info xfi = XZ_FILE_INFO_INIT;
+	prefetch.count = 0;
+
 	if (!parse_indexes(&xfi, pair)) {
 		bool fail;
 
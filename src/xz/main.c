@@ -227,12 +227,15 @@ main(int argc, char **argv)
 	// any files:
 	//
 	//   - --stdout, --test, or --list was used. Note that --test
-	//     implies opt_stdout = true but --list doesn't.
+	//     implies opt_stdout = true but --list doesn't. --list with
+	//     --index-cache=write writes the cache files so it cannot use
+	//     the read-only sandbox.
 	//
 	//   - Output goes to stdout because --files or --files0 wasn't used
 	//     and no arguments were given on the command line or the
 	//     arguments are all "-" (indicating standard input).
-	bool to_stdout_only = opt_stdout || opt_mode == MODE_LIST;
+	bool to_stdout_only = opt_stdout
+			|| (opt_mode == MODE_LIST && !opt_index_cache_write);
 	if (!to_stdout_only && args.files_name == NULL) {
 		// If all of the filenames provided are "-" (more than one
 		// "-" could be specified), then we are only going to be
@@ -254,8 +257,10 @@ main(int argc, char **argv)
 		// Allow strict sandboxing if we are processing exactly one
 		// file to standard output. This requires that --files or
 		// --files0 wasn't specified (an unknown number of filenames
-		// could be provided that way).
-		if (args.files_name == NULL && args.arg_count == 1)
+		// could be provided that way). --index-cache needs to open
+		// the cache file after the source file.
+		if (args.files_name == NULL && args.arg_count == 1
+				&& !opt_index_cache)
 			sandbox_allow_strict();
 	}
 #endif
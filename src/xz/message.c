@@ -58,7 +58,9 @@ static lzma_stream *progress_strm;
 
 /// This is true if we are in passthru mode (not actually compressing or
 /// decompressing) and thus cannot use lzma_get_progress(progress_strm, ...).
-/// That is, we are using coder_passthru() in coder.c.
+/// That is, we are using coder_passthru() in coder.c. This is true also
+/// when testing with parallel_test() which doesn't use progress_strm
+/// for decoding but stores the progress in total_in and total_out.
 static bool progress_is_from_passthru;
 
 /// Expected size of the input stream is needed to show completion percentage
@@ -975,6 +977,10 @@ message_help(bool long_help)
 "                      ignore possible remaining input data"));
 		puts(_(
 "      --no-sparse     do not create sparse files when decompressing\n"
+"      --index-cache[=MODE]\n"
+"                      with --list, read the Index from FILE.xzidx if it\n"
+"                      matches FILE; MODE=write also creates or replaces\n"
+"                      FILE.xzidx if it is missing or out of date\n"
 "  -S, --suffix=.SUF   use the suffix '.SUF' on compressed files\n"
 "      --files[=FILE]  read filenames to process from FILE; if FILE is\n"
 "                      omitted, filenames are read from the standard input;\n"
@@ -1017,6 +1023,9 @@ message_help(bool long_help)
 "                      filter chain number (0-9) followed by a ':' before the\n"
 "                      uncompressed data size"));
 		puts(_(
+"      --auto-filters  choose BCJ, Delta, or plain LZMA2 for each .xz block\n"
+"                      based on a sample of its uncompressed data"));
+		puts(_(
 "      --flush-timeout=TIMEOUT\n"
 "                      when compressing, if more than TIMEOUT milliseconds has\n"
 "                      passed since the previous flush and reading more input\n"
@@ -1069,12 +1078,14 @@ message_help(bool long_help)
 "  --lzma2[=OPTS]      more of the following options (valid values; default):\n"
 "                        preset=PRE reset options to a preset (0-9[e])\n"
 "                        dict=NUM   dictionary size (4KiB - 1536MiB; 8MiB)\n"
-"                        lc=NUM     number of literal context bits (0-4; 3)\n"
-"                        lp=NUM     number of literal position bits (0-4; 0)\n"
-"                        pb=NUM     number of position bits (0-4; 2)\n"
-"                        mode=MODE  compression mode (fast, normal; normal)\n"
+"                        lc=NUM     literal context bits (0-4, auto; 3)\n"
+"                        lp=NUM     literal position bits (0-4, auto; 0)\n"
+"                        pb=NUM     position bits (0-4, auto; 2)\n"
+"                        mode=MODE  compression mode (fast, normal, turbo;\n"
+"                                   normal)\n"
 "                        nice=NUM   nice length of a match (2-273; 64)\n"
-"                        mf=NAME    match finder (hc3, hc4, bt2, bt3, bt4; bt4)\n"
+"                        mf=NAME    match finder (hc3, hc4, hc5, bt2, bt3,\n"
+"                                   bt4, bt5; bt4)\n"
 "                        depth=NUM  maximum search depth; 0=automatic (default)"));
 #endif
 
@@ -1088,6 +1099,8 @@ message_help(bool long_help)
 "  --ia64[=OPTS]       IA-64 (Itanium) BCJ filter\n"
 "  --sparc[=OPTS]      SPARC BCJ filter\n"
 "  --riscv[=OPTS]      RISC-V BCJ filter\n"
+"  --x86split[=OPTS]   x86 filter that stores branch targets separately\n"
+"                      (experimental, not in the .xz specification)\n"
 "                      Valid OPTS for all BCJ filters:\n"
 "                        start=NUM  start offset for conversions (default=0)"));
 
@@ -248,6 +248,17 @@ error_lzma_preset(const char *valuestr)
 }
 
 
+/// Parses the value of lc, lp, or pb. "auto" gives LZMA_LCLPPB_AUTO.
+static uint32_t
+parse_lclppb(const char *name, const char *valuestr, uint32_t max)
+{
+	if (strcmp(valuestr, "auto") == 0)
+		return LZMA_LCLPPB_AUTO;
+
+	return (uint32_t)(str_to_uint64(name, valuestr, 0, max));
+}
+
+
 static void
 set_lzma(void *options, unsigned key, uint64_t value, const char *valuestr)
 {
@@ -283,15 +294,15 @@ set_lzma(void *options, unsigned key, uint64_t value, const char *valuestr)
 		break;
 
 	case OPT_LC:
-		opt->lc = value;
+		opt->lc = parse_lclppb("lc", valuestr, LZMA_LCLP_MAX);
 		break;
 
 	case OPT_LP:
-		opt->lp = value;
+		opt->lp = parse_lclppb("lp", valuestr, LZMA_LCLP_MAX);
 		break;
 
 	case OPT_PB:
-		opt->pb = value;
+		opt->pb = parse_lclppb("pb", valuestr, LZMA_PB_MAX);
 		break;
 
 	case OPT_MODE:
@@ -319,15 +330,18 @@ options_lzma(const char *str)
 	static const name_id_map modes[] = {
 		{ "fast",   LZMA_MODE_FAST },
 		{ "normal", LZMA_MODE_NORMAL },
+		{ "turbo",  LZMA_MODE_TURBO },
 		{ NULL,     0 }
 	};
 
 	static const name_id_map mfs[] = {
 		{ "hc3", LZMA_MF_HC3 },
 		{ "hc4", LZMA_MF_HC4 },
+		{ "hc5", LZMA_MF_HC5 },
 		{ "bt2", LZMA_MF_BT2 },
 		{ "bt3", LZMA_MF_BT3 },
 		{ "bt4", LZMA_MF_BT4 },
+		{ "bt5", LZMA_MF_BT5 },
 		{ NULL,  0 }
 	};
 
@@ -335,9 +349,9 @@ options_lzma(const char *str)
 		{ "preset", NULL,   UINT64_MAX, 0 },
 		{ "dict",   NULL,   LZMA_DICT_SIZE_MIN,
 				(UINT32_C(1) << 30) + (UINT32_C(1) << 29) },
-		{ "lc",     NULL,   LZMA_LCLP_MIN, LZMA_LCLP_MAX },
-		{ "lp",     NULL,   LZMA_LCLP_MIN, LZMA_LCLP_MAX },
-		{ "pb",     NULL,   LZMA_PB_MIN, LZMA_PB_MAX },
+		{ "lc",     NULL,   UINT64_MAX, 0 },
+		{ "lp",     NULL,   UINT64_MAX, 0 },
+		{ "pb",     NULL,   UINT64_MAX, 0 },
 		{ "mode",   modes,  0, 0 },
 		{ "nice",   NULL,   2, 273 },
 		{ "mf",     mfs,    0, 0 },
@@ -351,7 +365,8 @@ options_lzma(const char *str)
 
 	parse_options(str, opts, &set_lzma, options);
 
-	if (options->lc + options->lp > LZMA_LCLP_MAX)
+	if (options->lc != LZMA_LCLPPB_AUTO && options->lp != LZMA_LCLPPB_AUTO
+			&& options->lc + options->lp > LZMA_LCLP_MAX)
 		message_fatal(_("The sum of lc and lp must not exceed 4"));
 
 	return options;
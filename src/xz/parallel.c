@@ -0,0 +1,681 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       parallel.c
+/// \brief      Reading and testing .xz Blocks in parallel using the Index
+///
+/// The Index tells where each Block is and how big it is, so the Blocks
+/// can be read and decoded independently of each other. Worker threads
+/// take the Blocks in order from a shared counter and read the file with
+/// pread() so that they don't disturb each other or the file position
+/// used by the main thread.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "private.h"
+
+
+#ifdef PARALLEL_ENABLED
+/// Read size bytes from the given position of the source file.
+/// This doesn't print anything so it can be used from worker threads.
+///
+/// \return     Zero on success, -1 if the end of the file was reached,
+///             or errno if reading failed.
+static int
+pread_full(const file_pair *pair, uint8_t *buf, size_t size, uint64_t pos)
+{
+	while (size > 0) {
+		const ssize_t amount = pread(pair->src_fd, buf,
+				my_min(size, SSIZE_MAX), (off_t)(pos));
+
+		if (amount == 0)
+			return -1;
+
+		if (amount == -1) {
+			if (errno == EINTR)
+				continue;
+
+			return errno;
+		}
+
+		buf += (size_t)(amount);
+		size -= (size_t)(amount);
+		pos += (uint64_t)(amount);
+	}
+
+	return 0;
+}
+
+
+static void
+print_read_error(const file_pair *pair, int read_error)
+{
+	if (read_error == -1)
+		message_error(_("%s: Unexpected end of file"),
+				pair->src_name);
+	else
+		message_error(_("%s: Read error: %s"),
+				pair->src_name, strerror(read_error));
+
+	return;
+}
+
+
+/// Start up to thread_count threads running func(arg) and wait for them
+/// to finish. If no threads can be created, func is run in this thread.
+/// Otherwise wait_func(arg, created) is called before joining the threads.
+static void
+run_threads(uint32_t thread_count, void *(*func)(void *arg), void *arg,
+		void (*wait_func)(void *arg, uint32_t created))
+{
+	mythread *threads = xmalloc(thread_count * sizeof(mythread));
+	uint32_t created = 0;
+
+	while (created < thread_count && mythread_create(
+			&threads[created], func, arg) == 0)
+		++created;
+
+	if (created == 0)
+		func(arg);
+	else if (wait_func != NULL)
+		wait_func(arg, created);
+
+	for (uint32_t i = 0; i < created; ++i)
+		mythread_join(threads[i]);
+
+	free(threads);
+	return;
+}
+
+
+/// Shared state of parallel_read_blocks()
+typedef struct {
+	const file_pair *pair;
+	parallel_block *blocks;
+	size_t count;
+
+	/// Index of the next Block to read in blocks[]
+	size_t next;
+
+	mythread_mutex mutex;
+} read_state;
+
+
+static MYTHREAD_RET_TYPE
+read_worker(void *arg)
+{
+	read_state *rs = arg;
+
+	while (true) {
+		size_t i;
+		mythread_sync(rs->mutex) {
+			i = rs->next;
+			if (i < rs->count)
+				++rs->next;
+		}
+
+		if (i >= rs->count)
+			break;
+
+		parallel_block *blk = &rs->blocks[i];
+		blk->read_error = pread_full(rs->pair, blk->header,
+				blk->header_size, blk->header_pos);
+
+		if (blk->read_error == 0 && blk->check_size > 0)
+			blk->read_error = pread_full(rs->pair, blk->check,
+					blk->check_size, blk->check_pos);
+	}
+
+	return MYTHREAD_RET_VALUE;
+}
+#endif
+
+
+extern bool
+parallel_read_blocks(file_pair *pair, parallel_block *blocks, size_t count)
+{
+#ifdef PARALLEL_ENABLED
+	const uint32_t threads = (uint32_t)(my_min(
+			hardware_threads_get(), count));
+
+	if (threads > 1) {
+		read_state rs = {
+			.pair = pair,
+			.blocks = blocks,
+			.count = count,
+			.next = 0,
+		};
+
+		if (mythread_mutex_init(&rs.mutex) == 0) {
+			run_threads(threads, &read_worker, &rs, NULL);
+			mythread_mutex_destroy(&rs.mutex);
+			return false;
+		}
+	}
+#endif
+
+	for (size_t i = 0; i < count; ++i) {
+		parallel_block *blk = &blocks[i];
+		blk->read_error = 0;
+
+		io_buf buf;
+		if (io_pread(pair, &buf, blk->header_size, blk->header_pos))
+			return true;
+
+		memcpy(blk->header, buf.u8, blk->header_size);
+
+		if (blk->check_size > 0) {
+			if (io_pread(pair, &buf, blk->check_size,
+					blk->check_pos))
+				return true;
+
+			memcpy(blk->check, buf.u8, blk->check_size);
+		}
+	}
+
+	return false;
+}
+
+
+extern bool
+parallel_block_error(const file_pair *pair, const parallel_block *blk)
+{
+	if (blk->read_error == 0)
+		return false;
+
+#ifdef PARALLEL_ENABLED
+	print_read_error(pair, blk->read_error);
+#else
+	(void)pair;
+	assert(0);
+#endif
+	return true;
+}
+
+
+#ifdef PARALLEL_ENABLED
+
+/// Size of the input and output buffers of each worker
+#define TEST_BUFFER_SIZE (64 * 1024)
+
+/// Shared state of parallel_test()
+typedef struct {
+	/// The Index of the file being tested
+	lzma_index *idx;
+
+	/// Iterator pointing to the previous Block given to a worker
+	lzma_index_iter iter;
+
+	const file_pair *pair;
+
+	/// Progress indicator is updated via this
+	lzma_stream *strm;
+
+	/// The Blocks are decoded in parallel as long as their total
+	/// memory usage stays below memlimit_threading. If a single Block
+	/// needs more than memlimit_stop, testing fails.
+	uint64_t memlimit_threading;
+	uint64_t memlimit_stop;
+	uint64_t mem_in_use;
+
+	/// Number of Blocks being decoded
+	uint32_t blocks_active;
+
+	/// Number of worker threads that have finished
+	uint32_t workers_finished;
+
+	/// Input and output buffers of the workers. Each worker takes
+	/// the next unused pair of buffers when it starts.
+	uint8_t *bufs;
+	uint32_t bufs_used;
+
+	/// Amount of input and output processed by the workers
+	uint64_t progress_in;
+	uint64_t progress_out;
+
+	/// Set when a Block has failed. The error is the one from the
+	/// first broken Block (the smallest number_in_file). The workers
+	/// don't start new Blocks after an error and they stop working on
+	/// the later Blocks but finish the earlier ones so that the same
+	/// error is reported as when decoding the file in order.
+	bool failed;
+	uint64_t error_block;
+
+	/// Error from liblzma. This is LZMA_OK if reading failed.
+	lzma_ret error_ret;
+
+	/// Non-zero if reading the file failed (see pread_full())
+	int error_read;
+
+	/// Memory needed by the Block if error_ret is LZMA_MEMLIMIT_ERROR
+	uint64_t error_memusage;
+
+	/// Set when user_abort is noticed by the main thread
+	bool stop;
+
+	/// Wakes up workers waiting for memory to become available
+	mythread_cond cond_mem;
+
+	/// Wakes up the main thread when a worker finishes
+	mythread_cond cond_main;
+
+	mythread_mutex mutex;
+} test_state;
+
+
+/// Record an error unless an earlier Block already failed.
+/// ts->mutex must be locked.
+static void
+set_error(test_state *ts, uint64_t block, lzma_ret ret, int read_error,
+		uint64_t memusage)
+{
+	if (ts->failed && ts->error_block <= block)
+		return;
+
+	ts->failed = true;
+	ts->error_block = block;
+	ts->error_ret = ret;
+	ts->error_read = read_error;
+	ts->error_memusage = memusage;
+	return;
+}
+
+
+/// Returns true if the worker should stop decoding the given Block.
+/// ts->mutex must be locked.
+static bool
+should_stop(const test_state *ts, uint64_t block)
+{
+	return ts->stop || (ts->failed && ts->error_block < block);
+}
+
+
+/// Decode one Block. The first part of the Block, including the Block
+/// Header, has been read into in[in_size] already. If reading the rest
+/// of the Block fails, *read_error is set and LZMA_OK is returned.
+static lzma_ret
+test_block(test_state *ts, lzma_stream *strm, const lzma_index_iter *iter,
+		uint8_t *in, size_t in_size, uint8_t *out,
+		int *read_error, uint64_t *memusage)
+{
+	const uint64_t block_number = iter->block.number_in_file;
+
+	// Zero would mean Index Indicator and thus not a valid Block.
+	if (in[0] == 0)
+		return LZMA_DATA_ERROR;
+
+	lzma_filter filters[LZMA_FILTERS_MAX + 1];
+	lzma_block block;
+	block.version = 1;
+	block.check = iter->stream.flags->check;
+	block.filters = filters;
+	block.header_size = lzma_block_header_size_decode(in[0]);
+	if (block.header_size > in_size)
+		return LZMA_DATA_ERROR;
+
+	lzma_ret ret = lzma_block_header_decode(&block, NULL, in);
+	if (ret != LZMA_OK)
+		return ret;
+
+	block.ignore_check = opt_ignore_check;
+
+	// Validate the sizes in the Block Header against the Index.
+	// If Uncompressed Size isn't in the Block Header, take it from
+	// the Index so that the Block decoder validates it.
+	ret = lzma_block_compressed_size(&block, iter->block.unpadded_size);
+	if (ret == LZMA_OK) {
+		if (block.uncompressed_size == LZMA_VLI_UNKNOWN)
+			block.uncompressed_size
+					= iter->block.uncompressed_size;
+		else if (block.uncompressed_size
+				!= iter->block.uncompressed_size)
+			ret = LZMA_DATA_ERROR;
+	}
+
+	if (ret != LZMA_OK) {
+		lzma_filters_free(filters, NULL);
+		return ret;
+	}
+
+	// Wait until there is enough memory available. The first Block
+	// is always allowed to start so that a Block that needs more than
+	// memlimit_threading doesn't stall.
+	*memusage = lzma_raw_decoder_memusage(filters);
+	if (*memusage == UINT64_MAX) {
+		lzma_filters_free(filters, NULL);
+		return LZMA_OPTIONS_ERROR;
+	}
+
+	if (*memusage > ts->memlimit_stop) {
+		lzma_filters_free(filters, NULL);
+		return LZMA_MEMLIMIT_ERROR;
+	}
+
+	bool stop;
+	mythread_sync(ts->mutex) {
+		while (!(stop = should_stop(ts, block_number))
+				&& ts->blocks_active > 0
+				&& ts->mem_in_use + *memusage
+					> ts->memlimit_threading)
+			mythread_cond_wait(&ts->cond_mem, &ts->mutex);
+
+		if (!stop) {
+			ts->mem_in_use += *memusage;
+			++ts->blocks_active;
+		}
+
+		// Let the next waiting worker see if its Block fits too
+		// or if it should stop.
+		mythread_cond_signal(&ts->cond_mem);
+	}
+
+	if (stop) {
+		lzma_filters_free(filters, NULL);
+		return LZMA_OK;
+	}
+
+	ret = lzma_block_decoder(strm, &block);
+	lzma_filters_free(filters, NULL);
+
+	// The rest of the Block after the Block Header
+	const uint64_t block_end = iter->block.compressed_file_offset
+			+ iter->block.total_size;
+	uint64_t in_pos = iter->block.compressed_file_offset + in_size;
+
+	strm->next_in = in + block.header_size;
+	strm->avail_in = in_size - block.header_size;
+
+	uint64_t reported_in = 0;
+	uint64_t reported_out = 0;
+
+	while (ret == LZMA_OK) {
+		if (strm->avail_in == 0 && in_pos < block_end) {
+			const size_t size = (size_t)(my_min(
+					block_end - in_pos, TEST_BUFFER_SIZE));
+			*read_error = pread_full(ts->pair, in, size, in_pos);
+			if (*read_error != 0)
+				break;
+
+			strm->next_in = in;
+			strm->avail_in = size;
+			in_pos += size;
+		}
+
+		// If the Block decoder cannot finish after getting all
+		// the input, lzma_code() returns LZMA_BUF_ERROR.
+		strm->next_out = out;
+		strm->avail_out = TEST_BUFFER_SIZE;
+		ret = lzma_code(strm, in_pos == block_end
+				? LZMA_FINISH : LZMA_RUN);
+		if (ret == LZMA_BUF_ERROR)
+			ret = LZMA_DATA_ERROR;
+
+		const uint64_t done_in = strm->total_in
+				+ block.header_size;
+		mythread_sync(ts->mutex) {
+			ts->progress_in += done_in - reported_in;
+			ts->progress_out += strm->total_out - reported_out;
+			stop = should_stop(ts, block_number);
+		}
+
+		reported_in = done_in;
+		reported_out = strm->total_out;
+
+		if (stop)
+			break;
+	}
+
+	// Everything up to the end of the Block must have been used.
+	if (ret == LZMA_STREAM_END)
+		ret = in_pos == block_end && strm->avail_in == 0
+				? LZMA_OK : LZMA_DATA_ERROR;
+
+	mythread_sync(ts->mutex) {
+		ts->mem_in_use -= *memusage;
+		--ts->blocks_active;
+		mythread_cond_signal(&ts->cond_mem);
+	}
+
+	return ret;
+}
+
+
+static MYTHREAD_RET_TYPE
+test_worker(void *arg)
+{
+	test_state *ts = arg;
+
+	uint8_t *in;
+	mythread_sync(ts->mutex) {
+		in = ts->bufs + (size_t)(ts->bufs_used++)
+				* 2 * TEST_BUFFER_SIZE;
+	}
+
+	uint8_t *out = in + TEST_BUFFER_SIZE;
+	lzma_stream strm = LZMA_STREAM_INIT;
+
+	while (true) {
+		lzma_index_iter iter;
+		bool done;
+		mythread_sync(ts->mutex) {
+			done = ts->stop || ts->failed
+					|| lzma_index_iter_next(&ts->iter,
+						LZMA_INDEX_ITER_BLOCK);
+			if (!done)
+				iter = ts->iter;
+		}
+
+		if (done)
+			break;
+
+		// Read the beginning of the Block. It contains
+		// the Block Header since the Index has validated that
+		// every Block is at least as big as its Block Header.
+		const size_t size = (size_t)(my_min(iter.block.total_size,
+				TEST_BUFFER_SIZE));
+		int read_error = pread_full(ts->pair, in, size,
+				iter.block.compressed_file_offset);
+		uint64_t memusage = 0;
+		lzma_ret ret = LZMA_OK;
+		if (read_error == 0)
+			ret = test_block(ts, &strm, &iter, in, size, out,
+					&read_error, &memusage);
+
+		if (ret != LZMA_OK || read_error != 0) {
+			mythread_sync(ts->mutex) {
+				set_error(ts, iter.block.number_in_file, ret,
+						read_error, memusage);
+			}
+		}
+	}
+
+	lzma_end(&strm);
+
+	mythread_sync(ts->mutex) {
+		++ts->workers_finished;
+		mythread_cond_signal(&ts->cond_main);
+	}
+
+	return MYTHREAD_RET_VALUE;
+}
+
+
+/// Update the progress indicator until all workers have finished.
+static void
+test_wait(void *arg, uint32_t created)
+{
+	test_state *ts = arg;
+	lzma_stream *strm = ts->strm;
+
+	while (true) {
+		bool done;
+		mythread_sync(ts->mutex) {
+			if (ts->workers_finished < created) {
+				mythread_condtime wait_abs;
+				mythread_condtime_set(&wait_abs,
+						&ts->cond_main, 200);
+				mythread_cond_timedwait(&ts->cond_main,
+						&ts->mutex, &wait_abs);
+			}
+
+			if (user_abort) {
+				ts->stop = true;
+				mythread_cond_signal(&ts->cond_mem);
+			}
+
+			strm->total_in = ts->progress_in;
+			strm->total_out = ts->progress_out;
+			done = ts->workers_finished == created;
+		}
+
+		message_progress_update();
+
+		if (done)
+			break;
+	}
+
+	return;
+}
+
+
+extern lzma_index *
+parallel_test_init(file_pair *pair)
+{
+	if (opt_single_stream || pair->src_fd == STDIN_FILENO
+			|| !S_ISREG(pair->src_st.st_mode)
+			|| pair->src_st.st_size < 2 * LZMA_STREAM_HEADER_SIZE
+			|| hardware_threads_get() < 2)
+		return NULL;
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_index *idx = NULL;
+	const uint64_t file_size = (uint64_t)(pair->src_st.st_size);
+	if (lzma_file_info_decoder(&strm, &idx,
+			hardware_memlimit_get(MODE_DECOMPRESS), file_size)
+			!= LZMA_OK)
+		return NULL;
+
+	io_buf buf;
+	uint64_t pos = 0;
+	lzma_ret ret = LZMA_OK;
+
+	do {
+		if (strm.avail_in == 0) {
+			const size_t size = (size_t)(my_min(
+					file_size - pos, IO_BUFFER_SIZE));
+			if (size == 0 || pread_full(pair, buf.u8,
+					size, pos) != 0)
+				break;
+
+			strm.next_in = buf.u8;
+			strm.avail_in = size;
+			pos += size;
+		}
+
+		ret = lzma_code(&strm, LZMA_RUN);
+
+		if (ret == LZMA_SEEK_NEEDED) {
+			pos = strm.seek_pos;
+			strm.avail_in = 0;
+			ret = LZMA_OK;
+		}
+	} while (ret == LZMA_OK && !user_abort);
+
+	lzma_end(&strm);
+
+	if (ret != LZMA_STREAM_END)
+		return NULL;
+
+	// Let the Stream decoder warn about unsupported integrity checks.
+	bool use_threads = lzma_index_block_count(idx) >= 2;
+
+	if (!opt_ignore_check) {
+		const uint32_t checks = lzma_index_checks(idx);
+		for (uint32_t i = 0; i <= LZMA_CHECK_ID_MAX; ++i)
+			if (((checks >> i) & 1) && !lzma_check_is_supported(
+					(lzma_check)(i)))
+				use_threads = false;
+	}
+
+	if (!use_threads) {
+		lzma_index_end(idx, NULL);
+		return NULL;
+	}
+
+	return idx;
+}
+
+
+extern bool
+parallel_test(file_pair *pair, lzma_stream *strm, lzma_index *idx)
+{
+	test_state ts = {
+		.idx = idx,
+		.pair = pair,
+		.strm = strm,
+		.memlimit_threading = hardware_memlimit_mtdec_get(),
+		.memlimit_stop = hardware_memlimit_get(MODE_DECOMPRESS),
+		.mem_in_use = 0,
+		.blocks_active = 0,
+		.workers_finished = 0,
+		.progress_in = 0,
+		.progress_out = 0,
+		.failed = false,
+		.error_block = 0,
+		.error_ret = LZMA_OK,
+		.error_read = 0,
+		.error_memusage = 0,
+		.stop = false,
+	};
+	lzma_index_iter_init(&ts.iter, idx);
+
+	const uint32_t threads = (uint32_t)(my_min(hardware_threads_get(),
+			lzma_index_block_count(idx)));
+
+	// Each worker gets an input and an output buffer.
+	ts.bufs = xmalloc((size_t)(threads) * 2 * TEST_BUFFER_SIZE);
+	ts.bufs_used = 0;
+
+	bool init_failed = true;
+	if (mythread_mutex_init(&ts.mutex) == 0) {
+		if (mythread_cond_init(&ts.cond_mem) == 0) {
+			if (mythread_cond_init(&ts.cond_main) == 0) {
+				init_failed = false;
+				run_threads(threads, &test_worker, &ts,
+						&test_wait);
+				mythread_cond_destroy(&ts.cond_main);
+			}
+
+			mythread_cond_destroy(&ts.cond_mem);
+		}
+
+		mythread_mutex_destroy(&ts.mutex);
+	}
+
+	free(ts.bufs);
+
+	bool success = false;
+
+	if (init_failed) {
+		message_error(_("%s: %s"), pair->src_name,
+				message_strm(LZMA_MEM_ERROR));
+	} else if (ts.failed && ts.error_read != 0) {
+		print_read_error(pair, ts.error_read);
+	} else if (ts.failed) {
+		message_error(_("%s: %s"), pair->src_name,
+				message_strm(ts.error_ret));
+
+		if (ts.error_ret == LZMA_MEMLIMIT_ERROR)
+			message_mem_needed(V_ERROR, ts.error_memusage);
+	} else if (!user_abort) {
+		// The Stream Headers, Indexes, and Stream Padding were
+		// validated by parallel_test_init().
+		strm->total_in = (uint64_t)(pair->src_st.st_size);
+		strm->total_out = lzma_index_uncompressed_size(idx);
+		success = true;
+	}
+
+	return success;
+}
+#endif
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       parallel.h
+/// \brief      Reading and testing .xz Blocks in parallel using the Index
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Reading from multiple threads needs pread() which isn't available on
+// Windows. There the callers use the single-threaded code.
+#if defined(MYTHREAD_ENABLED) && !defined(TUKLIB_DOSLIKE)
+#	define PARALLEL_ENABLED 1
+#endif
+
+
+/// Block Header and Check field of one Block as read from the file
+typedef struct {
+	/// Location and size of the Block Header. header_size may be
+	/// bigger than the real Block Header; the caller sets it to
+	/// the maximum that fits in the Block.
+	uint64_t header_pos;
+	uint32_t header_size;
+
+	/// Location and size of the Check field
+	uint32_t check_size;
+	uint64_t check_pos;
+
+	/// Zero if reading succeeded, -1 if the file ended too early,
+	/// or errno from a failed read.
+	int read_error;
+
+	uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+	uint8_t check[LZMA_CHECK_SIZE_MAX];
+} parallel_block;
+
+
+/// \brief      Read the Block Headers and Check fields of many Blocks
+///
+/// The caller sets the position and size fields of blocks[]. With
+/// threading support the reads are done in parallel and errors are
+/// stored in the read_error members so that the caller can report them
+/// when it gets to the Block. Without threading support the reads are
+/// done with io_pread() which prints the error message itself.
+///
+/// \return     False on success, true if an error message was printed.
+extern bool parallel_read_blocks(
+		file_pair *pair, parallel_block *blocks, size_t count);
+
+
+/// \brief      Print an error message if reading a Block failed
+///
+/// \return     False if blk was read successfully, true otherwise.
+extern bool parallel_block_error(
+		const file_pair *pair, const parallel_block *blk);
+
+
+#ifdef PARALLEL_ENABLED
+/// \brief      Prepare for testing the integrity of a file in parallel
+///
+/// The Index of the file is parsed without changing the file position.
+/// Testing in parallel isn't used if the file isn't a regular file, if
+/// only one thread would be used, if the Index cannot be parsed, or if
+/// the file uses an integrity check that isn't supported. Then the
+/// caller should use the normal Stream decoder which will report
+/// the possible errors in the file.
+///
+/// \return     The Index of the file if parallel_test() should be called,
+///             NULL otherwise. No messages are printed.
+extern lzma_index *parallel_test_init(file_pair *pair);
+
+
+/// \brief      Test the integrity of the file in parallel
+///
+/// Each Block is decoded from the file independently using the sizes
+/// from the Index, and the decoded data is discarded. The progress
+/// indicator reads the progress from strm->total_in and strm->total_out.
+/// idx is the Index from parallel_test_init(). The caller frees it.
+///
+/// \return     True if the file is valid, false if an error message
+///             was printed or the user aborted.
+extern bool parallel_test(file_pair *pair, lzma_stream *strm,
+		lzma_index *idx);
+#endif
@@ -72,9 +72,11 @@
 #include "options.h"
 #include "sandbox.h"
 #include "signals.h"
+#include "sniff.h"
 #include "suffix.h"
 #include "util.h"
 
 #ifdef HAVE_DECODERS
 #	include "list.h"
+#	include "parallel.h"
 #endif
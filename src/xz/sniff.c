@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       sniff.c
+/// \brief      Guesses a suitable filter chain from a sample of the input
+///
+/// The heuristics are deliberately simple and cheap since they are run
+/// once per Block. Byte statistics are compared using the sum of squared
+/// byte counts instead of entropy so that no floating point math is needed:
+/// the sum is n^2 / 256 for uniformly distributed bytes and grows as the
+/// distribution gets more skewed. Doubling the sum corresponds roughly to
+/// saving one bit per byte.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// This doesn't need private.h. Leaving it out allows building this file
+// into the tests too.
+#include "sysdefs.h"
+#include "lzma.h"
+#include "tuklib_integer.h"
+#include "sniff.h"
+
+
+/// Number of entries in the hash table used to estimate how much of
+/// the sample LZ77 would find as repeated strings
+#define MATCH_HASH_SIZE 4096
+
+/// Delta distances that are tried. Larger distances are rare and
+/// would need a larger sample to be detected reliably.
+static const uint8_t delta_dists[] = {
+	1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 32
+};
+
+
+/// Returns the sum of the squared byte counts of the sample.
+static uint64_t
+byte_stats(const uint32_t counts[256])
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < 256; ++i)
+		sum += (uint64_t)(counts[i]) * counts[i];
+
+	return sum;
+}
+
+
+/// Returns the number of four-byte strings in buf[] that have occurred
+/// earlier in the sample too. This is a crude estimate of how much
+/// the LZ77 part of LZMA2 will find.
+static size_t
+count_repeats(const uint8_t *buf, size_t size)
+{
+	// One bigger than the position so that zero means unused.
+	// The table is small enough for the stack, and keeping it local
+	// lets multiple threads sniff at the same time.
+	uint16_t hash[MATCH_HASH_SIZE];
+	memzero(hash, sizeof(hash));
+
+	assert(size <= UINT16_MAX);
+
+	size_t repeats = 0;
+
+	for (size_t i = 0; i + 4 <= size; ++i) {
+		const uint32_t value = read32le(buf + i);
+		const uint32_t h = (value * UINT32_C(2654435761)) >> 20;
+		const size_t prev = hash[h];
+
+		if (prev != 0 && read32le(buf + prev - 1) == value)
+			++repeats;
+
+		hash[h] = (uint16_t)(i + 1);
+	}
+
+	return repeats;
+}
+
+
+/// Detects executables from the file headers of the common formats.
+/// Returns the ID of the matching BCJ filter or LZMA_VLI_UNKNOWN.
+static lzma_vli
+detect_executable_header(const uint8_t *buf, size_t size)
+{
+	// ELF: The e_machine field uses the byte order of the file.
+	if (size >= 20 && buf[0] == 0x7F && buf[1] == 'E'
+			&& buf[2] == 'L' && buf[3] == 'F') {
+		const bool big_endian = buf[5] == 2;
+		const uint16_t machine = big_endian
+				? read16be(buf + 18) : read16le(buf + 18);
+
+		switch (machine) {
+		case 3:   // EM_386
+		case 62:  // EM_X86_64
+			return LZMA_FILTER_X86;
+
+		case 2:   // EM_SPARC
+		case 18:  // EM_SPARC32PLUS
+		case 43:  // EM_SPARCV9
+			return LZMA_FILTER_SPARC;
+
+		case 20:  // EM_PPC
+		case 21:  // EM_PPC64
+			// The PowerPC filter supports only big endian code.
+			return big_endian ? LZMA_FILTER_POWERPC
+					: LZMA_VLI_UNKNOWN;
+
+		case 40:  // EM_ARM
+			// 32-bit ARM Linux distributions build Thumb-2 code.
+			return big_endian ? LZMA_VLI_UNKNOWN
+					: LZMA_FILTER_ARMTHUMB;
+
+		case 50:  // EM_IA_64
+			return LZMA_FILTER_IA64;
+
+		case 183: // EM_AARCH64
+			return LZMA_FILTER_ARM64;
+
+		case 243: // EM_RISCV
+			return LZMA_FILTER_RISCV;
+		}
+
+		return LZMA_VLI_UNKNOWN;
+	}
+
+	// PE: The offset of the PE header is at 0x3C in the MS-DOS header.
+	if (size >= 0x40 && buf[0] == 'M' && buf[1] == 'Z') {
+		const uint32_t pe = read32le(buf + 0x3C);
+		if (pe > size - 6 || buf[pe] != 'P' || buf[pe + 1] != 'E'
+				|| buf[pe + 2] != 0 || buf[pe + 3] != 0)
+			return LZMA_VLI_UNKNOWN;
+
+		switch (read16le(buf + pe + 4)) {
+		case 0x014C: // IMAGE_FILE_MACHINE_I386
+		case 0x8664: // IMAGE_FILE_MACHINE_AMD64
+			return LZMA_FILTER_X86;
+
+		case 0x01C0: // IMAGE_FILE_MACHINE_ARM
+			return LZMA_FILTER_ARM;
+
+		case 0x01C2: // IMAGE_FILE_MACHINE_THUMB
+		case 0x01C4: // IMAGE_FILE_MACHINE_ARMNT
+			return LZMA_FILTER_ARMTHUMB;
+
+		case 0x0200: // IMAGE_FILE_MACHINE_IA64
+			return LZMA_FILTER_IA64;
+
+		case 0xAA64: // IMAGE_FILE_MACHINE_ARM64
+			return LZMA_FILTER_ARM64;
+
+		case 0x5064: // IMAGE_FILE_MACHINE_RISCV64
+			return LZMA_FILTER_RISCV;
+		}
+
+		return LZMA_VLI_UNKNOWN;
+	}
+
+	// Mach-O: Only little endian files are detected except for
+	// PowerPC which is big endian.
+	if (size >= 8) {
+		const uint32_t magic = read32le(buf);
+		if (magic == 0xFEEDFACE || magic == 0xFEEDFACF) {
+			switch (read32le(buf + 4)) {
+			case 7:          // CPU_TYPE_X86
+			case 0x01000007: // CPU_TYPE_X86_64
+				return LZMA_FILTER_X86;
+
+			case 12:         // CPU_TYPE_ARM
+				return LZMA_FILTER_ARMTHUMB;
+
+			case 0x0100000C: // CPU_TYPE_ARM64
+				return LZMA_FILTER_ARM64;
+			}
+
+			return LZMA_VLI_UNKNOWN;
+		}
+
+		const uint32_t magic_be = read32be(buf);
+		if ((magic_be == 0xFEEDFACE || magic_be == 0xFEEDFACF)
+				&& (read32be(buf + 4) & 0x00FFFFFF) == 18)
+			return LZMA_FILTER_POWERPC;
+	}
+
+	return LZMA_VLI_UNKNOWN;
+}
+
+
+/// Detects x86 machine code in the middle of a file. The 32-bit target
+/// of a CALL instruction in real code nearly always points to within
+/// +/-16 MiB so the most significant byte is 0x00 or 0xFF. In x86-64 code
+/// roughly one byte in 100 starts such a CALL. In other kinds of data the
+/// pattern is rare: with random data it occurs once per 32 KiB.
+static bool
+detect_x86_code(const uint8_t *buf, size_t size)
+{
+	if (size < 1024)
+		return false;
+
+	size_t calls = 0;
+	for (size_t i = 0; i + 5 <= size; ++i)
+		if (buf[i] == 0xE8 && (uint8_t)(buf[i + 4] + 1) <= 1)
+			++calls;
+
+	return calls >= size / 512;
+}
+
+
+extern void
+sniff_data(sniff_result *result, const uint8_t *buf, size_t size)
+{
+	result->filter_id = LZMA_VLI_UNKNOWN;
+	result->delta_dist = 0;
+	result->incompressible = false;
+
+	if (size > SNIFF_SAMPLE_MAX)
+		size = SNIFF_SAMPLE_MAX;
+
+	// Executables
+	lzma_vli id = detect_executable_header(buf, size);
+	if (id == LZMA_VLI_UNKNOWN && detect_x86_code(buf, size))
+		id = LZMA_FILTER_X86;
+
+	if (id != LZMA_VLI_UNKNOWN) {
+		if (lzma_filter_encoder_is_supported(id))
+			result->filter_id = id;
+
+		return;
+	}
+
+	// The statistical tests below need a reasonable amount of data.
+	if (size < 1024)
+		return;
+
+	uint32_t counts[256];
+	memzero(counts, sizeof(counts));
+	for (size_t i = 0; i < size; ++i)
+		++counts[buf[i]];
+
+	const uint64_t raw_stats = byte_stats(counts);
+	const size_t repeats = count_repeats(buf, size);
+
+	// Incompressible data: the byte distribution is close to uniform
+	// (within 5 % of the expected value for random data) and there are
+	// practically no repeated strings.
+	const uint64_t uniform = (uint64_t)(size) * size / 256 + size;
+	if (raw_stats <= uniform + uniform / 20 && repeats < size / 128) {
+		result->incompressible = true;
+		return;
+	}
+
+	// If LZ77 finds much of the data as repeats, Delta would only
+	// hide those repeats.
+	if (repeats >= size / 4
+			|| !lzma_filter_encoder_is_supported(
+				LZMA_FILTER_DELTA))
+		return;
+
+	// Fixed-stride data: find the Delta distance that makes the byte
+	// distribution most skewed. Require that it is clearly better
+	// than without Delta.
+	uint64_t best_stats = raw_stats * 2;
+
+	for (size_t d = 0; d < ARRAY_SIZE(delta_dists); ++d) {
+		const size_t dist = delta_dists[d];
+
+		memzero(counts, sizeof(counts));
+		for (size_t i = dist; i < size; ++i)
+			++counts[(uint8_t)(buf[i] - buf[i - dist])];
+
+		// Scale to the same number of bytes as raw_stats.
+		const uint64_t stats = byte_stats(counts)
+				* size / (size - dist) * size / (size - dist);
+
+		// Only a clearly better result makes a longer distance win.
+		// Otherwise multiples of the real distance could be chosen.
+		const uint64_t limit = result->filter_id == LZMA_VLI_UNKNOWN
+				? best_stats : best_stats + best_stats / 8;
+		if (stats > limit) {
+			best_stats = stats;
+			result->filter_id = LZMA_FILTER_DELTA;
+			result->delta_dist = (uint32_t)(dist);
+		}
+	}
+
+	return;
+}
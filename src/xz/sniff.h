@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       sniff.h
+/// \brief      Guesses a suitable filter chain from a sample of the input
+//
+///////////////////////////////////////////////////////////////////////////////
+
+/// Kind of data detected by sniff_data()
+typedef struct {
+	/// ID of a filter that should be placed before LZMA2: one of
+	/// the BCJ filters, LZMA_FILTER_DELTA, or LZMA_VLI_UNKNOWN if
+	/// plain LZMA2 should be used.
+	lzma_vli filter_id;
+
+	/// Distance for the Delta filter if filter_id is LZMA_FILTER_DELTA
+	uint32_t delta_dist;
+
+	/// True if the data seems to be incompressible. Then filter_id
+	/// is LZMA_VLI_UNKNOWN and the fastest LZMA2 settings should be
+	/// used. LZMA2 stores chunks that don't compress as uncompressed.
+	bool incompressible;
+} sniff_result;
+
+
+/// \brief      Guess the type of data from a sample
+///
+/// The sample should be the first bytes of a Block. Executables are
+/// detected from their headers (ELF, PE, and Mach-O) and x86 machine code
+/// also from the frequency of CALL instructions. Fixed-stride binary data
+/// is detected by comparing byte statistics before and after the Delta
+/// transformation with different distances. Only filters supported by
+/// the liblzma encoder in use are returned.
+///
+/// \param      result  The result is stored here.
+/// \param      buf     Sample of the data
+/// \param      size    Size of the sample; only the first
+///                     SNIFF_SAMPLE_MAX bytes are used.
+extern void sniff_data(sniff_result *result,
+		const uint8_t *buf, size_t size);
+
+
+/// Maximum number of bytes that sniff_data() looks at
+#define SNIFF_SAMPLE_MAX 8192
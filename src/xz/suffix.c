@@ -209,13 +209,9 @@ compressed_name(const char *src_name, size_t src_len)
 #endif
 			".tlz",
 			NULL
-#ifdef HAVE_LZIP_DECODER
-		// This is needed to keep the table indexing in sync with
-		// enum format_type from coder.h.
+#if defined(HAVE_LZIP_ENCODER) || defined(HAVE_LZIP_DECODER)
 		}, {
-/*
 			".lz",
-*/
 			NULL
 #endif
 		}, {
@@ -227,9 +223,6 @@ compressed_name(const char *src_name, size_t src_len)
 
 	// args.c ensures these.
 	assert(opt_format != FORMAT_AUTO);
-#ifdef HAVE_LZIP_DECODER
-	assert(opt_format != FORMAT_LZIP);
-#endif
 
 	const size_t format = opt_format - 1;
 	const char *const *suffixes = all_suffixes[format];
@@ -289,9 +282,10 @@ compressed_name(const char *src_name, size_t src_len)
 					&& suffix[0] == '.')
 				--src_len;
 
-		} else if (custom_suffix == NULL
+		} else if (custom_suffix == NULL && opt_format <= FORMAT_LZMA
 				&& strcasecmp(sufsep, ".tar") == 0) {
-			// ".tar" is handled specially.
+			// ".tar" is handled specially. .tar.lz isn't since
+			// .tlz is already used for .tar.lzma.
 			//
 			// Examples:
 			// xz foo.tar          -> foo.txz
@@ -299,9 +293,6 @@ compressed_name(const char *src_name, size_t src_len)
 			static const char *const tar_suffixes[] = {
 				".txz", // .tar.xz
 				".tlz", // .tar.lzma
-/*
-				".tlz", // .tar.lz
-*/
 			};
 			suffix = tar_suffixes[format];
 			suffix_len = 4;
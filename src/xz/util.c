@@ -17,7 +17,7 @@
 #endif
 
 /// Buffers for uint64_to_str() and uint64_to_nicestr()
-static char bufs[4][128];
+static char bufs[5][128];
 
 
 // Thousand separator support in uint64_to_str() and uint64_to_nicestr():
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       bench_lz_decoder.c
+/// \brief      Measures LZMA decoding speed on text-like and log-like data
+///
+/// This isn't run as a test. The data is dominated by short matches at
+/// small distances which makes the speed depend mostly on how fast
+/// the LZ decoder copies matches. Build with "make bench_lz_decoder"
+/// and run without arguments, or give the number of rounds as
+/// the only argument.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "sysdefs.h"
+#include "lzma.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+#define DATA_SIZE (16 << 20)
+
+
+static uint32_t seed = 5;
+
+/// xorshift32
+static uint32_t
+next_random(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+
+/// Lowercase words with a skewed distribution, like English text
+static size_t
+fill_text(uint8_t *buf, size_t size)
+{
+	static char words[512][12];
+	for (size_t i = 0; i < ARRAY_SIZE(words); ++i) {
+		const size_t len = 1 + next_random() % 10;
+		for (size_t j = 0; j < len; ++j)
+			words[i][j] = (char)('a' + next_random() % 26);
+
+		words[i][len] = '\0';
+	}
+
+	size_t pos = 0;
+	while (true) {
+		// Squaring the random number makes the first words
+		// much more common than the last ones.
+		const uint32_t r = next_random() % 512;
+		const char *word = words[r * r / 512];
+		const size_t len = strlen(word);
+
+		if (pos + len + 1 > size)
+			return pos;
+
+		memcpy(buf + pos, word, len);
+		pos += len;
+		buf[pos++] = next_random() % 16 == 0 ? '\n' : ' ';
+	}
+}
+
+
+/// Log lines with increasing timestamps and a few fields
+static size_t
+fill_log(uint8_t *buf, size_t size)
+{
+	static const char *const levels[] = { "INFO", "DEBUG", "WARN" };
+	static const char *const msgs[] = {
+		"connection accepted", "request completed",
+		"cache miss", "retrying operation", "session closed",
+	};
+
+	unsigned long t = 1700000000;
+	size_t pos = 0;
+
+	while (true) {
+		char line[160];
+		t += next_random() % 3;
+		const int len = snprintf(line, sizeof(line),
+				"%lu.%03u host%u %s [%u] %s id=%u\n",
+				t, next_random() % 1000, next_random() % 4,
+				levels[next_random() % 3],
+				next_random() % 32768,
+				msgs[next_random() % 5],
+				next_random() % 100);
+
+		if (len <= 0 || pos + (size_t)(len) > size)
+			return pos;
+
+		memcpy(buf + pos, line, (size_t)(len));
+		pos += (size_t)(len);
+	}
+}
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)(ts.tv_sec) + (double)(ts.tv_nsec) / 1e9;
+}
+
+
+static void
+bench(const char *name, const uint8_t *data, size_t size, unsigned rounds)
+{
+	const size_t compressed_max = lzma_stream_buffer_bound(size);
+	uint8_t *compressed = malloc(compressed_max);
+	uint8_t *decoded = malloc(size);
+	if (compressed == NULL || decoded == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	size_t compressed_size = 0;
+	if (lzma_easy_buffer_encode(6, LZMA_CHECK_NONE, NULL, data, size,
+			compressed, &compressed_size, compressed_max)
+			!= LZMA_OK) {
+		fprintf(stderr, "Encoding failed\n");
+		exit(1);
+	}
+
+	double best = 0.0;
+
+	for (unsigned i = 0; i < rounds; ++i) {
+		uint64_t memlimit = UINT64_MAX;
+		size_t in_pos = 0;
+		size_t out_pos = 0;
+
+		const double start = now();
+		const lzma_ret ret = lzma_stream_buffer_decode(&memlimit, 0,
+				NULL, compressed, &in_pos, compressed_size,
+				decoded, &out_pos, size);
+		const double elapsed = now() - start;
+
+		if (ret != LZMA_OK || out_pos != size
+				|| memcmp(decoded, data, size) != 0) {
+			fprintf(stderr, "%s: Decoding failed\n", name);
+			exit(1);
+		}
+
+		if (i == 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	printf("%-6s %9zu -> %8zu bytes  %8.1f MB/s\n", name, size,
+			compressed_size, (double)(size) / best / 1e6);
+
+	free(compressed);
+	free(decoded);
+}
+
+
+extern int
+main(int argc, char **argv)
+{
+	unsigned rounds = 5;
+	if (argc > 1)
+		rounds = (unsigned)(atoi(argv[1]));
+
+	if (rounds == 0) {
+		fprintf(stderr, "Usage: %s [ROUNDS]\n", argv[0]);
+		return 1;
+	}
+
+	uint8_t *data = malloc(DATA_SIZE);
+	if (data == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	bench("text", data, fill_text(data, DATA_SIZE), rounds);
+	bench("log", data, fill_log(data, DATA_SIZE), rounds);
+
+	free(data);
+	return 0;
+}
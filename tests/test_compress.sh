@@ -139,6 +139,52 @@ test_xz -2
 test_xz -3
 test_xz -4
 
+# Choose the filters automatically. The small Block size makes the
+# filter chain change in the middle of the larger test files.
+test_xz -1 --auto-filters --block-size=16KiB
+
+# Test a file with many Blocks using two threads. Then the Blocks are
+# decoded in parallel straight from the file using the Index.
+if $XZ -c -1 --block-size=16KiB "$FILE" > "$TMP_COMP" \
+		&& $XZ -t --threads=2 "$TMP_COMP" ; then
+	:
+else
+	echo "Testing with two threads failed: $FILE"
+	exit 1
+fi
+
+# When testing in parallel, the error from the first broken Block must be
+# reported even if a later Block fails sooner. The second Stream needs
+# more memory than the limit allows. Once the first Stream is corrupted,
+# the result must be the same as when decoding the file in order.
+if $XZ -c -1 "$FILE" > "$TMP_COMP" \
+		&& $XZ -c --lzma2=preset=0,dict=5MiB "$FILE" >> "$TMP_COMP" \
+		&& ! LC_ALL=C $XZ -t --threads=2 "$TMP_COMP" 2> "$TMP_UNCOMP" \
+		&& grep 'Memory usage limit reached' "$TMP_UNCOMP" > /dev/null
+then
+	:
+else
+	echo "Memory usage limit wasn't reported: $FILE"
+	exit 1
+fi
+
+# Overwrite 16 bytes in the middle of the first Block.
+$XZ -c -1 "$FILE" > "$TMP_UNCOMP"
+SIZE=$(wc -c < "$TMP_UNCOMP")
+printf 'XXXXXXXXXXXXXXXX' | dd of="$TMP_COMP" bs=1 seek=$((SIZE / 2)) \
+		conv=notrunc 2> /dev/null
+
+if LC_ALL=C $XZ -t --threads=2 "$TMP_COMP" 2> "$TMP_UNCOMP" ; then
+	echo "Corrupt file was accepted: $FILE"
+	exit 1
+elif grep 'Compressed data is corrupt' "$TMP_UNCOMP" > /dev/null ; then
+	:
+else
+	echo "Wrong error for the first broken Block: $FILE"
+	cat "$TMP_UNCOMP"
+	exit 1
+fi
+
 test_filter()
 {
 	if test -f ../config.h ; then
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_delta.c
+/// \brief      Tests the Delta filter against a trivial reference
+///
+/// The Delta encoder and decoder have separate code paths for the first
+/// bytes of each call (which use the history from the previous call) and
+/// for the rest of the buffer (which may be vectorized). These tests feed
+/// the data in chunks of varying sizes so that the boundaries between
+/// the paths land everywhere.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+
+
+#define DATA_SIZE (64 * 1024)
+
+static const uint32_t distances[] = {
+	1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 100, 255, 256
+};
+
+static uint8_t original[DATA_SIZE];
+static uint8_t expected[DATA_SIZE];
+static uint8_t compressed[DATA_SIZE * 2];
+static uint8_t decoded[DATA_SIZE];
+
+static uint32_t seed;
+
+
+/// Returns a chunk size from 1 to 600 bytes, mostly small.
+static size_t
+next_chunk_size(void)
+{
+	const uint32_t r = test_random(&seed);
+	return (r & 1) ? 1 + r % 40 : 1 + r % 600;
+}
+
+
+static void
+reference_encode(uint8_t *buf, size_t size, uint32_t distance)
+{
+	// Go backwards so that the original bytes are still available.
+	for (size_t i = size; i-- > 0; )
+		buf[i] -= i >= distance ? buf[i - distance] : 0;
+}
+
+
+static void
+fill_original(void)
+{
+	// Mix of slowly changing values (the kind of data that Delta is
+	// meant for) and random bytes.
+	seed = 1;
+	for (size_t i = 0; i < DATA_SIZE; ++i) {
+		const uint32_t r = test_random(&seed);
+		original[i] = (i / 4096) & 1 ? (uint8_t)(r)
+				: (uint8_t)(i * 3 + (r & 3));
+	}
+}
+
+
+#if defined(HAVE_ENCODER_DELTA) && defined(HAVE_DECODER_DELTA) \
+		&& defined(HAVE_ENCODER_LZMA2) && defined(HAVE_DECODER_LZMA2)
+static void
+encode_chunked(const lzma_filter *filters, size_t *out_size)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_raw_encoder(&strm, filters), LZMA_OK);
+
+	strm.next_in = original;
+	strm.next_out = compressed;
+	strm.avail_out = sizeof(compressed);
+
+	lzma_ret ret;
+	do {
+		if (strm.avail_in == 0) {
+			const size_t left = DATA_SIZE - strm.total_in;
+			const size_t chunk = next_chunk_size();
+			strm.avail_in = my_min(left, chunk);
+		}
+
+		ret = lzma_code(&strm, strm.total_in + strm.avail_in
+				== DATA_SIZE ? LZMA_FINISH : LZMA_RUN);
+	} while (ret == LZMA_OK);
+
+	assert_lzma_ret(ret, LZMA_STREAM_END);
+	*out_size = strm.total_out;
+	lzma_end(&strm);
+}
+
+
+static void
+decode_chunked(const lzma_filter *filters, size_t in_size)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_raw_decoder(&strm, filters), LZMA_OK);
+
+	memzero(decoded, sizeof(decoded));
+	strm.next_in = compressed;
+	strm.avail_in = in_size;
+	strm.next_out = decoded;
+
+	lzma_ret ret;
+	do {
+		if (strm.avail_out == 0) {
+			const size_t left = DATA_SIZE - strm.total_out;
+			if (left == 0)
+				break;
+
+			const size_t chunk = next_chunk_size();
+			strm.avail_out = my_min(left, chunk);
+		}
+
+		ret = lzma_code(&strm, LZMA_RUN);
+	} while (ret == LZMA_OK);
+
+	assert_uint_eq(strm.total_out, DATA_SIZE);
+	lzma_end(&strm);
+}
+
+
+static void
+test_chain(uint32_t dist1, uint32_t dist2)
+{
+	lzma_options_lzma opt_lzma;
+	assert_false(lzma_lzma_preset(&opt_lzma, 0));
+
+	lzma_options_delta opt_delta1 = {
+		.type = LZMA_DELTA_TYPE_BYTE,
+		.dist = dist1,
+	};
+	lzma_options_delta opt_delta2 = {
+		.type = LZMA_DELTA_TYPE_BYTE,
+		.dist = dist2,
+	};
+
+	// If dist2 is zero, only one Delta filter is used. With two
+	// Delta filters the second one encodes in place.
+	lzma_filter filters[4] = {
+		{ .id = LZMA_FILTER_DELTA, .options = &opt_delta1 },
+		{ .id = LZMA_FILTER_DELTA, .options = &opt_delta2 },
+		{ .id = LZMA_FILTER_LZMA2, .options = &opt_lzma },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+
+	if (dist2 == 0) {
+		filters[1] = filters[2];
+		filters[2] = filters[3];
+	}
+
+	memcpy(expected, original, DATA_SIZE);
+	reference_encode(expected, DATA_SIZE, dist1);
+	if (dist2 != 0)
+		reference_encode(expected, DATA_SIZE, dist2);
+
+	size_t compressed_size;
+	encode_chunked(filters, &compressed_size);
+
+	// Decoding with plain LZMA2 must give exactly what the
+	// reference encoder produced.
+	const lzma_filter lzma2_only[2] = {
+		{ .id = LZMA_FILTER_LZMA2, .options = &opt_lzma },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+	decode_chunked(lzma2_only, compressed_size);
+	assert_array_eq(decoded, expected, DATA_SIZE);
+
+	// Decoding the full chain must give the original data back.
+	decode_chunked(filters, compressed_size);
+	assert_array_eq(decoded, original, DATA_SIZE);
+}
+#endif
+
+
+static void
+test_delta_single(void)
+{
+#if !defined(HAVE_ENCODER_DELTA) || !defined(HAVE_DECODER_DELTA) \
+		|| !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("Delta or LZMA2 encoder or decoder support disabled");
+#else
+	for (size_t i = 0; i < ARRAY_SIZE(distances); ++i)
+		test_chain(distances[i], 0);
+#endif
+}
+
+
+static void
+test_delta_in_place(void)
+{
+#if !defined(HAVE_ENCODER_DELTA) || !defined(HAVE_DECODER_DELTA) \
+		|| !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("Delta or LZMA2 encoder or decoder support disabled");
+#else
+	for (size_t i = 0; i < ARRAY_SIZE(distances); ++i)
+		test_chain(distances[i],
+				distances[ARRAY_SIZE(distances) - 1 - i]);
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_delta_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+	fill_original();
+
+	tuktest_run(test_delta_single);
+	tuktest_run(test_delta_in_place);
+
+	return tuktest_end();
+}
@@ -191,6 +191,47 @@ test_lzma_str_to_filters(void)
 
 	lzma_filters_free(filters, NULL);
 
+	// The match finders with five-byte hashing.
+	error_pos = -1;
+	assert_true(lzma_str_to_filters("lzma2=mf=hc5", &error_pos,
+			filters, LZMA_STR_NO_VALIDATION, NULL) == NULL);
+	assert_int_eq(error_pos, 12);
+	opts = filters[0].options;
+	assert_uint_eq(opts->mf, LZMA_MF_HC5);
+	lzma_filters_free(filters, NULL);
+
+	error_pos = -1;
+	assert_true(lzma_str_to_filters("lzma2=mf=bt5", &error_pos,
+			filters, LZMA_STR_NO_VALIDATION, NULL) == NULL);
+	assert_int_eq(error_pos, 12);
+	opts = filters[0].options;
+	assert_uint_eq(opts->mf, LZMA_MF_BT5);
+	lzma_filters_free(filters, NULL);
+
+	// lc, lp, and pb accept "auto". The lc + lp check ignores it.
+	error_pos = -1;
+	assert_true(lzma_str_to_filters("lzma2=lc=auto,lp=4,pb=auto",
+			&error_pos, filters, 0, NULL) == NULL);
+	assert_int_eq(error_pos, 26);
+	opts = filters[0].options;
+	assert_uint_eq(opts->lc, LZMA_LCLPPB_AUTO);
+	assert_uint_eq(opts->lp, 4);
+	assert_uint_eq(opts->pb, LZMA_LCLPPB_AUTO);
+	lzma_filters_free(filters, NULL);
+
+#if defined(HAVE_ENCODER_LZMA1) || defined(HAVE_DECODER_LZMA1)
+	// LZMA1 has no way to choose them so "auto" is rejected there.
+	error_pos = -1;
+	assert_true(lzma_str_to_filters("lzma1=lc=auto", &error_pos,
+			filters, LZMA_STR_ALL_FILTERS, NULL) != NULL);
+	assert_int_eq(error_pos, 13);
+#endif
+
+	error_pos = -1;
+	assert_true(lzma_str_to_filters("lzma2=mode=auto", &error_pos,
+			filters, 0, NULL) != NULL);
+	assert_int_eq(error_pos, 11);
+
 #if defined(HAVE_ENCODER_X86) || defined(HAVE_DECODER_X86)
 	// Test BCJ Filter options.
 	error_pos = -1;
@@ -432,6 +473,17 @@ test_lzma_str_from_filters(void)
 
 	lzma_filters_free(filters, NULL);
 
+	// LZMA_LCLPPB_AUTO is shown as "auto".
+	assert_true(lzma_str_to_filters("lzma2:pb=auto", NULL, filters, 0,
+			NULL) == NULL);
+
+	assert_lzma_ret(lzma_str_from_filters(&output_str, filters,
+			LZMA_STR_ENCODER, NULL), LZMA_OK);
+	assert_true(strstr(output_str, ",pb=auto,") != NULL);
+	free(output_str);
+
+	lzma_filters_free(filters, NULL);
+
 #if defined(HAVE_ENCODER_X86) || defined(HAVE_DECODER_X86)
 	assert_true(lzma_str_to_filters("x86 lzma2", NULL, filters, 0, NULL)
 			== NULL);
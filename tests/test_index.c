@@ -1758,6 +1758,264 @@ test_lzma_index_buffer_decode(void)
 }
 
 
+/// Check that *block matches the Block in *iter.
+static void
+flat_block_is_equal(const lzma_index_flat_block *block,
+		const lzma_index_iter *iter)
+{
+	assert_uint_eq(block->number_in_file, iter->block.number_in_file);
+	assert_uint_eq(block->compressed_file_offset,
+			iter->block.compressed_file_offset);
+	assert_uint_eq(block->uncompressed_file_offset,
+			iter->block.uncompressed_file_offset);
+	assert_uint_eq(block->unpadded_size, iter->block.unpadded_size);
+	assert_uint_eq(block->total_size, iter->block.total_size);
+	assert_uint_eq(block->uncompressed_size,
+			iter->block.uncompressed_size);
+}
+
+
+/// Check that flat has the same Blocks as idx and that
+/// lzma_index_flat_locate() finds the same Blocks as
+/// lzma_index_iter_locate().
+static void
+flat_is_equal(const lzma_index_flat *flat, const lzma_index *idx)
+{
+	assert_uint_eq(lzma_index_flat_block_count(flat),
+			lzma_index_block_count(idx));
+	assert_uint_eq(lzma_index_flat_uncompressed_size(flat),
+			lzma_index_uncompressed_size(idx));
+
+	lzma_index_flat_block block;
+	lzma_index_iter iter;
+	lzma_index_iter_init(&iter, idx);
+
+	lzma_vli number = 1;
+	while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_BLOCK)) {
+		assert_false(lzma_index_flat_get(flat, number++, &block));
+		flat_block_is_equal(&block, &iter);
+	}
+
+	assert_true(lzma_index_flat_get(flat, 0, &block));
+	assert_true(lzma_index_flat_get(flat, number, &block));
+
+	const lzma_vli size = lzma_index_uncompressed_size(idx);
+	for (lzma_vli target = 0; target < size; target += 0x33) {
+		assert_false(lzma_index_iter_locate(&iter, target));
+		assert_false(lzma_index_flat_locate(flat, target, &block));
+		flat_block_is_equal(&block, &iter);
+	}
+
+	assert_false(lzma_index_iter_locate(&iter, size - 1));
+	assert_false(lzma_index_flat_locate(flat, size - 1, &block));
+	flat_block_is_equal(&block, &iter);
+
+	assert_true(lzma_index_flat_locate(flat, size, &block));
+}
+
+
+static void
+test_lzma_index_flat(void)
+{
+	lzma_index_flat *flat = NULL;
+
+	// Two Streams with empty Blocks at the beginning, in the middle,
+	// and at the end of the first Stream
+	lzma_index *idx = lzma_index_init(NULL);
+	assert_true(idx != NULL);
+	assert_lzma_ret(lzma_index_append(idx, NULL, 0x20, 0), LZMA_OK);
+	assert_lzma_ret(lzma_index_append(idx, NULL, 0x1001, 0x100),
+			LZMA_OK);
+	assert_lzma_ret(lzma_index_append(idx, NULL, 0x21, 0), LZMA_OK);
+	assert_lzma_ret(lzma_index_append(idx, NULL, 0x2002, 0x300),
+			LZMA_OK);
+	assert_lzma_ret(lzma_index_append(idx, NULL, 0x22, 0), LZMA_OK);
+
+	lzma_index *second = lzma_index_init(NULL);
+	assert_true(second != NULL);
+	assert_lzma_ret(lzma_index_append(second, NULL, 0x3003, 0x555),
+			LZMA_OK);
+	assert_lzma_ret(lzma_index_stream_padding(idx, 8), LZMA_OK);
+	assert_lzma_ret(lzma_index_cat(idx, second, NULL), LZMA_OK);
+
+	assert_lzma_ret(lzma_index_flat_from_index(NULL, idx, NULL),
+			LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_index_flat_from_index(&flat, NULL, NULL),
+			LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_index_flat_from_index(&flat, idx, NULL),
+			LZMA_OK);
+	flat_is_equal(flat, idx);
+	lzma_index_flat_end(flat, NULL);
+	lzma_index_end(idx, NULL);
+
+	// An empty Index
+	idx = lzma_index_init(NULL);
+	assert_true(idx != NULL);
+	assert_lzma_ret(lzma_index_flat_from_index(&flat, idx, NULL),
+			LZMA_OK);
+	lzma_index_flat_block block;
+	assert_uint_eq(lzma_index_flat_block_count(flat), 0);
+	assert_true(lzma_index_flat_locate(flat, 0, &block));
+	assert_true(lzma_index_flat_get(flat, 1, &block));
+	lzma_index_flat_end(flat, NULL);
+	lzma_index_end(idx, NULL);
+
+	lzma_index_flat_end(NULL, NULL);
+
+#ifdef HAVE_ENCODERS
+	// Decode the Index field that was encoded from decode_test_index.
+	assert_true(decode_buffer_size != 0);
+
+	size_t in_pos = 1;
+	assert_lzma_ret(lzma_index_flat_decode(NULL, NULL, decode_buffer,
+			&in_pos, decode_buffer_size, LZMA_STREAM_HEADER_SIZE),
+			LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_index_flat_decode(&flat, NULL, decode_buffer,
+			&in_pos, 0, LZMA_STREAM_HEADER_SIZE),
+			LZMA_PROG_ERROR);
+	assert_true(flat == NULL);
+
+	in_pos = 0;
+	assert_lzma_ret(lzma_index_flat_decode(&flat, NULL, decode_buffer,
+			&in_pos, decode_buffer_size, LZMA_STREAM_HEADER_SIZE),
+			LZMA_OK);
+	assert_uint_eq(in_pos, decode_buffer_size);
+	flat_is_equal(flat, decode_test_index);
+	lzma_index_flat_end(flat, NULL);
+
+	// Truncated input
+	for (size_t size = 0; size < decode_buffer_size; ++size) {
+		in_pos = 0;
+		assert_lzma_ret(lzma_index_flat_decode(&flat, NULL,
+				decode_buffer, &in_pos, size,
+				LZMA_STREAM_HEADER_SIZE), LZMA_DATA_ERROR);
+		assert_true(flat == NULL);
+		assert_uint_eq(in_pos, 0);
+	}
+
+	// Corrupt input. Every byte is covered by the CRC32.
+	uint8_t *corrupt = tuktest_malloc(decode_buffer_size);
+	for (size_t i = 0; i < decode_buffer_size; ++i) {
+		memcpy(corrupt, decode_buffer, decode_buffer_size);
+		corrupt[i] ^= 0x01;
+
+		in_pos = 0;
+		assert_lzma_ret(lzma_index_flat_decode(&flat, NULL,
+				corrupt, &in_pos, decode_buffer_size,
+				LZMA_STREAM_HEADER_SIZE), LZMA_DATA_ERROR);
+		assert_true(flat == NULL);
+	}
+
+	// A huge Number of Records must not cause a huge allocation.
+	static const uint8_t huge_count[] = {
+		0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x05, 0x00
+	};
+	in_pos = 0;
+	assert_lzma_ret(lzma_index_flat_decode(&flat, NULL, huge_count,
+			&in_pos, sizeof(huge_count),
+			LZMA_STREAM_HEADER_SIZE), LZMA_DATA_ERROR);
+#endif
+}
+
+
+static void
+test_lzma_index_cache(void)
+{
+#if !defined(HAVE_ENCODERS) || !defined(HAVE_DECODERS)
+	assert_skip("Encoder or decoder support disabled");
+#else
+	// Three Streams with different Checks and Stream Padding.
+	// The second Stream is empty.
+	lzma_index *idx = NULL;
+	static const lzma_check checks[3] = {
+		LZMA_CHECK_CRC32, LZMA_CHECK_NONE, LZMA_CHECK_SHA256
+	};
+
+	for (uint32_t n = 0; n < 3; ++n) {
+		lzma_index *s = lzma_index_init(NULL);
+		assert_true(s != NULL);
+
+		for (uint32_t b = 0; n != 1 && b < 100 * n + 3; ++b)
+			assert_lzma_ret(lzma_index_append(s, NULL,
+					0x100 + b * 7, 0x1000 + b * 3),
+					LZMA_OK);
+
+		lzma_stream_flags flags = {
+			.version = 0,
+			.check = checks[n],
+			.backward_size = lzma_index_size(s),
+		};
+		assert_lzma_ret(lzma_index_stream_flags(s, &flags), LZMA_OK);
+		assert_lzma_ret(lzma_index_stream_padding(s, 4 * n),
+				LZMA_OK);
+
+		if (idx == NULL)
+			idx = s;
+		else
+			assert_lzma_ret(lzma_index_cat(idx, s, NULL),
+					LZMA_OK);
+	}
+
+	const uint64_t file_size = lzma_index_file_size(idx);
+	const uint64_t mtime = 1234567890;
+
+	uint8_t *buf;
+	size_t size;
+	assert_lzma_ret(lzma_index_cache_encode(NULL, file_size, mtime,
+			NULL, &buf, &size), LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_index_cache_encode(idx, file_size, mtime,
+			NULL, NULL, &size), LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_index_cache_encode(idx, file_size, mtime,
+			NULL, &buf, &size), LZMA_OK);
+
+	lzma_index *decoded;
+	assert_lzma_ret(lzma_index_cache_decode(NULL, UINT64_MAX, NULL,
+			buf, size, file_size, mtime), LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_index_cache_decode(&decoded, UINT64_MAX, NULL,
+			buf, size, file_size, mtime), LZMA_OK);
+	assert_true(index_is_equal(idx, decoded));
+	assert_uint_eq(lzma_index_checks(decoded), lzma_index_checks(idx));
+	lzma_index_end(decoded, NULL);
+
+	// The cache doesn't match the file.
+	assert_lzma_ret(lzma_index_cache_decode(&decoded, UINT64_MAX, NULL,
+			buf, size, file_size + 4, mtime), LZMA_DATA_ERROR);
+	assert_true(decoded == NULL);
+	assert_lzma_ret(lzma_index_cache_decode(&decoded, UINT64_MAX, NULL,
+			buf, size, file_size, mtime + 1), LZMA_DATA_ERROR);
+	assert_true(decoded == NULL);
+
+	// Truncated or corrupt cache
+	assert_lzma_ret(lzma_index_cache_decode(&decoded, UINT64_MAX, NULL,
+			buf, size - 1, file_size, mtime), LZMA_DATA_ERROR);
+
+	for (size_t i = 0; i < size; i += 13) {
+		buf[i] ^= 0x40;
+		assert_lzma_ret(lzma_index_cache_decode(&decoded, UINT64_MAX,
+				NULL, buf, size, file_size, mtime),
+				LZMA_DATA_ERROR);
+		assert_true(decoded == NULL);
+		buf[i] ^= 0x40;
+	}
+
+	// Too low memory usage limit
+	assert_lzma_ret(lzma_index_cache_decode(&decoded, 1, NULL,
+			buf, size, file_size, mtime), LZMA_MEMLIMIT_ERROR);
+	assert_true(decoded == NULL);
+
+	free(buf);
+	lzma_index_end(idx, NULL);
+
+	// Stream Flags are required.
+	idx = lzma_index_init(NULL);
+	assert_true(idx != NULL);
+	assert_lzma_ret(lzma_index_cache_encode(idx, 0, 0,
+			NULL, &buf, &size), LZMA_PROG_ERROR);
+	lzma_index_end(idx, NULL);
+#endif
+}
+
+
 #if defined(BUILD_MONOLITHIC)
 #define main   xz_test_index_main
 #endif
@@ -1790,6 +2048,8 @@ main(int argc, const char **argv)
 	tuktest_run(test_lzma_index_decoder);
 	tuktest_run(test_lzma_index_buffer_encode);
 	tuktest_run(test_lzma_index_buffer_decode);
+	tuktest_run(test_lzma_index_flat);
+	tuktest_run(test_lzma_index_cache);
 	lzma_index_end(decode_test_index, NULL);
 	return tuktest_end();
 }
@@ -0,0 +1,134 @@
+#!/bin/sh
+# SPDX-License-Identifier: 0BSD
+
+###############################################################################
+#
+# Tests xz --list --index-cache
+#
+###############################################################################
+
+# Optional argument:
+# $1 = directory of the xz executable
+
+# If xz was not built, skip this test. Autotools and CMake put
+# the xz executable in a different location.
+XZ=${1:-../src/xz}/xz
+if test ! -x "$XZ"; then
+	echo "xz was not built, skipping this test."
+	exit 77
+fi
+
+# The test file is created with xz so both encoder and decoder
+# support are needed.
+if test ! -f ../config.h ; then
+	:
+elif grep 'define HAVE_ENCODERS' ../config.h > /dev/null \
+		&& grep 'define HAVE_DECODERS' ../config.h > /dev/null ; then
+	:
+else
+	echo "Compression or decompression support is disabled, skipping this test."
+	exit 77
+fi
+
+FILE="index_cache_temp.xz"
+CACHE="$FILE.xzidx"
+
+rm -f "$FILE" "$CACHE" "$CACHE.tmp" index_cache_ref \
+	index_cache_list1 index_cache_list2 index_cache_old
+
+fail()
+{
+	echo "$1"
+	exit 1
+}
+
+# Two Streams so that the cache has more than one Stream to store.
+{
+	echo foo | "$XZ" -c
+	echo bar | "$XZ" -c --check=crc64
+} > "$FILE" || fail "Failed to create the test file"
+
+"$XZ" --robot --list "$FILE" > index_cache_list1 \
+	|| fail "Failed to list the test file"
+
+# The default mode only reads the cache and never creates it.
+"$XZ" --robot --list --index-cache "$FILE" > index_cache_list2 \
+	|| fail "--index-cache failed without a cache file"
+cmp index_cache_list1 index_cache_list2 > /dev/null \
+	|| fail "--index-cache changed the output of --list"
+test -f "$CACHE" && fail "--index-cache created the cache file"
+
+"$XZ" --robot --list --index-cache=read "$FILE" > /dev/null \
+	|| fail "--index-cache=read failed"
+test -f "$CACHE" && fail "--index-cache=read created the cache file"
+
+if "$XZ" --list --index-cache=foo "$FILE" > /dev/null 2>&1 ; then
+	fail "Unsupported --index-cache mode was accepted"
+fi
+
+# The write mode creates the cache without leaving the temporary file.
+"$XZ" --robot --list --index-cache=write "$FILE" > index_cache_list2 \
+	|| fail "--index-cache=write failed"
+cmp index_cache_list1 index_cache_list2 > /dev/null \
+	|| fail "--index-cache=write changed the output of --list"
+test -f "$CACHE" || fail "--index-cache=write didn't create the cache file"
+test -f "$CACHE.tmp" && fail "The temporary cache file was left behind"
+
+# Break the Stream Footer magic bytes at the end of the file without
+# changing its size or modification time. --list fails without the cache
+# but the cache still matches the file.
+touch -r "$FILE" index_cache_ref
+printf 'XX' | dd of="$FILE" bs=1 seek=$(($(wc -c < "$FILE") - 2)) \
+	conv=notrunc 2> /dev/null || fail "Failed to modify the test file"
+touch -r index_cache_ref "$FILE"
+
+if "$XZ" --robot --list "$FILE" > /dev/null 2>&1 ; then
+	fail "Corrupt test file wasn't detected"
+fi
+
+"$XZ" --robot --list --index-cache "$FILE" > index_cache_list2 \
+	|| fail "The cache wasn't used"
+cmp index_cache_list1 index_cache_list2 > /dev/null \
+	|| fail "The output from the cache differs from the original"
+
+# A different modification time makes the cache stale. It isn't used
+# and the read mode doesn't touch it.
+touch -t 200001010000 "$FILE"
+cp "$CACHE" index_cache_old
+if "$XZ" --robot --list --index-cache "$FILE" > /dev/null 2>&1 ; then
+	fail "A stale cache was used"
+fi
+cmp "$CACHE" index_cache_old > /dev/null \
+	|| fail "--index-cache modified the cache file"
+
+# The write mode replaces a stale cache but not if the temporary file
+# exists already.
+{
+	echo foo | "$XZ" -c
+	echo bar | "$XZ" -c --check=crc64
+} > "$FILE" || fail "Failed to create the test file"
+touch -t 200101010000 "$FILE"
+
+: > "$CACHE.tmp"
+"$XZ" --robot --list --index-cache=write "$FILE" > /dev/null \
+	|| fail "--index-cache=write failed with an existing temporary file"
+cmp "$CACHE" index_cache_old > /dev/null \
+	|| fail "The cache was written despite an existing temporary file"
+test -s "$CACHE.tmp" && fail "The existing temporary file was modified"
+rm -f "$CACHE.tmp"
+
+"$XZ" --robot --list --index-cache=write "$FILE" > /dev/null \
+	|| fail "--index-cache=write failed with a stale cache"
+if cmp "$CACHE" index_cache_old > /dev/null ; then
+	fail "--index-cache=write didn't replace a stale cache"
+fi
+
+"$XZ" --robot --list --index-cache "$FILE" > index_cache_list2 \
+	|| fail "The replaced cache wasn't used"
+cmp index_cache_list1 index_cache_list2 > /dev/null \
+	|| fail "The output from the replaced cache differs"
+
+rm -f "$FILE" "$CACHE" "$CACHE.tmp" index_cache_ref \
+	index_cache_list1 index_cache_list2 index_cache_old
+
+exit 0
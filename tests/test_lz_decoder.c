@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_lz_decoder.c
+/// \brief      Tests the LZ decoder dictionary handling and match copying
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+
+
+// The data has to be a few times bigger than the dictionary to make
+// the dictionary wrap.
+#define BIG_DICT_SIZE (8U << 20)
+#define BIG_DATA_SIZE (2 * BIG_DICT_SIZE + 12345)
+
+// Size of the data for the match copying tests
+#define REPEAT_DATA_SIZE (400 * 1024)
+
+
+#if defined(HAVE_ENCODER_LZMA1) && defined(HAVE_DECODER_LZMA1)
+/// Decode a raw LZMA1 stream in chunks of varying size and compare
+/// the output to expected[]. chunk_mul and chunk_add control the
+/// sequence of output buffer sizes.
+static void
+decode_and_compare(const lzma_filter *filters,
+		const uint8_t *in, size_t in_size,
+		const uint8_t *expected, uint8_t *out, size_t out_size,
+		size_t chunk_mul, size_t chunk_add)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_raw_decoder(&strm, filters), LZMA_OK);
+
+	// Fill the output with a pattern so that bytes written past
+	// the output buffer by the decoder would be noticed.
+	memset(out, 0xA5, out_size);
+	strm.next_in = in;
+	strm.avail_in = in_size;
+	strm.next_out = out;
+
+	lzma_ret ret = LZMA_OK;
+	size_t chunk = 1;
+	while (ret == LZMA_OK && strm.total_out < out_size) {
+		strm.avail_out = my_min(chunk,
+				out_size - (size_t)(strm.total_out));
+		ret = lzma_code(&strm, LZMA_RUN);
+		chunk = (chunk * chunk_mul + chunk_add) % 100003 + 1;
+	}
+
+	// The raw LZMA1 encoder writes the end of payload marker.
+	assert_lzma_ret(ret, LZMA_STREAM_END);
+	assert_uint_eq(strm.total_out, out_size);
+	assert_array_eq(out, expected, out_size);
+
+	lzma_end(&strm);
+}
+
+
+/// Fill buf with runs copied from earlier in buf at distances up to
+/// the dictionary size and some literals in between.
+static void
+fill_big(uint8_t *buf, size_t size)
+{
+	uint32_t seed = 7;
+	size_t i = 0;
+
+	while (i < size) {
+		uint32_t r = test_random(&seed) << 16;
+		r |= test_random(&seed);
+
+		if (i < 300 || (r & 0x0F) == 0) {
+			buf[i++] = (uint8_t)(r >> 16);
+			continue;
+		}
+
+		// The distance is usually small but sometimes close to
+		// the dictionary size. Short distances with long runs
+		// create overlapping matches.
+		const size_t max_dist = (r & 0x10)
+				? my_min(i, BIG_DICT_SIZE - 1) : 300;
+		const size_t dist = 1 + (r >> 5) % max_dist;
+		size_t len = 2 + (r >> 20) % 300;
+		if (len > size - i)
+			len = size - i;
+
+		while (len-- > 0) {
+			buf[i] = buf[i - dist];
+			++i;
+		}
+	}
+}
+#endif
+
+
+static void
+test_big_dict(void)
+{
+#if !defined(HAVE_ENCODER_LZMA1) || !defined(HAVE_DECODER_LZMA1)
+	assert_skip("LZMA1 encoder or decoder is disabled");
+#else
+	uint8_t *original = tuktest_malloc(BIG_DATA_SIZE);
+	fill_big(original, BIG_DATA_SIZE);
+
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 0));
+	opt.dict_size = BIG_DICT_SIZE;
+
+	const lzma_filter filters[2] = {
+		{ LZMA_FILTER_LZMA1, &opt },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+
+	const size_t compressed_max = BIG_DATA_SIZE + BIG_DATA_SIZE / 2;
+	uint8_t *compressed = tuktest_malloc(compressed_max);
+	size_t compressed_size = 0;
+
+	assert_lzma_ret(lzma_raw_buffer_encode(filters, NULL, original,
+			BIG_DATA_SIZE, compressed, &compressed_size,
+			compressed_max), LZMA_OK);
+
+	// Small output buffers make the decoder stop at many different
+	// positions, also right before and after the dictionary wraps.
+	uint8_t *decoded = tuktest_malloc(BIG_DATA_SIZE);
+	decode_and_compare(filters, compressed, compressed_size,
+			original, decoded, BIG_DATA_SIZE, 3, 0);
+	decode_and_compare(filters, compressed, compressed_size,
+			original, decoded, BIG_DATA_SIZE, 7, 1);
+#endif
+}
+
+
+#if defined(HAVE_ENCODER_LZMA1) && defined(HAVE_DECODER_LZMA1)
+/// Fill buf with runs of every length from 2 to 80 at every distance
+/// from 1 to 40, some longer runs, and random literals in between.
+/// The matches are short and overlap their source like in text.
+static size_t
+fill_repeat(uint8_t *buf, size_t size)
+{
+	uint32_t seed = 11;
+	size_t i = 0;
+
+	for (size_t dist = 1; dist <= 40; ++dist) {
+		for (size_t len = 2; len <= 80 + (dist % 4) * 100; ++len) {
+			// A few random literals make the encoder
+			// start a new match here.
+			const size_t literals = dist + 1 + len % 5;
+			if (i + literals + len > size)
+				return i;
+
+			for (size_t j = 0; j < literals; ++j)
+				buf[i++] = (uint8_t)(test_random(&seed));
+
+			for (size_t j = 0; j < len; ++j, ++i)
+				buf[i] = buf[i - dist];
+		}
+	}
+
+	return i;
+}
+#endif
+
+
+static void
+test_repeat(void)
+{
+#if !defined(HAVE_ENCODER_LZMA1) || !defined(HAVE_DECODER_LZMA1)
+	assert_skip("LZMA1 encoder or decoder is disabled");
+#else
+	uint8_t *original = tuktest_malloc(REPEAT_DATA_SIZE);
+	const size_t size = fill_repeat(original, REPEAT_DATA_SIZE);
+
+	const size_t compressed_max = size + size / 2;
+	uint8_t *compressed = tuktest_malloc(compressed_max);
+	uint8_t *decoded = tuktest_malloc(size);
+
+	// The small dictionary makes the dictionary buffer wrap many times
+	// so that matches get copied from the end of the buffer too.
+	static const uint32_t dict_sizes[] = { 4096, 1 << 20 };
+
+	for (size_t i = 0; i < ARRAY_SIZE(dict_sizes); ++i) {
+		lzma_options_lzma opt;
+		assert_false(lzma_lzma_preset(&opt, 6));
+		opt.dict_size = dict_sizes[i];
+
+		const lzma_filter filters[2] = {
+			{ LZMA_FILTER_LZMA1, &opt },
+			{ LZMA_VLI_UNKNOWN, NULL },
+		};
+
+		size_t compressed_size = 0;
+		assert_lzma_ret(lzma_raw_buffer_encode(filters, NULL,
+				original, size, compressed,
+				&compressed_size, compressed_max), LZMA_OK);
+
+		// Output buffer sizes of one byte cut every match,
+		// the others cut them at varying positions.
+		decode_and_compare(filters, compressed, compressed_size,
+				original, decoded, size, 0, 0);
+		decode_and_compare(filters, compressed, compressed_size,
+				original, decoded, size, 7, 3);
+		decode_and_compare(filters, compressed, compressed_size,
+				original, decoded, size, 1, size);
+	}
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_lz_decoder_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+	tuktest_run(test_repeat);
+	tuktest_run(test_big_dict);
+	return tuktest_end();
+}
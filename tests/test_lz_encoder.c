@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_lz_encoder.c
+/// \brief      Tests reinitializing the LZ encoder and the turbo mode
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+
+
+#define DATA_SIZE (64 * 1024)
+
+static uint8_t original[DATA_SIZE];
+
+
+#ifdef HAVE_ENCODER_LZMA1
+/// Encode in_size bytes from original[] with an already-initialized
+/// lzma_stream and return the size of the output.
+static size_t
+encode(lzma_stream *strm, size_t in_size, uint8_t *out, size_t out_size)
+{
+	strm->next_in = original;
+	strm->avail_in = in_size;
+	strm->next_out = out;
+	strm->avail_out = out_size;
+
+	assert_lzma_ret(lzma_code(strm, LZMA_FINISH), LZMA_STREAM_END);
+	return out_size - strm->avail_out;
+}
+#endif
+
+
+static void
+test_reinit(void)
+{
+#ifndef HAVE_ENCODER_LZMA1
+	assert_skip("LZMA1 encoder is disabled");
+#else
+	static const lzma_match_finder mfs[] = {
+		LZMA_MF_HC3,
+		LZMA_MF_HC4,
+		LZMA_MF_HC5,
+		LZMA_MF_BT2,
+		LZMA_MF_BT3,
+		LZMA_MF_BT4,
+		LZMA_MF_BT5,
+	};
+
+	static uint8_t expected[DATA_SIZE * 2];
+	static uint8_t out[DATA_SIZE * 2];
+
+	for (size_t i = 0; i < ARRAY_SIZE(mfs); ++i) {
+		if (!lzma_mf_is_supported(mfs[i]))
+			continue;
+
+		lzma_options_lzma opt;
+		assert_false(lzma_lzma_preset(&opt, 6));
+		opt.dict_size = 4096;
+		opt.mf = mfs[i];
+
+		const lzma_filter filters[2] = {
+			{ LZMA_FILTER_LZMA1, &opt },
+			{ LZMA_VLI_UNKNOWN, NULL },
+		};
+
+		// Reinitializing the encoder must reset the match finder
+		// completely even though the hash arrays are reused. Any
+		// leftover positions from the previous round would allow
+		// matches to data that the decoder doesn't have. Different
+		// amounts of input make the positions differ from round
+		// to round.
+		lzma_stream strm = LZMA_STREAM_INIT;
+
+		for (size_t round = 0; round < 8; ++round) {
+			const size_t in_size = DATA_SIZE - round * 1000;
+
+			size_t expected_size = 0;
+			assert_lzma_ret(lzma_raw_buffer_encode(filters, NULL,
+					original, in_size, expected,
+					&expected_size, sizeof(expected)),
+					LZMA_OK);
+
+			assert_lzma_ret(lzma_raw_encoder(&strm, filters),
+					LZMA_OK);
+			const size_t out_size = encode(&strm, in_size,
+					out, sizeof(out));
+
+			assert_uint_eq(out_size, expected_size);
+			assert_array_eq(out, expected, out_size);
+		}
+
+		lzma_end(&strm);
+	}
+#endif
+}
+
+
+static void
+test_turbo(void)
+{
+#if !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("LZMA2 encoder or decoder is disabled");
+#else
+	assert_true(lzma_mode_is_supported(LZMA_MODE_TURBO));
+
+	static const lzma_match_finder mfs[] = {
+		LZMA_MF_HC3,
+		LZMA_MF_HC4,
+		LZMA_MF_HC5,
+		LZMA_MF_BT4,
+	};
+
+	static uint8_t compressed[DATA_SIZE * 2];
+	static uint8_t decoded[DATA_SIZE];
+
+	for (size_t i = 0; i < ARRAY_SIZE(mfs); ++i) {
+		if (!lzma_mf_is_supported(mfs[i]))
+			continue;
+
+		// The default depth (0) makes the match finder check
+		// only one candidate. Test also a deeper search.
+		for (uint32_t depth = 0; depth <= 16; depth += 16) {
+			lzma_options_lzma opt;
+			assert_false(lzma_lzma_preset(&opt, 0));
+			opt.mode = LZMA_MODE_TURBO;
+			opt.mf = mfs[i];
+			opt.depth = depth;
+
+			const lzma_filter filters[2] = {
+				{ LZMA_FILTER_LZMA2, &opt },
+				{ LZMA_VLI_UNKNOWN, NULL },
+			};
+
+			size_t compressed_size = 0;
+			assert_lzma_ret(lzma_raw_buffer_encode(filters, NULL,
+					original, DATA_SIZE, compressed,
+					&compressed_size, sizeof(compressed)),
+					LZMA_OK);
+
+			// Four different letters fit in two bits.
+			assert_uint(compressed_size, <, DATA_SIZE / 3);
+
+			size_t in_pos = 0;
+			size_t out_pos = 0;
+			assert_lzma_ret(lzma_raw_buffer_decode(filters, NULL,
+					compressed, &in_pos, compressed_size,
+					decoded, &out_pos, sizeof(decoded)),
+					LZMA_OK);
+
+			assert_uint_eq(in_pos, compressed_size);
+			assert_uint_eq(out_pos, DATA_SIZE);
+			assert_array_eq(decoded, original, DATA_SIZE);
+		}
+	}
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_lz_encoder_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+	test_fill_letters(original, DATA_SIZE, 3, 4);
+
+	tuktest_run(test_reinit);
+	tuktest_run(test_turbo);
+
+	return tuktest_end();
+}
@@ -10,6 +10,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "tests.h"
+#include "mythread.h"
 
 #ifdef HAVE_LZIP_DECODER
 
@@ -446,6 +447,214 @@ test_invalid_memlimit(void)
 
 	lzma_end(&strm);
 }
+
+
+#ifdef MYTHREAD_ENABLED
+/// Decode in_size bytes from "in" with LZMA_CONCATENATED using the
+/// single-threaded decoder if threads is zero and the multithreaded
+/// decoder otherwise. If one_byte is true, the input is given one byte
+/// at a time with LZMA_RUN. The amount of input used and the CRC32 of
+/// the output are stored in *total_in and *crc.
+static lzma_ret
+decode_buffer(const uint8_t *in, size_t in_size, uint32_t threads,
+		uint64_t memlimit_threading, bool one_byte,
+		uint64_t *total_in, uint32_t *crc)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+
+	if (threads == 0) {
+		assert_lzma_ret(lzma_lzip_decoder(&strm, UINT64_MAX,
+				LZMA_CONCATENATED), LZMA_OK);
+	} else {
+		const lzma_mt mt = {
+			.flags = LZMA_CONCATENATED,
+			.threads = threads,
+			.memlimit_threading = memlimit_threading,
+			.memlimit_stop = UINT64_MAX,
+		};
+		assert_lzma_ret(lzma_lzip_decoder_mt(&strm, &mt), LZMA_OK);
+	}
+
+	uint8_t output_buffer[DECODE_CHUNK_SIZE];
+	const uint8_t *in_end = in + in_size;
+
+	strm.next_in = in;
+	*crc = 0;
+
+	lzma_ret ret = LZMA_OK;
+	while (ret == LZMA_OK) {
+		lzma_action action = LZMA_FINISH;
+		strm.avail_in = (size_t)(in_end - strm.next_in);
+
+		if (one_byte && strm.avail_in > 0) {
+			strm.avail_in = 1;
+			action = LZMA_RUN;
+		}
+
+		strm.next_out = output_buffer;
+		strm.avail_out = sizeof(output_buffer);
+
+		ret = lzma_code(&strm, action);
+
+		*crc = lzma_crc32(output_buffer,
+				(size_t)(strm.next_out - output_buffer), *crc);
+	}
+
+	*total_in = strm.total_in;
+	lzma_end(&strm);
+	return ret;
+}
+
+
+/// Check that the multithreaded decoder gives the same result as
+/// the single-threaded decoder.
+static void
+compare_mt(const uint8_t *in, size_t in_size)
+{
+	for (unsigned one_byte = 0; one_byte <= 1; ++one_byte) {
+		uint64_t st_total_in;
+		uint32_t st_crc;
+		const lzma_ret st_ret = decode_buffer(in, in_size, 0, 0,
+				one_byte, &st_total_in, &st_crc);
+
+		// Threads 1-4 with memlimit_threading high enough for
+		// threaded mode and then 2 threads with memlimit_threading
+		// so low that direct mode must be used.
+		for (uint32_t i = 1; i <= 5; ++i) {
+			const uint32_t threads = i <= 4 ? i : 2;
+			const uint64_t memlimit_threading
+					= i <= 4 ? UINT64_MAX : 1;
+
+			uint64_t mt_total_in;
+			uint32_t mt_crc;
+			const lzma_ret mt_ret = decode_buffer(in, in_size,
+					threads, memlimit_threading, one_byte,
+					&mt_total_in, &mt_crc);
+
+			// The output before an error is the same too.
+			assert_lzma_ret(mt_ret, st_ret);
+			assert_uint_eq(mt_crc, st_crc);
+
+			if (st_ret == LZMA_STREAM_END)
+				assert_uint_eq(mt_total_in, st_total_in);
+		}
+	}
+}
+#endif
+
+
+static void
+test_mt_files(void)
+{
+#ifndef MYTHREAD_ENABLED
+	assert_skip("Threading support disabled");
+#else
+	static const char *const files[] = {
+		"files/good-1-v0.lz",
+		"files/good-1-v0-trailing-1.lz",
+		"files/good-1-v1.lz",
+		"files/good-1-v1-trailing-1.lz",
+		"files/good-1-v1-trailing-2.lz",
+		"files/good-2-v0-v1.lz",
+		"files/good-2-v1-v0.lz",
+		"files/good-2-v1-v1.lz",
+		"files/bad-1-v0-uncomp-size.lz",
+		"files/bad-1-v1-crc32.lz",
+		"files/bad-1-v1-dict-1.lz",
+		"files/bad-1-v1-dict-2.lz",
+		"files/bad-1-v1-magic-1.lz",
+		"files/bad-1-v1-magic-2.lz",
+		"files/bad-1-v1-member-size.lz",
+		"files/bad-1-v1-trailing-magic.lz",
+		"files/bad-1-v1-uncomp-size.lz",
+		"files/unsupported-1-v234.lz",
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(files); ++i) {
+		size_t file_size;
+		uint8_t *data = tuktest_file_from_srcdir(files[i],
+				&file_size);
+		compare_mt(data, file_size);
+	}
+#endif
+}
+
+
+static void
+test_mt_many_members(void)
+{
+#ifndef MYTHREAD_ENABLED
+	assert_skip("Threading support disabled");
+#else
+	// Concatenate many copies of a one-member file so that there is
+	// work for all the threads. Test without and with trailing data.
+	size_t member_size;
+	const uint8_t *member = tuktest_file_from_srcdir(
+			"files/good-1-v1.lz", &member_size);
+
+	const size_t members = 64;
+	const uint8_t trailing[] = { 0x00, 0x01, 0x02, 0x03 };
+
+	const size_t in_size = members * member_size + sizeof(trailing);
+	uint8_t *in = tuktest_malloc(in_size);
+
+	for (size_t i = 0; i < members; ++i)
+		memcpy(in + i * member_size, member, member_size);
+
+	memcpy(in + members * member_size, trailing, sizeof(trailing));
+
+	compare_mt(in, in_size - sizeof(trailing));
+	compare_mt(in, in_size);
+
+	// A worker thread fails on a corrupt member in the middle. It and
+	// the members after it are decoded again in direct mode which
+	// gives the same output and error as the single-threaded decoder.
+	// The footer has CRC32, Data size, and Member size.
+	uint8_t *footer = in + 21 * member_size - 20;
+	footer[0] ^= 0x01;
+	compare_mt(in, in_size);
+	footer[0] ^= 0x01;
+
+	footer[4] ^= 0x01;
+	compare_mt(in, in_size);
+	footer[4] ^= 0x01;
+
+	// Check that the members were really decoded by the worker threads.
+	// With the trailing data the last member isn't followed by another
+	// member so it would be decoded in direct mode after the threads
+	// have been stopped.
+	const lzma_mt mt = {
+		.flags = LZMA_CONCATENATED,
+		.threads = 4,
+		.memlimit_threading = UINT64_MAX,
+		.memlimit_stop = UINT64_MAX,
+	};
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_lzip_decoder_mt(&strm, &mt), LZMA_OK);
+
+	uint8_t *out = tuktest_malloc(members * DECODE_CHUNK_SIZE);
+	strm.next_in = in;
+	strm.avail_in = in_size - sizeof(trailing);
+	strm.next_out = out;
+	strm.avail_out = members * DECODE_CHUNK_SIZE;
+
+	assert_lzma_ret(lzma_code(&strm, LZMA_FINISH), LZMA_STREAM_END);
+	assert_uint_eq(strm.avail_in, 0);
+
+	lzma_worker_stats stats[4];
+	const uint32_t count = lzma_get_worker_stats(&strm, stats, 4);
+	assert_true(count >= 1 && count <= 4);
+
+	uint64_t blocks = 0;
+	for (uint32_t i = 0; i < count; ++i)
+		blocks += stats[i].blocks;
+
+	assert_uint_eq(blocks, members);
+
+	lzma_end(&strm);
+#endif
+}
 #endif
 
 
@@ -474,6 +683,8 @@ main(int argc, const char **argv)
 	tuktest_run(test_invalid_uncomp_size);
 	tuktest_run(test_invalid_member_size);
 	tuktest_run(test_invalid_memlimit);
+	tuktest_run(test_mt_files);
+	tuktest_run(test_mt_many_members);
 	return tuktest_end();
 #endif
 }
@@ -0,0 +1,421 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_lzip_encoder.c
+/// \brief      Tests encoding lzip data
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+#include "mythread.h"
+
+#if defined(HAVE_LZIP_ENCODER) && defined(HAVE_LZIP_DECODER)
+
+#define DATA_SIZE (300 * 1024)
+#define MEMBER_SIZE (64 * 1024)
+
+// Enough for DATA_SIZE bytes of the test data in any number of members
+#define OUT_SIZE (2 * DATA_SIZE)
+
+// Size of a .lz member with no uncompressed data: header, the LZMA1
+// stream with only the end of payload marker, and the footer.
+#define EMPTY_MEMBER_SIZE 36
+
+static uint8_t original[DATA_SIZE];
+
+
+/// Encode in_size bytes from original[] and return the size of the output.
+/// If flush_interval isn't zero, LZMA_FULL_BARRIER is used after every
+/// flush_interval bytes.
+static size_t
+encode(lzma_stream *strm, size_t in_size, size_t flush_interval,
+		uint8_t *out, size_t out_size)
+{
+	strm->next_in = original;
+	strm->next_out = out;
+	strm->avail_out = out_size;
+
+	size_t in_pos = 0;
+	while (flush_interval > 0 && in_size - in_pos > flush_interval) {
+		strm->avail_in = flush_interval;
+		assert_lzma_ret(lzma_code(strm, LZMA_FULL_BARRIER),
+				LZMA_STREAM_END);
+		assert_uint_eq(strm->avail_in, 0);
+		in_pos += flush_interval;
+	}
+
+	strm->avail_in = in_size - in_pos;
+	assert_lzma_ret(lzma_code(strm, LZMA_FINISH), LZMA_STREAM_END);
+	assert_uint_eq(strm->avail_in, 0);
+
+	return out_size - strm->avail_out;
+}
+
+
+/// Decode a .lz file and check that the result equals the first
+/// expected_size bytes of original[]. Return the number of .lz members.
+static size_t
+check_decode(const uint8_t *in, size_t in_size, size_t expected_size)
+{
+	// Decode the members one at a time to count them. The footer
+	// position isn't known without decoding the member.
+	size_t members = 0;
+	for (size_t pos = 0; pos < in_size; ++members) {
+		assert_true(in_size - pos >= EMPTY_MEMBER_SIZE);
+
+		// "LZIP" and the format version 1
+		assert_uint_eq(in[pos + 0], 0x4C);
+		assert_uint_eq(in[pos + 1], 0x5A);
+		assert_uint_eq(in[pos + 2], 0x49);
+		assert_uint_eq(in[pos + 3], 0x50);
+		assert_uint_eq(in[pos + 4], 1);
+
+		lzma_stream strm = LZMA_STREAM_INIT;
+		assert_lzma_ret(lzma_lzip_decoder(&strm, UINT64_MAX, 0),
+				LZMA_OK);
+		uint8_t *out = tuktest_malloc(DATA_SIZE);
+		strm.next_in = in + pos;
+		strm.avail_in = in_size - pos;
+		strm.next_out = out;
+		strm.avail_out = DATA_SIZE;
+		assert_lzma_ret(lzma_code(&strm, LZMA_FINISH),
+				LZMA_STREAM_END);
+
+		// Check that the Member size field is right.
+		const size_t used = (size_t)(strm.total_in);
+		assert_uint_eq(read64le(in + pos + used - 8), used);
+
+		lzma_end(&strm);
+		pos += used;
+	}
+
+	// Decode all members at once.
+	uint8_t *out = tuktest_malloc(DATA_SIZE + 1);
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_lzip_decoder(&strm, UINT64_MAX,
+			LZMA_CONCATENATED), LZMA_OK);
+
+	strm.next_in = in;
+	strm.avail_in = in_size;
+	strm.next_out = out;
+	strm.avail_out = DATA_SIZE + 1;
+
+	assert_lzma_ret(lzma_code(&strm, LZMA_FINISH), LZMA_STREAM_END);
+	assert_uint_eq(strm.total_in, in_size);
+	assert_uint_eq(strm.total_out, expected_size);
+	assert_array_eq(out, original, expected_size);
+
+	lzma_end(&strm);
+	return members;
+}
+#endif
+
+
+static void
+test_options(void)
+{
+#if !defined(HAVE_LZIP_ENCODER) || !defined(HAVE_LZIP_DECODER)
+	assert_skip("LZMA1 encoder or lzip decoder is disabled");
+#else
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 1));
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, NULL), LZMA_OPTIONS_ERROR);
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+
+	// lc/lp/pb are fixed in the .lz format.
+	opt.lc = 0;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OPTIONS_ERROR);
+	opt.lc = 3;
+	opt.lp = 1;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OPTIONS_ERROR);
+	opt.lp = 0;
+	opt.pb = 0;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OPTIONS_ERROR);
+	opt.pb = 2;
+
+	// The dictionary size cannot be over 512 MiB.
+	opt.dict_size = (UINT32_C(512) << 20) + 1;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OPTIONS_ERROR);
+	opt.dict_size = 1U << 20;
+
+	// Preset dictionary cannot be stored in the .lz header.
+	opt.preset_dict = original;
+	opt.preset_dict_size = 1024;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OPTIONS_ERROR);
+	opt.preset_dict = NULL;
+	opt.preset_dict_size = 0;
+
+	// No flushing marker exists in the .lz format.
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+	uint8_t out[128];
+	strm.next_in = original;
+	strm.avail_in = 1;
+	strm.next_out = out;
+	strm.avail_out = sizeof(out);
+	assert_lzma_ret(lzma_code(&strm, LZMA_SYNC_FLUSH), LZMA_PROG_ERROR);
+
+	lzma_end(&strm);
+
+#	ifdef MYTHREAD_ENABLED
+	lzma_mt mt = {
+		.threads = 2,
+		.preset = 1,
+	};
+
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+	assert_uint(lzma_lzip_encoder_mt_memusage(&mt), <, UINT64_MAX);
+
+	mt.flags = 1;
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OPTIONS_ERROR);
+	assert_uint_eq(lzma_lzip_encoder_mt_memusage(&mt), UINT64_MAX);
+	mt.flags = 0;
+
+	mt.threads = 0;
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OPTIONS_ERROR);
+	mt.threads = 2;
+
+	// The filter chain must be a single LZMA1 filter.
+	lzma_filter filters[3] = {
+		{ LZMA_FILTER_LZMA2, &opt },
+		{ LZMA_VLI_UNKNOWN, NULL },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+	mt.filters = filters;
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OPTIONS_ERROR);
+	assert_uint_eq(lzma_lzip_encoder_mt_memusage(&mt), UINT64_MAX);
+
+	filters[0].id = LZMA_FILTER_LZMA1;
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+
+	filters[1] = filters[0];
+	filters[0].id = LZMA_FILTER_X86;
+	filters[0].options = NULL;
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OPTIONS_ERROR);
+
+	filters[0] = filters[1];
+	filters[1].id = LZMA_VLI_UNKNOWN;
+	opt.pb = 0;
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OPTIONS_ERROR);
+
+	lzma_end(&strm);
+#	endif
+#endif
+}
+
+
+#if defined(HAVE_LZIP_ENCODER) && defined(HAVE_LZIP_DECODER)
+/// Encode empty input with the given dictionary size and return the
+/// dictionary size field of the .lz header.
+static uint8_t
+encode_dict_size(uint32_t dict_size)
+{
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 0));
+	opt.dict_size = dict_size;
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+
+	uint8_t out[EMPTY_MEMBER_SIZE];
+	assert_uint_eq(encode(&strm, 0, 0, out, sizeof(out)),
+			EMPTY_MEMBER_SIZE);
+	lzma_end(&strm);
+
+	return out[5];
+}
+#endif
+
+
+static void
+test_dict_size(void)
+{
+#if !defined(HAVE_LZIP_ENCODER) || !defined(HAVE_LZIP_DECODER)
+	assert_skip("LZMA1 encoder or lzip decoder is disabled");
+#else
+	// The field stores 2^n - k * 2^(n-4) where k is in the range [0, 7].
+	// Sizes that cannot be represented are rounded up.
+	assert_uint_eq(encode_dict_size(4096), 0x0C);
+	assert_uint_eq(encode_dict_size(4097), 0xED);
+	assert_uint_eq(encode_dict_size(5000), 0xCD);
+	assert_uint_eq(encode_dict_size(5120), 0xCD);
+	assert_uint_eq(encode_dict_size(5121), 0xAD);
+	assert_uint_eq(encode_dict_size(8192), 0x0D);
+	assert_uint_eq(encode_dict_size(3U << 20), 0x96);
+	assert_uint_eq(encode_dict_size(8U << 20), 0x17);
+	assert_uint_eq(encode_dict_size((8U << 20) + 1), 0xF8);
+	assert_uint_eq(encode_dict_size(512U << 20), 0x1D);
+#endif
+}
+
+
+static void
+test_empty(void)
+{
+#if !defined(HAVE_LZIP_ENCODER) || !defined(HAVE_LZIP_DECODER)
+	assert_skip("LZMA1 encoder or lzip decoder is disabled");
+#else
+	// Empty input still produces one member.
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 1));
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+
+	uint8_t st_out[2 * EMPTY_MEMBER_SIZE];
+	assert_uint_eq(encode(&strm, 0, 0, st_out, sizeof(st_out)),
+			EMPTY_MEMBER_SIZE);
+	assert_uint_eq(check_decode(st_out, EMPTY_MEMBER_SIZE, 0), 1);
+
+	// Flushing without input doesn't create empty members.
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+	strm.next_out = st_out;
+	strm.avail_out = sizeof(st_out);
+	assert_lzma_ret(lzma_code(&strm, LZMA_FULL_FLUSH), LZMA_STREAM_END);
+	assert_uint_eq(strm.total_out, 0);
+	assert_lzma_ret(lzma_code(&strm, LZMA_FINISH), LZMA_STREAM_END);
+	assert_uint_eq(strm.total_out, EMPTY_MEMBER_SIZE);
+
+	lzma_end(&strm);
+
+#	ifdef MYTHREAD_ENABLED
+	const lzma_mt mt = {
+		.threads = 2,
+		.preset = 1,
+	};
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+
+	uint8_t mt_out[2 * EMPTY_MEMBER_SIZE];
+	assert_uint_eq(encode(&strm, 0, 0, mt_out, sizeof(mt_out)),
+			EMPTY_MEMBER_SIZE);
+	assert_array_eq(mt_out, st_out, EMPTY_MEMBER_SIZE);
+
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+	strm.next_out = mt_out;
+	strm.avail_out = sizeof(mt_out);
+	assert_lzma_ret(lzma_code(&strm, LZMA_FULL_FLUSH), LZMA_STREAM_END);
+	assert_uint_eq(strm.total_out, 0);
+	assert_lzma_ret(lzma_code(&strm, LZMA_FINISH), LZMA_STREAM_END);
+	assert_uint_eq(strm.total_out, EMPTY_MEMBER_SIZE);
+
+	lzma_end(&strm);
+#	endif
+#endif
+}
+
+
+static void
+test_members(void)
+{
+#if !defined(HAVE_LZIP_ENCODER) || !defined(HAVE_LZIP_DECODER)
+	assert_skip("LZMA1 encoder or lzip decoder is disabled");
+#else
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 6));
+	opt.dict_size = MEMBER_SIZE;
+
+	// Without flushing everything goes into one member.
+	uint8_t *st_out = tuktest_malloc(OUT_SIZE);
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+	size_t st_size = encode(&strm, DATA_SIZE, 0, st_out, OUT_SIZE);
+	assert_uint_eq(check_decode(st_out, st_size, DATA_SIZE), 1);
+
+	// LZMA_FULL_BARRIER starts a new member. Reinitializing the
+	// encoder reuses the old LZMA1 encoder.
+	assert_lzma_ret(lzma_lzip_encoder(&strm, &opt), LZMA_OK);
+	st_size = encode(&strm, DATA_SIZE, MEMBER_SIZE, st_out, OUT_SIZE);
+	assert_uint_eq(check_decode(st_out, st_size, DATA_SIZE),
+			(DATA_SIZE + MEMBER_SIZE - 1) / MEMBER_SIZE);
+	lzma_end(&strm);
+
+#	ifdef MYTHREAD_ENABLED
+	// The threaded encoder must produce identical output with any
+	// number of threads and it must match the single-threaded encoder
+	// when the members are the same. The dictionary isn't bigger than
+	// the members so the threaded encoder doesn't need to reduce it.
+	const lzma_filter filters[2] = {
+		{ LZMA_FILTER_LZMA1, &opt },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+
+	uint8_t *mt_out = tuktest_malloc(OUT_SIZE);
+
+	for (uint32_t threads = 1; threads <= 4; ++threads) {
+		const lzma_mt mt = {
+			.threads = threads,
+			.block_size = MEMBER_SIZE,
+			.filters = filters,
+		};
+
+		assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+		const size_t mt_size = encode(&strm, DATA_SIZE, 0,
+				mt_out, OUT_SIZE);
+
+		assert_uint_eq(mt_size, st_size);
+		assert_array_eq(mt_out, st_out, st_size);
+
+		// Each member counts as one Block in the statistics.
+		lzma_worker_stats stats[4];
+		const uint32_t count = lzma_get_worker_stats(
+				&strm, stats, 4);
+		assert_true(count >= 1 && count <= threads);
+
+		uint64_t blocks = 0;
+		uint64_t progress_in = 0;
+		for (uint32_t i = 0; i < count; ++i) {
+			blocks += stats[i].blocks;
+			progress_in += stats[i].progress_in;
+		}
+
+		assert_uint_eq(blocks, (DATA_SIZE + MEMBER_SIZE - 1)
+				/ MEMBER_SIZE);
+		assert_uint_eq(progress_in, DATA_SIZE);
+
+		// LZMA_FULL_FLUSH ends a member early in threaded mode too.
+		assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+		const size_t flushed_size = encode(&strm, DATA_SIZE,
+				MEMBER_SIZE / 2, mt_out, OUT_SIZE);
+		assert_uint_eq(check_decode(mt_out, flushed_size,
+				DATA_SIZE), (DATA_SIZE + MEMBER_SIZE / 2 - 1)
+					/ (MEMBER_SIZE / 2));
+	}
+
+	// With the default member size the dictionary size is
+	// used as is and the data fits into one member.
+	const lzma_mt mt = {
+		.threads = 2,
+		.filters = filters,
+	};
+	assert_lzma_ret(lzma_lzip_encoder_mt(&strm, &mt), LZMA_OK);
+	const size_t mt_size = encode(&strm, DATA_SIZE, 0, mt_out, OUT_SIZE);
+	assert_uint_eq(check_decode(mt_out, mt_size, DATA_SIZE), 1);
+
+	lzma_end(&strm);
+#	endif
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_lzip_encoder_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+#if defined(HAVE_LZIP_ENCODER) && defined(HAVE_LZIP_DECODER)
+	test_fill_letters(original, DATA_SIZE, 7, 8);
+#endif
+
+	tuktest_run(test_options);
+	tuktest_run(test_dict_size);
+	tuktest_run(test_empty);
+	tuktest_run(test_members);
+
+	return tuktest_end();
+}
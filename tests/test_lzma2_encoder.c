@@ -0,0 +1,422 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_lzma2_encoder.c
+/// \brief      Tests choosing lc, lp, and pb with LZMA_LCLPPB_AUTO and
+///             storing random-looking data without compressing it
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+
+
+#define DATA_SIZE (128 * 1024)
+
+/// Text-like data for which the defaults are kept
+static uint8_t text[DATA_SIZE];
+
+/// 16-bit stereo samples for which the defaults aren't good
+static uint8_t samples[DATA_SIZE];
+
+/// Over 1 MiB of text followed by samples. The values are chosen again
+/// when the encoder has got past the text.
+#define MIXED_TEXT_SIZE ((1024 + 128) * 1024)
+#define MIXED_SIZE (MIXED_TEXT_SIZE + 4 * DATA_SIZE)
+static uint8_t mixed[MIXED_SIZE];
+
+/// Over 1 MiB of text in which each letter depends on the previous one,
+/// followed by runs of new samples and such text. A run of samples
+/// must not decide the values for the whole next interval.
+#define ALTERNATING_SIZE (MIXED_TEXT_SIZE + 8 * DATA_SIZE)
+static uint8_t alternating[ALTERNATING_SIZE];
+
+/// Random bytes followed by a copy of them. The first half has to be
+/// stored as uncompressed LZMA2 chunks but the copy compresses well.
+static uint8_t noise[2 * DATA_SIZE];
+
+/// Amount of random data that is followed by text. This isn't
+/// a multiple of the chunk size.
+#define NOISE_TEXT_RANDOM 100000
+
+
+/// A triangle wave with noise in the left channel and
+/// a quieter copy of it in the right channel
+static void
+fill_samples(uint8_t *buf, size_t size, uint32_t *seed)
+{
+	for (size_t i = 0; i < size; i += 4) {
+		const uint32_t phase = (uint32_t)(i / 4) % 512;
+		const uint32_t wave = phase < 256 ? phase : 511 - phase;
+		const uint32_t left = wave * 64 + test_random(seed) % 256;
+
+		write16le(buf + i, (uint16_t)(left));
+		write16le(buf + i + 2, (uint16_t)(left / 2));
+	}
+}
+
+
+static void
+fill_data(void)
+{
+	uint32_t seed = 5;
+
+	for (size_t i = 0; i < DATA_SIZE; ++i)
+		text[i] = (uint8_t)('a' + test_random(&seed) % 16);
+
+	fill_samples(samples, DATA_SIZE, &seed);
+
+	for (size_t i = 0; i < MIXED_TEXT_SIZE; ++i)
+		mixed[i] = (uint8_t)('a' + test_random(&seed) % 16);
+
+	for (size_t i = MIXED_TEXT_SIZE; i < MIXED_SIZE; i += DATA_SIZE)
+		memcpy(mixed + i, samples, DATA_SIZE);
+
+	uint32_t prev = 0;
+	for (size_t i = 0; i < ALTERNATING_SIZE; ++i) {
+		if (i >= MIXED_TEXT_SIZE
+				&& (i - MIXED_TEXT_SIZE) / DATA_SIZE % 2 == 0) {
+			fill_samples(alternating + i, DATA_SIZE, &seed);
+			i += DATA_SIZE - 1;
+			continue;
+		}
+
+		prev = (prev * 7 + test_random(&seed) % 4) % 26;
+		alternating[i] = (uint8_t)('a' + prev);
+	}
+
+	for (size_t i = 0; i < DATA_SIZE; ++i)
+		noise[i] = (uint8_t)(test_random(&seed));
+
+	memcpy(noise + DATA_SIZE, noise, DATA_SIZE);
+}
+
+
+#if defined(HAVE_ENCODER_LZMA2) && defined(HAVE_DECODER_LZMA2)
+/// Encodes the data with the given lc/lp/pb and the options of preset 6.
+/// The input is given to lzma_code() in pieces of in_step bytes.
+/// Returns the size of the output.
+static size_t
+encode(const uint8_t *in, size_t in_size,
+		uint32_t lc, uint32_t lp, uint32_t pb,
+		size_t in_step, uint8_t *out, size_t out_size)
+{
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 6));
+	opt.lc = lc;
+	opt.lp = lp;
+	opt.pb = pb;
+
+	const lzma_filter filters[2] = {
+		{ LZMA_FILTER_LZMA2, &opt },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_raw_encoder(&strm, filters), LZMA_OK);
+
+	strm.next_out = out;
+	strm.avail_out = out_size;
+
+	size_t in_pos = 0;
+	while (in_pos < in_size) {
+		const size_t amount = my_min(in_step, in_size - in_pos);
+		strm.next_in = in + in_pos;
+		strm.avail_in = amount;
+		in_pos += amount;
+
+		const lzma_action action
+				= in_pos == in_size ? LZMA_FINISH : LZMA_RUN;
+		const lzma_ret ret = lzma_code(&strm, action);
+		assert_lzma_ret(ret, action == LZMA_FINISH
+				? LZMA_STREAM_END : LZMA_OK);
+		assert_uint_eq(strm.avail_in, 0);
+	}
+
+	const size_t size = (size_t)(strm.total_out);
+	lzma_end(&strm);
+
+	// Decode to check that the output is valid. The decoder takes
+	// lc/lp/pb from the LZMA2 chunk headers.
+	assert_false(lzma_lzma_preset(&opt, 6));
+	static uint8_t decoded[ALTERNATING_SIZE];
+	size_t out_pos = 0;
+	size_t dec_in_pos = 0;
+	assert_lzma_ret(lzma_raw_buffer_decode(filters, NULL,
+			out, &dec_in_pos, size,
+			decoded, &out_pos, in_size), LZMA_OK);
+	assert_uint_eq(dec_in_pos, size);
+	assert_uint_eq(out_pos, in_size);
+	assert_array_eq(decoded, in, in_size);
+
+	return size;
+}
+
+
+/// Counts the uncompressed and LZMA chunks in LZMA2 data
+static void
+count_chunks(const uint8_t *buf, size_t size,
+		size_t *stored, size_t *compressed)
+{
+	*stored = 0;
+	*compressed = 0;
+
+	size_t pos = 0;
+	while (buf[pos] != 0x00) {
+		const uint8_t control = buf[pos];
+
+		if (control == 0x01 || control == 0x02) {
+			pos += 3U + read16be(buf + pos + 1) + 1;
+			++*stored;
+		} else {
+			assert_uint(control, >=, 0x80);
+			pos += (control >= 0xC0 ? 6U : 5U)
+					+ read16be(buf + pos + 3) + 1;
+			++*compressed;
+		}
+
+		assert_uint(pos, <, size);
+	}
+
+	// The end marker has to be the last byte.
+	assert_uint_eq(pos + 1, size);
+}
+#endif
+
+
+static void
+test_lclppb_auto(void)
+{
+#if !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("LZMA2 encoder or decoder is disabled");
+#else
+	static uint8_t fixed[DATA_SIZE * 2];
+	static uint8_t chosen[DATA_SIZE * 2];
+
+	// The first LZMA2 chunk has the properties byte after the
+	// control byte and the sizes.
+	const uint8_t props_default = (LZMA_PB_DEFAULT * 5 + LZMA_LP_DEFAULT)
+			* 9 + LZMA_LC_DEFAULT;
+
+	// With text the defaults are kept and the output is the same
+	// as with the defaults given explicitly.
+	const size_t fixed_size = encode(text, DATA_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			DATA_SIZE, fixed, sizeof(fixed));
+	const size_t text_size = encode(text, DATA_SIZE,
+			LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO,
+			DATA_SIZE, chosen, sizeof(chosen));
+	assert_uint_eq(chosen[5], props_default);
+	assert_uint_eq(text_size, fixed_size);
+	assert_array_eq(chosen, fixed, fixed_size);
+
+	// With the samples other values are chosen and the output
+	// becomes smaller.
+	const size_t samples_default = encode(samples, DATA_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			DATA_SIZE, fixed, sizeof(fixed));
+	const size_t samples_size = encode(samples, DATA_SIZE,
+			LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO,
+			DATA_SIZE, chosen, sizeof(chosen));
+	assert_true(chosen[5] != props_default);
+	assert_uint(samples_size, <, samples_default);
+
+	// The choice doesn't depend on how the input is split into
+	// lzma_code() calls because the encoder waits for enough input.
+	const size_t split_size = encode(samples, DATA_SIZE,
+			LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO,
+			1000, fixed, sizeof(fixed));
+	assert_uint_eq(split_size, samples_size);
+	assert_array_eq(fixed, chosen, samples_size);
+
+	// A fixed value is kept as is. lc is lowered from the default
+	// to keep lc + lp valid.
+	encode(samples, DATA_SIZE, LZMA_LCLPPB_AUTO, 3, 1, DATA_SIZE,
+			chosen, sizeof(chosen));
+	assert_uint_eq(chosen[5], (1 * 5 + 3) * 9 + 1);
+
+	// More memory is needed to choose the values.
+	lzma_options_lzma opt;
+	assert_false(lzma_lzma_preset(&opt, 6));
+
+	lzma_filter filters[2] = {
+		{ LZMA_FILTER_LZMA2, &opt },
+		{ LZMA_VLI_UNKNOWN, NULL },
+	};
+
+	const uint64_t memusage = lzma_raw_encoder_memusage(filters);
+	opt.pb = LZMA_LCLPPB_AUTO;
+	assert_uint(lzma_raw_encoder_memusage(filters), >, memusage);
+
+	// LZMA_LCLPPB_AUTO cannot be enabled with lzma_filters_update()
+	// if it wasn't used when the encoder was initialized.
+	lzma_stream strm = LZMA_STREAM_INIT;
+	opt.pb = LZMA_PB_DEFAULT;
+	assert_lzma_ret(lzma_raw_encoder(&strm, filters), LZMA_OK);
+
+	opt.pb = LZMA_LCLPPB_AUTO;
+	assert_lzma_ret(lzma_filters_update(&strm, filters),
+			LZMA_OPTIONS_ERROR);
+
+	opt.pb = 0;
+	assert_lzma_ret(lzma_filters_update(&strm, filters), LZMA_OK);
+
+	lzma_end(&strm);
+
+	// LZMA1 has no way to use the chosen values.
+#	ifdef HAVE_ENCODER_LZMA1
+	filters[0].id = LZMA_FILTER_LZMA1;
+	opt.pb = LZMA_LCLPPB_AUTO;
+	assert_lzma_ret(lzma_raw_encoder(&strm, filters),
+			LZMA_OPTIONS_ERROR);
+	lzma_end(&strm);
+#	endif
+#endif
+}
+
+
+static void
+test_lclppb_auto_interval(void)
+{
+#if !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("LZMA2 encoder or decoder is disabled");
+#else
+	static uint8_t fixed[MIXED_SIZE + MIXED_SIZE / 2];
+	static uint8_t chosen[MIXED_SIZE + MIXED_SIZE / 2];
+
+	// The defaults are kept for the text at the start of the stream.
+	// When the values are chosen again at the samples, the encoder
+	// has to end the LZMA2 chunk where the symbols that it has already
+	// parsed end, reset the state, and write new properties.
+	const size_t default_size = encode(mixed, MIXED_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			MIXED_SIZE, fixed, sizeof(fixed));
+	const size_t mixed_size = encode(mixed, MIXED_SIZE,
+			LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO,
+			MIXED_SIZE, chosen, sizeof(chosen));
+	assert_uint(mixed_size, <, default_size);
+
+	// Splitting the input doesn't change the output.
+	const size_t split_size = encode(mixed, MIXED_SIZE,
+			LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO,
+			4000, fixed, sizeof(fixed));
+	assert_uint_eq(split_size, mixed_size);
+	assert_array_eq(fixed, chosen, mixed_size);
+#endif
+}
+
+
+static void
+test_lclppb_auto_alternating(void)
+{
+#if !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("LZMA2 encoder or decoder is disabled");
+#else
+	static uint8_t fixed[ALTERNATING_SIZE];
+	static uint8_t chosen[ALTERNATING_SIZE];
+
+	// A run of samples can make other values look better but the text
+	// after it needs the defaults. Changing the values within the
+	// stream must not make the output bigger.
+	const size_t default_size = encode(alternating, ALTERNATING_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			ALTERNATING_SIZE, fixed, sizeof(fixed));
+	const size_t alternating_size = encode(alternating, ALTERNATING_SIZE,
+			LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO, LZMA_LCLPPB_AUTO,
+			ALTERNATING_SIZE, chosen, sizeof(chosen));
+	assert_uint(alternating_size, <=, default_size);
+#endif
+}
+
+
+static void
+test_store_random(void)
+{
+#if !defined(HAVE_ENCODER_LZMA2) || !defined(HAVE_DECODER_LZMA2)
+	assert_skip("LZMA2 encoder or decoder is disabled");
+#else
+	static uint8_t out[4 * DATA_SIZE];
+	static uint8_t split[4 * DATA_SIZE];
+	size_t stored;
+	size_t compressed;
+
+	// Random data is stored in uncompressed chunks of 64 KiB.
+	// encode() checks that it decodes correctly.
+	const size_t random_size = encode(noise, DATA_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			DATA_SIZE, out, sizeof(out));
+	count_chunks(out, random_size, &stored, &compressed);
+	assert_uint_eq(stored, 2);
+	assert_uint_eq(compressed, 0);
+	assert_uint_eq(random_size, DATA_SIZE + 2 * 3 + 1);
+
+	// Splitting the input doesn't change the output.
+	const size_t split_size = encode(noise, DATA_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			1000, split, sizeof(split));
+	assert_uint_eq(split_size, random_size);
+	assert_array_eq(split, out, random_size);
+
+	// The copy of the random data is found by the match finder even
+	// though it isn't encoded with LZMA. The copy looks random too but
+	// it must be compressed instead of stored.
+	const size_t repeated_size = encode(noise, 2 * DATA_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			2 * DATA_SIZE, out, sizeof(out));
+	count_chunks(out, repeated_size, &stored, &compressed);
+	assert_uint(compressed, >, 0);
+	assert_uint(stored, <=, 3);
+	assert_uint(repeated_size, <, DATA_SIZE + DATA_SIZE / 32);
+
+	// Text right after random data is compressed even if it starts
+	// in the middle of a stored chunk. Only the chunk that contains
+	// the end of the random data may be cut short.
+	static uint8_t noise_text[NOISE_TEXT_RANDOM + DATA_SIZE];
+	memcpy(noise_text, noise, NOISE_TEXT_RANDOM);
+	memcpy(noise_text + NOISE_TEXT_RANDOM, text, DATA_SIZE);
+
+	const size_t noise_text_size = encode(noise_text, sizeof(noise_text),
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			sizeof(noise_text), out, sizeof(out));
+	count_chunks(out, noise_text_size, &stored, &compressed);
+	assert_uint_eq(stored, 2);
+	assert_uint(compressed, >, 0);
+	assert_uint(noise_text_size, <, NOISE_TEXT_RANDOM + 68049 + 1024);
+
+	const size_t noise_text_split = encode(noise_text, sizeof(noise_text),
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			1000, split, sizeof(split));
+	assert_uint_eq(noise_text_split, noise_text_size);
+	assert_array_eq(split, out, noise_text_size);
+
+	// Compressible data is never stored. The output is the same
+	// as from the LZMA encoder without the check for random data.
+	const size_t text_size = encode(text, DATA_SIZE,
+			LZMA_LC_DEFAULT, LZMA_LP_DEFAULT, LZMA_PB_DEFAULT,
+			DATA_SIZE, out, sizeof(out));
+	count_chunks(out, text_size, &stored, &compressed);
+	assert_uint_eq(stored, 0);
+	assert_uint_eq(text_size, 68049);
+	assert_uint_eq(lzma_crc32(out, text_size, 0), 0xDFD8C83B);
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_lzma2_encoder_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+	fill_data();
+
+	tuktest_run(test_lclppb_auto);
+	tuktest_run(test_lclppb_auto_interval);
+	tuktest_run(test_lclppb_auto_alternating);
+	tuktest_run(test_store_random);
+
+	return tuktest_end();
+}
@@ -10,6 +10,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "tests.h"
+#include "mythread.h"
 
 #define BUFFER_SIZE 1024
 
@@ -535,6 +536,248 @@ test_decode_bad_lzma_properties(void)
 
 	lzma_end(&strm);
 }
+
+
+/////////////////
+// Batch tests //
+/////////////////
+
+// Number and size of the chunks in the batch tests. The output buffers
+// are as big as the input chunks like in a file system that compresses
+// fixed-size clusters, so not all input will fit with every chunk.
+#define BATCH_COUNT 64
+#define BATCH_CHUNK_SIZE 4096
+#define BATCH_DICT_SIZE (64 << 10)
+
+static uint8_t batch_in[BATCH_COUNT][BATCH_CHUNK_SIZE];
+static uint8_t batch_out[BATCH_COUNT][BATCH_CHUNK_SIZE];
+static uint8_t batch_decoded[BATCH_COUNT][BATCH_CHUNK_SIZE];
+
+
+static void
+init_batch_input(void)
+{
+	// The chunks vary from incompressible to highly compressible.
+	uint32_t n = 0x12345678;
+
+	for (size_t i = 0; i < BATCH_COUNT; ++i) {
+		for (size_t j = 0; j < BATCH_CHUNK_SIZE; ++j) {
+			n = n * 1103515245 + 12345;
+			batch_in[i][j] = (uint8_t)(n >> 24) % (i * 4 + 1);
+		}
+	}
+}
+
+
+static void
+test_batch_options(void)
+{
+	lzma_options_lzma opt_lzma;
+	assert_false(lzma_lzma_preset(&opt_lzma, LZMA_PRESET_DEFAULT));
+
+	uint8_t out[BUFFER_SIZE];
+	lzma_microlzma_buffer buf;
+	memset(&buf, 0, sizeof(buf));
+	buf.in = hello_world;
+	buf.in_size = sizeof(hello_world);
+	buf.out = out;
+	buf.out_size = sizeof(out);
+
+	// An empty batch is fine.
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma, NULL, 0,
+			NULL, NULL), LZMA_OK);
+	assert_lzma_ret(lzma_microlzma_decode_batch(BATCH_DICT_SIZE, NULL, 0,
+			NULL, NULL), LZMA_OK);
+
+	// NULL arguments
+	assert_lzma_ret(lzma_microlzma_encode_batch(NULL, &buf, 1,
+			NULL, NULL), LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma, NULL, 1,
+			NULL, NULL), LZMA_PROG_ERROR);
+	assert_lzma_ret(lzma_microlzma_decode_batch(BATCH_DICT_SIZE, NULL, 1,
+			NULL, NULL), LZMA_PROG_ERROR);
+
+	// Invalid threading options
+	lzma_mt mt;
+	memset(&mt, 0, sizeof(mt));
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma, &buf, 1,
+			&mt, NULL), LZMA_OPTIONS_ERROR);
+
+	mt.threads = 16385;
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma, &buf, 1,
+			&mt, NULL), LZMA_OPTIONS_ERROR);
+
+	mt.threads = 1;
+	mt.flags = LZMA_CONCATENATED;
+	assert_lzma_ret(lzma_microlzma_decode_batch(BATCH_DICT_SIZE, &buf, 1,
+			&mt, NULL), LZMA_OPTIONS_ERROR);
+
+	// Invalid lc
+	opt_lzma.lc = 5;
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma, &buf, 1,
+			NULL, NULL), LZMA_OPTIONS_ERROR);
+	assert_lzma_ret(buf.ret, LZMA_OPTIONS_ERROR);
+}
+
+
+static void
+test_batch_errors(void)
+{
+	lzma_options_lzma opt_lzma;
+	assert_false(lzma_lzma_preset(&opt_lzma, LZMA_PRESET_DEFAULT));
+
+	// The middle buffer is too small. The others must still be encoded.
+	uint8_t out[3][BUFFER_SIZE];
+	lzma_microlzma_buffer bufs[3];
+	memset(bufs, 0, sizeof(bufs));
+
+	for (size_t i = 0; i < 3; ++i) {
+		bufs[i].in = hello_world;
+		bufs[i].in_size = sizeof(hello_world);
+		bufs[i].out = out[i];
+		bufs[i].out_size = sizeof(out[i]);
+	}
+
+	bufs[1].out_size = 5;
+
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma, bufs, 3,
+			NULL, NULL), LZMA_BUF_ERROR);
+	assert_lzma_ret(bufs[0].ret, LZMA_OK);
+	assert_lzma_ret(bufs[1].ret, LZMA_BUF_ERROR);
+	assert_lzma_ret(bufs[2].ret, LZMA_OK);
+	assert_uint_eq(bufs[0].out_used, ENCODED_OUTPUT_SIZE);
+	assert_uint_eq(bufs[2].out_used, ENCODED_OUTPUT_SIZE);
+	assert_uint_eq(bufs[0].in_used, sizeof(hello_world));
+	assert_uint_eq(lzma_crc32(out[2], ENCODED_OUTPUT_SIZE, 0),
+			hello_world_encoded_crc);
+
+	// Decode: corrupt, truncated, and valid streams
+	uint8_t decoded[3][BUFFER_SIZE];
+	for (size_t i = 0; i < 3; ++i) {
+		bufs[i].in = out[i];
+		bufs[i].in_size = ENCODED_OUTPUT_SIZE;
+		bufs[i].out = decoded[i];
+		bufs[i].out_size = sizeof(hello_world);
+		bufs[i].uncomp_size_is_exact = true;
+	}
+
+	memcpy(out[1], out[0], ENCODED_OUTPUT_SIZE);
+	out[0][ENCODED_OUTPUT_SIZE - 1] ^= 0x55;
+	bufs[1].in_size = ENCODED_OUTPUT_SIZE - 5;
+
+	assert_lzma_ret(lzma_microlzma_decode_batch(BATCH_DICT_SIZE, bufs, 3,
+			NULL, NULL), LZMA_DATA_ERROR);
+	assert_lzma_ret(bufs[0].ret, LZMA_DATA_ERROR);
+	assert_lzma_ret(bufs[1].ret, LZMA_DATA_ERROR);
+	assert_lzma_ret(bufs[2].ret, LZMA_OK);
+	assert_uint_eq(bufs[2].in_used, ENCODED_OUTPUT_SIZE);
+	assert_uint_eq(bufs[2].out_used, sizeof(hello_world));
+	assert_array_eq(decoded[2], hello_world, sizeof(hello_world));
+}
+
+
+// Encode and decode the test chunks in a batch and compare the result
+// to the single-stream API.
+static void
+batch_roundtrip(const lzma_mt *mt)
+{
+	lzma_options_lzma opt_lzma;
+	assert_false(lzma_lzma_preset(&opt_lzma, 6));
+	opt_lzma.dict_size = BATCH_DICT_SIZE;
+
+	lzma_microlzma_buffer bufs[BATCH_COUNT];
+	memset(bufs, 0, sizeof(bufs));
+	memset(batch_out, 0, sizeof(batch_out));
+
+	for (size_t i = 0; i < BATCH_COUNT; ++i) {
+		bufs[i].in = batch_in[i];
+		bufs[i].in_size = BATCH_CHUNK_SIZE;
+		bufs[i].out = batch_out[i];
+		bufs[i].out_size = BATCH_CHUNK_SIZE;
+	}
+
+	assert_lzma_ret(lzma_microlzma_encode_batch(&opt_lzma,
+			bufs, BATCH_COUNT, mt, NULL), LZMA_OK);
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	uint8_t out[BATCH_CHUNK_SIZE];
+
+	for (size_t i = 0; i < BATCH_COUNT; ++i) {
+		assert_lzma_ret(bufs[i].ret, LZMA_OK);
+
+		assert_lzma_ret(lzma_microlzma_encoder(&strm, &opt_lzma),
+				LZMA_OK);
+		strm.next_in = batch_in[i];
+		strm.avail_in = BATCH_CHUNK_SIZE;
+		strm.next_out = out;
+		strm.avail_out = sizeof(out);
+		assert_lzma_ret(lzma_code(&strm, LZMA_FINISH),
+				LZMA_STREAM_END);
+
+		assert_uint_eq(bufs[i].in_used, strm.total_in);
+		assert_uint_eq(bufs[i].out_used, strm.total_out);
+		assert_array_eq(batch_out[i], out, bufs[i].out_used);
+	}
+
+	lzma_end(&strm);
+
+	// The most compressible chunk must have fit completely
+	// and the least compressible one not.
+	assert_uint_eq(bufs[0].in_used, BATCH_CHUNK_SIZE);
+	assert_true(bufs[0].out_used < BATCH_CHUNK_SIZE / 2);
+	assert_true(bufs[BATCH_COUNT - 1].in_used < BATCH_CHUNK_SIZE);
+
+	for (size_t i = 0; i < BATCH_COUNT; ++i) {
+		bufs[i].in = batch_out[i];
+		bufs[i].in_size = bufs[i].out_used;
+		bufs[i].out = batch_decoded[i];
+		bufs[i].out_size = bufs[i].in_used;
+
+		// Test both exact and inexact uncompressed sizes.
+		bufs[i].uncomp_size_is_exact = i % 2 == 0;
+	}
+
+	assert_lzma_ret(lzma_microlzma_decode_batch(BATCH_DICT_SIZE,
+			bufs, BATCH_COUNT, mt, NULL), LZMA_OK);
+
+	for (size_t i = 0; i < BATCH_COUNT; ++i) {
+		assert_lzma_ret(bufs[i].ret, LZMA_OK);
+		assert_uint_eq(bufs[i].out_used, bufs[i].out_size);
+		assert_array_eq(batch_decoded[i], batch_in[i],
+				bufs[i].out_used);
+	}
+}
+
+
+static void
+test_batch_roundtrip(void)
+{
+	init_batch_input();
+
+	batch_roundtrip(NULL);
+
+#ifdef MYTHREAD_ENABLED
+	lzma_mt mt;
+	memset(&mt, 0, sizeof(mt));
+
+	for (uint32_t threads = 1; threads <= 4; ++threads) {
+		mt.threads = threads;
+		batch_roundtrip(&mt);
+	}
+
+	// More threads than chunks
+	mt.threads = BATCH_COUNT * 2;
+	batch_roundtrip(&mt);
+
+	mt.thread_pool = lzma_thread_pool_init(2, NULL);
+	assert_true(mt.thread_pool != NULL);
+
+	mt.threads = 3;
+	batch_roundtrip(&mt);
+
+	lzma_thread_pool_end(mt.thread_pool, NULL);
+#endif
+}
 #endif
 
 
@@ -565,6 +808,9 @@ main(int argc, const char **argv)
 	tuktest_run(test_decode_uncomp_size_wrong);
 	tuktest_run(test_decode_comp_size_wrong);
 	tuktest_run(test_decode_bad_lzma_properties);
+	tuktest_run(test_batch_options);
+	tuktest_run(test_batch_errors);
+	tuktest_run(test_batch_roundtrip);
 #	endif
 
 	return tuktest_end();
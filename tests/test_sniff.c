@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_sniff.c
+/// \brief      Tests the filter chosen by xz --auto-filters
+///
+/// sniff.c from the xz sources is built into this test. The filters it
+/// returns are limited to those that the liblzma encoder supports, so the
+/// expected results are checked against lzma_filter_encoder_is_supported().
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+#include "sniff.h"
+
+
+#define DATA_SIZE SNIFF_SAMPLE_MAX
+
+static uint8_t buf[DATA_SIZE];
+
+
+/// Returns id if the encoder supports it and LZMA_VLI_UNKNOWN otherwise.
+static lzma_vli
+supported(lzma_vli id)
+{
+	return lzma_filter_encoder_is_supported(id) ? id : LZMA_VLI_UNKNOWN;
+}
+
+
+static void
+fill_random(uint32_t seed)
+{
+	for (size_t i = 0; i < DATA_SIZE; ++i)
+		buf[i] = (uint8_t)(test_random(&seed) >> 8);
+}
+
+
+/// Fills buf[] with random bytes and x86 CALL instructions whose
+/// targets are within +/-16 MiB. There is no executable header.
+static void
+fill_x86_code(void)
+{
+	fill_random(1);
+
+	uint32_t seed = 2;
+	for (size_t i = 0; i + 5 <= DATA_SIZE; i += 40) {
+		const uint32_t r = test_random(&seed);
+		buf[i] = 0xE8;
+		write32le(buf + i + 1, r & 1 ? r & 0x00FFFFFF
+				: r | 0xFF000000);
+	}
+}
+
+
+static void
+test_x86_code(void)
+{
+	fill_x86_code();
+
+	sniff_result result;
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, supported(LZMA_FILTER_X86));
+	assert_false(result.incompressible);
+
+	// A short sample isn't enough for guessing.
+	sniff_data(&result, buf, 1000);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+}
+
+
+static void
+test_headers(void)
+{
+	// Use data that wouldn't get a filter without the header. Then
+	// set the header fields that sniff_data() looks at.
+	test_fill_letters(buf, DATA_SIZE, 5, 16);
+
+	sniff_result result;
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+
+	// Little endian ELF
+	memcpy(buf, "\x7F" "ELF\x02\x01", 6);
+
+	write16le(buf + 18, 62); // EM_X86_64
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, supported(LZMA_FILTER_X86));
+
+	write16le(buf + 18, 183); // EM_AARCH64
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, supported(LZMA_FILTER_ARM64));
+
+	// The PowerPC filter doesn't support little endian code.
+	write16le(buf + 18, 21); // EM_PPC64
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+
+	// Big endian ELF
+	buf[5] = 2;
+	write16be(buf + 18, 21);
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, supported(LZMA_FILTER_POWERPC));
+
+	// PE
+	test_fill_letters(buf, DATA_SIZE, 5, 16);
+	memcpy(buf, "MZ", 2);
+	write32le(buf + 0x3C, 0x80);
+	memcpy(buf + 0x80, "PE\0\0", 4);
+
+	write16le(buf + 0x84, 0x8664); // IMAGE_FILE_MACHINE_AMD64
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, supported(LZMA_FILTER_X86));
+
+	write16le(buf + 0x84, 0xAA64); // IMAGE_FILE_MACHINE_ARM64
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, supported(LZMA_FILTER_ARM64));
+
+	// The PE header offset points past the end of the sample.
+	write32le(buf + 0x3C, DATA_SIZE);
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+}
+
+
+static void
+test_text(void)
+{
+	test_fill_letters(buf, DATA_SIZE, 5, 16);
+
+	sniff_result result;
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+	assert_false(result.incompressible);
+}
+
+
+static void
+test_random_data(void)
+{
+	fill_random(3);
+
+	sniff_result result;
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+	assert_true(result.incompressible);
+
+	// The same random bytes twice are compressible.
+	memcpy(buf + DATA_SIZE / 2, buf, DATA_SIZE / 2);
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+	assert_false(result.incompressible);
+}
+
+
+static void
+test_delta(void)
+{
+	// Slowly growing 32-bit little endian integers
+	uint32_t seed = 4;
+	uint32_t value = 0x12345678;
+	for (size_t i = 0; i < DATA_SIZE; i += 4) {
+		value += test_random(&seed) & 0xFF;
+		write32le(buf + i, value);
+	}
+
+	sniff_result result;
+	sniff_data(&result, buf, DATA_SIZE);
+	assert_false(result.incompressible);
+
+	if (lzma_filter_encoder_is_supported(LZMA_FILTER_DELTA)) {
+		assert_uint_eq(result.filter_id, LZMA_FILTER_DELTA);
+		assert_uint_eq(result.delta_dist, 4);
+	} else {
+		assert_uint_eq(result.filter_id, LZMA_VLI_UNKNOWN);
+	}
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_sniff_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+	tuktest_run(test_x86_code);
+	tuktest_run(test_headers);
+	tuktest_run(test_text);
+	tuktest_run(test_random_data);
+	tuktest_run(test_delta);
+
+	return tuktest_end();
+}
@@ -0,0 +1,473 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_thread_pool.c
+/// \brief      Tests lzma_thread_pool and the scheduling options of
+///             the multithreaded coders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+#include "mythread.h"
+
+
+#if defined(MYTHREAD_ENABLED) && defined(HAVE_ENCODERS) \
+		&& defined(HAVE_DECODERS) && defined(HAVE_ENCODER_LZMA2) \
+		&& defined(HAVE_DECODER_LZMA2)
+#	define HAVE_POOL_TESTS 1
+#endif
+
+
+#define DATA_SIZE (256 * 1024)
+#define STREAMS 3
+
+static uint8_t original[DATA_SIZE];
+
+
+#ifdef HAVE_POOL_TESTS
+static uint8_t compressed[STREAMS][DATA_SIZE * 2];
+static uint8_t decoded[STREAMS][DATA_SIZE];
+
+
+/// Runs lzma_code() on all streams in turns, giving each only a little
+/// input at a time. All streams must make progress even if the pool
+/// has fewer threads than what the streams could use together.
+static void
+code_interleaved(lzma_stream strm[STREAMS],
+		const uint8_t *in[STREAMS], const size_t in_size[STREAMS],
+		uint8_t *out[STREAMS], size_t out_size)
+{
+	bool done[STREAMS] = { false };
+	size_t in_pos[STREAMS] = { 0 };
+	size_t done_count = 0;
+
+	for (size_t i = 0; i < STREAMS; ++i) {
+		strm[i].next_out = out[i];
+		strm[i].avail_out = out_size;
+	}
+
+	while (done_count < STREAMS) {
+		for (size_t i = 0; i < STREAMS; ++i) {
+			if (done[i])
+				continue;
+
+			const size_t chunk = my_min(in_size[i] - in_pos[i],
+					4096);
+			strm[i].next_in = in[i] + in_pos[i];
+			strm[i].avail_in = chunk;
+
+			const lzma_ret ret = lzma_code(&strm[i],
+					in_pos[i] + chunk == in_size[i]
+					? LZMA_FINISH : LZMA_RUN);
+			in_pos[i] += chunk - strm[i].avail_in;
+
+			if (ret == LZMA_STREAM_END) {
+				done[i] = true;
+				++done_count;
+			} else {
+				assert_lzma_ret(ret, LZMA_OK);
+			}
+		}
+	}
+}
+#endif
+
+
+static void
+test_thread_pool_init(void)
+{
+#ifndef MYTHREAD_ENABLED
+	assert_skip("Threading support disabled");
+#else
+	assert_true(lzma_thread_pool_init(0, NULL) == NULL);
+	assert_true(lzma_thread_pool_init(UINT32_MAX, NULL) == NULL);
+
+	lzma_thread_pool *pool = lzma_thread_pool_init(4, NULL);
+	assert_true(pool != NULL);
+	lzma_thread_pool_end(pool, NULL);
+
+	// NULL is allowed like with free().
+	lzma_thread_pool_end(NULL, NULL);
+#endif
+}
+
+
+static void
+test_worker_stats_no_coder(void)
+{
+	assert_uint_eq(lzma_get_worker_stats(NULL, NULL, 0), 0);
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	lzma_worker_stats stats;
+	assert_uint_eq(lzma_get_worker_stats(&strm, &stats, 1), 0);
+
+#ifdef HAVE_DECODERS
+	// A single-threaded coder has no workers.
+	assert_lzma_ret(lzma_auto_decoder(&strm, UINT64_MAX, 0), LZMA_OK);
+	assert_uint_eq(lzma_get_worker_stats(&strm, &stats, 1), 0);
+	lzma_end(&strm);
+
+	// lzma_end() sets strm->internal to NULL.
+	assert_uint_eq(lzma_get_worker_stats(&strm, &stats, 1), 0);
+#endif
+}
+
+
+static void
+test_thread_pool_roundtrip(void)
+{
+#ifndef HAVE_POOL_TESTS
+	assert_skip("Threading or LZMA2 encoder or decoder support disabled");
+#else
+	// Only one thread in the pool although each stream wants to use
+	// three. The pool doesn't get more threads so a stream must not
+	// keep the thread while it waits for more input.
+	lzma_thread_pool *pool = lzma_thread_pool_init(1, NULL);
+	assert_true(pool != NULL);
+
+	lzma_mt mt = {
+		.threads = 3,
+		.block_size = 16 * 1024,
+		.preset = 1,
+		.check = LZMA_CHECK_CRC32,
+		.memlimit_threading = UINT64_MAX,
+		.memlimit_stop = UINT64_MAX,
+		.thread_pool = pool,
+	};
+
+	lzma_stream strm[STREAMS];
+	const uint8_t *in[STREAMS];
+	size_t in_size[STREAMS];
+	uint8_t *out[STREAMS];
+
+	// Run the coders twice to check that the threads of the pool
+	// can be used by new streams and by reinitialized coders.
+	for (size_t round = 0; round < 2; ++round) {
+		for (size_t i = 0; i < STREAMS; ++i) {
+			if (round == 0)
+				strm[i] = (lzma_stream)LZMA_STREAM_INIT;
+
+			assert_lzma_ret(lzma_stream_encoder_mt(&strm[i], &mt),
+					LZMA_OK);
+			in[i] = original;
+			in_size[i] = DATA_SIZE - i * 1000;
+			out[i] = compressed[i];
+		}
+
+		code_interleaved(strm, in, in_size, out, DATA_SIZE * 2);
+
+		for (size_t i = 0; i < STREAMS; ++i) {
+			in[i] = compressed[i];
+			in_size[i] = (size_t)(strm[i].total_out);
+			out[i] = decoded[i];
+
+			assert_lzma_ret(lzma_stream_decoder_mt(&strm[i], &mt),
+					LZMA_OK);
+		}
+
+		code_interleaved(strm, in, in_size, out, DATA_SIZE);
+
+		for (size_t i = 0; i < STREAMS; ++i) {
+			assert_uint_eq(strm[i].total_out, DATA_SIZE - i * 1000);
+			assert_array_eq(decoded[i], original,
+					DATA_SIZE - i * 1000);
+		}
+	}
+
+	for (size_t i = 0; i < STREAMS; ++i)
+		lzma_end(&strm[i]);
+
+	lzma_thread_pool_end(pool, NULL);
+#endif
+}
+
+
+static void
+test_thread_pool_reinit(void)
+{
+#ifndef HAVE_POOL_TESTS
+	assert_skip("Threading or LZMA2 encoder or decoder support disabled");
+#else
+	// Two full Blocks are queued in a pool of one thread and then
+	// the encoder is reinitialized. The jobs may start only after
+	// their Blocks have been stopped. Their workers must still
+	// become available for the new Stream. Whether the jobs start
+	// before or after the stop depends on the scheduling, so this
+	// is repeated a few times.
+	lzma_thread_pool *pool = lzma_thread_pool_init(1, NULL);
+	assert_true(pool != NULL);
+
+	lzma_mt mt = {
+		.threads = 2,
+		.block_size = 1 << 20,
+		.preset = 1,
+		.check = LZMA_CHECK_CRC32,
+		.thread_pool = pool,
+	};
+
+	const size_t big_size = 2 << 20;
+	uint8_t *big = tuktest_malloc(big_size);
+	for (size_t i = 0; i < big_size; i += DATA_SIZE)
+		memcpy(big + i, original, DATA_SIZE);
+
+	uint8_t *out = tuktest_malloc(big_size);
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+
+	for (size_t round = 0; round < 8; ++round) {
+		assert_lzma_ret(lzma_stream_encoder_mt(&strm, &mt), LZMA_OK);
+
+		strm.next_in = big;
+		strm.avail_in = big_size;
+		strm.next_out = out;
+		strm.avail_out = big_size;
+		while (strm.avail_in > 0)
+			assert_lzma_ret(lzma_code(&strm, LZMA_RUN), LZMA_OK);
+	}
+
+	assert_lzma_ret(lzma_stream_encoder_mt(&strm, &mt), LZMA_OK);
+
+	strm.next_in = big;
+	strm.avail_in = big_size;
+	strm.next_out = out;
+	strm.avail_out = big_size;
+
+	lzma_ret ret;
+	do {
+		ret = lzma_code(&strm, LZMA_FINISH);
+	} while (ret == LZMA_OK);
+
+	assert_lzma_ret(ret, LZMA_STREAM_END);
+	assert_uint_eq(strm.total_in, big_size);
+
+	const size_t out_size = (size_t)(strm.total_out);
+	lzma_end(&strm);
+	lzma_thread_pool_end(pool, NULL);
+
+	uint64_t memlimit = UINT64_MAX;
+	size_t in_pos = 0;
+	size_t decoded_pos = 0;
+	uint8_t *decoded_big = tuktest_malloc(big_size);
+	assert_lzma_ret(lzma_stream_buffer_decode(&memlimit, 0, NULL,
+			out, &in_pos, out_size,
+			decoded_big, &decoded_pos, big_size), LZMA_OK);
+	assert_uint_eq(decoded_pos, big_size);
+	assert_array_eq(decoded_big, big, big_size);
+#endif
+}
+
+
+static void
+test_decode_ahead(void)
+{
+#ifndef HAVE_POOL_TESTS
+	assert_skip("Threading or LZMA2 encoder or decoder support disabled");
+#else
+	// One big Block followed by many small ones. The threaded
+	// encoder is used because the threaded decoder needs the sizes
+	// in the Block Headers.
+	lzma_mt mt = {
+		.threads = 1,
+		.block_size = DATA_SIZE,
+		.preset = 1,
+		.check = LZMA_CHECK_CRC32,
+	};
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_stream_encoder_mt(&strm, &mt), LZMA_OK);
+
+	strm.next_out = compressed[0];
+	strm.avail_out = sizeof(compressed[0]);
+
+	size_t in_pos = 0;
+	size_t block_size = DATA_SIZE / 2;
+	while (in_pos < DATA_SIZE) {
+		const size_t size = my_min(block_size, DATA_SIZE - in_pos);
+		strm.next_in = original + in_pos;
+		strm.avail_in = size;
+		in_pos += size;
+
+		const lzma_action action = in_pos == DATA_SIZE
+				? LZMA_FINISH : LZMA_FULL_FLUSH;
+		lzma_ret ret;
+		do {
+			ret = lzma_code(&strm, action);
+		} while (ret == LZMA_OK);
+
+		assert_lzma_ret(ret, LZMA_STREAM_END);
+		block_size = 4096;
+	}
+
+	const size_t compressed_size = (size_t)(strm.total_out);
+
+	// Decode with a window that fits the small Blocks but not
+	// the big one, so the big one is decoded only when the queue
+	// is empty. Decode in small output steps so that the output
+	// queue fills up.
+	mt.threads = 4;
+	mt.memlimit_threading = UINT64_MAX;
+	mt.memlimit_stop = UINT64_MAX;
+	mt.decode_ahead = 64 * 1024;
+
+	assert_lzma_ret(lzma_stream_decoder_mt(&strm, &mt), LZMA_OK);
+	assert_uint_eq(lzma_get_worker_stats(&strm, NULL, 0), 0);
+
+	strm.next_in = compressed[0];
+	strm.avail_in = compressed_size;
+	strm.next_out = decoded[0];
+
+	lzma_ret ret;
+	do {
+		strm.avail_out = my_min(1000, (size_t)(decoded[0]
+				+ DATA_SIZE - strm.next_out));
+		ret = lzma_code(&strm, LZMA_FINISH);
+	} while (ret == LZMA_OK);
+
+	assert_lzma_ret(ret, LZMA_STREAM_END);
+	assert_uint_eq(strm.total_out, DATA_SIZE);
+	assert_array_eq(decoded[0], original, DATA_SIZE);
+
+	// The statistics of the workers must add up.
+	lzma_worker_stats stats[4];
+	const uint32_t count = lzma_get_worker_stats(&strm, stats, 4);
+	assert_true(count >= 1 && count <= 4);
+
+	uint64_t blocks = 0;
+	uint64_t progress_out = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		blocks += stats[i].blocks;
+		progress_out += stats[i].progress_out;
+	}
+
+	assert_uint_eq(blocks, 1 + (DATA_SIZE / 2 + 4095) / 4096);
+	assert_uint_eq(progress_out, DATA_SIZE);
+
+	lzma_end(&strm);
+#endif
+}
+
+
+static void
+test_worker_arena(void)
+{
+#if !defined(HAVE_POOL_TESTS) || !defined(HAVE_ENCODER_DELTA) \
+		|| !defined(HAVE_DECODER_DELTA)
+	assert_skip("Threading or Delta or LZMA2 support disabled");
+#else
+	// Alternate between two filter chains so that the filter coders
+	// need new memory for every Block. The encoder keeps the LZMA2
+	// encoder but its buffers change size with the dictionary. The
+	// decoder has to replace the whole chain because of the Delta
+	// filter. The memory of the previous Block must be reused.
+	lzma_options_lzma opt_lzma[2];
+	assert_false(lzma_lzma_preset(&opt_lzma[0], 1));
+	assert_false(lzma_lzma_preset(&opt_lzma[1], 1));
+	opt_lzma[0].dict_size = 3 << 19;
+
+	lzma_options_delta opt_delta = {
+		.type = LZMA_DELTA_TYPE_BYTE,
+		.dist = 4,
+	};
+
+	const lzma_filter chains[2][3] = {
+		{
+			{ LZMA_FILTER_LZMA2, &opt_lzma[0] },
+			{ LZMA_VLI_UNKNOWN, NULL },
+		},
+		{
+			{ LZMA_FILTER_DELTA, &opt_delta },
+			{ LZMA_FILTER_LZMA2, &opt_lzma[1] },
+			{ LZMA_VLI_UNKNOWN, NULL },
+		},
+	};
+
+	lzma_mt mt = {
+		.threads = 1,
+		.block_size = DATA_SIZE,
+		.filters = chains[0],
+		.check = LZMA_CHECK_CRC32,
+	};
+
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_stream_encoder_mt(&strm, &mt), LZMA_OK);
+
+	strm.next_out = compressed[0];
+	strm.avail_out = sizeof(compressed[0]);
+
+	const size_t block_size = DATA_SIZE / 8;
+	for (size_t i = 0; i < DATA_SIZE / block_size; ++i) {
+		strm.next_in = original + i * block_size;
+		strm.avail_in = block_size;
+
+		const lzma_action action = (i + 1) * block_size == DATA_SIZE
+				? LZMA_FINISH : LZMA_FULL_FLUSH;
+		lzma_ret ret;
+		do {
+			ret = lzma_code(&strm, action);
+		} while (ret == LZMA_OK);
+
+		assert_lzma_ret(ret, LZMA_STREAM_END);
+
+		if (action == LZMA_FULL_FLUSH)
+			assert_lzma_ret(lzma_filters_update(&strm,
+					chains[(i + 1) % 2]), LZMA_OK);
+	}
+
+	lzma_worker_stats stats;
+	assert_uint_eq(lzma_get_worker_stats(&strm, &stats, 1), 1);
+	assert_uint_eq(stats.blocks, DATA_SIZE / block_size);
+	assert_true(stats.allocs_avoided > 0);
+
+	const size_t compressed_size = (size_t)(strm.total_out);
+	lzma_end(&strm);
+
+	// The decoder worker decodes all Blocks so it can reuse
+	// the memory too.
+	mt.flags = 0;
+	mt.memlimit_threading = UINT64_MAX;
+	mt.memlimit_stop = UINT64_MAX;
+	assert_lzma_ret(lzma_stream_decoder_mt(&strm, &mt), LZMA_OK);
+
+	strm.next_in = compressed[0];
+	strm.avail_in = compressed_size;
+	strm.next_out = decoded[0];
+	strm.avail_out = DATA_SIZE;
+	assert_lzma_ret(lzma_code(&strm, LZMA_FINISH), LZMA_STREAM_END);
+	assert_array_eq(decoded[0], original, DATA_SIZE);
+
+	assert_uint_eq(lzma_get_worker_stats(&strm, &stats, 1), 1);
+	assert_uint_eq(stats.blocks, DATA_SIZE / block_size);
+	assert_true(stats.allocs_avoided > 0);
+
+	// The last Block has the smaller dictionary but it reused
+	// the bigger dictionary buffer of the previous Block. The memory
+	// usage must include the whole buffer.
+	assert_true(lzma_memusage(&strm)
+			>= lzma_raw_decoder_memusage(chains[0]));
+
+	lzma_end(&strm);
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_thread_pool_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+	test_fill_letters(original, DATA_SIZE, 7, 8);
+
+	tuktest_run(test_thread_pool_init);
+	tuktest_run(test_worker_stats_no_coder);
+	tuktest_run(test_thread_pool_roundtrip);
+	tuktest_run(test_thread_pool_reinit);
+	tuktest_run(test_decode_ahead);
+	tuktest_run(test_worker_arena);
+
+	return tuktest_end();
+}
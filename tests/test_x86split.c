@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: 0BSD
+
+///////////////////////////////////////////////////////////////////////////////
+//
+/// \file       test_x86split.c
+/// \brief      Tests the x86 split filter
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "tests.h"
+
+
+#if defined(HAVE_ENCODER_X86SPLIT) && defined(HAVE_DECODER_X86SPLIT) \
+		&& defined(HAVE_ENCODER_LZMA2) && defined(HAVE_DECODER_LZMA2)
+#	define HAVE_X86SPLIT_TESTS 1
+#endif
+
+
+#define DATA_SIZE (300 * 1024)
+
+static uint8_t original[DATA_SIZE];
+static uint8_t compressed[DATA_SIZE * 2];
+static uint8_t decoded[DATA_SIZE];
+
+static uint32_t seed;
+
+
+/// Fills original[] with something that looks a little like x86 code:
+/// random bytes with plenty of CALL, JMP, and Jcc instructions with
+/// both short and long targets. Some opcodes are placed so that they
+/// cross the 64 KiB chunk boundaries.
+static void
+fill_original(void)
+{
+	seed = 42;
+	size_t i = 0;
+
+	while (i < DATA_SIZE) {
+		const uint32_t r = test_random(&seed);
+
+		if (i % 65536 >= 65533 || r % 8 == 0) {
+			original[i++] = 0xE8;
+		} else if (r % 8 == 1) {
+			original[i++] = 0xE9;
+		} else if (r % 8 == 2 && i + 1 < DATA_SIZE) {
+			original[i++] = 0x0F;
+			original[i++] = 0x80 | (r >> 4 & 0x0F);
+		} else {
+			original[i++] = (uint8_t)(r >> 8);
+			continue;
+		}
+
+		// A target within +/-16 MiB gets converted,
+		// other targets don't.
+		const uint32_t t = test_random(&seed);
+		const uint8_t msb = t % 4 == 0 ? (uint8_t)(t >> 8)
+				: t % 2 == 0 ? 0x00 : 0xFF;
+
+		for (size_t j = 0; j < 3 && i < DATA_SIZE; ++j)
+			original[i++] = (uint8_t)(test_random(&seed));
+
+		if (i < DATA_SIZE)
+			original[i++] = msb;
+	}
+}
+
+
+#ifdef HAVE_X86SPLIT_TESTS
+static size_t
+encode(const lzma_filter *filters, size_t size, size_t flush_interval)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_raw_encoder(&strm, filters), LZMA_OK);
+
+	strm.next_out = compressed;
+	strm.avail_out = sizeof(compressed);
+
+	size_t in_pos = 0;
+	while (true) {
+		const size_t chunk = my_min(size - in_pos, flush_interval);
+		const lzma_action action = in_pos + chunk == size
+				? LZMA_FINISH : LZMA_SYNC_FLUSH;
+
+		strm.next_in = original + in_pos;
+		strm.avail_in = chunk;
+		in_pos += chunk;
+
+		lzma_ret ret;
+		do {
+			ret = lzma_code(&strm, action);
+		} while (ret == LZMA_OK);
+
+		assert_lzma_ret(ret, LZMA_STREAM_END);
+		assert_uint_eq(strm.avail_in, 0);
+
+		if (action == LZMA_FINISH)
+			break;
+	}
+
+	const size_t compressed_size = strm.total_out;
+	lzma_end(&strm);
+	return compressed_size;
+}
+
+
+/// Decodes compressed[] into decoded[]. If decoding is expected to succeed,
+/// out_size must be the expected amount of output. Returns true if
+/// the output matches original[].
+static bool
+decode(const lzma_filter *filters, size_t in_size, size_t out_size,
+		lzma_ret expected_ret)
+{
+	lzma_stream strm = LZMA_STREAM_INIT;
+	assert_lzma_ret(lzma_raw_decoder(&strm, filters), LZMA_OK);
+
+	memzero(decoded, sizeof(decoded));
+	strm.next_in = compressed;
+	strm.avail_in = in_size;
+	strm.next_out = decoded;
+	strm.avail_out = sizeof(decoded);
+
+	lzma_ret ret;
+	do {
+		ret = lzma_code(&strm, LZMA_FINISH);
+	} while (ret == LZMA_OK);
+
+	assert_lzma_ret(ret, expected_ret);
+
+	bool matches = false;
+	if (expected_ret == LZMA_STREAM_END) {
+		assert_uint_eq(strm.total_out, out_size);
+		matches = memcmp(decoded, original, out_size) == 0;
+	}
+
+	lzma_end(&strm);
+	return matches;
+}
+#endif
+
+
+static void
+test_x86split_roundtrip(void)
+{
+#ifndef HAVE_X86SPLIT_TESTS
+	assert_skip("x86split or LZMA2 encoder or decoder support disabled");
+#else
+	lzma_options_lzma opt_lzma;
+	assert_false(lzma_lzma_preset(&opt_lzma, 0));
+
+	lzma_options_bcj opt_bcj = { .start_offset = 0 };
+
+	const lzma_filter filters[3] = {
+		{ .id = LZMA_FILTER_X86_SPLIT, .options = &opt_bcj },
+		{ .id = LZMA_FILTER_LZMA2, .options = &opt_lzma },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+
+	static const size_t sizes[] = {
+		0, 1, 4, 5, 6, 65535, 65536, 65537, DATA_SIZE
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(sizes); ++i) {
+		const size_t size = sizes[i];
+		assert_true(decode(filters, encode(filters, size, SIZE_MAX),
+				size, LZMA_STREAM_END));
+	}
+
+	// Flushing ends the current chunk.
+	assert_true(decode(filters, encode(filters, DATA_SIZE, 1000),
+			DATA_SIZE, LZMA_STREAM_END));
+	assert_true(decode(filters, encode(filters, 20000, 7),
+			20000, LZMA_STREAM_END));
+
+	// Non-zero start offset
+	opt_bcj.start_offset = 0x12345;
+	assert_true(decode(filters, encode(filters, DATA_SIZE, SIZE_MAX),
+			DATA_SIZE, LZMA_STREAM_END));
+#endif
+}
+
+
+static void
+test_x86split_corrupt(void)
+{
+#ifndef HAVE_X86SPLIT_TESTS
+	assert_skip("x86split or LZMA2 encoder or decoder support disabled");
+#else
+	lzma_options_lzma opt_lzma;
+	assert_false(lzma_lzma_preset(&opt_lzma, 0));
+
+	const lzma_filter filters[3] = {
+		{ .id = LZMA_FILTER_X86_SPLIT, .options = NULL },
+		{ .id = LZMA_FILTER_LZMA2, .options = &opt_lzma },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+
+	// Build the encoded form of the filter by hand and store it
+	// uncompressed with LZMA2 so that the chunk headers can be
+	// edited easily.
+	const lzma_filter lzma2_only[2] = {
+		{ .id = LZMA_FILTER_LZMA2, .options = &opt_lzma },
+		{ .id = LZMA_VLI_UNKNOWN, .options = NULL },
+	};
+
+	// Header: main_size = 5, flag_count = 1, call_size = 4,
+	// jump_size = 0. Then the main stream, one flag byte, and
+	// one big endian call target.
+	uint8_t chunk[16 + 5 + 1 + 4] = {
+		5, 0, 0, 0, 1, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0,
+		0xE8, 'a', 'b', 'c', 'd',
+		0x01,
+		0x00, 0x00, 0x00, 0x15,
+	};
+
+	// The call target 0x15 is relative to the end of
+	// the instruction at offset 5.
+	static const uint8_t expected[] = {
+		0xE8, 0x10, 0x00, 0x00, 0x00, 'a', 'b', 'c', 'd'
+	};
+
+	// Correct chunk
+	size_t out_pos = 0;
+	assert_lzma_ret(lzma_raw_buffer_encode(lzma2_only, NULL,
+			chunk, sizeof(chunk), compressed, &out_pos,
+			sizeof(compressed)), LZMA_OK);
+	memcpy(original, expected, sizeof(expected));
+	assert_true(decode(filters, out_pos, sizeof(expected),
+			LZMA_STREAM_END));
+
+	// Truncated chunk
+	out_pos = 0;
+	assert_lzma_ret(lzma_raw_buffer_encode(lzma2_only, NULL,
+			chunk, sizeof(chunk) - 1, compressed, &out_pos,
+			sizeof(compressed)), LZMA_OK);
+	decode(filters, out_pos, 0, LZMA_DATA_ERROR);
+
+	// Unused flag bits must be zero.
+	chunk[21] = 0x03;
+	out_pos = 0;
+	assert_lzma_ret(lzma_raw_buffer_encode(lzma2_only, NULL,
+			chunk, sizeof(chunk), compressed, &out_pos,
+			sizeof(compressed)), LZMA_OK);
+	decode(filters, out_pos, 0, LZMA_DATA_ERROR);
+	chunk[21] = 0x01;
+
+	// A target that the encoder wouldn't have converted
+	chunk[22] = 0x12;
+	out_pos = 0;
+	assert_lzma_ret(lzma_raw_buffer_encode(lzma2_only, NULL,
+			chunk, sizeof(chunk), compressed, &out_pos,
+			sizeof(compressed)), LZMA_OK);
+	decode(filters, out_pos, 0, LZMA_DATA_ERROR);
+	chunk[22] = 0x00;
+
+	// Sizes that don't add up
+	chunk[8] = 8;
+	out_pos = 0;
+	assert_lzma_ret(lzma_raw_buffer_encode(lzma2_only, NULL,
+			chunk, sizeof(chunk), compressed, &out_pos,
+			sizeof(compressed)), LZMA_OK);
+	decode(filters, out_pos, 0, LZMA_DATA_ERROR);
+
+	fill_original();
+#endif
+}
+
+
+static void
+test_x86split_str(void)
+{
+#if !defined(HAVE_ENCODER_X86SPLIT) || !defined(HAVE_DECODER_X86SPLIT)
+	assert_skip("x86split encoder or decoder support disabled");
+#else
+	lzma_filter filters[LZMA_FILTERS_MAX + 1];
+	assert_true(lzma_str_to_filters("x86split:start=16 lzma2",
+			NULL, filters, 0, NULL) == NULL);
+	assert_uint_eq(filters[0].id, LZMA_FILTER_X86_SPLIT);
+
+	char *str;
+	assert_lzma_ret(lzma_str_from_filters(&str, filters,
+			LZMA_STR_ENCODER, NULL), LZMA_OK);
+	assert_str_eq(str, "x86split:start=16 lzma2:dict=8MiB,lc=3,lp=0,"
+			"pb=2,mode=normal,nice=64,mf=bt4,depth=0");
+
+	free(str);
+	lzma_filters_free(filters, NULL);
+#endif
+}
+
+
+#if defined(BUILD_MONOLITHIC)
+#define main   xz_test_x86split_main
+#endif
+
+extern int
+main(int argc, const char **argv)
+{
+	tuktest_start(argc, argv);
+
+	fill_original();
+
+	tuktest_run(test_x86split_roundtrip);
+	tuktest_run(test_x86split_corrupt);
+	tuktest_run(test_x86split_str);
+
+	return tuktest_end();
+}
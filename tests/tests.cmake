@@ -24,15 +24,23 @@ if(BUILD_TESTING)
         test_bcj_exact_size
         test_block_header
         test_check
+        test_delta
         test_filter_flags
         test_filter_str
         test_hardware
         test_index
         test_index_hash
+        test_lz_decoder
+        test_lz_encoder
         test_lzip_decoder
+        test_lzip_encoder
+        test_lzma2_encoder
         test_memlimit
+        test_sniff
         test_stream_flags
+        test_thread_pool
         test_vli
+        test_x86split
     )
 
     # MicroLZMA encoder is needed for both encoder and decoder tests.
@@ -76,6 +84,26 @@ if(BUILD_TESTING)
         )
     endforeach()
 
+    # test_sniff tests the filter detection of xz --auto-filters.
+    target_sources(test_sniff PRIVATE src/xz/sniff.c src/xz/sniff.h)
+    target_include_directories(test_sniff PRIVATE src/xz)
+
+
+    # Benchmark that isn't run as a test. Build it explicitly with
+    # "cmake --build . --target bench_lz_decoder".
+    if(HAVE_ENCODERS AND HAVE_DECODERS AND HAVE_CLOCK_MONOTONIC)
+        add_executable(bench_lz_decoder EXCLUDE_FROM_ALL
+                       tests/bench_lz_decoder.c)
+        target_include_directories(bench_lz_decoder PRIVATE
+            src/common
+            src/liblzma/api
+        )
+        target_link_libraries(bench_lz_decoder PRIVATE liblzma)
+        set_target_properties(bench_lz_decoder PROPERTIES
+            RUNTIME_OUTPUT_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}/tests_bin"
+        )
+    endif()
+
 
     ###########################
     # Command line tool tests #
@@ -149,6 +177,20 @@ if(BUILD_TESTING)
         )
     endif()
 
+    # test_index_cache.sh only needs LZMA2 encoder and decoder.
+    if(UNIX AND HAVE_ENCODERS AND HAVE_DECODERS)
+        file(MAKE_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}/test_index_cache")
+
+        add_test(NAME test_index_cache.sh
+            COMMAND "${CMAKE_CURRENT_SOURCE_DIR}/tests/test_index_cache.sh" ".."
+            WORKING_DIRECTORY "${CMAKE_CURRENT_BINARY_DIR}/test_index_cache"
+        )
+
+        set_tests_properties(test_index_cache.sh PROPERTIES
+            SKIP_RETURN_CODE 77
+        )
+    endif()
+
     # The test_compress.sh based tests compress and decompress using different
     # filters so run it only if all encoders and decoders have been enabled.
     if(UNIX AND HAVE_ALL_ENCODERS AND HAVE_ALL_DECODERS)
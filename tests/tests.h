@@ -71,4 +71,25 @@ static const char enum_strings_lzma_check[][24] = {
 #define assert_lzma_check(test_expr, ref_val) \
 	assert_enum_eq(test_expr, ref_val, enum_strings_lzma_check)
 
+
+// Pseudorandom numbers for generating test data. The same seed gives
+// the same data on every platform. Only the high bits are returned
+// since the low bits of this generator aren't very random.
+static inline uint32_t
+test_random(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+
+// Fill buf with the first "letters" lowercase letters picked with
+// test_random(). The result compresses well but not trivially well.
+static inline void
+test_fill_letters(uint8_t *buf, size_t size, uint32_t seed, uint32_t letters)
+{
+	for (size_t i = 0; i < size; ++i)
+		buf[i] = (uint8_t)('a' + test_random(&seed) % letters);
+}
+
 #endif